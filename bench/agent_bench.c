@@ -0,0 +1,541 @@
+/*
+ * Hot paths of the agent in isolation: rtattr parsing of link and route
+ * notifications, interface lookups, address add/delete, counter updates
+ * and rendering of the interface table (text and binary CLI), on fixtures
+ * of every combination of interface and address counts.
+ *
+ * Every benchmark is warmed up, then repeated: each repetition times a
+ * batch of operations and yields one ns/op sample; min, percentiles and
+ * mean are taken over the samples. -j prints one JSON object per line,
+ * -c compares the medians with such a file from an earlier build:
+ *
+ *   make bench     or     bench/agent_bench [-i 100,10000] [-a 1,8] [-r reps]
+ *                                           [-w warmup] [-t sec] [-b name] [-j] [-c base.json]
+ */
+#include "parser.h"
+#include "netlink.h"
+#include "snapshot.h"
+#include "cli.h"
+#include "binproto.h"
+#include "nlbin.h"
+#include "buffer.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+
+#define MAX_SIZES 8
+#define LOOKUPS 4096                   /* random keys per lookup batch */
+#define BENCH_IFINDEX_BASE 100
+
+typedef struct fixture {
+    int ifaces;
+    int addrs;                         /* per interface, alternating IPv4 / IPv6 */
+    int *keys;                         /* LOOKUPS random ifindexes */
+    char (*names)[IFNAMSIZ];           /* their names */
+    uint32_t round;                    /* distinguishes counter values between batches */
+} fixture_t;
+
+typedef struct bench {
+    const char *name;
+    int per_fixture;                   /* 0: independent of the table size, run once */
+    int batch;                         /* ops per repetition */
+    /* time batch ops, untimed setup and cleanup allowed; returns ns */
+    uint64_t (*run)(fixture_t *f, int batch);
+} bench_t;
+
+typedef struct result {
+    double min, p50, p90, p99, mean;
+    int reps;
+} result_t;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* keeps results of timed loops alive */
+static volatile uintptr_t sink;
+
+/* ---- fixtures ---- */
+
+static void fixture_addr(int i, int k, int *family, uint8_t addr[16]) {
+    memset(addr, 0, 16);
+    if (k % 2 == 0) {
+        uint32_t a = htonl(0x0a000000u + (uint32_t)i * 64 + (uint32_t)k);
+        memcpy(addr, &a, 4);
+        *family = AF_INET;
+    } else {
+        /* 2001:db8:<i>::<k> */
+        addr[0] = 0x20, addr[1] = 0x01, addr[2] = 0x0d, addr[3] = 0xb8;
+        addr[4] = (uint8_t)(i >> 24), addr[5] = (uint8_t)(i >> 16);
+        addr[6] = (uint8_t)(i >> 8), addr[7] = (uint8_t)i;
+        addr[15] = (uint8_t)k;
+        *family = AF_INET6;
+    }
+}
+
+static int fixture_build(fixture_t *f, int ifaces, int addrs) {
+    init_iface_table();
+    memset(f, 0, sizeof(*f));
+    f->ifaces = ifaces;
+    f->addrs = addrs;
+    for (int i = 0; i < ifaces; i++) {
+        char name[IFNAMSIZ];
+        snprintf(name, sizeof(name), "bench%d", i);
+        iface_info_t *inf = iface_register(BENCH_IFINDEX_BASE + i, name);
+        if (!inf) return -1;
+        iface_set_link(inf, IFF_UP | IFF_RUNNING, 1500, 6);
+        for (int k = 0; k < addrs; k++) {
+            int family;
+            uint8_t a[16];
+            fixture_addr(i, k, &family, a);
+            iface_add_addr(inf, family, a, family == AF_INET ? 24 : 64, 0);
+        }
+    }
+    f->keys = malloc(LOOKUPS * sizeof(*f->keys));
+    f->names = malloc(LOOKUPS * sizeof(*f->names));
+    if (!f->keys || !f->names) return -1;
+    for (int j = 0; j < LOOKUPS; j++) {
+        int i = ifaces ? (int)(rnd() % (uint64_t)ifaces) : 0;
+        f->keys[j] = BENCH_IFINDEX_BASE + i;
+        snprintf(f->names[j], IFNAMSIZ, "bench%d", i);
+    }
+    iface_snap_publish();
+    return 0;
+}
+
+static void fixture_free(fixture_t *f) {
+    free(f->keys);
+    free(f->names);
+    f->keys = NULL;
+    f->names = NULL;
+}
+
+/* ---- rtattr parsing ---- */
+
+static char link_msg[2048] __attribute__((aligned(NLMSG_ALIGNTO)));
+static char route_msg[512] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+static void put_attr(struct nlmsghdr *nlh, uint16_t type, const void *data, size_t len) {
+    struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = (unsigned short)RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* attributes of a typical veth RTM_NEWLINK, stats included */
+static void build_messages(void) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *)link_msg;
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    nlh->nlmsg_type = RTM_NEWLINK;
+    uint32_t u32 = 1500;
+    uint8_t u8 = 6;
+    uint8_t mac[6] = { 0x02, 0x42, 0xac, 0x11, 0x00, 0x02 };
+    struct rtnl_link_stats64 s64;
+    struct rtnl_link_stats s32;
+    memset(&s64, 0, sizeof(s64));
+    memset(&s32, 0, sizeof(s32));
+    put_attr(nlh, IFLA_IFNAME, "veth1a2b3c4", 12);
+    put_attr(nlh, IFLA_TXQLEN, &u32, 4);
+    put_attr(nlh, IFLA_OPERSTATE, &u8, 1);
+    put_attr(nlh, IFLA_LINKMODE, &u8, 1);
+    put_attr(nlh, IFLA_MTU, &u32, 4);
+    put_attr(nlh, IFLA_MIN_MTU, &u32, 4);
+    put_attr(nlh, IFLA_MAX_MTU, &u32, 4);
+    put_attr(nlh, IFLA_GROUP, &u32, 4);
+    put_attr(nlh, IFLA_PROMISCUITY, &u32, 4);
+    put_attr(nlh, IFLA_NUM_TX_QUEUES, &u32, 4);
+    put_attr(nlh, IFLA_NUM_RX_QUEUES, &u32, 4);
+    put_attr(nlh, IFLA_CARRIER, &u8, 1);
+    put_attr(nlh, IFLA_QDISC, "noqueue", 8);
+    put_attr(nlh, IFLA_CARRIER_CHANGES, &u32, 4);
+    put_attr(nlh, IFLA_PROTO_DOWN, &u8, 1);
+    put_attr(nlh, IFLA_ADDRESS, mac, 6);
+    put_attr(nlh, IFLA_BROADCAST, mac, 6);
+    put_attr(nlh, IFLA_STATS64, &s64, sizeof(s64));
+    put_attr(nlh, IFLA_STATS, &s32, sizeof(s32));
+    put_attr(nlh, IFLA_LINK, &u32, 4);
+
+    nlh = (struct nlmsghdr *)route_msg;
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type = RTM_NEWROUTE;
+    struct rtmsg *rt = NLMSG_DATA(nlh);
+    rt->rtm_family = AF_INET;
+    rt->rtm_dst_len = 24;
+    uint32_t dst = htonl(0xc0a80100u), gw = htonl(0xc0a80001u);
+    int oif = 2;
+    u32 = RT_TABLE_MAIN;
+    put_attr(nlh, RTA_TABLE, &u32, 4);
+    put_attr(nlh, RTA_DST, &dst, 4);
+    u32 = 100;
+    put_attr(nlh, RTA_PRIORITY, &u32, 4);
+    put_attr(nlh, RTA_GATEWAY, &gw, 4);
+    put_attr(nlh, RTA_OIF, &oif, 4);
+}
+
+static uint64_t run_parse_link(fixture_t *f, int batch) {
+    (void)f;
+    struct nlmsghdr *nlh = (struct nlmsghdr *)link_msg;
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) {
+        struct rtattr *tb[IFLA_MAX + 1];
+        memset(tb, 0, sizeof(tb));
+        struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+        rtattr_get(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nlh));
+        sink += (uintptr_t)tb[IFLA_STATS64];
+    }
+    return now_ns() - t0;
+}
+
+static uint64_t run_parse_route(fixture_t *f, int batch) {
+    (void)f;
+    struct nlmsghdr *nlh = (struct nlmsghdr *)route_msg;
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) {
+        struct rtattr *tb[RTA_MAX + 1];
+        memset(tb, 0, sizeof(tb));
+        rtattr_get(tb, RTA_MAX, RTM_RTA(NLMSG_DATA(nlh)), RTM_PAYLOAD(nlh));
+        sink += (uintptr_t)tb[RTA_OIF];
+    }
+    return now_ns() - t0;
+}
+
+/* ---- table ---- */
+
+static uint64_t run_lookup_index(fixture_t *f, int batch) {
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) sink += (uintptr_t)get_iface_by_index(f->keys[n % LOOKUPS]);
+    return now_ns() - t0;
+}
+
+static uint64_t run_lookup_name(fixture_t *f, int batch) {
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) sink += (uintptr_t)get_iface_by_name(f->names[n % LOOKUPS]);
+    return now_ns() - t0;
+}
+
+static uint64_t run_lookup_miss(fixture_t *f, int batch) {
+    int base = BENCH_IFINDEX_BASE + f->ifaces + 1;
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) sink += (uintptr_t)get_iface_by_index(base + (n & 1023));
+    return now_ns() - t0;
+}
+
+/* one extra address per op, added or deleted in the timed part; the ops walk the
+ * interfaces in a scattered order from a random start, so every op adds or
+ * deletes a distinct (interface, address) pair and none takes a no-op path */
+static uint64_t addr_batch(fixture_t *f, int batch, int timed_add) {
+    if (f->ifaces <= 0) return 0;
+    uint64_t ifaces = (uint64_t)f->ifaces;
+    uint64_t stride = ifaces % 65537 ? 65537 : 1;  /* prime, so coprime unless it divides */
+    uint64_t start = rnd() % ifaces;
+    iface_info_t **infs = malloc((size_t)batch * sizeof(*infs));
+    uint32_t *addrs = malloc((size_t)batch * sizeof(*addrs));
+    if (!infs || !addrs) {
+        free(infs);
+        free(addrs);
+        return 0;
+    }
+    for (int n = 0; n < batch; n++) {
+        uint64_t i = (start + (uint64_t)n * stride) % ifaces;
+        infs[n] = get_iface_by_index(BENCH_IFINDEX_BASE + (int)i);
+        /* 198.18.0.0/15, not in the fixture; the next one once every interface has one */
+        addrs[n] = htonl(0xc6120001u + (uint32_t)((uint64_t)n / ifaces));
+    }
+    uint64_t t0 = 0, t1 = 0;
+    for (int phase = 0; phase < 2; phase++) {
+        int add = phase == 0;
+        if (add == timed_add) t0 = now_ns();
+        for (int n = 0; n < batch; n++) {
+            if (add) iface_add_addr(infs[n], AF_INET, &addrs[n], 32, 0);
+            else iface_del_addr(infs[n], AF_INET, &addrs[n], 32);
+        }
+        if (add == timed_add) t1 = now_ns();
+    }
+    free(infs);
+    free(addrs);
+    return t1 - t0;
+}
+
+static uint64_t run_addr_add(fixture_t *f, int batch) {
+    return addr_batch(f, batch, 1);
+}
+
+static uint64_t run_addr_del(fixture_t *f, int batch) {
+    return addr_batch(f, batch, 0);
+}
+
+static uint64_t run_counters(fixture_t *f, int batch) {
+    iface_counters_t c;
+    memset(&c, 0, sizeof(c));
+    f->round++;
+    uint64_t t0 = now_ns();
+    for (int n = 0; n < batch; n++) {
+        iface_info_t *inf = get_iface_by_index(f->keys[n % LOOKUPS]);
+        c.rx_bytes = ((uint64_t)f->round << 32) + (uint64_t)n;
+        c.rx_packets = c.rx_bytes / 512;
+        iface_set_counters(inf, &c);
+    }
+    return now_ns() - t0;
+}
+
+/* ---- rendering: one op is the whole table ---- */
+
+static uint64_t run_render_text(fixture_t *f, int batch) {
+    (void)f;
+    uint64_t ns = 0;
+    for (int n = 0; n < batch; n++) {
+        obuf_t out;
+        obuf_init(&out);
+        uint64_t t0 = now_ns();
+        cli_render_interfaces(&out);
+        ns += now_ns() - t0;
+        sink += out.bytes;
+        obuf_free(&out);
+    }
+    return ns;
+}
+
+static uint64_t run_render_binary(fixture_t *f, int batch) {
+    (void)f;
+    struct {
+        nlb_hdr_t h;
+        nlb_query_t q;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.h.len = sizeof(req);
+    req.h.count = 1;
+    req.h.type = NLB_REQUEST;
+    req.q.op = NLB_Q_ALL;
+    uint64_t ns = 0;
+    for (int n = 0; n < batch; n++) {
+        obuf_t out;
+        obuf_init(&out);
+        uint64_t t0 = now_ns();
+        binproto_frame(&out, &req, sizeof(req));
+        ns += now_ns() - t0;
+        sink += out.bytes;
+        obuf_free(&out);
+    }
+    return ns;
+}
+
+static const bench_t benches[] = {
+    { "parse_link",    0, 100000, run_parse_link },
+    { "parse_route",   0, 100000, run_parse_route },
+    { "lookup_index",  1, LOOKUPS, run_lookup_index },
+    { "lookup_name",   1, LOOKUPS, run_lookup_name },
+    { "lookup_miss",   1, LOOKUPS, run_lookup_miss },
+    { "addr_add",      1, 1024, run_addr_add },
+    { "addr_del",      1, 1024, run_addr_del },
+    { "counters",      1, LOOKUPS, run_counters },
+    { "render_text",   1, 1, run_render_text },
+    { "render_binary", 1, 1, run_render_binary },
+};
+
+/* ---- driver ---- */
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct(const double *v, int n, double q) {
+    return v[(int)(q * (n - 1) + 0.5)];
+}
+
+/* warmup, then up to reps samples or until budget_s is used (at least 5) */
+static void measure(const bench_t *b, fixture_t *f, int reps, int warmup, double budget_s, result_t *r) {
+    int batch = b->batch;
+    double *v = malloc((size_t)reps * sizeof(*v));
+    memset(r, 0, sizeof(*r));
+    if (!v) return;
+    for (int i = 0; i < warmup; i++) b->run(f, batch);
+    uint64_t start = now_ns();
+    int n = 0;
+    while (n < reps) {
+        v[n++] = (double)b->run(f, batch) / batch;
+        if (n >= 5 && (now_ns() - start) / 1e9 > budget_s) break;
+    }
+    qsort(v, (size_t)n, sizeof(*v), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += v[i];
+    r->reps = n;
+    r->min = v[0];
+    r->p50 = pct(v, n, 0.50);
+    r->p90 = pct(v, n, 0.90);
+    r->p99 = pct(v, n, 0.99);
+    r->mean = sum / n;
+    free(v);
+}
+
+typedef struct baseline {
+    char name[64];
+    int ifaces, addrs;
+    double p50;
+} baseline_t;
+
+static baseline_t *base;
+static int base_count;
+
+static int load_baseline(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        baseline_t e;
+        const char *p = strstr(line, "\"p50_ns\":");
+        if (!p || sscanf(line, "{\"bench\":\"%63[^\"]\",\"ifaces\":%d,\"addrs\":%d", e.name, &e.ifaces,
+                         &e.addrs) != 3 || sscanf(p, "\"p50_ns\":%lf", &e.p50) != 1) {
+            continue;
+        }
+        baseline_t *nb = realloc(base, (size_t)(base_count + 1) * sizeof(*nb));
+        if (!nb) break;
+        base = nb;
+        base[base_count++] = e;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static const baseline_t *find_baseline(const char *name, int ifaces, int addrs) {
+    for (int i = 0; i < base_count; i++) {
+        if (strcmp(base[i].name, name) == 0 && base[i].ifaces == ifaces && base[i].addrs == addrs) return &base[i];
+    }
+    return NULL;
+}
+
+static void print_result(const bench_t *b, const fixture_t *f, const result_t *r, int json) {
+    if (json) {
+        printf("{\"bench\":\"%s\",\"ifaces\":%d,\"addrs\":%d,\"batch\":%d,\"reps\":%d,"
+               "\"min_ns\":%.1f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"mean_ns\":%.1f}\n",
+               b->name, f->ifaces, f->addrs, b->batch, r->reps, r->min, r->p50, r->p90, r->p99, r->mean);
+        return;
+    }
+    printf("%-14s %7d %5d %5d %12.1f %12.1f %12.1f %12.1f", b->name, f->ifaces, f->addrs, r->reps, r->min,
+           r->p50, r->p90, r->p99);
+    const baseline_t *e = base ? find_baseline(b->name, f->ifaces, f->addrs) : NULL;
+    if (e && e->p50 > 0) printf(" %+8.1f%%", (r->p50 - e->p50) / e->p50 * 100.0);
+    printf("\n");
+}
+
+static int parse_sizes(const char *s, int *v) {
+    int n = 0;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok && n < MAX_SIZES; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long x = strtol(tok, &end, 10);
+        if (*end || x < 0 || x > 1000000) return -1;
+        v[n++] = (int)x;
+    }
+    return n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-i ifaces,...] [-a addrs,...] [-r reps] [-w warmup] [-t sec] [-b name] [-j] [-c base.json]\n"
+            "  -i/-a  fixture sizes, every combination is run (default 100,10000,100000 and 1,8)\n"
+            "  -r     samples per benchmark (default 50), -w warmup batches (default 3)\n"
+            "  -t     stop sampling a benchmark after sec seconds, 5 samples minimum (default 0.5)\n"
+            "  -b     only benchmarks whose name contains name\n"
+            "  -j     one JSON object per result\n"
+            "  -c     show the change of the median against an earlier -j output\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int ifaces[MAX_SIZES] = { 100, 10000, 100000 }, n_ifaces = 3;
+    int addrs[MAX_SIZES] = { 1, 8 }, n_addrs = 2;
+    int reps = 50, warmup = 3, json = 0;
+    double budget = 0.5;
+    const char *only = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:a:r:w:t:b:jc:h")) != -1) {
+        switch (opt) {
+        case 'i': n_ifaces = parse_sizes(optarg, ifaces); break;
+        case 'a': n_addrs = parse_sizes(optarg, addrs); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 't': budget = atof(optarg); break;
+        case 'b': only = optarg; break;
+        case 'j': json = 1; break;
+        case 'c':
+            if (load_baseline(optarg) < 0) return 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+        if (n_ifaces < 1 || n_addrs < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 5 || warmup < 0 || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* the table operations log at info level; keep the output to the results */
+    logger_set_level_name("warn");
+    build_messages();
+    if (iface_snap_start() < 0) return 1;
+
+    if (!json) {
+        printf("agent: ns/op over repetitions of a batch (render: ns per full table)\n");
+        printf("%-14s %7s %5s %5s %12s %12s %12s %12s%s\n", "bench", "ifaces", "addrs", "reps", "min", "p50",
+               "p90", "p99", base ? "  vs base" : "");
+    }
+    size_t nb = sizeof(benches) / sizeof(benches[0]);
+    fixture_t f;
+    for (size_t k = 0; k < nb; k++) {
+        if (benches[k].per_fixture || (only && !strstr(benches[k].name, only))) continue;
+        result_t r;
+        if (fixture_build(&f, 0, 0) < 0) return 1;
+        measure(&benches[k], &f, reps, warmup, budget, &r);
+        print_result(&benches[k], &f, &r, json);
+        fixture_free(&f);
+    }
+    for (int i = 0; i < n_ifaces; i++) {
+        for (int a = 0; a < n_addrs; a++) {
+            int built = 0;
+            for (size_t k = 0; k < nb; k++) {
+                if (!benches[k].per_fixture || (only && !strstr(benches[k].name, only))) continue;
+                if (!built && fixture_build(&f, ifaces[i] ? ifaces[i] : 1, addrs[a]) < 0) {
+                    fprintf(stderr, "fixture %d x %d: out of memory\n", ifaces[i], addrs[a]);
+                    return 1;
+                }
+                built = 1;
+                result_t r;
+                measure(&benches[k], &f, reps, warmup, budget, &r);
+                print_result(&benches[k], &f, &r, json);
+            }
+            if (built) fixture_free(&f);
+        }
+    }
+    init_iface_table();
+    free(base);
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Gorilla block codec: bytes/sample and encode/decode throughput on
+ * synthetic counter traces shaped like what the poll path records
+ * (unix ms timestamp + rx/tx bytes + rx/tx errors per sample).
+ *
+ *   make bench        or        bench/gorilla_bench [samples] [block_bytes]
+ */
+#include "gorilla.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define COLS 4
+
+typedef struct trace {
+    const char *name;
+    void (*gen)(uint64_t *t, uint64_t *v, size_t n);
+} trace_t;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* uniform in [-j, j] */
+static int64_t jitter(int64_t j) {
+    return j ? (int64_t)(rnd() % (uint64_t)(2 * j + 1)) - j : 0;
+}
+
+static void advance(uint64_t *v, const uint64_t *prev, double rx_bps, double tx_bps, double dt, int err_chance) {
+    v[0] = prev[0] + (uint64_t)(rx_bps * dt);
+    v[1] = prev[1] + (uint64_t)(tx_bps * dt);
+    v[2] = prev[2] + (err_chance && rnd() % (uint64_t)err_chance == 0);
+    v[3] = prev[3];
+}
+
+/* container veth: 8 s polls, a stray ARP now and then */
+static void gen_idle(uint64_t *t, uint64_t *v, size_t n) {
+    uint64_t ts = 1760000000000ull;
+    uint64_t cur[COLS] = { 123456, 65432, 0, 0 };
+    for (size_t i = 0; i < n; i++) {
+        ts += 8000 + (uint64_t)jitter(2);
+        if (rnd() % 16 == 0) cur[0] += 60, cur[1] += 42;
+        t[i] = ts;
+        memcpy(&v[i * COLS], cur, sizeof(cur));
+    }
+}
+
+/* uplink: 1 s polls, ~100 Mbit/s with +-20 % noise, rare errors */
+static void gen_steady(uint64_t *t, uint64_t *v, size_t n) {
+    uint64_t ts = 1760000000000ull;
+    uint64_t cur[COLS] = { 987654321012ull, 123456789012ull, 17, 0 };
+    for (size_t i = 0; i < n; i++) {
+        uint64_t step = 1000 + (uint64_t)jitter(5);
+        ts += step;
+        double noise = 0.8 + (rnd() % 4000) / 10000.0;
+        uint64_t next[COLS];
+        advance(next, cur, 12.5e6 * noise, 3e6 * noise, step / 1000.0, 5000);
+        memcpy(cur, next, sizeof(cur));
+        t[i] = ts;
+        memcpy(&v[i * COLS], cur, sizeof(cur));
+    }
+}
+
+/* adaptive interval 250..2000 ms, idle stretches and 1 GB/s bursts */
+static void gen_bursty(uint64_t *t, uint64_t *v, size_t n) {
+    uint64_t ts = 1760000000000ull;
+    uint64_t cur[COLS] = { 0, 0, 0, 0 };
+    uint64_t iv = 2000;
+    int busy = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (rnd() % 64 == 0) busy = !busy;
+        iv = busy ? (iv > 250 ? iv / 2 : 250) : (iv < 2000 ? iv * 2 : 2000);
+        uint64_t step = iv + (uint64_t)jitter(3);
+        ts += step;
+        double rate = busy ? 1e9 * (0.5 + (rnd() % 1000) / 2000.0) : (rnd() % 4) * 100.0;
+        uint64_t next[COLS];
+        advance(next, cur, rate, rate / 8, step / 1000.0, busy ? 200 : 0);
+        memcpy(cur, next, sizeof(cur));
+        t[i] = ts;
+        memcpy(&v[i * COLS], cur, sizeof(cur));
+    }
+}
+
+/* 5 s polls, daily sine between 1 and 50 MB/s */
+static void gen_diurnal(uint64_t *t, uint64_t *v, size_t n) {
+    uint64_t ts = 1760000000000ull;
+    uint64_t cur[COLS] = { 1ull << 40, 1ull << 38, 0, 0 };
+    for (size_t i = 0; i < n; i++) {
+        uint64_t step = 5000 + (uint64_t)jitter(4);
+        ts += step;
+        double phase = (double)(ts % 86400000ull) / 86400000.0 * 2 * M_PI;
+        double rate = 25.5e6 + 24.5e6 * sin(phase);
+        uint64_t next[COLS];
+        advance(next, cur, rate, rate / 3, step / 1000.0, 0);
+        memcpy(cur, next, sizeof(cur));
+        t[i] = ts;
+        memcpy(&v[i * COLS], cur, sizeof(cur));
+    }
+}
+
+static const trace_t traces[] = {
+    { "idle",    gen_idle },
+    { "steady",  gen_steady },
+    { "bursty",  gen_bursty },
+    { "diurnal", gen_diurnal },
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    uint32_t block_bytes = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 512;
+    if (n < 2 || block_bytes < 64) {
+        fprintf(stderr, "usage: %s [samples>=2] [block_bytes>=64]\n", argv[0]);
+        return 1;
+    }
+    uint64_t *t = malloc(n * sizeof(*t));
+    uint64_t *v = malloc(n * COLS * sizeof(*v));
+    uint64_t *t2 = malloc(n * sizeof(*t2));
+    uint64_t *v2 = malloc(n * COLS * sizeof(*v2));
+    /* worst case one sample per block */
+    size_t max_blocks = n;
+    gorilla_block_t *blocks = calloc(max_blocks, sizeof(*blocks));
+    uint8_t *arena = calloc(max_blocks, (size_t)block_bytes + GORILLA_SLACK);
+    if (!t || !v || !t2 || !v2 || !blocks || !arena) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    /* fault the output pages in before anything is timed */
+    memset(t2, 0, n * sizeof(*t2));
+    memset(v2, 0, n * COLS * sizeof(*v2));
+    for (size_t b = 0; b < max_blocks; b++) {
+        blocks[b].data = arena + b * ((size_t)block_bytes + GORILLA_SLACK);
+        blocks[b].cap = block_bytes;
+    }
+
+    printf("gorilla: %zu samples/trace, %u byte blocks, raw %zu bytes/sample\n",
+           n, block_bytes, sizeof(uint64_t) * (1 + COLS));
+    printf("%-8s %8s %10s %10s %12s %12s\n", "trace", "blocks", "B/sample", "mem B/smp",
+           "enc Msmp/s", "dec Msmp/s");
+    int failed = 0;
+    for (size_t k = 0; k < sizeof(traces) / sizeof(traces[0]); k++) {
+        traces[k].gen(t, v, n);
+
+        size_t used = 0;
+        gorilla_enc_t e;
+        double t0 = now_sec();
+        gorilla_block_reset(&blocks[0]);
+        gorilla_enc_begin(&e, &blocks[0], COLS);
+        for (size_t i = 0; i < n; i++) {
+            if (gorilla_enc_append(&e, t[i], &v[i * COLS]) < 0) {
+                used++;
+                gorilla_block_reset(&blocks[used]);
+                gorilla_enc_begin(&e, &blocks[used], COLS);
+                gorilla_enc_append(&e, t[i], &v[i * COLS]);
+            }
+        }
+        double enc = now_sec() - t0;
+        used++;
+
+        uint64_t bits = 0;
+        for (size_t b = 0; b < used; b++) bits += blocks[b].bits;
+
+        size_t i = 0;
+        t0 = now_sec();
+        for (size_t b = 0; b < used && i < n; b++) {
+            gorilla_dec_t d;
+            gorilla_dec_begin(&d, &blocks[b], COLS);
+            while (i < n && gorilla_dec_next(&d, &t2[i], &v2[i * COLS])) i++;
+        }
+        double dec = now_sec() - t0;
+        int bad = i != n || memcmp(t, t2, n * sizeof(*t)) != 0 ||
+                  memcmp(v, v2, n * COLS * sizeof(*v)) != 0;
+        failed |= bad;
+
+        printf("%-8s %8zu %10.2f %10.2f %12.1f %12.1f%s\n", traces[k].name, used,
+               bits / 8.0 / n, (double)used * block_bytes / n, n / enc / 1e6, n / dec / 1e6,
+               bad ? "  MISMATCH" : "");
+    }
+    free(arena);
+    free(blocks);
+    free(v2);
+    free(t2);
+    free(v);
+    free(t);
+    return failed;
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "addrset.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+static size_t addr_len(int family) {
+    return family == AF_INET ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+}
+
+static uint32_t addr_hash(const iface_addr_t *a) {
+    uint32_t h = hash_bytes(a->addr.raw, addr_len(a->family));
+    return h ^ ((uint32_t)a->family << 24) ^ ((uint32_t)a->prefixlen * 0x9e3779b1u);
+}
+
+static int addr_equal(const iface_addr_t *x, const iface_addr_t *y) {
+    return x->family == y->family &&
+           x->prefixlen == y->prefixlen &&
+           memcmp(x->addr.raw, y->addr.raw, addr_len(x->family)) == 0;
+}
+
+void iface_addr_make(iface_addr_t *a, int family, const void *addr, int prefixlen, uint32_t flags) {
+    memset(a, 0, sizeof(*a));
+    a->family = (uint8_t)family;
+    a->prefixlen = (uint8_t)prefixlen;
+    a->flags = flags;
+    memcpy(a->addr.raw, addr, addr_len(family));
+}
+
+const char *iface_addr_ntop(const iface_addr_t *a, char *buf, size_t len) {
+    if (!inet_ntop(a->family, a->addr.raw, buf, len)) {
+        buf[0] = '\0';
+    }
+    return buf;
+}
+
+static void slots_insert(iface_addr_set_t *set, int pos) {
+    uint32_t i = addr_hash(&set->items[pos]) & set->mask;
+    while (set->slots[i]) i = (i + 1) & set->mask;
+    set->slots[i] = (uint32_t)pos + 1;
+}
+
+static int slots_rebuild(iface_addr_set_t *set, uint32_t nslots) {
+    uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+    if (!slots) return -1;
+    free(set->slots);
+    set->slots = slots;
+    set->mask = nslots - 1;
+    for (int pos = 0; pos < set->count; pos++) {
+        slots_insert(set, pos);
+    }
+    return 0;
+}
+
+/* 返回保存 a 的槽位，没有则 -1 */
+static long slots_find(const iface_addr_set_t *set, const iface_addr_t *a) {
+    uint32_t i = addr_hash(a) & set->mask;
+    while (set->slots[i]) {
+        if (addr_equal(&set->items[set->slots[i] - 1], a)) return i;
+        i = (i + 1) & set->mask;
+    }
+    return -1;
+}
+
+static uint32_t slots_of_pos(const iface_addr_set_t *set, int pos) {
+    uint32_t i = addr_hash(&set->items[pos]) & set->mask;
+    while (set->slots[i] != (uint32_t)pos + 1) i = (i + 1) & set->mask;
+    return i;
+}
+
+/* 向后移位删除 */
+static void slots_remove(iface_addr_set_t *set, uint32_t i) {
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & set->mask;
+        if (!set->slots[j]) break;
+        uint32_t home = addr_hash(&set->items[set->slots[j] - 1]) & set->mask;
+        if (((j - home) & set->mask) >= ((j - i) & set->mask)) {
+            set->slots[i] = set->slots[j];
+            i = j;
+        }
+    }
+    set->slots[i] = 0;
+}
+
+static int find_pos(const iface_addr_set_t *set, const iface_addr_t *a) {
+    if (set->slots) {
+        long s = slots_find(set, a);
+        return s < 0 ? -1 : (int)set->slots[s] - 1;
+    }
+    for (int i = 0; i < set->count; i++) {
+        if (addr_equal(&set->items[i], a)) return i;
+    }
+    return -1;
+}
+
+iface_addr_t *addrset_find(const iface_addr_set_t *set, const iface_addr_t *a) {
+    int pos = find_pos(set, a);
+    return pos < 0 ? NULL : &set->items[pos];
+}
+
+int addrset_add(iface_addr_set_t *set, const iface_addr_t *a) {
+    int pos = find_pos(set, a);
+    if (pos >= 0) {
+        set->items[pos].flags = a->flags;
+        return 0;
+    }
+    if (set->count == set->cap) {
+        int cap = set->cap ? set->cap * 2 : 4;
+        iface_addr_t *n = realloc(set->items, (size_t)cap * sizeof(*n));
+        if (!n) return -1;
+        set->items = n;
+        set->cap = cap;
+    }
+    if (set->count + 1 >= ADDRSET_HASH_MIN &&
+        (!set->slots || (uint32_t)(set->count + 1) * 2 > set->mask + 1)) {
+        uint32_t nslots = set->slots ? (set->mask + 1) * 2 : 2 * hash_pow2(ADDRSET_HASH_MIN);
+        if (slots_rebuild(set, nslots) < 0) return -1;
+    }
+    pos = set->count++;
+    set->items[pos] = *a;
+    if (set->slots) slots_insert(set, pos);
+    return 1;
+}
+
+int addrset_del(iface_addr_set_t *set, const iface_addr_t *a) {
+    int pos = find_pos(set, a);
+    if (pos < 0) return 0;
+    int last = set->count - 1;
+    if (set->slots) {
+        slots_remove(set, slots_of_pos(set, pos));
+        if (pos != last) {
+            uint32_t s = slots_of_pos(set, last);
+            set->items[pos] = set->items[last];
+            set->slots[s] = (uint32_t)pos + 1;
+        }
+    } else if (pos != last) {
+        set->items[pos] = set->items[last];
+    }
+    set->count--;
+    return 1;
+}
+
+void addrset_clear(iface_addr_set_t *set) {
+    set->count = 0;
+    if (set->slots) memset(set->slots, 0, (size_t)(set->mask + 1) * sizeof(uint32_t));
+}
+
+void addrset_free(iface_addr_set_t *set) {
+    free(set->items);
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+size_t addrset_memory(const iface_addr_set_t *set) {
+    size_t n = (size_t)set->cap * sizeof(iface_addr_t);
+    if (set->slots) n += (size_t)(set->mask + 1) * sizeof(uint32_t);
+    return n;
+}
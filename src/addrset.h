@@ -0,0 +1,49 @@
+#ifndef ADDRSET_H
+#define ADDRSET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+/* 二进制地址：网络字节序原样保存，只在展示时格式化 */
+typedef struct iface_addr {
+    uint8_t family;                    /* AF_INET / AF_INET6 */
+    uint8_t prefixlen;                 /* CIDR prefix */
+    uint16_t reserved;
+    uint32_t flags;                    /* IFA_F_* */
+    union {
+        struct in_addr v4;
+        struct in6_addr v6;
+        uint8_t raw[16];
+    } addr;
+} iface_addr_t;
+
+/*
+ * 每接口地址集合：连续数组 + 开放寻址哈希（键：family/addr/prefixlen）。
+ * 地址较少时只做线性比较，超过 ADDRSET_HASH_MIN 才建立哈希。
+ */
+#define ADDRSET_HASH_MIN 8
+
+typedef struct iface_addr_set {
+    iface_addr_t *items;
+    uint32_t *slots;                   /* item 位置 + 1，0 为空 */
+    uint32_t mask;                     /* 槽位数 - 1 */
+    int count;
+    int cap;
+} iface_addr_set_t;
+
+/* 返回 1 新增，0 已存在（仅更新 flags），-1 失败 */
+int addrset_add(iface_addr_set_t *set, const iface_addr_t *a);
+/* 返回 1 已删除，0 不存在 */
+int addrset_del(iface_addr_set_t *set, const iface_addr_t *a);
+iface_addr_t *addrset_find(const iface_addr_set_t *set, const iface_addr_t *a);
+void addrset_clear(iface_addr_set_t *set);
+void addrset_free(iface_addr_set_t *set);
+size_t addrset_memory(const iface_addr_set_t *set);
+
+/* 由原始地址字节构造（addr 为 4 或 16 字节，网络字节序） */
+void iface_addr_make(iface_addr_t *a, int family, const void *addr, int prefixlen, uint32_t flags);
+/* 格式化为文本，buf 至少 INET6_ADDRSTRLEN */
+const char *iface_addr_ntop(const iface_addr_t *a, char *buf, size_t len);
+
+#endif
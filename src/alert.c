@@ -1,62 +1,367 @@
+#define _GNU_SOURCE
 #include "alert.h"
 #include "parser.h"
 #include "logger.h"
+#include "config.h"
+#include "hash.h"
+#include <net/if.h>
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
-#include <dirent.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <fnmatch.h>
+#include <pthread.h>
 
-static unsigned long prev_rx[128];
-static unsigned long prev_tx[128];
-static time_t prev_time = 0;
+#define ALERT_RATES 8
+#define ALERT_TAU_DEFAULT 10.0
 
-void alert_check_cycle(void) {
-    // simple check: if rx_errors > threshold, log warn
-    // also compute per-second rate
-    time_t now = time(NULL);
-    double elapsed = (prev_time == 0) ? 0 : difftime(now, prev_time);
-
-    // iterate known interfaces via naive approach (parser has internal table)
-    // We'll call list and then use get_iface_by_name to fetch to compute.
-    // But parser doesn't expose array publicly; for brevity, re-open /sys/class/net
-    // and compute diffs using get_iface_by_name
-    FILE *f;
-    // We will just go through ifnames by reading /sys/class/net again
-    // For simplicity limit to 128 entries
-    char ifname[64];
-    // iterate
-    DIR *d = opendir("/sys/class/net");
-    if (!d) return;
-    struct dirent *de;
-    int idx = 0;
-    while ((de = readdir(d)) != NULL) {
-        if (de->d_name[0] == '.') continue;
-        iface_info_t *inf = get_iface_by_name(de->d_name);
-        if (!inf) continue;
-        // check errors
-        if (inf->rx_err > 10 || inf->tx_err > 10) {
-            log_warn("interface %s has rx_err=%lu tx_err=%lu", inf->ifname, inf->rx_err, inf->tx_err);
+enum { OP_GT, OP_GE, OP_LT, OP_LE };
+
+/* the first ALERT_RATES metrics are EWMA rates of these counters */
+static const struct {
+    const char *name;
+    size_t off;                        /* offset in iface_counters_t, or -1 */
+} metrics[] = {
+    { "rx_bytes_ps",   offsetof(iface_counters_t, rx_bytes) },
+    { "tx_bytes_ps",   offsetof(iface_counters_t, tx_bytes) },
+    { "rx_packets_ps", offsetof(iface_counters_t, rx_packets) },
+    { "tx_packets_ps", offsetof(iface_counters_t, tx_packets) },
+    { "rx_err_ps",     offsetof(iface_counters_t, rx_err) },
+    { "tx_err_ps",     offsetof(iface_counters_t, tx_err) },
+    { "rx_dropped_ps", offsetof(iface_counters_t, rx_dropped) },
+    { "tx_dropped_ps", offsetof(iface_counters_t, tx_dropped) },
+    { "rx_err",        offsetof(iface_counters_t, rx_err) },
+    { "tx_err",        offsetof(iface_counters_t, tx_err) },
+    { "rx_dropped",    offsetof(iface_counters_t, rx_dropped) },
+    { "tx_dropped",    offsetof(iface_counters_t, tx_dropped) },
+    { "down",          (size_t)-1 },
+};
+#define METRIC_COUNT (int)(sizeof(metrics) / sizeof(metrics[0]))
+
+static const char *op_names[] = { ">", ">=", "<", "<=" };
+
+typedef struct alert_rule {
+    char name[32];
+    char match[64];                    /* fnmatch glob on ifname */
+    int metric;
+    int op;
+    double threshold;
+    double clear;                      /* hysteresis: must cross back past this */
+    double for_sec;                    /* condition must hold this long */
+    double hold_sec;                   /* minimum time between transitions */
+} alert_rule_t;
+
+typedef struct rule_state {
+    uint8_t matched;
+    uint8_t firing;
+    double pending_since;              /* 0: condition not met */
+    double last_change;
+    double value;
+} rule_state_t;
+
+/* per-interface state, looked up by ifindex */
+typedef struct alert_iface {
+    int ifindex;
+    char ifname[IFNAMSIZ];             /* name the rule matches were computed for */
+    double last_t;                     /* 0: no sample yet */
+    iface_counters_t last;
+    int have_rate;
+    double rate[ALERT_RATES];
+    rule_state_t r[];                  /* rule_count entries */
+} alert_iface_t;
+
+static alert_rule_t *rules = NULL;
+static int rule_count = 0;
+static int rule_cap = 0;
+static double ewma_tau = ALERT_TAU_DEFAULT;
+
+/* rules and states: evaluation may run on the alert thread (threaded=1) */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static alert_iface_t **states = NULL;  /* dense */
+static int state_count = 0;
+static int state_cap = 0;
+static int *state_map = NULL;          /* ifindex -> position + 1 */
+static int state_map_cap = 0;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t counter_at(const iface_counters_t *c, size_t off) {
+    return *(const uint64_t *)((const char *)c + off);
+}
+
+static int add_rule(const alert_rule_t *r) {
+    if (rule_count == rule_cap) {
+        int cap = rule_cap ? rule_cap * 2 : 8;
+        alert_rule_t *n = realloc(rules, (size_t)cap * sizeof(*n));
+        if (!n) {
+            log_err("alert: out of memory loading rules");
+            return -1;
         }
-        if (elapsed > 0) {
-            unsigned long rx = inf->rx_bytes;
-            unsigned long tx = inf->tx_bytes;
-            unsigned long rx_diff = rx - prev_rx[idx];
-            unsigned long tx_diff = tx - prev_tx[idx];
-            double rx_rate = rx_diff / elapsed;
-            double tx_rate = tx_diff / elapsed;
-            // If rx_rate too high (demo threshold), warn
-            if (rx_rate > 10000000.0) { // 10MB/s arbitrary
-                log_warn("high traffic on %s: rx_rate=%.0f B/s", inf->ifname, rx_rate);
-            }
-            prev_rx[idx] = rx;
-            prev_tx[idx] = tx;
-        } else {
-            prev_rx[idx] = inf->rx_bytes;
-            prev_tx[idx] = inf->tx_bytes;
+        rules = n;
+        rule_cap = cap;
+    }
+    rules[rule_count++] = *r;
+    return 0;
+}
+
+static int parse_rule(const char *spec, alert_rule_t *r) {
+    char metric[32], op[4];
+    int used = 0;
+    memset(r, 0, sizeof(*r));
+    strcpy(r->match, "*");
+    if (sscanf(spec, "%31s %31s %3s %lf%n", r->name, metric, op, &r->threshold, &used) != 4) {
+        return -1;
+    }
+    r->metric = -1;
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (strcmp(metric, metrics[i].name) == 0) r->metric = i;
+    }
+    if (r->metric < 0) return -1;
+    r->op = -1;
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(op, op_names[i]) == 0) r->op = i;
+    }
+    if (r->op < 0) return -1;
+    r->clear = r->threshold;
+
+    const char *p = spec + used;
+    char tok[96];
+    int n;
+    while (sscanf(p, "%95s%n", tok, &n) == 1) {
+        p += n;
+        if (strncmp(tok, "clear=", 6) == 0) r->clear = strtod(tok + 6, NULL);
+        else if (strncmp(tok, "for=", 4) == 0) r->for_sec = strtod(tok + 4, NULL);
+        else if (strncmp(tok, "hold=", 5) == 0) r->hold_sec = strtod(tok + 5, NULL);
+        else if (strncmp(tok, "match=", 6) == 0) snprintf(r->match, sizeof(r->match), "%.63s", tok + 6);
+        else return -1;
+    }
+    return 0;
+}
+
+static void load_rule_cb(const char *value, void *arg) {
+    int *bad = arg;
+    alert_rule_t r;
+    if (parse_rule(value, &r) < 0) {
+        log_err("alert: cannot parse rule '%s'", value);
+        (*bad)++;
+        return;
+    }
+    add_rule(&r);
+}
+
+static void free_states(void) {
+    for (int i = 0; i < state_count; i++) free(states[i]);
+    free(states);
+    free(state_map);
+    states = NULL;
+    state_map = NULL;
+    state_count = state_cap = state_map_cap = 0;
+}
+
+int alert_init(void) {
+    int bad = 0;
+    pthread_mutex_lock(&lock);
+    free_states();
+    rule_count = 0;
+    ewma_tau = config_get_double("alert_ewma_tau_sec", ALERT_TAU_DEFAULT);
+    if (ewma_tau <= 0) ewma_tau = ALERT_TAU_DEFAULT;
+
+    config_foreach("alert_rule", load_rule_cb, &bad);
+    if (rule_count == 0 && !bad) {
+        /* no rules configured: the historical checks, thresholds from the old keys */
+        char spec[128];
+        alert_rule_t r;
+        long err = config_get_int("rx_err_threshold", 10);
+        snprintf(spec, sizeof(spec), "rx_errors rx_err > %ld", err);
+        if (parse_rule(spec, &r) == 0) add_rule(&r);
+        snprintf(spec, sizeof(spec), "tx_errors tx_err > %ld", err);
+        if (parse_rule(spec, &r) == 0) add_rule(&r);
+        snprintf(spec, sizeof(spec), "link_down down > 0 for=%ld",
+                 config_get_int("link_down_threshold_sec", 3));
+        if (parse_rule(spec, &r) == 0) add_rule(&r);
+        if (parse_rule("high_rx rx_bytes_ps > 10000000 clear=8000000 hold=30", &r) == 0) add_rule(&r);
+    }
+    pthread_mutex_unlock(&lock);
+    log_info("alert: %d rules loaded", rule_count);
+    return bad ? -1 : 0;
+}
+
+static alert_iface_t *state_get(iface_info_t *inf) {
+    int ifindex = inf->ifindex;
+    if (ifindex < state_map_cap && state_map[ifindex]) return states[state_map[ifindex] - 1];
+
+    if (ifindex >= state_map_cap) {
+        int cap = (int)hash_pow2((uint32_t)ifindex + 1);
+        if (cap < 256) cap = 256;
+        int *n = realloc(state_map, (size_t)cap * sizeof(int));
+        if (!n) return NULL;
+        memset(n + state_map_cap, 0, (size_t)(cap - state_map_cap) * sizeof(int));
+        state_map = n;
+        state_map_cap = cap;
+    }
+    if (state_count == state_cap) {
+        int cap = state_cap ? state_cap * 2 : 64;
+        alert_iface_t **n = realloc(states, (size_t)cap * sizeof(*n));
+        if (!n) return NULL;
+        states = n;
+        state_cap = cap;
+    }
+    alert_iface_t *s = calloc(1, sizeof(*s) + (size_t)rule_count * sizeof(rule_state_t));
+    if (!s) return NULL;
+    s->ifindex = ifindex;
+    states[state_count++] = s;
+    state_map[ifindex] = state_count;
+    return s;
+}
+
+static void state_remove_at(int pos) {
+    alert_iface_t *s = states[pos];
+    for (int i = 0; i < rule_count; i++) {
+        if (s->r[i].firing) {
+            log_info("alert %s cleared on %s: interface removed", rules[i].name, s->ifname);
+        }
+    }
+    state_map[s->ifindex] = 0;
+    free(s);
+    state_count--;
+    if (pos != state_count) {
+        states[pos] = states[state_count];
+        state_map[states[pos]->ifindex] = pos + 1;
+    }
+}
+
+static void update_rates(alert_iface_t *s, const iface_counters_t *c, double now) {
+    if (s->last_t > 0 && now > s->last_t) {
+        double dt = now - s->last_t;
+        double alpha = dt / (ewma_tau + dt);
+        for (int i = 0; i < ALERT_RATES; i++) {
+            uint64_t cur = counter_at(c, metrics[i].off);
+            uint64_t prev = counter_at(&s->last, metrics[i].off);
+            if (cur < prev) continue;          /* counter reset: re-baseline */
+            double r = (double)(cur - prev) / dt;
+            s->rate[i] = s->have_rate ? s->rate[i] + alpha * (r - s->rate[i]) : r;
+        }
+        s->have_rate = 1;
+    }
+    s->last = *c;
+    s->last_t = now;
+}
+
+static int metric_value(const alert_iface_t *s, const iface_info_t *inf, int m, double *v) {
+    if (m < ALERT_RATES) {
+        if (!s->have_rate) return -1;
+        *v = s->rate[m];
+    } else if (metrics[m].off == (size_t)-1) {
+        *v = ((inf->flags & IFF_UP) && !inf->up) ? 1.0 : 0.0;
+    } else {
+        *v = (double)counter_at(&inf->stats, metrics[m].off);
+    }
+    return 0;
+}
+
+static int compare(int op, double v, double t) {
+    switch (op) {
+    case OP_GT: return v > t;
+    case OP_GE: return v >= t;
+    case OP_LT: return v < t;
+    default:    return v <= t;
+    }
+}
+
+static void eval_rule(const alert_rule_t *r, rule_state_t *rs, const iface_info_t *inf, double v, double now) {
+    rs->value = v;
+    if (rs->last_change > 0 && now - rs->last_change < r->hold_sec) return;
+
+    if (!rs->firing) {
+        if (!compare(r->op, v, r->threshold)) {
+            rs->pending_since = 0;
+            return;
+        }
+        if (rs->pending_since == 0) rs->pending_since = now;
+        if (now - rs->pending_since < r->for_sec) return;
+        rs->firing = 1;
+        rs->last_change = now;
+        log_warn("alert %s FIRING on %s: %s=%.2f %s %g", r->name, inf->ifname,
+                 metrics[r->metric].name, v, op_names[r->op], r->threshold);
+    } else if (!compare(r->op, v, r->clear)) {
+        /* hysteresis: firing clears only once the value is back past the clear level */
+        rs->firing = 0;
+        rs->pending_since = 0;
+        log_info("alert %s cleared on %s after %.0f s: %s=%.2f", r->name, inf->ifname,
+                 now - rs->last_change, metrics[r->metric].name, v);
+        rs->last_change = now;
+    }
+}
+
+void alert_eval_iface(iface_info_t *inf, double now) {
+    pthread_mutex_lock(&lock);
+    alert_iface_t *s = state_get(inf);
+    if (!s) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    if (strcmp(s->ifname, inf->ifname) != 0) {
+        memcpy(s->ifname, inf->ifname, IFNAMSIZ);
+        for (int i = 0; i < rule_count; i++) {
+            s->r[i].matched = fnmatch(rules[i].match, inf->ifname, 0) == 0;
+        }
+    }
+    update_rates(s, &inf->stats, now);
+
+    for (int i = 0; i < rule_count; i++) {
+        double v;
+        if (!s->r[i].matched || metric_value(s, inf, rules[i].metric, &v) < 0) continue;
+        eval_rule(&rules[i], &s->r[i], inf, v, now);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void alert_sweep(void) {
+    pthread_mutex_lock(&lock);
+    for (int pos = 0; pos < state_count; ) {
+        if (!get_iface_by_index(states[pos]->ifindex)) state_remove_at(pos);
+        else pos++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void alert_check_cycle(void) {
+    double now = now_sec();
+    int count = get_iface_count();
+    for (int pos = 0; pos < count; pos++) {
+        alert_eval_iface(get_iface_at(pos), now);
+    }
+    alert_sweep();
+}
+
+int alert_rule_count(void) {
+    return rule_count;
+}
+
+void alert_foreach_active(void (*cb)(const alert_active_t *a, void *arg), void *arg) {
+    double now = now_sec();
+    pthread_mutex_lock(&lock);
+    for (int pos = 0; pos < state_count; pos++) {
+        alert_iface_t *s = states[pos];
+        for (int i = 0; i < rule_count; i++) {
+            if (!s->r[i].firing) continue;
+            alert_active_t a;
+            a.rule = rules[i].name;
+            a.metric = metrics[rules[i].metric].name;
+            memcpy(a.ifname, s->ifname, IFNAMSIZ);
+            a.ifindex = s->ifindex;
+            a.value = s->r[i].value;
+            a.threshold = rules[i].threshold;
+            a.since = now - s->r[i].last_change;
+            cb(&a, arg);
         }
-        idx++;
-        if (idx >= 128) break;
     }
-    closedir(d);
-    prev_time = now;
+    pthread_mutex_unlock(&lock);
 }
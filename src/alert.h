@@ -1,6 +1,42 @@
 #ifndef ALERT_H
 #define ALERT_H
 
+#include "parser.h"
+
+/*
+ * Rule-driven alerts. State is kept per ifindex: the last counter sample and
+ * EWMA rates of bytes, packets, errors and drops, plus a small state machine
+ * per rule (pending -> firing -> cleared) with hysteresis and hold-down.
+ *
+ * Rules come from repeated config lines:
+ *   alert_rule=<name> <metric> <op> <threshold> [clear=<v>] [for=<sec>] [hold=<sec>] [match=<glob>]
+ * metric: rx_bytes_ps tx_bytes_ps rx_packets_ps tx_packets_ps rx_err_ps tx_err_ps
+ *         rx_dropped_ps tx_dropped_ps (EWMA rates), rx_err tx_err rx_dropped
+ *         tx_dropped (counters), down (admin up without carrier)
+ * op: > >= < <=
+ */
+
+typedef struct alert_active {
+    const char *rule;
+    const char *metric;
+    char ifname[IFNAMSIZ];
+    int ifindex;
+    double value;
+    double threshold;
+    double since;                      /* seconds firing */
+} alert_active_t;
+
+/* load rules from the config; 0 on success, -1 if a rule failed to parse */
+int alert_init(void);
+/* feed the interface table (counters just refreshed) through the rules */
 void alert_check_cycle(void);
+/* evaluate one interface at monotonic time now (seconds) */
+void alert_eval_iface(iface_info_t *inf, double now);
+/* drop state of interfaces that left the table */
+void alert_sweep(void);
+
+int alert_rule_count(void);
+/* active alerts, one callback per (rule, interface) */
+void alert_foreach_active(void (*cb)(const alert_active_t *a, void *arg), void *arg);
 
 #endif
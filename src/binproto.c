@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "binproto.h"
+#include "nlbin.h"
+#include "parser.h"
+#include <string.h>
+
+static binproto_stats_t stats;
+
+typedef struct reply {
+    obuf_t *out;
+    uint32_t count;
+    uint32_t len;
+    int all;                           /* an NLB_Q_ALL was answered */
+} reply_t;
+
+static int put(reply_t *r, void *rec, uint16_t type, size_t len, uint16_t query) {
+    nlb_rec_t *h = rec;
+    h->type = type;
+    h->len = (uint16_t)len;
+    h->query = query;
+    h->reserved = 0;
+    if (obuf_append(r->out, rec, len) < 0) return -1;
+    r->count++;
+    r->len += (uint32_t)len;
+    return 0;
+}
+
+static int put_status(reply_t *r, uint16_t query, int32_t ifindex, uint32_t status) {
+    nlb_status_t s;
+    s.ifindex = ifindex;
+    s.status = status;
+    return put(r, &s, NLB_R_STATUS, sizeof(s), query);
+}
+
+static void fill_counters(nlb_counters_t *d, const iface_counters_t *s) {
+    d->rx_bytes = s->rx_bytes;
+    d->tx_bytes = s->tx_bytes;
+    d->rx_packets = s->rx_packets;
+    d->tx_packets = s->tx_packets;
+    d->rx_errors = s->rx_err;
+    d->tx_errors = s->tx_err;
+    d->rx_dropped = s->rx_dropped;
+    d->tx_dropped = s->tx_dropped;
+    d->rx_fifo_errors = s->rx_fifo;
+    d->tx_fifo_errors = s->tx_fifo;
+    d->multicast = s->multicast;
+}
+
+static int put_iface(reply_t *r, uint16_t query, const iface_info_t *inf) {
+    nlb_iface_t d;
+    d.ifindex = inf->ifindex;
+    d.flags = inf->flags;
+    d.mtu = inf->mtu;
+    d.operstate = inf->operstate;
+    d.up = inf->up ? 1 : 0;
+    d.naddr = (uint16_t)inf->addrs.count;
+    d.flaps = inf->flaps;
+    d.reserved = 0;
+    d.gen = inf->gen;
+    memcpy(d.ifname, inf->ifname, NLB_IFNAMSIZ);
+    d.ifname[NLB_IFNAMSIZ - 1] = '\0';
+    fill_counters(&d.stats, &inf->stats);
+    return put(r, &d, NLB_R_IFACE, sizeof(d), query);
+}
+
+static int put_counters(reply_t *r, uint16_t query, const iface_info_t *inf) {
+    nlb_counters_rec_t d;
+    d.ifindex = inf->ifindex;
+    d.reserved = 0;
+    d.gen = inf->gen;
+    fill_counters(&d.stats, &inf->stats);
+    return put(r, &d, NLB_R_COUNTERS, sizeof(d), query);
+}
+
+static int put_addrs(reply_t *r, uint16_t query, const iface_info_t *inf) {
+    nlb_addr_t d;
+    memset(&d, 0, sizeof(d));
+    d.ifindex = inf->ifindex;
+    for (int i = 0; i < inf->addrs.count; i++) {
+        const iface_addr_t *a = &inf->addrs.items[i];
+        d.family = a->family;
+        d.prefixlen = a->prefixlen;
+        d.flags = a->flags;
+        memcpy(d.addr, a->addr.raw, sizeof(d.addr));
+        if (put(r, &d, NLB_R_ADDR, sizeof(d), query) < 0) return -1;
+    }
+    return 0;
+}
+
+static const iface_info_t *lookup(const nlb_query_t *q) {
+    if (q->ifindex) return get_iface_by_index(q->ifindex);
+    char name[NLB_IFNAMSIZ];
+    memcpy(name, q->ifname, sizeof(name));
+    name[NLB_IFNAMSIZ - 1] = '\0';
+    return get_iface_by_name(name);
+}
+
+static int answer(reply_t *r, uint16_t i, const nlb_query_t *q) {
+    const iface_info_t *inf;
+    switch (q->op) {
+    case NLB_Q_GEN: {
+        nlb_gen_t g;
+        g.table_gen = iface_table_gen();
+        g.data_gen = iface_table_data_gen();
+        g.ifaces = (uint32_t)get_iface_count();
+        g.reserved = 0;
+        return put(r, &g, NLB_R_GEN, sizeof(g), i);
+    }
+    case NLB_Q_ALL:
+        /* the whole table once per request: 127 of them would be 127 copies */
+        if (r->all) return put_status(r, i, 0, NLB_S_LIMIT);
+        r->all = 1;
+        for (int pos = 0; pos < get_iface_count(); pos++) {
+            inf = get_iface_at(pos);
+            if (inf->gen > q->gen && put_iface(r, i, inf) < 0) return -1;
+        }
+        return 0;
+    case NLB_Q_IFACE:
+    case NLB_Q_COUNTERS:
+    case NLB_Q_ADDRS:
+        inf = lookup(q);
+        if (!inf) return put_status(r, i, q->ifindex, NLB_S_NOT_FOUND);
+        if ((q->flags & NLB_QF_IF_CHANGED) && q->op != NLB_Q_ADDRS && inf->gen <= q->gen) {
+            return put_status(r, i, inf->ifindex, NLB_S_UNCHANGED);
+        }
+        if (q->op == NLB_Q_IFACE) return put_iface(r, i, inf);
+        if (q->op == NLB_Q_COUNTERS) return put_counters(r, i, inf);
+        return put_addrs(r, i, inf);
+    default:
+        return put_status(r, i, q->ifindex, NLB_S_BAD_QUERY);
+    }
+}
+
+static int bad_frame(obuf_t *out, uint32_t seq) {
+    nlb_hdr_t h = { sizeof(h), 0, NLB_ERROR, 0, seq };
+    stats.errors++;
+    obuf_append(out, &h, sizeof(h));
+    return -1;
+}
+
+int binproto_frame(obuf_t *out, const void *buf, size_t len) {
+    nlb_hdr_t req;
+    if (len < sizeof(req)) return 0;
+    memcpy(&req, buf, sizeof(req));
+    if (req.type != NLB_REQUEST || req.len > NLB_MAX_REQUEST || req.len < sizeof(req) ||
+        req.len != sizeof(req) + (uint64_t)req.count * sizeof(nlb_query_t)) {
+        return bad_frame(out, req.seq);
+    }
+    if (len < req.len) return 0;
+
+    /* the header goes first; its length and count are known at the end.
+     * On failure the partial reply is cut off before the error frame. */
+    size_t mark = out->bytes;
+    nlb_hdr_t *hp = obuf_reserve(out, sizeof(nlb_hdr_t));
+    if (!hp) return bad_frame(out, req.seq);
+    reply_t r = { out, 0, sizeof(nlb_hdr_t), 0 };
+    const char *q = (const char *)buf + sizeof(req);
+    for (uint32_t i = 0; i < req.count; i++, q += sizeof(nlb_query_t)) {
+        nlb_query_t query;
+        memcpy(&query, q, sizeof(query));
+        if (answer(&r, (uint16_t)i, &query) < 0) {
+            obuf_truncate(out, mark);
+            return bad_frame(out, req.seq);
+        }
+    }
+    nlb_hdr_t h = { r.len, r.count, NLB_REPLY, 0, req.seq };
+    memcpy(hp, &h, sizeof(h));
+
+    stats.requests++;
+    stats.queries += req.count;
+    stats.records += r.count;
+    return (int)req.len;
+}
+
+void binproto_get_stats(binproto_stats_t *st) {
+    *st = stats;
+}
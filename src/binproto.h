@@ -0,0 +1,29 @@
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "buffer.h"
+
+/*
+ * Server side of the binary CLI protocol (layout in nlbin.h). Records are
+ * filled field by field from the interface table and appended to the
+ * connection's output buffer; nothing is formatted as text.
+ */
+
+typedef struct binproto_stats {
+    uint64_t requests;
+    uint64_t queries;
+    uint64_t records;
+    uint64_t errors;                   /* malformed requests */
+} binproto_stats_t;
+
+/*
+ * Answer the request frame at the start of buf. Returns the bytes consumed,
+ * 0 while the frame is incomplete, -1 for a malformed frame (an NLB_ERROR
+ * frame was appended, close the connection once it is flushed).
+ */
+int binproto_frame(obuf_t *out, const void *buf, size_t len);
+void binproto_get_stats(binproto_stats_t *st);
+
+#endif
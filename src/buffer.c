@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#define OBUF_IOV_MAX 64
+
+void obuf_init(obuf_t *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+void obuf_free(obuf_t *b) {
+    obuf_chunk_t *c = b->head;
+    while (c) {
+        obuf_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    memset(b, 0, sizeof(*b));
+}
+
+static obuf_chunk_t *chunk_new(size_t need) {
+    size_t cap = need > OBUF_CHUNK ? need : OBUF_CHUNK;
+    obuf_chunk_t *c = malloc(sizeof(*c) + cap);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->off = c->len = 0;
+    c->cap = cap;
+    return c;
+}
+
+/* 返回至少有 need 字节空闲的尾块 */
+static obuf_chunk_t *tail_with_room(obuf_t *b, size_t need) {
+    if (b->tail && b->tail->cap - b->tail->len >= need) return b->tail;
+    obuf_chunk_t *c = chunk_new(need);
+    if (!c) return NULL;
+    if (b->tail) b->tail->next = c;
+    else b->head = c;
+    b->tail = c;
+    return c;
+}
+
+int obuf_append(obuf_t *b, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        obuf_chunk_t *c = tail_with_room(b, 1);
+        if (!c) return -1;
+        size_t n = c->cap - c->len;
+        if (n > len) n = len;
+        memcpy(c->data + c->len, p, n);
+        c->len += n;
+        b->bytes += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void *obuf_reserve(obuf_t *b, size_t len) {
+    obuf_chunk_t *c = tail_with_room(b, len);
+    if (!c) return NULL;
+    void *p = c->data + c->len;
+    c->len += len;
+    b->bytes += len;
+    return p;
+}
+
+void obuf_truncate(obuf_t *b, size_t bytes) {
+    if (bytes >= b->bytes) return;
+    size_t keep = bytes;
+    obuf_chunk_t *c = b->head;
+    while (c) {
+        size_t left = c->len - c->off;
+        if (keep <= left) break;
+        keep -= left;
+        c = c->next;
+    }
+    /* c 是保留部分的最后一块，释放其后的块 */
+    c->len = c->off + keep;
+    obuf_chunk_t *next = c->next;
+    c->next = NULL;
+    b->tail = c;
+    while (next) {
+        obuf_chunk_t *n = next->next;
+        free(next);
+        next = n;
+    }
+    b->bytes = bytes;
+}
+
+int obuf_printf(obuf_t *b, const char *fmt, ...) {
+    va_list ap;
+    obuf_chunk_t *c = tail_with_room(b, 256);
+    if (!c) return -1;
+
+    /* 直接格式化到尾块，放不下再换一个足够大的新块 */
+    va_start(ap, fmt);
+    int n = vsnprintf(c->data + c->len, c->cap - c->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+    if ((size_t)n >= c->cap - c->len) {
+        c = chunk_new((size_t)n + 1);
+        if (!c) return -1;
+        if (b->tail) b->tail->next = c;
+        else b->head = c;
+        b->tail = c;
+        va_start(ap, fmt);
+        vsnprintf(c->data, c->cap, fmt, ap);
+        va_end(ap);
+    }
+    c->len += (size_t)n;
+    b->bytes += (size_t)n;
+    return n;
+}
+
+ssize_t obuf_flush(obuf_t *b, int fd) {
+    ssize_t total = 0;
+    while (b->head) {
+        struct iovec iov[OBUF_IOV_MAX];
+        int cnt = 0;
+        for (obuf_chunk_t *c = b->head; c && cnt < OBUF_IOV_MAX; c = c->next) {
+            if (c->len == c->off) continue;
+            iov[cnt].iov_base = c->data + c->off;
+            iov[cnt].iov_len = c->len - c->off;
+            cnt++;
+        }
+        if (cnt == 0) break;
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        total += n;
+        b->bytes -= (size_t)n;
+        /* 释放写完的块 */
+        while (b->head && n >= 0) {
+            obuf_chunk_t *c = b->head;
+            size_t left = c->len - c->off;
+            if ((size_t)n < left) {
+                c->off += (size_t)n;
+                break;
+            }
+            n -= (ssize_t)left;
+            if (c == b->tail) {
+                /* 保留尾块复用 */
+                c->off = c->len = 0;
+                break;
+            }
+            b->head = c->next;
+            free(c);
+        }
+    }
+    return total;
+}
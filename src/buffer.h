@@ -0,0 +1,40 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * 分块输出缓冲：按 OBUF_CHUNK 大小的块追加，flush 时用 writev 一次写出多块，
+ * 非阻塞 fd 写不完的部分留在缓冲中等下一次 EPOLLOUT。
+ */
+#define OBUF_CHUNK 16384
+
+typedef struct obuf_chunk {
+    struct obuf_chunk *next;
+    size_t off;                        /* 已写出的字节 */
+    size_t len;                        /* 已填充的字节 */
+    size_t cap;
+    char data[];
+} obuf_chunk_t;
+
+typedef struct obuf {
+    obuf_chunk_t *head;
+    obuf_chunk_t *tail;
+    size_t bytes;                      /* 未写出的字节数 */
+} obuf_t;
+
+void obuf_init(obuf_t *b);
+void obuf_free(obuf_t *b);
+int obuf_append(obuf_t *b, const void *data, size_t len);
+int obuf_printf(obuf_t *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+/* 预留 len 字节连续空间（计入 bytes），内容由调用方稍后回填；flush 之前有效 */
+void *obuf_reserve(obuf_t *b, size_t len);
+/* 丢弃末尾追加的内容，只保留前 bytes 个未写出的字节（bytes 取自之前的 b->bytes） */
+void obuf_truncate(obuf_t *b, size_t bytes);
+
+/* 写出尽可能多的数据；返回写出的字节数，出错返回 -1（EAGAIN 不算错误） */
+ssize_t obuf_flush(obuf_t *b, int fd);
+static inline int obuf_empty(const obuf_t *b) { return b->bytes == 0; }
+
+#endif
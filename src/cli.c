@@ -2,18 +2,80 @@
 #include "cli.h"
 #include "logger.h"
 #include "parser.h"
+#include "route.h"
+#include "netlink.h"
+#include "config.h"
+#include "coalesce.h"
+#include "alert.h"
+#include "reactor.h"
+#include "sched.h"
+#include "history.h"
+#include "openmetrics.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "shmpub.h"
+#include "netns.h"
+#include "nlfilter.h"
+#include "watch.h"
+#include "binproto.h"
+#include "journal.h"
+#include "nlbin.h"
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <sys/epoll.h>
 #include <fcntl.h>
 #include <stdio.h>
-#include <dirent.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
 
 #define CLI_SOCKET_PATH "/tmp/nlagent.sock"
+#define CLI_INBUF 4096
+#define CLI_MAX_CLIENTS_DEFAULT 256
+/* stop reading new commands from a client while this much output is queued */
+#define CLI_OUT_HIGHWAT (8u << 20)
+
+/*
+ * Per-connection state: a line buffer for input and a chunked output buffer,
+ * all non-blocking and driven by epoll. By default a connection behaves like
+ * the old one-shot CLI: every command line received in the first batch is
+ * answered, then the connection is closed once the output is flushed. After
+ * "keepalive" the connection stays open until EOF or "quit", and each
+ * response is terminated by an empty line. After "watch" change events are
+ * streamed until the peer closes the connection (a half-close only ends
+ * its commands) or sends "quit". A connection that starts with NLB_MAGIC
+ * speaks the binary protocol of nlbin.h instead, and stays open until EOF.
+ */
+enum { CLI_PROTO_UNKNOWN, CLI_PROTO_TEXT, CLI_PROTO_BINARY };
+
+typedef struct cli_conn {
+    reactor_handler_t h;               /* h.arg points back to the connection */
+    int fd;
+    uint32_t events;                   /* events currently registered */
+    int proto;                         /* CLI_PROTO_*, decided by the first bytes */
+    int keepalive;
+    int closing;                       /* close once output is flushed */
+    int rd_eof;                        /* watching, peer shut down its write side */
+    watch_sub_t *watch;
+    size_t in_len;
+    char in[CLI_INBUF];
+    obuf_t out;
+} cli_conn_t;
+
+typedef struct cli_cmd {
+    const char *name;                  /* prefix match, the rest is args */
+    void (*fn)(cli_conn_t *c, char *args);
+} cli_cmd_t;
+
 static int cli_sock = -1;
+static void listen_event(reactor_handler_t *h, uint32_t events);
+static reactor_handler_t listen_handler = { .fd = -1, .cb = listen_event };
+static int conn_count = 0;
+static int max_clients = CLI_MAX_CLIENTS_DEFAULT;
 
 static int make_socket_non_blocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -23,7 +85,7 @@ static int make_socket_non_blocking(int fd) {
     return 0;
 }
 
-int cli_start(int epoll_fd) {
+int cli_start(void) {
     struct sockaddr_un addr;
     unlink(CLI_SOCKET_PATH);
     cli_sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -39,7 +101,7 @@ int cli_start(int epoll_fd) {
         close(cli_sock);
         return -1;
     }
-    if (listen(cli_sock, 5) < 0) {
+    if (listen(cli_sock, 128) < 0) {
         log_err("cli listen failed: %s", strerror(errno));
         close(cli_sock);
         return -1;
@@ -47,70 +109,816 @@ int cli_start(int epoll_fd) {
     if (make_socket_non_blocking(cli_sock) < 0) {
         log_warn("could not make cli_sock non blocking");
     }
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = cli_sock;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cli_sock, &ev) < 0) {
-        log_err("epoll_ctl add cli_sock failed: %s", strerror(errno));
+    /* accept loop runs to EAGAIN, so the listener may be edge-triggered */
+    listen_handler.fd = cli_sock;
+    if (reactor_add(&listen_handler, EPOLLIN | reactor_et_flag()) < 0) {
         close(cli_sock);
         return -1;
     }
+    max_clients = (int)config_get_int("cli_max_clients", CLI_MAX_CLIENTS_DEFAULT);
     log_info("cli socket listening at %s", CLI_SOCKET_PATH);
     return cli_sock;
 }
 
-void cli_handle_connection(int fd) {
-    if (fd == cli_sock) {
-        int conn = accept(cli_sock, NULL, NULL);
-        if (conn < 0) {
-            log_err("accept cli conn failed: %s", strerror(errno));
-            return;
+/* ---- rendering ---- */
+
+/* from the published view: never observes a half-applied update */
+void cli_render_interfaces(obuf_t *out) {
+    const iface_view_t *v = iface_snap_begin();
+    if (!v) {
+        obuf_printf(out, "interface table not published yet\n");
+        iface_snap_end();
+        return;
+    }
+    for (int pos = 0; pos < v->count; pos++) {
+        const iface_info_t *inf = v->ifaces[pos];
+        obuf_printf(out, "%s\t%s\n", inf->ifname, inf->up ? "UP" : "DOWN");
+        for (int i = 0; i < inf->addrs.count; i++) {
+            char abuf[INET6_ADDRSTRLEN];
+            obuf_printf(out, "  - %s/%d\n",
+                        iface_addr_ntop(&inf->addrs.items[i], abuf, sizeof(abuf)),
+                        inf->addrs.items[i].prefixlen);
+        }
+    }
+    iface_snap_end();
+}
+
+static void cmd_show_interfaces(cli_conn_t *c, char *args) {
+    (void)args;
+    cli_render_interfaces(&c->out);
+}
+
+static const char *route_table_name(uint32_t id, char *buf, size_t len) {
+    switch (id) {
+    case RT_TABLE_MAIN:    return "main";
+    case RT_TABLE_LOCAL:   return "local";
+    case RT_TABLE_DEFAULT: return "default";
+    default:
+        snprintf(buf, len, "%u", id);
+        return buf;
+    }
+}
+
+/* route lookup <ip> [table <id>] */
+static void cmd_route_lookup(cli_conn_t *c, char *args) {
+    obuf_t *out = &c->out;
+    char ipstr[INET6_ADDRSTRLEN + 1] = {0};
+    unsigned int table = RT_TABLE_MAIN;
+
+    if (sscanf(args, "%46s table %u", ipstr, &table) < 1) {
+        obuf_printf(out, "usage: route lookup <ip> [table <id>]\n");
+        return;
+    }
+    uint8_t addr[16];
+    int family = strchr(ipstr, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(family, ipstr, addr) != 1) {
+        obuf_printf(out, "invalid address %s\n", ipstr);
+        return;
+    }
+
+    struct timespec t0, t1;
+    int plen = 0;
+    uint8_t prefix[16];
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const rt_entry_t *e = route_lookup(table, family, addr, &plen, prefix);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ns = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+
+    if (!e) {
+        obuf_printf(out, "no route to %s in table %u (%.3f us)\n", ipstr, table, ns / 1000.0);
+        return;
+    }
+
+    char pbuf[INET6_ADDRSTRLEN], tbuf[16];
+    inet_ntop(family, prefix, pbuf, sizeof(pbuf));
+    for (; e; e = e->next) {
+        obuf_printf(out, "%s/%d table %s proto %u scope %u type %u metric %u\n",
+                    pbuf, plen, route_table_name(table, tbuf, sizeof(tbuf)), e->protocol,
+                    e->scope, e->type, e->priority);
+        for (int i = 0; i < e->nh_count; i++) {
+            const rt_nexthop_t *nh = &e->nh[i];
+            char gw[INET6_ADDRSTRLEN] = "-";
+            const char *ifname = "-";
+            if (nh->gw_family) inet_ntop(nh->gw_family, nh->gw, gw, sizeof(gw));
+            iface_info_t *inf = get_iface_by_index(nh->oif);
+            if (inf) ifname = inf->ifname;
+            obuf_printf(out, "  nexthop via %s dev %s weight %u\n", gw, ifname, nh->weight);
+        }
+        for (int i = 0; i < e->metric_count; i++) {
+            obuf_printf(out, "  metric[%u] %u\n", e->metrics[i].type, e->metrics[i].value);
         }
-        // read simple command (blocking small read)
-        char buf[256];
-        int n = read(conn, buf, sizeof(buf)-1);
-        if (n <= 0) {
-            close(conn);
+    }
+    obuf_printf(out, "lookup %.3f us\n", ns / 1000.0);
+}
+
+/* route summary: per-table counts and memory */
+static void cmd_route_summary(cli_conn_t *c, char *args) {
+    (void)args;
+    char tbuf[16];
+    obuf_printf(&c->out, "table\tv4_routes\tv6_routes\tprefixes\tnodes\tmemory_bytes\n");
+    int n = route_table_count();
+    for (int i = 0; i < n; i++) {
+        rt_table_stats_t st;
+        if (route_table_stats(i, &st) < 0) continue;
+        obuf_printf(&c->out, "%s\t%zu\t%zu\t%zu\t%zu\t%zu\n",
+                    route_table_name(st.table, tbuf, sizeof(tbuf)),
+                    st.routes[0], st.routes[1], st.prefixes[0] + st.prefixes[1],
+                    st.nodes[0] + st.nodes[1], st.memory);
+    }
+}
+
+/* show netlink: receive path counters */
+static void cmd_show_netlink(cli_conn_t *c, char *args) {
+    (void)args;
+    nl_rx_stats_t rx;
+    const nl_rx_stats_t *st = &rx;
+    netlink_get_rx_stats(&rx);
+    double w = st->wakeups ? (double)st->wakeups : 1.0;
+    obuf_printf(&c->out,
+        "rcvbuf\t%d\n"
+        "wakeups\t%llu\n"
+        "datagrams\t%llu\n"
+        "messages\t%llu\n"
+        "datagrams_per_wakeup_avg\t%.2f\n"
+        "datagrams_per_wakeup_max\t%u\n"
+        "messages_per_wakeup_avg\t%.2f\n"
+        "messages_per_wakeup_max\t%u\n"
+        "overruns\t%llu\n"
+        "truncated\t%llu\n"
+        "dump_truncated\t%llu\n"
+        "resyncs\t%llu\n"
+        "resync_last_us\t%llu\n"
+        "resync_max_us\t%llu\n"
+        "captured\t%llu\n"
+        "capture_bytes\t%llu\n",
+        st->rcvbuf,
+        (unsigned long long)st->wakeups,
+        (unsigned long long)st->datagrams,
+        (unsigned long long)st->messages,
+        st->datagrams / w, st->max_datagrams_per_wakeup,
+        st->messages / w, st->max_messages_per_wakeup,
+        (unsigned long long)st->overruns,
+        (unsigned long long)st->truncated,
+        (unsigned long long)st->dump_truncated,
+        (unsigned long long)st->resyncs,
+        (unsigned long long)st->last_resync_us,
+        (unsigned long long)st->max_resync_us,
+        (unsigned long long)st->captured,
+        (unsigned long long)st->capture_bytes);
+
+    const nl_sync_stats_t *ss = netlink_sync_stats();
+    obuf_printf(&c->out,
+        "ready_us\t%llu\n"
+        "syncs\t%llu\n"
+        "sync_last_us\t%llu\n"
+        "sync_links\t%d\n"
+        "sync_addrs\t%d\n"
+        "sync_routes\t%d\n"
+        "sync_neighbors\t%d\n",
+        (unsigned long long)ss->ready_us,
+        (unsigned long long)ss->syncs,
+        (unsigned long long)ss->last_us,
+        ss->links, ss->addrs, ss->routes, ss->neighbors);
+
+    static const char *modes[] = { "off", "on", "audit" };
+    nlfilter_stats_t fs;
+    nlfilter_get_stats(&fs);
+    obuf_printf(&c->out,
+        "filter\t%s\n"
+        "filter_rules\t%d\n"
+        "filter_insns\t%d\n"
+        "delivered_link\t%llu\n"
+        "delivered_addr\t%llu\n"
+        "delivered_route\t%llu\n"
+        "delivered_other\t%llu\n"
+        "filtered_audit\t%llu\n"
+        "filtered_userspace\t%llu\n",
+        modes[fs.mode], fs.rules, fs.insns,
+        (unsigned long long)fs.delivered[NLF_KIND_LINK],
+        (unsigned long long)fs.delivered[NLF_KIND_ADDR],
+        (unsigned long long)fs.delivered[NLF_KIND_ROUTE],
+        (unsigned long long)fs.delivered[NLF_KIND_OTHER],
+        (unsigned long long)fs.audited, (unsigned long long)fs.user_dropped);
+    nlfilter_rule_stats_t rs;
+    for (int i = 0; nlfilter_rule_stats(i, &rs) == 0; i++) {
+        obuf_printf(&c->out, "rule\t%s\t%s\t%llu\n", rs.name,
+                    rs.in_kernel ? "kernel" : "userspace", (unsigned long long)rs.hits);
+    }
+}
+
+/* show coalesce: link event coalescing counters */
+static void cmd_show_coalesce(cli_conn_t *c, char *args) {
+    (void)args;
+    const coalesce_stats_t *st = coalesce_get_stats();
+    obuf_printf(&c->out,
+        "window_ms\t%d\n"
+        "received\t%llu\n"
+        "noop\t%llu\n"
+        "merged\t%llu\n"
+        "emitted\t%llu\n"
+        "flaps\t%llu\n"
+        "pending\t%d\n",
+        st->window_ms,
+        (unsigned long long)st->received, (unsigned long long)st->noop,
+        (unsigned long long)st->merged, (unsigned long long)st->emitted,
+        (unsigned long long)st->flaps, st->pending);
+}
+
+static void render_alert(const alert_active_t *a, void *arg) {
+    obuf_printf(arg, "%s\t%s\t%s\t%.2f\t%g\t%.0f\n",
+                a->rule, a->ifname, a->metric, a->value, a->threshold, a->since);
+}
+
+/* show alerts: currently firing (rule, interface) pairs */
+static void cmd_show_alerts(cli_conn_t *c, char *args) {
+    (void)args;
+    obuf_printf(&c->out, "rule\tiface\tmetric\tvalue\tthreshold\tfiring_sec\n");
+    alert_foreach_active(render_alert, &c->out);
+}
+
+/* show loop: event loop counters */
+static void cmd_show_loop(cli_conn_t *c, char *args) {
+    (void)args;
+    const reactor_stats_t *st = reactor_get_stats();
+    obuf_printf(&c->out,
+        "wakeups\t%llu\n"
+        "events\t%llu\n"
+        "timer_fires\t%llu\n"
+        "timer_overruns\t%llu\n"
+        "signals\t%llu\n"
+        "handlers\t%d\n"
+        "edge_triggered\t%d\n",
+        (unsigned long long)st->wakeups, (unsigned long long)st->events,
+        (unsigned long long)st->timer_fires, (unsigned long long)st->timer_overruns,
+        (unsigned long long)st->signals, st->handlers, st->edge_triggered);
+}
+
+/* show sched: polling scheduler and per-class intervals */
+static void cmd_show_sched(cli_conn_t *c, char *args) {
+    (void)args;
+    const sched_stats_t *st = sched_get_stats();
+    obuf_printf(&c->out,
+        "tick_ms\t%d\n"
+        "budget\t%d\n"
+        "nodes\t%d\n"
+        "ticks\t%llu\n"
+        "polls\t%llu\n"
+        "single_requests\t%llu\n"
+        "dumps\t%llu\n"
+        "deferred\t%llu\n"
+        "reconciles\t%llu\n",
+        st->tick_ms, st->budget, st->nodes,
+        (unsigned long long)st->ticks, (unsigned long long)st->polls,
+        (unsigned long long)st->single_requests, (unsigned long long)st->dumps,
+        (unsigned long long)st->deferred, (unsigned long long)st->reconciles);
+    obuf_printf(&c->out, "class\tmin_ms\tmax_ms\tmembers\tpolls\n");
+    int n = sched_class_count();
+    for (int i = 0; i < n; i++) {
+        sched_class_stats_t cs;
+        if (sched_class_stats(i, &cs) < 0) continue;
+        obuf_printf(&c->out, "%s\t%u\t%u\t%d\t%llu\n", cs.name, cs.min_ms, cs.max_ms,
+                    cs.members, (unsigned long long)cs.polls);
+    }
+    obuf_printf(&c->out, "iface\tinterval_ms\n");
+    int count = get_iface_count();
+    for (int pos = 0; pos < count; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        obuf_printf(&c->out, "%s\t%d\n", inf->ifname, sched_iface_interval(inf->ifindex));
+    }
+}
+
+/* show pipeline: per-stage ring depth and latency in threaded mode */
+static void cmd_show_pipeline(cli_conn_t *c, char *args) {
+    (void)args;
+    obuf_printf(&c->out, "threaded\t%d\n", pipeline_threaded());
+    if (!pipeline_threaded()) return;
+    obuf_printf(&c->out, "stage\tpushed\tpopped\tdepth\tdepth_max\tfull\tlat_avg_us\tlat_max_us\n");
+    for (int i = 0; i < PIPE_STAGES; i++) {
+        pipeline_stage_stats_t st;
+        if (pipeline_stage_stats(i, &st) < 0) continue;
+        obuf_printf(&c->out, "%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%.1f\t%.1f\n", st.name,
+                    (unsigned long long)st.pushed, (unsigned long long)st.popped,
+                    (unsigned long long)st.depth, (unsigned long long)st.depth_max,
+                    (unsigned long long)st.full, st.lat_avg_us, st.lat_max_us);
+    }
+}
+
+/* show snapshot: published interface table views and reclamation */
+static void cmd_show_snapshot(cli_conn_t *c, char *args) {
+    (void)args;
+    iface_snap_stats_t st;
+    iface_snap_get_stats(&st);
+    obuf_printf(&c->out,
+        "gen\t%llu\n"
+        "publishes\t%llu\n"
+        "records_copied\t%llu\n"
+        "reclaimed\t%llu\n"
+        "retired_pending\t%d\n"
+        "readers\t%d\n"
+        "readers_active\t%d\n",
+        (unsigned long long)st.gen, (unsigned long long)st.publishes,
+        (unsigned long long)st.records_copied, (unsigned long long)st.reclaimed,
+        st.retired, st.readers, st.active);
+}
+
+/* show shm: shared-memory table for local readers */
+static void cmd_show_shm(cli_conn_t *c, char *args) {
+    (void)args;
+    shmpub_stats_t st;
+    shmpub_get_stats(&st);
+    if (!st.path) {
+        obuf_printf(&c->out, "shm disabled\n");
+        return;
+    }
+    obuf_printf(&c->out,
+        "path\t%s\n"
+        "capacity\t%u\n"
+        "interfaces\t%u\n"
+        "high_water\t%u\n"
+        "bytes\t%llu\n"
+        "publishes\t%llu\n"
+        "records_written\t%llu\n"
+        "grows\t%llu\n",
+        st.path, st.capacity, st.count, st.high_water, (unsigned long long)st.size,
+        (unsigned long long)st.publishes, (unsigned long long)st.records_written,
+        (unsigned long long)st.grows);
+}
+
+/* show netns [<name>]: monitored namespaces, or the interfaces of one */
+static void cmd_show_netns(cli_conn_t *c, char *args) {
+    char name[64] = "";
+    if (sscanf(args, " %63s", name) == 1) {
+        if (netns_render_ifaces(&c->out, name) < 0) obuf_printf(&c->out, "no namespace %s\n", name);
+        return;
+    }
+    netns_stats_t st;
+    netns_get_stats(&st);
+    obuf_printf(&c->out,
+        "namespaces\t%d\n"
+        "interfaces\t%d\n"
+        "memory_bytes\t%llu\n"
+        "bytes_per_namespace\t%llu\n"
+        "msgs\t%llu\n"
+        "rx_bytes\t%llu\n"
+        "cpu_ms\t%.3f\n"
+        "overruns\t%llu\n"
+        "added\t%llu\n"
+        "removed\t%llu\n"
+        "scans\t%llu\n"
+        "last_scan_ms\t%.3f\n",
+        st.namespaces, st.interfaces, (unsigned long long)st.memory,
+        (unsigned long long)(st.namespaces ? st.memory / (uint64_t)st.namespaces : 0),
+        (unsigned long long)st.msgs, (unsigned long long)st.bytes, st.cpu_ns / 1e6,
+        (unsigned long long)st.overruns, (unsigned long long)st.added,
+        (unsigned long long)st.removed, (unsigned long long)st.scans, st.last_scan_us / 1000.0);
+    netns_render_list(&c->out);
+}
+
+/* show history: store geometry and memory, with the cost at 50k interfaces */
+static void cmd_show_history(cli_conn_t *c, char *args) {
+    (void)args;
+    history_stats_t st;
+    history_get_stats(&st);
+    obuf_printf(&c->out,
+        "raw_blocks\t%d\n"
+        "raw_block_bytes\t%d\n"
+        "raw_samples\t%llu\n"
+        "raw_bytes_per_sample\t%.2f\n"
+        "minute_slots\t%d\n"
+        "hour_slots\t%d\n"
+        "tracked\t%d\n"
+        "untracked\t%d\n"
+        "samples\t%llu\n"
+        "bytes_per_iface\t%zu\n"
+        "bytes\t%zu\n"
+        "max_bytes\t%zu\n"
+        "bytes_at_50k\t%zu\n",
+        st.raw_blocks, st.raw_block_bytes, (unsigned long long)st.raw_samples,
+        st.raw_samples ? st.raw_bits / 8.0 / st.raw_samples : 0.0, st.minute_slots, st.hour_slots, st.tracked, st.untracked,
+        (unsigned long long)st.samples, st.bytes_per_iface, st.bytes, st.max_bytes,
+        st.bytes_per_iface * 50000);
+}
+
+/* history <ifname> [range]: range is <n>[s|m|h|d], default 10m */
+static void cmd_history(cli_conn_t *c, char *args) {
+    char ifname[IFNAMSIZ];
+    char unit = 'm';
+    unsigned long n = 10;
+    char range[32] = "";
+    if (sscanf(args, "%15s %31s", ifname, range) < 1) {
+        obuf_printf(&c->out, "usage: history <ifname> [<n>s|m|h|d]\n");
+        return;
+    }
+    if (range[0]) {
+        char *end;
+        n = strtoul(range, &end, 10);
+        unit = *end ? *end : 's';
+        if (n == 0 || (end[0] && end[1])) unit = '?';
+    }
+    uint32_t mult;
+    switch (unit) {
+    case 's': mult = 1; break;
+    case 'm': mult = 60; break;
+    case 'h': mult = 3600; break;
+    case 'd': mult = 86400; break;
+    default:
+        obuf_printf(&c->out, "bad range %s, expected <n>s|m|h|d\n", range);
+        return;
+    }
+    if (n > UINT32_MAX / mult) {
+        obuf_printf(&c->out, "range %s too large\n", range);
+        return;
+    }
+    if (history_render(&c->out, ifname, (uint32_t)n * mult) < 0) {
+        obuf_printf(&c->out, "no such interface %s\n", ifname);
+    }
+}
+
+#define CLI_EVENTS_MAX 100000
+
+/* events <from> <to> [ifname glob]: journal records in a time range */
+static void cmd_events(cli_conn_t *c, char *args) {
+    char from_s[32], to_s[32], glob[64] = "";
+    uint64_t from, to;
+    if (sscanf(args, "%31s %31s %63s", from_s, to_s, glob) < 2) {
+        obuf_printf(&c->out, "usage: events <from> <to> [if]   (now, -<n>s|m|h|d, unix time, YYYY-MM-DD[THH:MM[:SS]])\n");
+        return;
+    }
+    if (nlj_parse_time(from_s, &from) < 0) {
+        obuf_printf(&c->out, "bad time %s\n", from_s);
+        return;
+    }
+    if (nlj_parse_time(to_s, &to) < 0) {
+        obuf_printf(&c->out, "bad time %s\n", to_s);
+        return;
+    }
+    if (journal_query(&c->out, from, to, glob[0] ? glob : NULL, CLI_EVENTS_MAX) < 0) {
+        obuf_printf(&c->out, "journal disabled\n");
+    }
+}
+
+static void cmd_show_journal(cli_conn_t *c, char *args) {
+    (void)args;
+    journal_stats_t st;
+    journal_get_stats(&st);
+    if (!st.dir) {
+        obuf_printf(&c->out, "journal\tdisabled\n");
+        return;
+    }
+    obuf_printf(&c->out,
+                "dir\t%s\nsegments\t%d\nsegment_size\t%llu\ncurrent_used\t%llu\nrecords\t%llu\nbytes\t%llu\n"
+                "rotations\t%llu\nspare_misses\t%llu\nlost\t%llu\n",
+                st.dir, st.segments, (unsigned long long)st.seg_size, (unsigned long long)st.cur_used,
+                (unsigned long long)st.records, (unsigned long long)st.bytes, (unsigned long long)st.rotations,
+                (unsigned long long)st.spare_misses, (unsigned long long)st.lost);
+}
+
+/* show openmetrics: exposition endpoint counters */
+static void cmd_show_openmetrics(cli_conn_t *c, char *args) {
+    (void)args;
+    const om_stats_t *st = openmetrics_get_stats();
+    obuf_printf(&c->out,
+        "scrapes\t%llu\n"
+        "layouts\t%llu\n"
+        "patched\t%llu\n"
+        "steps\t%llu\n"
+        "cow_copies\t%llu\n"
+        "interfaces\t%d\n"
+        "body_bytes\t%zu\n"
+        "clients\t%d\n",
+        (unsigned long long)st->scrapes, (unsigned long long)st->layouts,
+        (unsigned long long)st->patched, (unsigned long long)st->steps,
+        (unsigned long long)st->cow_copies, st->interfaces, st->body_bytes, st->clients);
+}
+
+static void cmd_show_clients(cli_conn_t *c, char *args) {
+    (void)args;
+    binproto_stats_t b;
+    binproto_get_stats(&b);
+    obuf_printf(&c->out, "clients\t%d\nmax_clients\t%d\n", conn_count, max_clients);
+    obuf_printf(&c->out, "binary_requests\t%llu\nbinary_queries\t%llu\nbinary_records\t%llu\nbinary_errors\t%llu\n",
+                (unsigned long long)b.requests, (unsigned long long)b.queries,
+                (unsigned long long)b.records, (unsigned long long)b.errors);
+}
+
+/* show log: logger counters */
+static void cmd_show_log(cli_conn_t *c, char *args) {
+    (void)args;
+    log_stats_t st;
+    logger_get_stats(&st);
+    obuf_printf(&c->out,
+        "level\t%s\n"
+        "rate_limit\t%d\n"
+        "ring_slots\t%u\n"
+        "written\t%llu\n"
+        "batches\t%llu\n"
+        "dropped\t%llu\n"
+        "suppressed\t%llu\n",
+        logger_level_name(st.level), st.rate_limit, st.ring_slots,
+        (unsigned long long)st.written, (unsigned long long)st.batches,
+        (unsigned long long)st.dropped, (unsigned long long)st.suppressed);
+}
+
+/* log level [err|warn|info|debug] */
+static void cmd_log_level(cli_conn_t *c, char *args) {
+    char name[16];
+    if (sscanf(args, "%15s", name) != 1) {
+        obuf_printf(&c->out, "%s\n", logger_level_name(log_level_cur));
+        return;
+    }
+    if (logger_set_level_name(name) < 0) {
+        obuf_printf(&c->out, "unknown level %s (err|warn|info|debug)\n", name);
+        return;
+    }
+    obuf_printf(&c->out, "log level set to %s\n", logger_level_name(log_level_cur));
+}
+
+static void cmd_show_watch(cli_conn_t *c, char *args) {
+    (void)args;
+    watch_stats_t st;
+    watch_get_stats(&st);
+    obuf_printf(&c->out,
+                "subscribers\t%d\nring\t%u\npublished\t%llu\ngaps\t%llu\ndropped\t%llu\n"
+                "disconnected\t%llu\n",
+                st.subscribers, st.ring, (unsigned long long)st.published, (unsigned long long)st.gaps,
+                (unsigned long long)st.dropped, (unsigned long long)st.disconnected);
+    watch_render(&c->out);
+}
+
+static void watch_notify(void *arg);
+
+static void cmd_watch(cli_conn_t *c, char *args) {
+    if (c->watch) {
+        obuf_printf(&c->out, "already watching\n");
+        return;
+    }
+    char err[128];
+    c->watch = watch_subscribe(args, watch_notify, c, err, sizeof(err));
+    if (!c->watch) {
+        obuf_printf(&c->out, "%s\n", err);
+        return;
+    }
+    watch_describe(c->watch, &c->out);
+}
+
+static void cmd_keepalive(cli_conn_t *c, char *args) {
+    (void)args;
+    c->keepalive = 1;
+}
+
+static void cmd_quit(cli_conn_t *c, char *args) {
+    (void)args;
+    c->closing = 1;
+}
+
+static const cli_cmd_t commands[] = {
+    { "show interfaces", cmd_show_interfaces },
+    { "list",            cmd_show_interfaces },
+    { "show netlink",    cmd_show_netlink },
+    { "show coalesce",   cmd_show_coalesce },
+    { "show alerts",     cmd_show_alerts },
+    { "show clients",    cmd_show_clients },
+    { "show loop",       cmd_show_loop },
+    { "show sched",      cmd_show_sched },
+    { "show pipeline",   cmd_show_pipeline },
+    { "show snapshot",   cmd_show_snapshot },
+    { "show shm",        cmd_show_shm },
+    { "show netns",      cmd_show_netns },
+    { "show log",        cmd_show_log },
+    { "show history",    cmd_show_history },
+    { "show openmetrics", cmd_show_openmetrics },
+    { "show watch",      cmd_show_watch },
+    { "show journal",    cmd_show_journal },
+    { "history ",        cmd_history },
+    { "events ",         cmd_events },
+    { "log level",       cmd_log_level },
+    { "route lookup ",   cmd_route_lookup },
+    { "route summary",   cmd_route_summary },
+    { "watch",           cmd_watch },
+    { "keepalive",       cmd_keepalive },
+    { "quit",            cmd_quit },
+};
+
+static void execute_line(cli_conn_t *c, char *line) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        size_t n = strlen(commands[i].name);
+        if (strncmp(line, commands[i].name, n) == 0) {
+            commands[i].fn(c, line + n);
+            if (c->keepalive && commands[i].fn != cmd_quit) obuf_append(&c->out, "\n", 1);
             return;
         }
-        buf[n] = '\0';
-        // only support "show interfaces\n" or "list\n"
-        if (strncmp(buf, "show interfaces", 15) == 0 || strncmp(buf, "list", 4)==0) {
-            // capture output by writing to socket
-            // We'll duplicate behavior of list_interfaces to socket by simple approach: format lines
-            // For simplicity call list_interfaces to stdout and also write minimal info
-            // Better approach: iterate parser table and write formatted lines
-            // We'll implement quick iteration by reusing /sys/class/net
-            if (strncmp(buf, "show interfaces", 15) == 0 ||
-                strncmp(buf, "list", 4) == 0)
-            {
-                iface_info_t *inf = iface_list;
-                char line[512];
-
-                while (inf) {
-                    int len = snprintf(line, sizeof(line),
-                        "%s\t%s\n",
-                        inf->ifname,
-                        inf->up ? "UP" : "DOWN");
-                    write(conn, line, len);
-
-                    for (int i = 0; i < inf->addr_cnt; i++) {
-                        len = snprintf(line, sizeof(line),
-                            "  - %s/%d\n",
-                            inf->addrs[i].addr,
-                            inf->addrs[i].prefixlen);
-                        write(conn, line, len);
-                    }
-
-                    inf = inf->next;
-                }
-                
+    }
+    obuf_printf(&c->out, "unknown command\n");
+    if (c->keepalive) obuf_append(&c->out, "\n", 1);
+}
+
+/* ---- connection handling ---- */
+
+static void conn_free(reactor_handler_t *h) {
+    free(h->arg);
+}
+
+/* watch_notify closes other connections too: the free waits for the batch */
+static void conn_close(cli_conn_t *c) {
+    watch_unsubscribe(c->watch);
+    c->watch = NULL;
+    int fd = c->fd;
+    obuf_free(&c->out);
+    reactor_release(&c->h, conn_free);
+    close(fd);
+    conn_count--;
+}
+
+static void conn_update_events(cli_conn_t *c) {
+    uint32_t want = c->rd_eof ? 0 : EPOLLRDHUP;
+    if (!c->closing && !c->rd_eof && c->out.bytes < CLI_OUT_HIGHWAT) want |= EPOLLIN;
+    if (!obuf_empty(&c->out)) want |= EPOLLOUT;
+    if (want == c->events) return;
+    reactor_mod(&c->h, want);
+    c->events = want;
+}
+
+static void conn_event(reactor_handler_t *h, uint32_t events);
+
+static void cli_accept(void) {
+    for (;;) {
+        int fd = accept4(cli_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_err("accept cli conn failed: %s", strerror(errno));
             }
-        } 
-        else {
-            const char *resp = "unknown command\n";
-            write(conn, resp, strlen(resp));
+            return;
+        }
+        if (conn_count >= max_clients) {
+            static const char busy[] = "too many clients\n";
+            (void)!write(fd, busy, sizeof(busy) - 1);
+            close(fd);
+            continue;
+        }
+        cli_conn_t *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->h.fd = fd;
+        c->h.cb = conn_event;
+        c->h.arg = c;
+        /* level-triggered: reading pauses at the output high watermark */
+        c->events = EPOLLIN | EPOLLRDHUP;
+        obuf_init(&c->out);
+        if (reactor_add(&c->h, c->events) < 0) {
+            close(fd);
+            free(c);
+            continue;
         }
-        close(conn);
+        conn_count++;
+    }
+}
+
+/* NLB_MAGIC before anything else selects the binary protocol; -1 while undecided */
+static int select_proto(cli_conn_t *c, int eof) {
+    size_t magic = sizeof(NLB_MAGIC) - 1;
+    if (c->in_len == 0) return -1;
+    if (c->in_len < magic && memcmp(c->in, NLB_MAGIC, c->in_len) == 0 && !eof) return -1;
+    if (c->in_len >= magic && memcmp(c->in, NLB_MAGIC, magic - 1) == 0) {
+        if (c->in[magic - 1] != NLB_MAGIC[magic - 1]) {
+            obuf_printf(&c->out, "unsupported protocol version\n");
+            c->closing = 1;
+            return -1;
+        }
+        c->proto = CLI_PROTO_BINARY;
+        c->keepalive = 1;
+        memmove(c->in, c->in + magic, c->in_len - magic);
+        c->in_len -= magic;
+        return 0;
+    }
+    c->proto = CLI_PROTO_TEXT;
+    return 0;
+}
+
+/* answer every complete request frame in the input buffer */
+static int process_frames(cli_conn_t *c) {
+    int executed = 0;
+    size_t start = 0;
+    while (!c->closing) {
+        int n = binproto_frame(&c->out, c->in + start, c->in_len - start);
+        if (n < 0) c->closing = 1;
+        if (n <= 0) break;
+        start += (size_t)n;
+        executed++;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    return executed;
+}
+
+/* run every complete line in the input buffer */
+static int process_input(cli_conn_t *c, int eof) {
+    if (c->proto == CLI_PROTO_UNKNOWN && select_proto(c, eof) < 0) return 0;
+    if (c->proto == CLI_PROTO_BINARY) return process_frames(c);
+    int executed = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < c->in_len && !c->closing; i++) {
+        if (c->in[i] != '\n') continue;
+        c->in[i] = '\0';
+        if (i > start && c->in[i - 1] == '\r') c->in[i - 1] = '\0';
+        execute_line(c, c->in + start);
+        executed++;
+        start = i + 1;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+
+    /* peer shut down its write side after an unterminated line */
+    if (eof && c->in_len > 0 && !c->closing) {
+        c->in[c->in_len] = '\0';
+        execute_line(c, c->in);
+        executed++;
+        c->in_len = 0;
+    }
+    return executed;
+}
+
+static void conn_read(cli_conn_t *c) {
+    int eof = 0;
+    int executed = 0;
+    while (!c->closing) {
+        /* make room by answering what is complete, pipelined input may be longer */
+        if (c->in_len >= CLI_INBUF - 1) executed += process_input(c, 0);
+        if (c->in_len >= CLI_INBUF - 1) {
+            obuf_printf(&c->out, "line too long\n");
+            c->closing = 1;
+            break;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, CLI_INBUF - 1 - c->in_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) c->closing = 1;
+            break;
+        }
+        if (n == 0) {
+            eof = 1;
+            break;
+        }
+        c->in_len += (size_t)n;
+        if (c->out.bytes >= CLI_OUT_HIGHWAT) break;
+    }
+    executed += process_input(c, eof);
+    /* watchers stay until the peer goes away; one-shot clients are done after their first batch */
+    if (c->watch) c->rd_eof |= eof;
+    else if (eof || (!c->keepalive && executed > 0)) c->closing = 1;
+}
+
+/* move pending events into the output buffer and write what the socket takes */
+static int conn_watch_pump(cli_conn_t *c) {
+    if (watch_pump(c->watch, &c->out) < 0) return -1;
+    if (!obuf_empty(&c->out) && obuf_flush(&c->out, c->fd) < 0) return -1;
+    return 0;
+}
+
+static void watch_notify(void *arg) {
+    cli_conn_t *c = arg;
+    if (c->closing) return;
+    if (conn_watch_pump(c) < 0) {
+        conn_close(c);
+        return;
+    }
+    conn_update_events(c);
+}
+
+static void listen_event(reactor_handler_t *h, uint32_t events) {
+    (void)h;
+    (void)events;
+    cli_accept();
+}
+
+static void conn_event(reactor_handler_t *h, uint32_t events) {
+    cli_conn_t *c = h->arg;
+
+    if (events & EPOLLERR) {
+        conn_close(c);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP)) {
+        if (!c->rd_eof) conn_read(c);
+        if (c->watch && (events & EPOLLHUP)) {
+            conn_close(c);
+            return;
+        }
+    }
+    if (!obuf_empty(&c->out) && obuf_flush(&c->out, c->fd) < 0) {
+        conn_close(c);
+        return;
+    }
+    /* the socket took some output: refill from the event ring */
+    if (c->watch && !c->closing && conn_watch_pump(c) < 0) {
+        conn_close(c);
+        return;
+    }
+    if (c->closing && obuf_empty(&c->out)) {
+        conn_close(c);
+        return;
     }
+    conn_update_events(c);
 }
@@ -1,7 +1,13 @@
 #ifndef CLI_H
 #define CLI_H
 
-int cli_start(int epoll_fd);
-void cli_handle_connection(int fd);
+#include <stdint.h>
+#include "buffer.h"
+
+/* listen on the unix socket; connections are served from the reactor */
+int cli_start(void);
+
+/* "show interfaces" output */
+void cli_render_interfaces(obuf_t *out);
 
 #endif
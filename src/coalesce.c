@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include "coalesce.h"
+#include "logger.h"
+#include "config.h"
+#include "reactor.h"
+#include "watch.h"
+#include "journal.h"
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COALESCE_WINDOW_DEFAULT 100
+/* flags already reported as status/admin/operstate (IFF_LOWER_UP is 0x10000) */
+#define REPORTED_FLAGS (IFF_UP | IFF_RUNNING | 0x10000u)
+
+/* one open record per interface, referenced from iface_info_t.coalesce_slot */
+typedef struct pend {
+    int ifindex;
+    uint64_t first_ms;
+    uint64_t deadline_ms;
+    link_state_t before;               /* table state when the record opened */
+    link_state_t latest;
+    uint32_t transitions;              /* IFF_RUNNING changes */
+    uint32_t messages;
+} pend_t;
+
+static pend_t *pend = NULL;
+static int pend_count = 0;
+static int pend_cap = 0;
+static uint64_t next_deadline = 0;
+static int window_ms = COALESCE_WINDOW_DEFAULT;
+static coalesce_stats_t stats;
+static reactor_timer_t flush_timer;
+static int timer_ready = 0;
+
+static const char *oper_names[] = {
+    "unknown", "notpresent", "down", "lowerlayerdown", "testing", "dormant", "up"
+};
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static const char *oper_name(uint8_t s) {
+    return s < sizeof(oper_names) / sizeof(oper_names[0]) ? oper_names[s] : "?";
+}
+
+static int state_equal(const link_state_t *a, const link_state_t *b) {
+    return a->flags == b->flags && a->mtu == b->mtu && a->operstate == b->operstate;
+}
+
+static int running(const link_state_t *s) {
+    return (s->flags & IFF_RUNNING) ? 1 : 0;
+}
+
+static void flush_timer_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)expirations;
+    coalesce_flush(0);
+    int next = coalesce_timeout_ms();
+    if (next >= 0) reactor_timer_arm(t, (uint64_t)next, 0);
+}
+
+void coalesce_init(void) {
+    window_ms = (int)config_get_int("coalesce_window_ms", COALESCE_WINDOW_DEFAULT);
+    if (window_ms < 0) window_ms = 0;
+    if (!timer_ready && reactor_timer_init(&flush_timer, flush_timer_fire, NULL) == 0) {
+        timer_ready = 1;
+    }
+    /* without a flush timer records would never expire */
+    if (!timer_ready) window_ms = 0;
+    stats.window_ms = window_ms;
+}
+
+/* apply a consolidated change to the table and log it once */
+static void emit(iface_info_t *inf, const link_state_t *before, const link_state_t *after,
+                 uint32_t transitions, uint32_t messages, uint64_t span_ms) {
+    iface_set_link(inf, after->flags, after->mtu, after->operstate);
+    if (transitions) {
+        inf->flaps += transitions;
+        iface_touch(inf);
+    }
+    stats.flaps += transitions;
+    stats.emitted++;
+    if (transitions || !state_equal(before, after)) {
+        watch_link("change", inf, transitions);
+        journal_link(NLJ_OP_CHANGE, inf, transitions);
+    }
+
+    if (state_equal(before, after)) {
+        if (transitions) {
+            log_info("iface %s (idx %d) flapped %u times in %llu ms, status stays %s",
+                     inf->ifname, inf->ifindex, transitions, (unsigned long long)span_ms,
+                     inf->up ? "UP" : "DOWN");
+        }
+        return;
+    }
+
+    char msg[256];
+    size_t len = 0;
+    msg[0] = '\0';
+    if (running(before) != running(after)) {
+        len += snprintf(msg + len, sizeof(msg) - len, " status -> %s", inf->up ? "UP" : "DOWN");
+    }
+    if ((before->flags ^ after->flags) & IFF_UP) {
+        len += snprintf(msg + len, sizeof(msg) - len, " admin -> %s",
+                        (after->flags & IFF_UP) ? "up" : "down");
+    }
+    if (before->mtu != after->mtu) {
+        len += snprintf(msg + len, sizeof(msg) - len, " mtu %u -> %u", before->mtu, after->mtu);
+    }
+    if (before->operstate != after->operstate) {
+        len += snprintf(msg + len, sizeof(msg) - len, " operstate %s -> %s",
+                        oper_name(before->operstate), oper_name(after->operstate));
+    }
+    if ((before->flags ^ after->flags) & ~REPORTED_FLAGS) {
+        len += snprintf(msg + len, sizeof(msg) - len, " flags 0x%x -> 0x%x", before->flags, after->flags);
+    }
+    if (messages > 1 && len < sizeof(msg)) {
+        snprintf(msg + len, sizeof(msg) - len, " (%u messages, %u transitions in %llu ms)",
+                 messages, transitions, (unsigned long long)span_ms);
+    }
+    log_info("iface %s (idx %d)%s", inf->ifname, inf->ifindex, msg);
+}
+
+static void pend_remove(int i) {
+    pend_count--;
+    if (i != pend_count) {
+        pend[i] = pend[pend_count];
+        iface_info_t *moved = get_iface_by_index(pend[i].ifindex);
+        if (moved) moved->coalesce_slot = i + 1;
+    }
+}
+
+void coalesce_link(iface_info_t *inf, const link_state_t *st) {
+    stats.received++;
+
+    if (inf->coalesce_slot) {
+        pend_t *p = &pend[inf->coalesce_slot - 1];
+        if (state_equal(&p->latest, st)) {
+            stats.noop++;
+            return;
+        }
+        if (running(&p->latest) != running(st)) p->transitions++;
+        p->latest = *st;
+        p->messages++;
+        stats.merged++;
+        return;
+    }
+
+    link_state_t cur = { inf->flags, inf->mtu, inf->operstate };
+    if (state_equal(&cur, st)) {
+        stats.noop++;
+        return;
+    }
+    uint32_t transitions = running(&cur) != running(st);
+    if (window_ms == 0) {
+        emit(inf, &cur, st, transitions, 1, 0);
+        return;
+    }
+
+    if (pend_count == pend_cap) {
+        int cap = pend_cap ? pend_cap * 2 : 64;
+        pend_t *n = realloc(pend, (size_t)cap * sizeof(*n));
+        if (!n) {
+            log_err("coalesce: out of memory, applying link change directly");
+            emit(inf, &cur, st, transitions, 1, 0);
+            return;
+        }
+        pend = n;
+        pend_cap = cap;
+    }
+    uint64_t now = now_ms();
+    pend_t *p = &pend[pend_count++];
+    p->ifindex = inf->ifindex;
+    p->first_ms = now;
+    p->deadline_ms = now + (uint64_t)window_ms;
+    p->before = cur;
+    p->latest = *st;
+    p->transitions = transitions;
+    p->messages = 1;
+    inf->coalesce_slot = pend_count;
+    if (pend_count == 1 || p->deadline_ms < next_deadline) {
+        next_deadline = p->deadline_ms;
+        if (timer_ready) reactor_timer_arm(&flush_timer, (uint64_t)window_ms, 0);
+    }
+}
+
+void coalesce_forget(iface_info_t *inf) {
+    if (!inf || !inf->coalesce_slot) return;
+    int i = inf->coalesce_slot - 1;
+    inf->coalesce_slot = 0;
+    pend_remove(i);
+}
+
+int coalesce_flush(int force) {
+    if (!pend_count) return 0;
+    uint64_t now = now_ms();
+    if (!force && now < next_deadline) return 0;
+
+    int applied = 0;
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < pend_count; ) {
+        pend_t *p = &pend[i];
+        if (!force && p->deadline_ms > now) {
+            if (p->deadline_ms < next) next = p->deadline_ms;
+            i++;
+            continue;
+        }
+        iface_info_t *inf = get_iface_by_index(p->ifindex);
+        if (inf) {
+            inf->coalesce_slot = 0;
+            emit(inf, &p->before, &p->latest, p->transitions, p->messages, now - p->first_ms);
+            applied++;
+        }
+        pend_remove(i);
+    }
+    next_deadline = next;
+    return applied;
+}
+
+int coalesce_timeout_ms(void) {
+    if (!pend_count) return -1;
+    uint64_t now = now_ms();
+    return next_deadline > now ? (int)(next_deadline - now) : 0;
+}
+
+const coalesce_stats_t *coalesce_get_stats(void) {
+    stats.pending = pend_count;
+    return &stats;
+}
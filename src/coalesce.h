@@ -0,0 +1,42 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <stdint.h>
+#include "parser.h"
+
+/*
+ * Link event coalescing between the netlink receive path and the interface
+ * table. RTM_NEWLINK notifications are diffed against the stored link state;
+ * identical ones are dropped, real changes open a per-ifindex record that
+ * absorbs further messages for coalesce_window_ms and is then applied as a
+ * single change (with the number of carrier transitions seen meanwhile).
+ */
+
+typedef struct link_state {
+    uint32_t flags;                    /* ifi_flags */
+    uint32_t mtu;
+    uint8_t operstate;
+} link_state_t;
+
+typedef struct coalesce_stats {
+    uint64_t received;                 /* NEWLINK for known interfaces */
+    uint64_t noop;                     /* identical to stored or pending state */
+    uint64_t merged;                   /* absorbed into an open record */
+    uint64_t emitted;                  /* consolidated changes applied */
+    uint64_t flaps;                    /* carrier transitions absorbed */
+    int pending;
+    int window_ms;
+} coalesce_stats_t;
+
+void coalesce_init(void);
+/* NEWLINK for an interface already in the table */
+void coalesce_link(iface_info_t *inf, const link_state_t *st);
+/* the interface is about to be deleted: discard its record */
+void coalesce_forget(iface_info_t *inf);
+/* apply records whose window expired (all of them with force); returns count */
+int coalesce_flush(int force);
+/* ms until the next record is due, -1 when nothing is pending */
+int coalesce_timeout_ms(void);
+const coalesce_stats_t *coalesce_get_stats(void);
+
+#endif
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+typedef struct config_kv {
+    char *key;
+    char *value;
+} config_kv_t;
+
+static config_kv_t *kvs = NULL;
+static int kv_count = 0;
+static int kv_cap = 0;
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    *e = '\0';
+    return s;
+}
+
+void config_free(void) {
+    for (int i = 0; i < kv_count; i++) {
+        free(kvs[i].key);
+        free(kvs[i].value);
+    }
+    free(kvs);
+    kvs = NULL;
+    kv_count = kv_cap = 0;
+}
+
+int config_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        log_warn("config %s not readable (%s), using defaults", path, strerror(errno));
+        return -1;
+    }
+    config_free();
+
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *p = trim(line);
+        if (*p == '\0' || *p == '#') continue;
+        char *eq = strchr(p, '=');
+        if (!eq) {
+            log_warn("config %s:%d: missing '=', ignored", path, lineno);
+            continue;
+        }
+        *eq = '\0';
+        char *key = trim(p);
+        char *value = trim(eq + 1);
+        if (kv_count == kv_cap) {
+            int cap = kv_cap ? kv_cap * 2 : 32;
+            config_kv_t *n = realloc(kvs, (size_t)cap * sizeof(*n));
+            if (!n) break;
+            kvs = n;
+            kv_cap = cap;
+        }
+        kvs[kv_count].key = strdup(key);
+        kvs[kv_count].value = strdup(value);
+        kv_count++;
+    }
+    fclose(f);
+    log_info("config %s loaded (%d entries)", path, kv_count);
+    return 0;
+}
+
+const char *config_get(const char *key) {
+    for (int i = kv_count - 1; i >= 0; i--) {
+        if (strcmp(kvs[i].key, key) == 0) return kvs[i].value;
+    }
+    return NULL;
+}
+
+const char *config_get_str(const char *key, const char *def) {
+    const char *v = config_get(key);
+    return v ? v : def;
+}
+
+long config_get_int(const char *key, long def) {
+    const char *v = config_get(key);
+    if (!v) return def;
+    char *end;
+    errno = 0;
+    long n = strtol(v, &end, 0);
+    if (errno || end == v) {
+        log_warn("config %s=%s is not an integer, using %ld", key, v, def);
+        return def;
+    }
+    /* 允许 K/M/G 后缀（字节类配置） */
+    switch (*end) {
+    case 'k': case 'K': n <<= 10; break;
+    case 'm': case 'M': n <<= 20; break;
+    case 'g': case 'G': n <<= 30; break;
+    default: break;
+    }
+    return n;
+}
+
+double config_get_double(const char *key, double def) {
+    const char *v = config_get(key);
+    if (!v) return def;
+    char *end;
+    double d = strtod(v, &end);
+    if (end == v) {
+        log_warn("config %s=%s is not a number, using %g", key, v, def);
+        return def;
+    }
+    return d;
+}
+
+void config_foreach(const char *key, void (*cb)(const char *value, void *arg), void *arg) {
+    for (int i = 0; i < kv_count; i++) {
+        if (strcmp(kvs[i].key, key) == 0) cb(kvs[i].value, arg);
+    }
+}
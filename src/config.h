@@ -0,0 +1,21 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define NLAGENT_DEFAULT_CONF "/etc/nlagent/nlagent.conf"
+
+/*
+ * key=value 配置（conf/nlagent.conf）。'#' 开头为注释，同一 key 可以出现多次
+ * （例如规则类配置），config_get 返回最后一次出现的值。
+ */
+int config_load(const char *path);     /* 0 成功，-1 无法读取 */
+void config_free(void);
+
+const char *config_get(const char *key);
+const char *config_get_str(const char *key, const char *def);
+long config_get_int(const char *key, long def);
+double config_get_double(const char *key, double def);
+
+/* 按出现顺序遍历 key 的所有值 */
+void config_foreach(const char *key, void (*cb)(const char *value, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,168 @@
+#include "gorilla.h"
+#include <string.h>
+
+static const int payload_bits[6] = { 0, 7, 12, 20, 32, 64 };
+
+static inline uint64_t zigzag(int64_t x) {
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t z) {
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+/* bucket 0..5 for a zigzagged value */
+static inline int bucket_of(uint64_t zz) {
+    if (zz == 0) return 0;
+    if (zz < (1u << 7)) return 1;
+    if (zz < (1u << 12)) return 2;
+    if (zz < (1u << 20)) return 3;
+    if (zz < ((uint64_t)1 << 32)) return 4;
+    return 5;
+}
+
+static inline uint32_t bucket_size(int b) {
+    return (uint32_t)((b < 5 ? b + 1 : 5) + payload_bits[b]);
+}
+
+/* the low n bits of v, most significant first; the target bits must be zero */
+static void put_bits(uint8_t *p, uint32_t pos, uint64_t v, int n) {
+    while (n > 0) {
+        uint32_t byte = pos >> 3;
+        int room = 8 - (int)(pos & 7);
+        int take = n < room ? n : room;
+        uint8_t bits = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        p[byte] |= (uint8_t)(bits << (room - take));
+        pos += (uint32_t)take;
+        n -= take;
+    }
+}
+
+/* n in 1..57 */
+static inline uint64_t get_bits(const uint8_t *p, uint32_t pos, int n) {
+    uint64_t w;
+    memcpy(&w, p + (pos >> 3), sizeof(w));
+    w = __builtin_bswap64(w);
+    return (w << (pos & 7)) >> (64 - n);
+}
+
+static inline uint64_t get_bits64(const uint8_t *p, uint32_t pos) {
+    return get_bits(p, pos, 32) << 32 | get_bits(p, pos + 32, 32);
+}
+
+static uint32_t put_dod(uint8_t *p, uint32_t pos, int64_t dod) {
+    uint64_t zz = zigzag(dod);
+    int b = bucket_of(zz);
+    int plen = b < 5 ? b + 1 : 5;
+    /* b ones then a zero (five ones for the last bucket) */
+    put_bits(p, pos, b < 5 ? ((1u << plen) - 2) : 0x1f, plen);
+    pos += (uint32_t)plen;
+    if (b == 5) {
+        put_bits(p, pos, zz >> 32, 32);
+        put_bits(p, pos + 32, zz & 0xffffffffu, 32);
+    } else if (b) {
+        put_bits(p, pos, zz, payload_bits[b]);
+    }
+    return pos + (uint32_t)payload_bits[b];
+}
+
+static inline int64_t get_dod(const uint8_t *p, uint32_t *pos) {
+    uint32_t peek = (uint32_t)get_bits(p, *pos, 5);
+    int ones = __builtin_clz(~(peek << 27));
+    *pos += (uint32_t)(ones < 5 ? ones + 1 : 5);
+    if (ones == 0) return 0;
+    uint64_t zz = ones == 5 ? get_bits64(p, *pos) : get_bits(p, *pos, payload_bits[ones]);
+    *pos += (uint32_t)payload_bits[ones];
+    return unzigzag(zz);
+}
+
+void gorilla_block_reset(gorilla_block_t *b) {
+    memset(b->data, 0, (size_t)b->cap + GORILLA_SLACK);
+    b->bits = 0;
+    b->count = 0;
+    b->t_first = b->t_last = 0;
+}
+
+void gorilla_enc_begin(gorilla_enc_t *e, gorilla_block_t *b, int ncols) {
+    memset(e, 0, sizeof(*e));
+    e->blk = b;
+    e->ncols = ncols;
+}
+
+int gorilla_enc_append(gorilla_enc_t *e, uint64_t t, const uint64_t *v) {
+    gorilla_block_t *b = e->blk;
+    uint32_t pos = b->bits;
+
+    if (b->count == 0) {
+        uint32_t need = 64u * (uint32_t)(1 + e->ncols);
+        if (need > b->cap * 8u) return -1;
+        put_bits(b->data, pos, t >> 32, 32);
+        put_bits(b->data, pos + 32, t & 0xffffffffu, 32);
+        pos += 64;
+        for (int c = 0; c < e->ncols; c++) {
+            put_bits(b->data, pos, v[c] >> 32, 32);
+            put_bits(b->data, pos + 32, v[c] & 0xffffffffu, 32);
+            pos += 64;
+            e->prev_v[c] = v[c];
+            e->prev_dv[c] = 0;
+        }
+        e->prev_t = t;
+        e->prev_dt = 0;
+        b->t_first = t;
+    } else {
+        int64_t dt = (int64_t)(t - e->prev_t);
+        int64_t dv[GORILLA_MAX_COLS];
+        uint32_t need = bucket_size(bucket_of(zigzag((int64_t)((uint64_t)dt - (uint64_t)e->prev_dt))));
+        for (int c = 0; c < e->ncols; c++) {
+            dv[c] = (int64_t)(v[c] - e->prev_v[c]);
+            need += bucket_size(bucket_of(zigzag((int64_t)((uint64_t)dv[c] - (uint64_t)e->prev_dv[c]))));
+        }
+        if (pos + need > b->cap * 8u) return -1;
+
+        pos = put_dod(b->data, pos, (int64_t)((uint64_t)dt - (uint64_t)e->prev_dt));
+        for (int c = 0; c < e->ncols; c++) {
+            pos = put_dod(b->data, pos, (int64_t)((uint64_t)dv[c] - (uint64_t)e->prev_dv[c]));
+            e->prev_v[c] = v[c];
+            e->prev_dv[c] = dv[c];
+        }
+        e->prev_t = t;
+        e->prev_dt = dt;
+    }
+    b->bits = pos;
+    b->count++;
+    b->t_last = t;
+    return 0;
+}
+
+void gorilla_dec_begin(gorilla_dec_t *d, const gorilla_block_t *b, int ncols) {
+    memset(d, 0, sizeof(*d));
+    d->blk = b;
+    d->ncols = ncols;
+}
+
+int gorilla_dec_next(gorilla_dec_t *d, uint64_t *t, uint64_t *v) {
+    const gorilla_block_t *b = d->blk;
+    const uint8_t *p = b->data;
+    if (d->idx >= b->count) return 0;
+
+    if (d->idx == 0) {
+        d->prev_t = get_bits64(p, 0);
+        d->pos = 64;
+        for (int c = 0; c < d->ncols; c++) {
+            d->prev_v[c] = get_bits64(p, d->pos);
+            d->pos += 64;
+        }
+    } else {
+        /* wrapping arithmetic, mirroring the encoder */
+        d->prev_dt = (int64_t)((uint64_t)d->prev_dt + (uint64_t)get_dod(p, &d->pos));
+        d->prev_t += (uint64_t)d->prev_dt;
+        for (int c = 0; c < d->ncols; c++) {
+            d->prev_dv[c] = (int64_t)((uint64_t)d->prev_dv[c] + (uint64_t)get_dod(p, &d->pos));
+            d->prev_v[c] += (uint64_t)d->prev_dv[c];
+        }
+    }
+    d->idx++;
+    *t = d->prev_t;
+    memcpy(v, d->prev_v, (size_t)d->ncols * sizeof(*v));
+    return 1;
+}
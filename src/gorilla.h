@@ -0,0 +1,69 @@
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <stdint.h>
+
+/*
+ * Bit-packed blocks of (timestamp, counter...) samples after Facebook's
+ * Gorilla. The first sample of a block is stored verbatim; every later one
+ * as the delta-of-delta of the timestamp and of each column, zigzagged into
+ * variable-width buckets:
+ *   0                 dod == 0
+ *   10    + 7 bits
+ *   110   + 12 bits
+ *   1110  + 20 bits
+ *   11110 + 32 bits
+ *   11111 + 64 bits
+ * Counters are integers, so their deltas are differenced exactly instead of
+ * XORing float bit patterns; a steady rate costs one bit per column.
+ * Arithmetic wraps, so counter resets and decreasing values round-trip.
+ *
+ * data must have GORILLA_SLACK readable bytes past cap: the decoder loads
+ * 64-bit words.
+ */
+
+#define GORILLA_MAX_COLS 8
+#define GORILLA_SLACK 8
+
+typedef struct gorilla_block {
+    uint8_t *data;
+    uint32_t cap;                      /* bytes usable for samples */
+    uint32_t bits;                     /* bits written */
+    uint32_t count;                    /* samples */
+    uint64_t t_first;
+    uint64_t t_last;
+} gorilla_block_t;
+
+typedef struct gorilla_enc {
+    gorilla_block_t *blk;
+    int ncols;
+    uint64_t prev_t;
+    int64_t prev_dt;
+    uint64_t prev_v[GORILLA_MAX_COLS];
+    int64_t prev_dv[GORILLA_MAX_COLS];
+} gorilla_enc_t;
+
+typedef struct gorilla_dec {
+    const gorilla_block_t *blk;
+    int ncols;
+    uint32_t pos;                      /* bit offset */
+    uint32_t idx;                      /* samples decoded */
+    uint64_t prev_t;
+    int64_t prev_dt;
+    uint64_t prev_v[GORILLA_MAX_COLS];
+    int64_t prev_dv[GORILLA_MAX_COLS];
+} gorilla_dec_t;
+
+/* empty the block (zeroes the data) */
+void gorilla_block_reset(gorilla_block_t *b);
+
+/* start encoding into b, which must be empty */
+void gorilla_enc_begin(gorilla_enc_t *e, gorilla_block_t *b, int ncols);
+/* append one sample; -1 if it does not fit (block unchanged) */
+int gorilla_enc_append(gorilla_enc_t *e, uint64_t t, const uint64_t *v);
+
+void gorilla_dec_begin(gorilla_dec_t *d, const gorilla_block_t *b, int ncols);
+/* 1 and the next sample, 0 at the end of the block */
+int gorilla_dec_next(gorilla_dec_t *d, uint64_t *t, uint64_t *v);
+
+#endif
@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "parser.h"
+#include "logger.h"
+#include "config.h"
+#include "hash.h"
+#include "gorilla.h"
+#include <net/if.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#define HIST_RAW_BLOCKS_DEFAULT 4
+#define HIST_RAW_BLOCK_BYTES_DEFAULT 512
+#define HIST_MINUTE_DEFAULT 60         /* 1 h of minutes */
+#define HIST_HOUR_DEFAULT 24           /* 1 day of hours */
+#define HIST_MAX_MB_DEFAULT 256
+#define HIST_TIERS 2
+
+static const struct {
+    const char *name;
+    size_t off;
+} hmetrics[HIST_METRICS] = {
+    { "rx_bytes", offsetof(iface_counters_t, rx_bytes) },
+    { "tx_bytes", offsetof(iface_counters_t, tx_bytes) },
+    { "rx_err",   offsetof(iface_counters_t, rx_err) },
+    { "tx_err",   offsetof(iface_counters_t, tx_err) },
+};
+
+static const uint32_t tier_width[HIST_TIERS] = { 60, 3600 };
+
+/* one rollup ring: bucket start plus min/avg/max/last per metric, column-wise */
+typedef struct hist_tier {
+    uint32_t head;                     /* next slot written */
+    uint32_t count;
+    uint32_t *t;                       /* bucket start, unix seconds */
+    float *min[HIST_METRICS];
+    float *avg[HIST_METRICS];
+    float *max[HIST_METRICS];
+    float *last[HIST_METRICS];
+} hist_tier_t;
+
+/* the bucket of a tier still being filled */
+typedef struct hist_acc {
+    uint32_t id;                       /* bucket start / tier width */
+    double w;                          /* seconds covered, 0: empty */
+    float min[HIST_METRICS];
+    float max[HIST_METRICS];
+    float last[HIST_METRICS];
+    double sum[HIST_METRICS];          /* rate x seconds */
+} hist_acc_t;
+
+typedef struct hist_iface {
+    int ifindex;
+    char ifname[IFNAMSIZ];
+    /* raw samples (unix ms, counter values), compressed; the newest block is open */
+    uint32_t raw_head;                 /* block being encoded */
+    uint32_t raw_count;                /* blocks in use */
+    gorilla_block_t *raw;
+    gorilla_enc_t enc;
+    uint64_t prev_t;                   /* previous sample, 0: none */
+    uint64_t prev_v[HIST_METRICS];
+    hist_tier_t tier[HIST_TIERS];
+    hist_acc_t acc[HIST_TIERS];
+    /* arrays follow in the same allocation */
+} hist_iface_t;
+
+static int raw_blocks = HIST_RAW_BLOCKS_DEFAULT;
+static int raw_block_bytes = HIST_RAW_BLOCK_BYTES_DEFAULT;
+static int tier_slots[HIST_TIERS] = { HIST_MINUTE_DEFAULT, HIST_HOUR_DEFAULT };
+static size_t iface_bytes = 0;
+static size_t max_bytes = 0;
+static uint64_t samples = 0;
+
+static hist_iface_t **hists = NULL;    /* dense */
+static int hist_count = 0;
+static int hist_cap = 0;
+static int *hist_map = NULL;           /* ifindex -> position + 1 */
+static int hist_map_cap = 0;
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static size_t block_size(void) {
+    size_t n = sizeof(hist_iface_t);
+    n += (size_t)raw_blocks * (sizeof(gorilla_block_t) + (size_t)raw_block_bytes + GORILLA_SLACK);
+    for (int k = 0; k < HIST_TIERS; k++) {
+        n += (size_t)tier_slots[k] * (sizeof(uint32_t) + 4 * HIST_METRICS * sizeof(float));
+    }
+    return n;
+}
+
+static void free_all(void) {
+    for (int i = 0; i < hist_count; i++) free(hists[i]);
+    free(hists);
+    free(hist_map);
+    hists = NULL;
+    hist_map = NULL;
+    hist_count = hist_cap = hist_map_cap = 0;
+}
+
+void history_init(void) {
+    int blocks = (int)config_get_int("history_raw_blocks", HIST_RAW_BLOCKS_DEFAULT);
+    int block_bytes = (int)config_get_int("history_raw_block_bytes", HIST_RAW_BLOCK_BYTES_DEFAULT);
+    int minute = (int)config_get_int("history_minute_slots", HIST_MINUTE_DEFAULT);
+    int hour = (int)config_get_int("history_hour_slots", HIST_HOUR_DEFAULT);
+    long mb = config_get_int("history_max_mb", HIST_MAX_MB_DEFAULT);
+    if (blocks < 2) blocks = 2;
+    /* room for the verbatim first sample plus a few more */
+    if (block_bytes < 128) block_bytes = 128;
+    block_bytes = (block_bytes + 7) & ~7;
+    if (minute < 1) minute = 1;
+    if (hour < 1) hour = 1;
+    if (mb < 0) mb = 0;
+
+    /* ring geometry is baked into every block: a change starts over */
+    if (blocks != raw_blocks || block_bytes != raw_block_bytes || minute != tier_slots[0] || hour != tier_slots[1]) {
+        if (hist_count) log_info("history: ring sizes changed, dropping %d histories", hist_count);
+        free_all();
+        raw_blocks = blocks;
+        raw_block_bytes = block_bytes;
+        tier_slots[0] = minute;
+        tier_slots[1] = hour;
+    }
+    iface_bytes = block_size();
+    max_bytes = (size_t)mb << 20;
+    log_info("history: %d x %d byte raw blocks, %d x 1 min, %d x 1 h per interface, %zu bytes each, cap %ld MB (%zu interfaces)",
+             raw_blocks, raw_block_bytes, tier_slots[0], tier_slots[1], iface_bytes, mb, max_bytes / iface_bytes);
+}
+
+static hist_iface_t *hist_find(int ifindex) {
+    if (ifindex <= 0 || ifindex >= hist_map_cap || !hist_map[ifindex]) return NULL;
+    return hists[hist_map[ifindex] - 1];
+}
+
+/* carve the arrays out of the block, widest type first */
+static void hist_layout(hist_iface_t *h) {
+    char *p = (char *)(h + 1);
+    h->raw = (gorilla_block_t *)p;
+    p += (size_t)raw_blocks * sizeof(gorilla_block_t);
+    for (int b = 0; b < raw_blocks; b++) {
+        h->raw[b].data = (uint8_t *)p;
+        h->raw[b].cap = (uint32_t)raw_block_bytes;
+        p += (size_t)raw_block_bytes + GORILLA_SLACK;
+    }
+    for (int k = 0; k < HIST_TIERS; k++) {
+        size_t col = (size_t)tier_slots[k] * sizeof(float);
+        for (int m = 0; m < HIST_METRICS; m++) {
+            h->tier[k].min[m] = (float *)p;  p += col;
+            h->tier[k].avg[m] = (float *)p;  p += col;
+            h->tier[k].max[m] = (float *)p;  p += col;
+            h->tier[k].last[m] = (float *)p; p += col;
+        }
+    }
+    for (int k = 0; k < HIST_TIERS; k++) {
+        h->tier[k].t = (uint32_t *)p;
+        p += (size_t)tier_slots[k] * sizeof(uint32_t);
+    }
+}
+
+static hist_iface_t *hist_get(const iface_info_t *inf) {
+    hist_iface_t *h = hist_find(inf->ifindex);
+    if (h) return h;
+    if ((size_t)(hist_count + 1) * iface_bytes > max_bytes) return NULL;
+
+    if (inf->ifindex >= hist_map_cap) {
+        int cap = (int)hash_pow2((uint32_t)inf->ifindex + 1);
+        if (cap < 256) cap = 256;
+        int *m = realloc(hist_map, (size_t)cap * sizeof(int));
+        if (!m) return NULL;
+        memset(m + hist_map_cap, 0, (size_t)(cap - hist_map_cap) * sizeof(int));
+        hist_map = m;
+        hist_map_cap = cap;
+    }
+    if (hist_count == hist_cap) {
+        int cap = hist_cap ? hist_cap * 2 : 64;
+        hist_iface_t **a = realloc(hists, (size_t)cap * sizeof(*a));
+        if (!a) return NULL;
+        hists = a;
+        hist_cap = cap;
+    }
+    h = calloc(1, iface_bytes);
+    if (!h) {
+        log_err("history: out of memory tracking %s", inf->ifname);
+        return NULL;
+    }
+    hist_layout(h);
+    gorilla_enc_begin(&h->enc, &h->raw[0], HIST_METRICS);
+    h->raw_count = 1;
+    h->ifindex = inf->ifindex;
+    hists[hist_count++] = h;
+    hist_map[h->ifindex] = hist_count;
+    return h;
+}
+
+static void hist_remove_at(int pos) {
+    hist_iface_t *h = hists[pos];
+    hist_map[h->ifindex] = 0;
+    free(h);
+    hist_count--;
+    if (pos != hist_count) {
+        hists[pos] = hists[hist_count];
+        hist_map[hists[pos]->ifindex] = pos + 1;
+    }
+}
+
+void history_sweep(void) {
+    for (int pos = 0; pos < hist_count; ) {
+        if (!get_iface_by_index(hists[pos]->ifindex)) hist_remove_at(pos);
+        else pos++;
+    }
+}
+
+/* ---- rollups ---- */
+
+static void acc_fold(hist_iface_t *h, int k, uint32_t tsec, const float *mn, const float *avg,
+                     const float *mx, const float *last, double w);
+
+/* close the open bucket of tier k into its ring and pass it up a tier */
+static void acc_close(hist_iface_t *h, int k) {
+    hist_acc_t *a = &h->acc[k];
+    hist_tier_t *r = &h->tier[k];
+    uint32_t slot = r->head;
+    float avg[HIST_METRICS];
+
+    r->t[slot] = a->id * tier_width[k];
+    for (int m = 0; m < HIST_METRICS; m++) {
+        avg[m] = (float)(a->sum[m] / a->w);
+        r->min[m][slot] = a->min[m];
+        r->avg[m][slot] = avg[m];
+        r->max[m][slot] = a->max[m];
+        r->last[m][slot] = a->last[m];
+    }
+    r->head = (slot + 1) % (uint32_t)tier_slots[k];
+    if (r->count < (uint32_t)tier_slots[k]) r->count++;
+
+    double w = a->w;
+    a->w = 0;
+    if (k + 1 < HIST_TIERS) acc_fold(h, k + 1, r->t[slot], a->min, avg, a->max, a->last, w);
+}
+
+static void acc_fold(hist_iface_t *h, int k, uint32_t tsec, const float *mn, const float *avg,
+                     const float *mx, const float *last, double w) {
+    hist_acc_t *a = &h->acc[k];
+    uint32_t id = tsec / tier_width[k];
+    if (a->w > 0 && id != a->id) acc_close(h, k);
+    if (a->w == 0) {
+        a->id = id;
+        for (int m = 0; m < HIST_METRICS; m++) {
+            a->min[m] = mn[m];
+            a->max[m] = mx[m];
+            a->sum[m] = 0;
+        }
+    }
+    for (int m = 0; m < HIST_METRICS; m++) {
+        if (mn[m] < a->min[m]) a->min[m] = mn[m];
+        if (mx[m] > a->max[m]) a->max[m] = mx[m];
+        a->sum[m] += (double)avg[m] * w;
+        a->last[m] = last[m];
+    }
+    a->w += w;
+}
+
+void history_record(const iface_info_t *inf) {
+    hist_iface_t *h = hist_get(inf);
+    if (!h) return;
+    if (strcmp(h->ifname, inf->ifname) != 0) memcpy(h->ifname, inf->ifname, IFNAMSIZ);
+
+    uint64_t now = wall_ms();
+    uint64_t v[HIST_METRICS];
+    for (int m = 0; m < HIST_METRICS; m++) {
+        v[m] = *(const uint64_t *)((const char *)&inf->stats + hmetrics[m].off);
+    }
+
+    if (gorilla_enc_append(&h->enc, now, v) < 0) {
+        /* block full: open the next one, dropping the oldest when all are used */
+        h->raw_head = (h->raw_head + 1) % (uint32_t)raw_blocks;
+        if (h->raw_count < (uint32_t)raw_blocks) h->raw_count++;
+        gorilla_block_t *b = &h->raw[h->raw_head];
+        gorilla_block_reset(b);
+        gorilla_enc_begin(&h->enc, b, HIST_METRICS);
+        gorilla_enc_append(&h->enc, now, v);
+    }
+    samples++;
+
+    if (h->prev_t && now > h->prev_t) {
+        double dt = (now - h->prev_t) / 1000.0;
+        float rate[HIST_METRICS];
+        int reset = 0;
+        for (int m = 0; m < HIST_METRICS; m++) {
+            if (v[m] < h->prev_v[m]) reset = 1;
+            else rate[m] = (float)((v[m] - h->prev_v[m]) / dt);
+        }
+        /* a counter reset re-baselines instead of producing a bogus rate */
+        if (!reset) acc_fold(h, 0, (uint32_t)(now / 1000), rate, rate, rate, rate, dt);
+    }
+    h->prev_t = now;
+    memcpy(h->prev_v, v, sizeof(v));
+}
+
+/* ---- rendering ---- */
+
+static const gorilla_block_t *raw_block(const hist_iface_t *h, uint32_t i) {
+    return &h->raw[(h->raw_head + (uint32_t)raw_blocks + 1 - h->raw_count + i) % (uint32_t)raw_blocks];
+}
+
+static void render_raw(obuf_t *out, const hist_iface_t *h, uint64_t from_ms) {
+    obuf_printf(out, "time\trx_bytes/s\ttx_bytes/s\trx_err/s\ttx_err/s\n");
+    uint64_t prev_t = 0, prev_v[HIST_METRICS], t, v[HIST_METRICS];
+    for (uint32_t i = 0; i < h->raw_count; i++) {
+        const gorilla_block_t *b = raw_block(h, i);
+        /* keep the last sample before the range: the first row needs it */
+        if (i + 1 < h->raw_count && raw_block(h, i + 1)->t_first < from_ms) continue;
+        gorilla_dec_t d;
+        gorilla_dec_begin(&d, b, HIST_METRICS);
+        while (gorilla_dec_next(&d, &t, v)) {
+            if (prev_t && t >= from_ms && t > prev_t) {
+                double dt = (t - prev_t) / 1000.0;
+                time_t sec = (time_t)(t / 1000);
+                struct tm tm;
+                char ts[16];
+                localtime_r(&sec, &tm);
+                strftime(ts, sizeof(ts), "%H:%M:%S", &tm);
+                obuf_printf(out, "%s.%03u", ts, (unsigned)(t % 1000));
+                for (int m = 0; m < HIST_METRICS; m++) {
+                    if (v[m] >= prev_v[m]) obuf_printf(out, "\t%.6g", (v[m] - prev_v[m]) / dt);
+                    else obuf_printf(out, "\t-");
+                }
+                obuf_printf(out, "\n");
+            }
+            prev_t = t;
+            memcpy(prev_v, v, sizeof(v));
+        }
+    }
+}
+
+static void render_bucket(obuf_t *out, int k, uint32_t t, const float *mn, const float *avg,
+                          const float *mx, const float *last, const char *mark) {
+    time_t sec = t;
+    struct tm tm;
+    char ts[32];
+    localtime_r(&sec, &tm);
+    strftime(ts, sizeof(ts), k == 0 ? "%H:%M" : "%m-%d %H:00", &tm);
+    obuf_printf(out, "%s%s", ts, mark);
+    for (int m = 0; m < HIST_METRICS; m++) {
+        obuf_printf(out, "\t%.6g/%.6g/%.6g/%.6g", mn[m], avg[m], mx[m], last[m]);
+    }
+    obuf_printf(out, "\n");
+}
+
+static void render_tier(obuf_t *out, const hist_iface_t *h, int k, uint32_t from) {
+    const hist_tier_t *r = &h->tier[k];
+    obuf_printf(out, "%s\t(min/avg/max/last per second)", k == 0 ? "minute" : "hour");
+    for (int m = 0; m < HIST_METRICS; m++) obuf_printf(out, "\t%s", hmetrics[m].name);
+    obuf_printf(out, "\n");
+
+    uint32_t slots = (uint32_t)tier_slots[k];
+    uint32_t first = (r->head + slots - r->count) % slots;
+    for (uint32_t i = 0; i < r->count; i++) {
+        uint32_t s = (first + i) % slots;
+        if (r->t[s] + tier_width[k] <= from) continue;
+        float mn[HIST_METRICS], avg[HIST_METRICS], mx[HIST_METRICS], last[HIST_METRICS];
+        for (int m = 0; m < HIST_METRICS; m++) {
+            mn[m] = r->min[m][s];
+            avg[m] = r->avg[m][s];
+            mx[m] = r->max[m][s];
+            last[m] = r->last[m][s];
+        }
+        render_bucket(out, k, r->t[s], mn, avg, mx, last, "");
+    }
+    /* the bucket still filling, marked with '*' */
+    const hist_acc_t *a = &h->acc[k];
+    if (a->w > 0) {
+        float avg[HIST_METRICS];
+        for (int m = 0; m < HIST_METRICS; m++) avg[m] = (float)(a->sum[m] / a->w);
+        render_bucket(out, k, a->id * tier_width[k], a->min, avg, a->max, a->last, "*");
+    }
+}
+
+int history_render(obuf_t *out, const char *ifname, uint32_t range_sec) {
+    iface_info_t *inf = get_iface_by_name(ifname);
+    if (!inf) return -1;
+    const hist_iface_t *h = hist_find(inf->ifindex);
+    if (!h || h->raw[h->raw_head].count == 0) {
+        obuf_printf(out, "no history for %s\n", ifname);
+        return 0;
+    }
+    uint64_t now = wall_ms();
+    uint64_t from_ms = now - (uint64_t)range_sec * 1000;
+
+    /* finest tier that still reaches back far enough */
+    if (raw_block(h, 0)->t_first <= from_ms || range_sec <= 60) render_raw(out, h, from_ms);
+    else if (range_sec <= (uint32_t)tier_slots[0] * tier_width[0]) render_tier(out, h, 0, (uint32_t)(from_ms / 1000));
+    else render_tier(out, h, 1, (uint32_t)(from_ms / 1000));
+    return 0;
+}
+
+void history_get_stats(history_stats_t *st) {
+    st->tracked = hist_count;
+    st->untracked = get_iface_count() - hist_count;
+    if (st->untracked < 0) st->untracked = 0;
+    st->bytes = (size_t)hist_count * iface_bytes;
+    st->bytes_per_iface = iface_bytes;
+    st->max_bytes = max_bytes;
+    st->samples = samples;
+    st->raw_blocks = raw_blocks;
+    st->raw_block_bytes = raw_block_bytes;
+    st->raw_bits = 0;
+    st->raw_samples = 0;
+    for (int i = 0; i < hist_count; i++) {
+        for (uint32_t b = 0; b < hists[i]->raw_count; b++) {
+            st->raw_bits += hists[i]->raw[b].bits;
+            st->raw_samples += hists[i]->raw[b].count;
+        }
+    }
+    st->minute_slots = tier_slots[0];
+    st->hour_slots = tier_slots[1];
+}
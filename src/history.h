@@ -0,0 +1,48 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "parser.h"
+#include "buffer.h"
+
+/*
+ * Fixed-memory counter history per interface. Three rings, sized once from
+ * the config:
+ *   raw     history_raw_blocks blocks of history_raw_block_bytes holding
+ *           the polled counter values, Gorilla-encoded (gorilla.h)
+ *   minute  history_minute_slots 1 min buckets of per-second rates
+ *   hour    history_hour_slots 1 h buckets, rolled up from the minutes
+ * The rollup rings are structure-of-arrays. Each bucket keeps min/avg/max/last of rx_bytes, tx_bytes, rx_err, tx_err
+ * rates (avg weighted by sample interval). A global cap (history_max_mb)
+ * bounds the total; interfaces beyond it are counted but not tracked.
+ */
+
+#define HIST_METRICS 4                 /* rx_bytes tx_bytes rx_err tx_err */
+
+typedef struct history_stats {
+    int tracked;
+    int untracked;                     /* refused by history_max_mb */
+    size_t bytes;                      /* all tracked interfaces */
+    size_t bytes_per_iface;
+    size_t max_bytes;
+    uint64_t samples;
+    int raw_blocks;
+    int raw_block_bytes;
+    uint64_t raw_bits;                 /* encoded, all tracked interfaces */
+    uint64_t raw_samples;              /* held in the raw blocks */
+    int minute_slots;
+    int hour_slots;
+} history_stats_t;
+
+void history_init(void);
+/* record the counters just refreshed for inf */
+void history_record(const iface_info_t *inf);
+/* free history of interfaces that left the table */
+void history_sweep(void);
+
+/* render the last range_sec seconds for ifname, choosing the tier by range */
+int history_render(obuf_t *out, const char *ifname, uint32_t range_sec);
+void history_get_stats(history_stats_t *st);
+
+#endif
@@ -0,0 +1,408 @@
+#define _GNU_SOURCE
+#include "journal.h"
+#include "logger.h"
+#include "config.h"
+#include "reactor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_DIR_DEFAULT "/var/lib/nlagent/journal"
+#define JOURNAL_SEGMENT_KB_DEFAULT 4096
+#define JOURNAL_SEGMENTS_DEFAULT 16
+#define JOURNAL_TICK_MS 1000
+#define JOURNAL_PAGE 4096
+
+typedef struct segment {
+    uint64_t no;
+    uint8_t *base;                     /* NULL: none */
+    size_t size;
+    nlj_header_t *hdr;
+} segment_t;
+
+static char dir[200];
+static int enabled;
+static size_t seg_size;
+static int max_segments;
+static segment_t cur, spare;
+static uint64_t *segs;                 /* numbers on disk, ascending, cur last */
+static int nsegs, segs_cap;
+static uint64_t last_ts;
+static uint64_t retry_no;              /* segment to create on the next tick after a failure */
+static reactor_timer_t tick;
+static journal_stats_t stats;
+
+static int mkdir_p(const char *path) {
+    char tmp[sizeof(dir)];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) < 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return mkdir(tmp, 0755) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+static int seg_map(segment_t *s, int fd, size_t size) {
+    /* prefault now so appends never wait for a page */
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    s->base = p;
+    s->size = size;
+    s->hdr = p;
+    return 0;
+}
+
+static void seg_unmap(segment_t *s) {
+    if (s->base) munmap(s->base, s->size);
+    memset(s, 0, sizeof(*s));
+}
+
+static int seg_create(segment_t *s, uint64_t no) {
+    char path[sizeof(dir) + 32];
+    nlj_seg_path(path, sizeof(path), dir, no);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_err("journal: create %s: %s", path, strerror(errno));
+        return -1;
+    }
+    /* blocks allocated up front: writing through the mapping cannot hit ENOSPC */
+    int rc = posix_fallocate(fd, 0, (off_t)seg_size);
+    if (rc == EOPNOTSUPP || rc == EINVAL) {
+        /* no fallocate here: sparse, the only case allowed to risk SIGBUS; ENOSPC fails */
+        rc = ftruncate(fd, (off_t)seg_size) < 0 ? errno : 0;
+    }
+    if (rc != 0 || seg_map(s, fd, seg_size) < 0) {
+        log_err("journal: allocate %s: %s", path, strerror(rc ? rc : errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    close(fd);
+
+    uint32_t index_cap = (uint32_t)(seg_size / (NLJ_INDEX_STRIDE * sizeof(nlj_rec_t)));
+    uint64_t data_off = sizeof(nlj_header_t) + (uint64_t)index_cap * sizeof(nlj_index_t);
+    data_off = (data_off + JOURNAL_PAGE - 1) & ~(uint64_t)(JOURNAL_PAGE - 1);
+    nlj_header_t *h = s->hdr;
+    memset(h, 0, sizeof(*h));
+    h->magic = NLJ_MAGIC;
+    h->version = NLJ_VERSION;
+    h->index_off = sizeof(nlj_header_t);
+    h->index_cap = index_cap;
+    h->data_off = (uint32_t)data_off;
+    h->seg_size = seg_size;
+    h->seg_no = no;
+    __atomic_store_n(&h->used, data_off, __ATOMIC_RELEASE);
+    s->no = no;
+    return 0;
+}
+
+/* continue the newest segment after a restart if it is ours and not sealed */
+static int seg_reopen(segment_t *s, uint64_t no) {
+    char path[sizeof(dir) + 32];
+    nlj_seg_path(path, sizeof(path), dir, no);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != seg_size || seg_map(s, fd, seg_size) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    nlj_seg_t v;
+    if (nlj_seg_attach(&v, s->base, s->size) < 0 || s->hdr->sealed || s->hdr->seg_no != no ||
+        s->hdr->used < s->hdr->data_off || s->hdr->used > seg_size) {
+        seg_unmap(s);
+        return -1;
+    }
+    s->no = no;
+    if (s->hdr->count) last_ts = s->hdr->last_ts_ns;
+    return 0;
+}
+
+static int segs_push(uint64_t no) {
+    if (nsegs == segs_cap) {
+        int cap = segs_cap ? segs_cap * 2 : 32;
+        uint64_t *p = realloc(segs, (size_t)cap * sizeof(*p));
+        if (!p) return -1;
+        segs = p;
+        segs_cap = cap;
+    }
+    segs[nsegs++] = no;
+    stats.segments = nsegs;
+    return 0;
+}
+
+/* delete the oldest segments beyond journal_segments */
+static void retire(void) {
+    while (nsegs > max_segments) {
+        char path[sizeof(dir) + 32];
+        nlj_seg_path(path, sizeof(path), dir, segs[0]);
+        if (unlink(path) < 0 && errno != ENOENT) log_warn("journal: unlink %s: %s", path, strerror(errno));
+        memmove(segs, segs + 1, (size_t)(nsegs - 1) * sizeof(*segs));
+        nsegs--;
+    }
+    stats.segments = nsegs;
+}
+
+static int rotate(void) {
+    __atomic_store_n(&cur.hdr->sealed, 1, __ATOMIC_RELEASE);
+    msync(cur.base, cur.size, MS_ASYNC);
+    uint64_t next = cur.no + 1;
+    seg_unmap(&cur);
+    if (spare.base) {
+        cur = spare;
+        memset(&spare, 0, sizeof(spare));
+    } else {
+        stats.spare_misses++;
+        if (seg_create(&cur, next) < 0) {
+            retry_no = next;
+            return -1;
+        }
+    }
+    stats.rotations++;
+    segs_push(cur.no);
+    return 0;
+}
+
+static void tick_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)t;
+    (void)expirations;
+    if (!cur.base) {
+        if (!retry_no || seg_create(&cur, retry_no) < 0) return;
+        retry_no = 0;
+        segs_push(cur.no);
+    }
+    if (!spare.base && cur.hdr->used > seg_size / 2) seg_create(&spare, cur.no + 1);
+    retire();
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t t = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    /* the time index needs order; a clock stepped back repeats the last stamp */
+    if (t < last_ts) t = last_ts;
+    last_ts = t;
+    return t;
+}
+
+/* rec is filled except for the timestamp */
+static void append(nlj_rec_t *rec) {
+    if (!enabled) return;
+    if (!cur.base || cur.hdr->used + rec->len > seg_size) {
+        if (!cur.base || rotate() < 0) {
+            stats.lost++;
+            return;
+        }
+    }
+    nlj_header_t *h = cur.hdr;
+    uint64_t off = h->used;
+    rec->ts_ns = now_ns();
+    memcpy(cur.base + off, rec, rec->len);
+    if (h->count % NLJ_INDEX_STRIDE == 0 && h->index_count < h->index_cap) {
+        nlj_index_t *ix = (nlj_index_t *)(cur.base + h->index_off);
+        ix[h->index_count].ts_ns = rec->ts_ns;
+        ix[h->index_count].off = off;
+        __atomic_store_n(&h->index_count, h->index_count + 1, __ATOMIC_RELEASE);
+    }
+    if (h->count == 0) h->first_ts_ns = rec->ts_ns;
+    h->last_ts_ns = rec->ts_ns;
+    h->count++;
+    __atomic_store_n(&h->used, off + rec->len, __ATOMIC_RELEASE);
+    stats.records++;
+    stats.bytes += rec->len;
+}
+
+static void rec_init(nlj_rec_t *r, size_t len, uint8_t type, uint8_t op, int ifindex, const char *ifname) {
+    memset(r, 0, len);
+    r->len = (uint16_t)len;
+    r->type = type;
+    r->op = op;
+    r->ifindex = ifindex;
+    if (ifname) memcpy(r->ifname, ifname, strnlen(ifname, NLJ_IFNAMSIZ - 1));
+}
+
+void journal_link(int op, const iface_info_t *inf, uint32_t transitions) {
+    if (!enabled) return;
+    nlj_link_t l;
+    rec_init(&l.h, sizeof(l), NLJ_T_LINK, (uint8_t)op, inf->ifindex, inf->ifname);
+    l.flags = inf->flags;
+    l.mtu = inf->mtu;
+    l.operstate = inf->operstate;
+    l.up = inf->up ? 1 : 0;
+    l.transitions = transitions;
+    append(&l.h);
+}
+
+void journal_link_rename(const iface_info_t *inf, const char *old) {
+    if (!enabled) return;
+    nlj_link_t l;
+    rec_init(&l.h, sizeof(l), NLJ_T_LINK, NLJ_OP_RENAME, inf->ifindex, inf->ifname);
+    l.flags = inf->flags;
+    l.mtu = inf->mtu;
+    l.operstate = inf->operstate;
+    l.up = inf->up ? 1 : 0;
+    memcpy(l.old_ifname, old, strnlen(old, NLJ_IFNAMSIZ - 1));
+    append(&l.h);
+}
+
+void journal_addr(int op, const iface_info_t *inf, const iface_addr_t *a) {
+    if (!enabled) return;
+    nlj_addr_t r;
+    rec_init(&r.h, sizeof(r), NLJ_T_ADDR, (uint8_t)op, inf->ifindex, inf->ifname);
+    r.family = a->family;
+    r.prefixlen = a->prefixlen;
+    r.flags = a->flags;
+    memcpy(r.addr, a->addr.raw, sizeof(r.addr));
+    append(&r.h);
+}
+
+void journal_route(int add, const rt_route_t *rt) {
+    if (!enabled) return;
+    nlj_route_t r;
+    const rt_nexthop_t *nh = rt->nh_count ? &rt->nh[0] : NULL;
+    const iface_info_t *inf = nh && nh->oif ? get_iface_by_index(nh->oif) : NULL;
+    rec_init(&r.h, sizeof(r), NLJ_T_ROUTE, add ? NLJ_OP_NEW : NLJ_OP_DEL, nh ? nh->oif : 0,
+             inf ? inf->ifname : NULL);
+    r.table = rt->table;
+    r.priority = rt->priority;
+    r.family = rt->family;
+    r.dst_len = rt->dst_len;
+    r.protocol = rt->protocol;
+    r.scope = rt->scope;
+    r.type = rt->type;
+    r.nh_count = (uint16_t)rt->nh_count;
+    memcpy(r.dst, rt->dst, sizeof(r.dst));
+    if (nh && nh->gw_family) {
+        r.gw_family = nh->gw_family;
+        memcpy(r.gw, nh->gw, sizeof(r.gw));
+    }
+    append(&r.h);
+}
+
+void journal_resync(void) {
+    if (!enabled) return;
+    nlj_rec_t r;
+    rec_init(&r, sizeof(r), NLJ_T_RESYNC, 0, 0, NULL);
+    append(&r);
+}
+
+int journal_start(void) {
+    const char *d = config_get_str("journal_dir", JOURNAL_DIR_DEFAULT);
+    if (!d[0]) {
+        log_info("journal: disabled");
+        return 0;
+    }
+    if (strlen(d) >= sizeof(dir)) {
+        log_err("journal: journal_dir too long");
+        return -1;
+    }
+    snprintf(dir, sizeof(dir), "%s", d);
+    long kb = config_get_int("journal_segment_kb", JOURNAL_SEGMENT_KB_DEFAULT);
+    if (kb < 64) kb = 64;
+    seg_size = ((size_t)kb << 10) & ~(size_t)(JOURNAL_PAGE - 1);
+    max_segments = (int)config_get_int("journal_segments", JOURNAL_SEGMENTS_DEFAULT);
+    if (max_segments < 2) max_segments = 2;
+
+    if (mkdir_p(dir) < 0) {
+        log_err("journal: mkdir %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    uint64_t *found = NULL;
+    int n = nlj_list(dir, &found);
+    if (n < 0) {
+        log_err("journal: scan %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < n; i++) segs_push(found[i]);
+    free(found);
+
+    if (nsegs == 0 || seg_reopen(&cur, segs[nsegs - 1]) < 0) {
+        uint64_t no = nsegs ? segs[nsegs - 1] + 1 : 1;
+        if (seg_create(&cur, no) < 0) return -1;
+        segs_push(no);
+    }
+    retire();
+    if (reactor_timer_init(&tick, tick_fire, NULL) == 0) {
+        reactor_timer_arm(&tick, JOURNAL_TICK_MS, JOURNAL_TICK_MS);
+    }
+    enabled = 1;
+    stats.dir = dir;
+    stats.seg_size = seg_size;
+    log_info("journal: %s, segment %llu, %d segments of %zu KB kept", dir, (unsigned long long)cur.no,
+             max_segments, seg_size >> 10);
+    return 0;
+}
+
+void journal_stop(void) {
+    if (!enabled) return;
+    enabled = 0;
+    if (cur.base) msync(cur.base, cur.size, MS_SYNC);
+    seg_unmap(&cur);
+    /* an unused spare would be continued as an empty segment; drop it */
+    if (spare.base) {
+        char path[sizeof(dir) + 32];
+        nlj_seg_path(path, sizeof(path), dir, spare.no);
+        seg_unmap(&spare);
+        unlink(path);
+    }
+}
+
+static int query_segment(obuf_t *out, const nlj_seg_t *s, uint64_t from, uint64_t to, const char *ifglob,
+                         int limit, int *shown) {
+    if (!s->hdr->count || s->hdr->first_ts_ns > to || s->hdr->last_ts_ns < from) return 0;
+    uint64_t off = nlj_seg_seek(s, from);
+    const nlj_rec_t *r;
+    char line[256], name[NLJ_IFNAMSIZ + 1];
+    while ((r = nlj_seg_next(s, &off))) {
+        if (r->ts_ns > to) return 1;
+        if (ifglob) {
+            memcpy(name, r->ifname, NLJ_IFNAMSIZ);
+            name[NLJ_IFNAMSIZ] = '\0';
+            if (fnmatch(ifglob, name, 0) != 0) continue;
+        }
+        if (*shown == limit) {
+            obuf_printf(out, "... more than %d events, narrow the range\n", limit);
+            return 1;
+        }
+        int n = nlj_format(r, line, sizeof(line));
+        if (n > 0) obuf_append(out, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+        (*shown)++;
+    }
+    return 0;
+}
+
+int journal_query(obuf_t *out, uint64_t from, uint64_t to, const char *ifglob, int limit) {
+    if (!enabled) return -1;
+    int shown = 0;
+    for (int i = 0; i < nsegs; i++) {
+        nlj_seg_t s;
+        int done;
+        if (segs[i] == cur.no) {
+            if (nlj_seg_attach(&s, cur.base, cur.size) < 0) continue;
+            done = query_segment(out, &s, from, to, ifglob, limit, &shown);
+        } else {
+            char path[sizeof(dir) + 32];
+            nlj_seg_path(path, sizeof(path), dir, segs[i]);
+            if (nlj_seg_open(&s, path) < 0) continue;
+            done = query_segment(out, &s, from, to, ifglob, limit, &shown);
+            nlj_seg_close(&s);
+        }
+        if (done) break;
+    }
+    return shown;
+}
+
+void journal_get_stats(journal_stats_t *st) {
+    *st = stats;
+    st->cur_used = cur.base ? cur.hdr->used : 0;
+}
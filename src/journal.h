@@ -0,0 +1,46 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "buffer.h"
+#include "parser.h"
+#include "route.h"
+#include "nljournal.h"
+
+/*
+ * Persistent event journal (format in nljournal.h).
+ * Records are copied into a memory-mapped segment that was created,
+ * allocated and prefaulted in advance, so appending is a memcpy on the event
+ * loop; the kernel writes the pages back. The next segment is prepared from
+ * a timer once the current one is half full, and the oldest are deleted
+ * beyond journal_segments.
+ */
+
+typedef struct journal_stats {
+    const char *dir;                   /* NULL: disabled */
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t rotations;
+    uint64_t spare_misses;             /* rotations that had to create the segment inline */
+    uint64_t lost;                     /* records not written (no segment) */
+    int segments;
+    uint64_t seg_size;
+    uint64_t cur_used;
+} journal_stats_t;
+
+int journal_start(void);
+/* flush and unmap; the current segment is continued on the next start */
+void journal_stop(void);
+
+/* publish points, next to the watch ones; op is NLJ_OP_* */
+void journal_link(int op, const iface_info_t *inf, uint32_t transitions);
+void journal_link_rename(const iface_info_t *inf, const char *old);
+void journal_addr(int op, const iface_info_t *inf, const iface_addr_t *a);
+void journal_route(int add, const rt_route_t *r);
+void journal_resync(void);
+
+/* events in [from, to] for interfaces matching ifglob (NULL: all); -1 if disabled */
+int journal_query(obuf_t *out, uint64_t from_ns, uint64_t to_ns, const char *ifglob, int limit);
+void journal_get_stats(journal_stats_t *st);
+
+#endif
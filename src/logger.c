@@ -1,22 +1,371 @@
+#define _GNU_SOURCE
 #include "logger.h"
+#include "config.h"
+#include "hash.h"
 #include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 
-static void vlog(const char *level, const char *fmt, va_list ap) {
-    time_t t = time(NULL);
-    char ts[64];
-    struct tm *tm = localtime(&t);
-    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", tm);
-    fprintf(stdout, "[%s] %s: ", ts, level);
-    vfprintf(stdout, fmt, ap);
-    fprintf(stdout, "\n");
+#define LOG_LINE_MAX 496               /* slot payload, longer lines are truncated */
+#define LOG_RING_DEFAULT 4096
+#define LOG_RATE_DEFAULT 50            /* lines per call site per second */
+#define LOG_BATCH_BYTES 65536
+
+/*
+ * Bounded MPMC ring (sequence number per slot). Producers claim a slot with a
+ * CAS on tail and format straight into it; the writer thread is the only
+ * consumer. seq == pos: free for the producer at pos; seq == pos + 1: filled.
+ */
+typedef struct log_slot {
+    _Atomic uint64_t seq;
+    uint32_t len;
+    char data[LOG_LINE_MAX];
+} log_slot_t;
+
+int log_level_cur = LOG_LVL_INFO;
+
+static log_slot_t *ring = NULL;
+static uint64_t ring_mask = 0;
+static _Atomic uint64_t ring_tail = 0;
+static uint64_t ring_head = 0;         /* writer thread only */
+
+static pthread_t writer;
+static int writer_running = 0;
+static _Atomic int writer_sleeping = 0;
+static _Atomic int writer_stop = 0;
+static int wake_fd = -1;
+static int rate_limit = LOG_RATE_DEFAULT;
+
+static _Atomic uint64_t st_written = 0;
+static _Atomic uint64_t st_dropped = 0;
+static _Atomic uint64_t st_suppressed = 0;
+static _Atomic uint64_t st_batches = 0;
+
+/* sites with suppressed lines, reported by the writer if they go quiet */
+static _Atomic(log_site_t *) quiet_sites = NULL;
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+static const char *level_keys[] = { "err", "warn", "info", "debug" };
+
+/* timestamps only change once a second: format once per thread per second */
+static __thread time_t ts_sec = -1;
+static __thread char ts_buf[32];
+
+static const char *cached_timestamp(time_t *sec) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != ts_sec) {
+        struct tm tm;
+        localtime_r(&now.tv_sec, &tm);
+        strftime(ts_buf, sizeof(ts_buf), "%Y-%m-%d %H:%M:%S", &tm);
+        ts_sec = now.tv_sec;
+    }
+    if (sec) *sec = now.tv_sec;
+    return ts_buf;
+}
+
+static void write_all(const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+static size_t format_line(char *out, size_t cap, int level, const char *fmt, va_list ap) {
+    int n = snprintf(out, cap, "[%s] %s: ", cached_timestamp(NULL), level_names[level]);
+    if (n < 0) return 0;
+    size_t len = (size_t)n < cap ? (size_t)n : cap - 1;
+    n = vsnprintf(out + len, cap - len, fmt, ap);
+    if (n > 0) len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+    if (len >= cap - 1) len = cap - 2;
+    out[len++] = '\n';
+    return len;
+}
+
+/*
+ * Producers publish (slot seq, quiet site) then read writer_sleeping; the
+ * writer sets writer_sleeping then rereads the ring. Both sides need a full
+ * fence between the two, or each may miss the other's store and the line
+ * waits in the ring until the next log call.
+ */
+static void wake_writer(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&writer_sleeping) && atomic_exchange(&writer_sleeping, 0)) {
+        uint64_t one = 1;
+        (void)!write(wake_fd, &one, sizeof(one));
+    }
+}
+
+static void vemit(int level, const char *fmt, va_list ap) {
+    if (!writer_running) {
+        char line[LOG_LINE_MAX];
+        size_t len = format_line(line, sizeof(line), level, fmt, ap);
+        write_all(line, len);
+        atomic_fetch_add_explicit(&st_written, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint64_t pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    log_slot_t *s;
+    for (;;) {
+        s = &ring[pos & ring_mask];
+        uint64_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* full: never block the caller */
+            atomic_fetch_add_explicit(&st_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        }
+    }
+    s->len = (uint32_t)format_line(s->data, sizeof(s->data), level, fmt, ap);
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+    wake_writer();
 }
 
-void log_info(const char *fmt, ...) {
-    va_list ap; va_start(ap, fmt); vlog("INFO", fmt, ap); va_end(ap);
+static void emit(int level, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vemit(level, fmt, ap);
+    va_end(ap);
 }
-void log_warn(const char *fmt, ...) {
-    va_list ap; va_start(ap, fmt); vlog("WARN", fmt, ap); va_end(ap);
+
+static void queue_quiet_site(log_site_t *site) {
+    if (atomic_exchange(&site->queued, 1)) return;
+    log_site_t *head = atomic_load(&quiet_sites);
+    do {
+        site->next_queued = head;
+    } while (!atomic_compare_exchange_weak(&quiet_sites, &head, site));
+    wake_writer();
+}
+
+static void report_suppressed(log_site_t *site, int direct) {
+    uint32_t missed = atomic_exchange(&site->suppressed, 0);
+    if (!missed) return;
+    if (!direct) {
+        emit(site->level, "last message from %s:%d repeated %u more times", site->file, site->line, missed);
+        return;
+    }
+    /* writer thread: straight to stdout, the ring may be full */
+    char line[LOG_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "[%s] %s: last message from %s:%d repeated %u more times\n",
+                     cached_timestamp(NULL), level_names[site->level], site->file, site->line, missed);
+    if (n > 0) write_all(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
 }
-void log_err(const char *fmt, ...) {
-    va_list ap; va_start(ap, fmt); vlog("ERROR", fmt, ap); va_end(ap);
+
+void log_emit(log_site_t *site, int level, const char *fmt, ...) {
+    if (rate_limit > 0) {
+        time_t now;
+        cached_timestamp(&now);
+        uint64_t cur = atomic_load_explicit(&site->window, memory_order_relaxed);
+        uint64_t next;
+        int fresh;
+        do {
+            fresh = (uint32_t)(cur >> 32) != (uint32_t)now;
+            if (fresh) {
+                next = (uint64_t)(uint32_t)now << 32 | 1;
+            } else if ((uint32_t)cur >= (uint32_t)rate_limit) {
+                atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&st_suppressed, 1, memory_order_relaxed);
+                if (writer_running) queue_quiet_site(site);
+                return;
+            } else {
+                next = cur + 1;
+            }
+        } while (!atomic_compare_exchange_weak_explicit(&site->window, &cur, next,
+                                                        memory_order_relaxed, memory_order_relaxed));
+        if (fresh) report_suppressed(site, 0);
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    vemit(level, fmt, ap);
+    va_end(ap);
+}
+
+/* copy finished slots into buf; stops at the first slot still being written */
+static size_t drain(char *buf, size_t cap) {
+    size_t len = 0;
+    for (;;) {
+        log_slot_t *s = &ring[ring_head & ring_mask];
+        uint64_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq != ring_head + 1) break;
+        if (len + s->len > cap) break;
+        memcpy(buf + len, s->data, s->len);
+        len += s->len;
+        atomic_store_explicit(&s->seq, ring_head + ring_mask + 1, memory_order_release);
+        ring_head++;
+        atomic_fetch_add_explicit(&st_written, 1, memory_order_relaxed);
+    }
+    return len;
+}
+
+/* report sites whose suppressing second is over; returns 1 if some still wait */
+static int report_quiet_sites(int all) {
+    log_site_t *s = atomic_exchange(&quiet_sites, NULL);
+    time_t now;
+    cached_timestamp(&now);
+    int waiting = 0;
+    while (s) {
+        log_site_t *next = s->next_queued;
+        uint32_t sec = (uint32_t)(atomic_load_explicit(&s->window, memory_order_relaxed) >> 32);
+        atomic_store(&s->queued, 0);
+        if (all || sec != (uint32_t)now) {
+            report_suppressed(s, 1);
+        } else {
+            queue_quiet_site(s);
+            waiting = 1;
+        }
+        s = next;
+    }
+    return waiting;
+}
+
+static int ring_ready(void) {
+    log_slot_t *s = &ring[ring_head & ring_mask];
+    return atomic_load_explicit(&s->seq, memory_order_acquire) == ring_head + 1;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    static char batch[LOG_BATCH_BYTES];
+    uint64_t reported_drops = 0;
+
+    for (;;) {
+        size_t len = drain(batch, sizeof(batch));
+        if (len) {
+            write_all(batch, len);
+            atomic_fetch_add_explicit(&st_batches, 1, memory_order_relaxed);
+            continue;
+        }
+        uint64_t drops = atomic_load_explicit(&st_dropped, memory_order_relaxed);
+        if (drops != reported_drops) {
+            char line[128];
+            int n = snprintf(line, sizeof(line), "[%s] WARN: logger ring full, dropped %llu lines\n",
+                             cached_timestamp(NULL), (unsigned long long)(drops - reported_drops));
+            write_all(line, (size_t)n);
+            reported_drops = drops;
+        }
+        if (atomic_load(&writer_stop)) {
+            report_quiet_sites(1);
+            break;
+        }
+        int waiting = report_quiet_sites(0);
+
+        atomic_store(&writer_sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);   /* pairs with wake_writer */
+        if (ring_ready()) {
+            atomic_store(&writer_sleeping, 0);
+            continue;
+        }
+        struct pollfd pfd = { .fd = wake_fd, .events = POLLIN };
+        if (atomic_load(&quiet_sites)) waiting = 1;
+        if (poll(&pfd, 1, waiting ? 250 : -1) > 0) {
+            uint64_t v;
+            (void)!read(wake_fd, &v, sizeof(v));
+        }
+        atomic_store(&writer_sleeping, 0);
+    }
+    return NULL;
+}
+
+int logger_set_level_name(const char *name) {
+    for (int i = 0; i <= LOG_LVL_DEBUG; i++) {
+        if (strcasecmp(name, level_keys[i]) == 0 || strcasecmp(name, level_names[i]) == 0) {
+            log_level_cur = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *logger_level_name(int level) {
+    if (level < 0 || level > LOG_LVL_DEBUG) return "?";
+    return level_keys[level];
+}
+
+void logger_configure(void) {
+    const char *lvl = config_get_str("log_level", "info");
+    if (logger_set_level_name(lvl) < 0) {
+        log_warn("unknown log_level '%s', using info", lvl);
+        log_level_cur = LOG_LVL_INFO;
+    }
+    rate_limit = (int)config_get_int("log_rate_limit", LOG_RATE_DEFAULT);
+}
+
+int logger_start(void) {
+    if (writer_running) return 0;
+
+    logger_configure();
+    long slots = config_get_int("log_ring_slots", LOG_RING_DEFAULT);
+    if (slots < 64) slots = 64;
+    if (slots > (1L << 20)) slots = 1L << 20;
+    uint64_t n = hash_pow2((uint32_t)slots);
+
+    ring = malloc(n * sizeof(*ring));
+    if (!ring) {
+        log_err("logger ring allocation failed, logging synchronously");
+        return -1;
+    }
+    for (uint64_t i = 0; i < n; i++) atomic_init(&ring[i].seq, i);
+    ring_mask = n - 1;
+    ring_head = 0;
+    atomic_store(&ring_tail, 0);
+
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        log_err("logger eventfd failed: %s", strerror(errno));
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    atomic_store(&writer_stop, 0);
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        log_err("logger thread start failed, logging synchronously");
+        close(wake_fd);
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    writer_running = 1;
+    atexit(logger_stop);
+    return 0;
+}
+
+void logger_stop(void) {
+    if (!writer_running) return;
+    atomic_store(&writer_stop, 1);
+    uint64_t one = 1;
+    (void)!write(wake_fd, &one, sizeof(one));
+    pthread_join(writer, NULL);
+    writer_running = 0;
+    close(wake_fd);
+    wake_fd = -1;
+    free(ring);
+    ring = NULL;
+}
+
+void logger_get_stats(log_stats_t *st) {
+    st->written = atomic_load(&st_written);
+    st->dropped = atomic_load(&st_dropped);
+    st->suppressed = atomic_load(&st_suppressed);
+    st->batches = atomic_load(&st_batches);
+    st->level = log_level_cur;
+    st->rate_limit = rate_limit;
+    st->ring_slots = ring ? (unsigned)(ring_mask + 1) : 0;
 }
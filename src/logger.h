@@ -3,9 +3,72 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
-void log_info(const char *fmt, ...);
-void log_warn(const char *fmt, ...);
-void log_err(const char *fmt, ...);
+/*
+ * Lines are formatted by the caller into a lock-free ring and written out by
+ * a dedicated thread in batches. A full ring drops the line (and counts it)
+ * instead of blocking the event loop.
+ *
+ * log_info/log_warn/log_err/log_debug are macros: every call site owns a
+ * static log_site_t so a noisy site can be rate limited on its own, with a
+ * "repeated N more times" line once it calms down (from the writer thread
+ * when the site goes quiet). Sites are shared by all threads.
+ */
+
+enum {
+    LOG_LVL_ERR = 0,
+    LOG_LVL_WARN,
+    LOG_LVL_INFO,
+    LOG_LVL_DEBUG,
+};
+
+typedef struct log_site {
+    const char *file;
+    int line;
+    int level;
+    _Atomic uint64_t window;           /* second << 32 | lines emitted in it */
+    _Atomic uint32_t suppressed;
+    _Atomic int queued;                /* on the writer's report list */
+    struct log_site *next_queued;
+} log_site_t;
+
+typedef struct log_stats {
+    uint64_t written;
+    uint64_t dropped;                  /* ring full */
+    uint64_t suppressed;               /* per-site rate limit */
+    uint64_t batches;
+    int level;
+    int rate_limit;
+    unsigned ring_slots;
+} log_stats_t;
+
+extern int log_level_cur;
+
+void log_emit(log_site_t *site, int level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define LOG_AT(lvl, ...) do {                                           \
+        static log_site_t log_site_ = { __FILE__, __LINE__, (lvl), 0, 0, 0, NULL }; \
+        if ((lvl) <= log_level_cur) log_emit(&log_site_, (lvl), __VA_ARGS__); \
+    } while (0)
+
+#define log_err(...)   LOG_AT(LOG_LVL_ERR, __VA_ARGS__)
+#define log_warn(...)  LOG_AT(LOG_LVL_WARN, __VA_ARGS__)
+#define log_info(...)  LOG_AT(LOG_LVL_INFO, __VA_ARGS__)
+#define log_debug(...) LOG_AT(LOG_LVL_DEBUG, __VA_ARGS__)
+
+/* start the writer thread; before this lines are written synchronously */
+int logger_start(void);
+/* (re)apply log_level and log_rate_limit from the config */
+void logger_configure(void);
+/* drain the ring and join the writer */
+void logger_stop(void);
+
+/* "err", "warn", "info", "debug"; returns -1 for an unknown name */
+int logger_set_level_name(const char *name);
+const char *logger_level_name(int level);
+void logger_get_stats(log_stats_t *st);
 
 #endif
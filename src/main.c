@@ -3,85 +3,143 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
-#include <sys/epoll.h>
 #include <errno.h>
 #include <string.h>
 #include <time.h>
 
 #include "logger.h"
 #include "parser.h"
-#include "metrics.h"
 #include "alert.h"
+#include "history.h"
+#include "openmetrics.h"
 #include "cli.h"
 #include "netlink.h"
+#include "config.h"
+#include "coalesce.h"
+#include "reactor.h"
+#include "sched.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "shmpub.h"
+#include "netns.h"
+#include "journal.h"
 
-// declare process_netlink_messages from netlink.c
-void process_netlink_messages(void);
+static const char *conf_path = NLAGENT_DEFAULT_CONF;
 
-static int running = 1;
-static int epfd = -1;
+/* SIGHUP: re-read the config and re-apply what can change at runtime */
+static void reload_config(void) {
+    if (config_load(conf_path) < 0) {
+        log_warn("reload: keeping the previous configuration");
+        return;
+    }
+    logger_configure();
+    coalesce_init();
+    alert_init();
+    history_init();
+    sched_configure();
+    log_info("configuration reloaded");
+}
 
-static void sigint_handler(int sig) {
-    log_info("received signal %d, exiting...", sig);
-    running = 0;
+static void on_signal(int signo) {
+    if (signo == SIGHUP) {
+        reload_config();
+        return;
+    }
+    log_info("received signal %d, exiting...", signo);
+    reactor_stop();
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c config]\n", prog);
 }
 
 int main(int argc, char **argv) {
-    signal(SIGINT, sigint_handler);
-    signal(SIGTERM, sigint_handler);
+    int opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            conf_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (reactor_init() < 0) return 1;
+
+    /* block before any thread starts so only the signalfd sees them */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    if (reactor_signals(&mask, on_signal) < 0) return 1;
+    signal(SIGPIPE, SIG_IGN);
 
     log_info("nlagent starting...");
+    config_load(conf_path);
+    logger_start();
 
     init_iface_table();
+    alert_init();
+    history_init();
 
-    epfd = epoll_create1(0);
-    if (epfd < 0) {
-        log_err("epoll_create1 failed: %s", strerror(errno));
-        return 1;
+    /* change history on disk; the agent runs without it */
+    if (journal_start() < 0) {
+        log_warn("event journal not available");
     }
 
-    if (netlink_start(epfd) < 0) {
+    /* threaded=1: rings first, so netlink_start() leaves the event socket to the ingest thread */
+    if (pipeline_init() < 0) {
+        log_err("pipeline_init failed");
+        return 1;
+    }
+    if (netlink_start() < 0) {
         log_err("netlink_start failed");
         return 1;
     }
-    if (cli_start(epfd) < 0) {
+    /* readers on any thread see the table through published views */
+    if (iface_snap_start() < 0) {
+        log_err("iface_snap_start failed");
+        return 1;
+    }
+    /* local consumers without a socket round trip are optional too */
+    if (shmpub_start() < 0) {
+        log_warn("shared-memory stats region not available");
+    }
+    /* other namespaces are monitored on the same loop when enabled */
+    if (netns_start() < 0) {
+        log_warn("netns monitoring not available");
+    }
+    if (cli_start() < 0) {
         log_err("cli_start failed");
         return 1;
     }
+    /* scrapers are optional: keep running without the endpoint */
+    if (openmetrics_start() < 0) {
+        log_warn("openmetrics endpoint not available");
+    }
 
-    const int MAX_EVENTS = 10;
-    struct epoll_event events[MAX_EVENTS];
-
-    time_t last_metrics = 0;
-    while (running) {
-        int nfds = epoll_wait(epfd, events, MAX_EVENTS, 1000); // timeout 1s
-        if (nfds < 0) {
-            if (errno == EINTR) continue;
-            log_err("epoll_wait failed: %s", strerror(errno));
-            break;
-        }
-        for (int i = 0;i<nfds;i++) {
-            int fd = events[i].data.fd;
-            if (fd == -1) continue;
-            if (fd == netlink_fd()) {
-                process_netlink_messages();
-            } else if (fd == -1) {
-                // skip
-            } else {
-                // assume cli socket or other
-                cli_handle_connection(fd);
-            }
-        }
+    if (pipeline_start() < 0) {
+        log_err("pipeline_start failed");
+        return 1;
+    }
 
-        time_t now = time(NULL);
-        if (now - last_metrics >= 5) { // poll interval
-            metrics_poll_once();
-            alert_check_cycle();
-            last_metrics = now;
-        }
+    /* counters, alerts and history: per-interface refresh on the timer wheel;
+     * from here on the pipeline threads run and must be stopped on every exit */
+    int ret = 0;
+    if (sched_start() < 0) {
+        log_err("sched_start failed");
+        ret = 1;
+    } else {
+        reactor_run();
     }
+    pipeline_stop();
+    netlink_stop();
+    shmpub_stop();
+    journal_stop();
 
     log_info("nlagent exiting");
-    close(epfd);
-    return 0;
+    return ret;
 }
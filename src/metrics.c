@@ -1,50 +1,130 @@
 #define _GNU_SOURCE
 #include "metrics.h"
 #include "parser.h"
+#include "netlink.h"
 #include "logger.h"
 #include <stdio.h>
-#include <dirent.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
-static unsigned long read_ull_file(const char *path) {
-    unsigned long v = 0;
+/* collection mode: one RTM_GETSTATS dump per cycle, sysfs only as fallback;
+ * cleared by the loop or the collector thread */
+static int use_netlink_stats = 1;
+
+static inline int netlink_stats_on(void) {
+    return __atomic_load_n(&use_netlink_stats, __ATOMIC_RELAXED);
+}
+
+static unsigned long long read_ull_file(const char *path) {
+    unsigned long long v = 0;
     FILE *f = fopen(path, "r");
     if (!f) return 0;
-    if (fscanf(f, "%lu", &v) != 1) v = 0;
+    if (fscanf(f, "%llu", &v) != 1) v = 0;
     fclose(f);
     return v;
 }
 
+static unsigned long long read_stat(const char *ifname, const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", ifname, name);
+    return read_ull_file(path);
+}
+
+/* fallback: re-open /sys/class/net/<if>/statistics/<counter> */
+static void read_sysfs_counters(const char *ifname, iface_counters_t *c) {
+    c->rx_bytes   = read_stat(ifname, "rx_bytes");
+    c->tx_bytes   = read_stat(ifname, "tx_bytes");
+    c->rx_packets = read_stat(ifname, "rx_packets");
+    c->tx_packets = read_stat(ifname, "tx_packets");
+    c->rx_err     = read_stat(ifname, "rx_errors");
+    c->tx_err     = read_stat(ifname, "tx_errors");
+    c->rx_dropped = read_stat(ifname, "rx_dropped");
+    c->tx_dropped = read_stat(ifname, "tx_dropped");
+    c->rx_fifo    = read_stat(ifname, "rx_fifo_errors");
+    c->tx_fifo    = read_stat(ifname, "tx_fifo_errors");
+    c->multicast  = read_stat(ifname, "multicast");
+}
+
+static void metrics_poll_sysfs_iface(iface_info_t *inf) {
+    iface_counters_t c;
+    read_sysfs_counters(inf->ifname, &c);
+    iface_set_counters(inf, &c);
+}
+
+static void metrics_poll_sysfs(void) {
+    int count = get_iface_count();
+    for (int pos = 0; pos < count; pos++) {
+        metrics_poll_sysfs_iface(get_iface_at(pos));
+    }
+}
+
+/* netlink errors that mean RTM_GETSTATS will never work here */
+static void netlink_stats_failed(void) {
+    if (errno == EOPNOTSUPP || errno == EINVAL) {
+        /* kernel without RTM_GETSTATS (< 4.7): stay on sysfs */
+        log_warn("RTM_GETSTATS not supported (%s), using sysfs counters", strerror(errno));
+        __atomic_store_n(&use_netlink_stats, 0, __ATOMIC_RELAXED);
+    } else {
+        log_warn("netlink stats request failed: %s, falling back to sysfs this time", strerror(errno));
+    }
+}
+
 void metrics_poll_once(void) {
-    // iterate known interfaces and update counters from sysfs
-    // for simplicity use getifaddrs-derived table in parser
-    // we assume parser provides list_interfaces to iterate; here we directly use names.
-    // A more robust impl would expose iteration API.
-    // For brevity, call list_interfaces() to print; but actually update counters per entry:
-    // We'll re-open /sys/class/net/<if>/statistics/* for each interface
-    // Implement basic approach:
-    struct {
-        char name[64];
-    } tmp;
-    // Ugly but simple: read /sys/class/net directory
-    DIR *d = opendir("/sys/class/net");
-    if (!d) return;
-    struct dirent *de;
-    while ((de = readdir(d)) != NULL) {
-        if (de->d_name[0] == '.') continue;
-        char rx_path[256], tx_path[256], rxerr_path[256], txerr_path[256];
-        snprintf(rx_path, sizeof(rx_path), "/sys/class/net/%s/statistics/rx_bytes", de->d_name);
-        snprintf(tx_path, sizeof(tx_path), "/sys/class/net/%s/statistics/tx_bytes", de->d_name);
-        snprintf(rxerr_path, sizeof(rxerr_path), "/sys/class/net/%s/statistics/rx_errors", de->d_name);
-        snprintf(txerr_path, sizeof(txerr_path), "/sys/class/net/%s/statistics/tx_errors", de->d_name);
-        unsigned long rx = read_ull_file(rx_path);
-        unsigned long tx = read_ull_file(tx_path);
-        unsigned long rxerr = read_ull_file(rxerr_path);
-        unsigned long txerr = read_ull_file(txerr_path);
-        iface_info_t *inf = get_iface_by_name(de->d_name);
-        if (inf) {
-            update_iface_counters(inf->ifindex, rx, tx, rxerr, txerr);
+    if (netlink_stats_on()) {
+        if (netlink_poll_stats() >= 0) return;
+        netlink_stats_failed();
+    }
+    metrics_poll_sysfs();
+}
+
+void metrics_poll_iface(iface_info_t *inf) {
+    if (netlink_stats_on()) {
+        if (netlink_poll_stats_iface(inf->ifindex) >= 0) return;
+        /* the interface may be gone already; that is not a collection failure */
+        if (errno == ENODEV) return;
+        netlink_stats_failed();
+    }
+    metrics_poll_sysfs_iface(inf);
+}
+
+/* ---- collector thread: same sources, results through a callback ---- */
+
+typedef struct collect_ctx {
+    const metrics_req_t *reqs;         /* sorted by ifindex */
+    int n;
+    metrics_cb cb;
+    void *arg;
+} collect_ctx_t;
+
+static int req_cmp(const void *a, const void *b) {
+    const metrics_req_t *x = a, *y = b;
+    return (x->ifindex > y->ifindex) - (x->ifindex < y->ifindex);
+}
+
+/* dump replies: only the interfaces that were asked for */
+static void collect_dump_cb(int ifindex, const iface_counters_t *c, void *arg) {
+    collect_ctx_t *ctx = arg;
+    metrics_req_t key;
+    key.ifindex = ifindex;
+    if (bsearch(&key, ctx->reqs, (size_t)ctx->n, sizeof(key), req_cmp)) ctx->cb(ifindex, c, ctx->arg);
+}
+
+void metrics_collect(metrics_req_t *reqs, int n, int dump, metrics_cb cb, void *arg) {
+    if (netlink_stats_on() && dump) {
+        qsort(reqs, (size_t)n, sizeof(*reqs), req_cmp);
+        collect_ctx_t ctx = { reqs, n, cb, arg };
+        if (netlink_query_stats(0, collect_dump_cb, &ctx) >= 0) return;
+        netlink_stats_failed();
+    }
+    for (int i = 0; i < n; i++) {
+        if (netlink_stats_on()) {
+            if (netlink_query_stats(reqs[i].ifindex, cb, arg) >= 0) continue;
+            if (errno == ENODEV) continue;
+            netlink_stats_failed();
         }
+        iface_counters_t c;
+        read_sysfs_counters(reqs[i].ifname, &c);
+        cb(reqs[i].ifindex, &c, arg);
     }
-    closedir(d);
 }
@@ -1,6 +1,24 @@
 #ifndef METRICS_H
 #define METRICS_H
 
+#include "parser.h"
+
+/* all interfaces: one RTM_GETSTATS dump (sysfs as fallback) */
 void metrics_poll_once(void);
+/* one interface: single RTM_GETSTATS request (sysfs as fallback) */
+void metrics_poll_iface(iface_info_t *inf);
+
+/*
+ * Collector thread (threaded pipeline): refresh the requested interfaces
+ * without touching the parser table, reporting counters through cb. With
+ * dump set one RTM_GETSTATS dump serves them all. reqs gets reordered.
+ */
+typedef struct metrics_req {
+    int ifindex;
+    char ifname[IFNAMSIZ];             /* for the sysfs fallback */
+} metrics_req_t;
+
+typedef void (*metrics_cb)(int ifindex, const iface_counters_t *c, void *arg);
+void metrics_collect(metrics_req_t *reqs, int n, int dump, metrics_cb cb, void *arg);
 
 #endif
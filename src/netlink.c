@@ -2,6 +2,15 @@
 #include "netlink.h"
 #include "parser.h"
 #include "logger.h"
+#include "route.h"
+#include "config.h"
+#include "coalesce.h"
+#include "reactor.h"
+#include "pipeline.h"
+#include "nlfilter.h"
+#include "watch.h"
+#include "journal.h"
+#include "nlcap.h"
 
 #include <sys/socket.h>
 #include <linux/netlink.h>
@@ -15,13 +24,68 @@
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
 
 /* netlink socket */
 static int nl_sock = -1;
 int netlink_fd(void) { return nl_sock; }
 
+static void nl_event(reactor_handler_t *h, uint32_t events);
+static reactor_handler_t nl_handler = { .fd = -1, .cb = nl_event };
+
+/*
+ * request socket: synchronous dumps (stats etc.), never joins multicast
+ * groups. One per thread, so the collector thread of the threaded pipeline
+ * can request counters while the main thread runs a sync.
+ */
+static __thread int req_sock = -1;
+static __thread unsigned int req_seq = 0;
+
+#define NL_DUMP_BUFSZ 32768
+#define NL_SYNC_ATTEMPTS 3
+#define NL_RENAME_CHECK_MS 30000
+
+typedef void (*nl_msg_cb)(struct nlmsghdr *nlh, void *arg);
+
+/* event receive path: rx_batch buffers per recvmmsg, sized for the largest message */
+#define NL_RX_BUFSZ 32768
+#define NL_BATCH_DEFAULT 32
+#define NL_BATCH_MAX 256
+#define NL_RCVBUF_DEFAULT (8 << 20)
+
+static int rx_batch = NL_BATCH_DEFAULT;
+static char *rx_bufs = NULL;
+static struct mmsghdr *rx_msgs = NULL;
+static struct iovec *rx_iov = NULL;
+static struct sockaddr_nl *rx_addrs = NULL;
+static uint32_t rx_wakeup_msgs = 0;
+static nl_rx_stats_t rx_stats;
+/* one writer per counter (the receiving thread or the loop), read from others */
+#define RX_ADD(f, n) __atomic_store_n(&rx_stats.f, rx_stats.f + (n), __ATOMIC_RELAXED)
+#define RX_SET(f, v) __atomic_store_n(&rx_stats.f, (v), __ATOMIC_RELAXED)
+
+/* netlink_capture: received datagrams to a file for nlreplay (receive thread only) */
+#define NL_CAPTURE_MAX_MB_DEFAULT 1024
+static nlcap_t capture;
+static int capturing = 0;
+static uint64_t capture_limit = 0;
+
+static int rx_alloc(void) {
+    rx_bufs = aligned_alloc(NLMSG_ALIGNTO * 16, (size_t)rx_batch * NL_RX_BUFSZ);
+    rx_msgs = calloc(rx_batch, sizeof(*rx_msgs));
+    rx_iov = calloc(rx_batch, sizeof(*rx_iov));
+    rx_addrs = calloc(rx_batch, sizeof(*rx_addrs));
+    if (!rx_bufs || !rx_msgs || !rx_iov || !rx_addrs) {
+        log_err("failed to allocate netlink receive buffers (%d x %d)", rx_batch, NL_RX_BUFSZ);
+        return -1;
+    }
+    return 0;
+}
+
 /* helper: parse rtattr list */
-static struct rtattr *rtattr_get(struct rtattr *tb[], int max, struct rtattr *rta, int len) {
+struct rtattr *rtattr_get(struct rtattr *tb[], int max, struct rtattr *rta, int len) {
     while (RTA_OK(rta, len)) {
         if (rta->rta_type <= max) {
             tb[rta->rta_type] = rta;
@@ -31,53 +95,191 @@ static struct rtattr *rtattr_get(struct rtattr *tb[], int max, struct rtattr *rt
     return NULL;
 }
 
-static int send_nl_addr_dump_req(int sock)
-{
+static int open_req_sock(void) {
+    if (req_sock >= 0) return req_sock;
+    req_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (req_sock < 0) {
+        log_err("socket NETLINK_ROUTE (request) failed: %s", strerror(errno));
+        return -1;
+    }
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;    /* nl_pid = 0: let the kernel pick a port id */
+    if (bind(req_sock, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        log_err("bind netlink request socket failed: %s", strerror(errno));
+        close(req_sock);
+        req_sock = -1;
+        return -1;
+    }
+    /* a dump should never stall the main loop for long */
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(req_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return req_sock;
+}
+
+/*
+ * Give up on a dump that did not reach NLMSG_DONE. The kernel keeps running
+ * it, and refuses every further dump request on the socket with EBUSY until
+ * it is drained, so close the socket; the next request opens a fresh one.
+ */
+static void req_sock_reset(void) {
+    if (req_sock < 0) return;
+    close(req_sock);
+    req_sock = -1;
+}
+
+/*
+ * Send a request on the request socket and feed every reply message with a
+ * matching sequence number to cb, until NLMSG_DONE for a dump or after the
+ * single (non-NLM_F_MULTI) reply otherwise.
+ * Returns number of messages handled, or -1 (errno set) on failure.
+ */
+static int nl_transact(struct nlmsghdr *req, int dump, nl_msg_cb cb, void *arg) {
+    if (open_req_sock() < 0) return -1;
+
+    req->nlmsg_flags = NLM_F_REQUEST | (dump ? NLM_F_DUMP : 0);
+    req->nlmsg_seq = ++req_seq;
+
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    if (sendto(req_sock, req, req->nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0) {
+        return -1;
+    }
+
+    static __thread char buf[NL_DUMP_BUFSZ] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int handled = 0;
+    for (;;) {
+        /* MSG_TRUNC: the real datagram length, to notice a reply cut to buf */
+        ssize_t len = recv(req_sock, buf, sizeof(buf), MSG_TRUNC);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            req_sock_reset();
+            errno = err;
+            return -1;
+        }
+        if (len > (ssize_t)sizeof(buf)) {
+            /* the rest of the reply cannot be trusted: abandon the dump */
+            __atomic_fetch_add(&rx_stats.dump_truncated, 1, __ATOMIC_RELAXED);
+            req_sock_reset();
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (len == 0) {
+            req_sock_reset();
+            errno = EIO;
+            return -1;
+        }
+        for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != req->nlmsg_seq) continue;   /* stale reply */
+            if (nlh->nlmsg_type == NLMSG_DONE) return handled;
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *e = NLMSG_DATA(nlh);
+                errno = e->error ? -e->error : EIO;
+                return -1;
+            }
+            cb(nlh, arg);
+            handled++;
+            if (!(nlh->nlmsg_flags & NLM_F_MULTI)) return handled;
+        }
+    }
+}
+
+static void copy_link_stats64(iface_counters_t *c, const struct rtnl_link_stats64 *s) {
+    c->rx_bytes   = s->rx_bytes;
+    c->tx_bytes   = s->tx_bytes;
+    c->rx_packets = s->rx_packets;
+    c->tx_packets = s->tx_packets;
+    c->rx_err     = s->rx_errors;
+    c->tx_err     = s->tx_errors;
+    c->rx_dropped = s->rx_dropped;
+    c->tx_dropped = s->tx_dropped;
+    c->rx_fifo    = s->rx_fifo_errors;
+    c->tx_fifo    = s->tx_fifo_errors;
+    c->multicast  = s->multicast;
+}
+
+typedef struct stats_ctx {
+    netlink_stats_cb cb;
+    void *arg;
+    int updated;
+} stats_ctx_t;
+
+/* handle one RTM_NEWSTATS reply */
+static void handle_stats_msg(struct nlmsghdr *nlh, void *arg) {
+    stats_ctx_t *ctx = arg;
+    if (nlh->nlmsg_type != RTM_NEWSTATS) return;
+    struct if_stats_msg *ifsm = NLMSG_DATA(nlh);
+
+    struct rtattr *tb[IFLA_STATS_MAX + 1];
+    memset(tb, 0, sizeof(tb));
+    struct rtattr *rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+    rtattr_get(tb, IFLA_STATS_MAX, rta, len);
+
+    if (!tb[IFLA_STATS_LINK_64] || RTA_PAYLOAD(tb[IFLA_STATS_LINK_64]) < sizeof(struct rtnl_link_stats64)) {
+        return;
+    }
+    struct rtnl_link_stats64 s64;
+    memcpy(&s64, RTA_DATA(tb[IFLA_STATS_LINK_64]), sizeof(s64));
+    iface_counters_t c;
+    copy_link_stats64(&c, &s64);
+    ctx->cb(ifsm->ifindex, &c, ctx->arg);
+    ctx->updated++;
+}
+
+/* RTM_GETSTATS for one interface, or a dump of all of them with ifindex 0 */
+int netlink_query_stats(int ifindex, netlink_stats_cb cb, void *arg) {
     struct {
         struct nlmsghdr nlh;
-        struct ifaddrmsg ifa;
+        struct if_stats_msg ifsm;
     } req;
 
     memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len  = NLMSG_LENGTH(sizeof(struct if_stats_msg));
+    req.nlh.nlmsg_type = RTM_GETSTATS;
+    req.ifsm.family = AF_UNSPEC;
+    req.ifsm.ifindex = ifindex;
+    req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
 
-    req.nlh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
-    req.nlh.nlmsg_type  = RTM_GETADDR;
-    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-    req.nlh.nlmsg_seq   = time(NULL);
-    req.nlh.nlmsg_pid   = getpid();
-
-    req.ifa.ifa_family = AF_UNSPEC;  /* IPv4 + IPv6 */
+    stats_ctx_t ctx = { cb, arg, 0 };
+    if (nl_transact(&req.nlh, ifindex == 0, handle_stats_msg, &ctx) < 0) {
+        return -1;
+    }
+    return ctx.updated;
+}
 
-    struct sockaddr_nl nladdr = {
-        .nl_family = AF_NETLINK,
-        .nl_pid    = 0,   /* kernel */
-    };
+static void store_counters(int ifindex, const iface_counters_t *c, void *arg) {
+    (void)arg;
+    update_iface_counters(ifindex, c);
+}
 
-    struct iovec iov = {
-        .iov_base = &req,
-        .iov_len  = req.nlh.nlmsg_len,
-    };
+/* one RTM_GETSTATS dump for every interface's 64-bit counters */
+int netlink_poll_stats(void) {
+    return netlink_query_stats(0, store_counters, NULL);
+}
 
-    struct msghdr msg = {
-        .msg_name    = &nladdr,
-        .msg_namelen = sizeof(nladdr),
-        .msg_iov     = &iov,
-        .msg_iovlen  = 1,
-    };
+/* RTM_GETSTATS for a single interface; returns 1 if updated, -1 on failure */
+int netlink_poll_stats_iface(int ifindex) {
+    return netlink_query_stats(ifindex, store_counters, NULL);
+}
 
-    int ret = sendmsg(sock, &msg, 0);
-    if (ret < 0) {
-        log_err("send RTM_GETADDR failed: %s", strerror(errno));
-    }
+/* handle link (RTM_NEWLINK / RTM_DELLINK) */
+static uint32_t resync_gen = 0;     /* != 0 while a sync link dump is running */
 
-    return ret;
+/* a tracked link is deleted, or renamed into netlink_filter_ignore */
+static void link_gone(int ifindex, int quiet) {
+    coalesce_forget(get_iface_by_index(ifindex));
+    delete_iface_by_index(ifindex);
+    /* the kernel drops the device's routes without RTM_DELROUTE */
+    size_t pruned = route_prune_oif(ifindex);
+    if (pruned && !quiet) log_info("pruned %zu routes via deleted ifindex=%d", pruned, ifindex);
 }
 
-/* handle link (RTM_NEWLINK / RTM_DELLINK) */
-static void handle_link_msg(struct nlmsghdr *nlh) {
+static void apply_link_msg(struct nlmsghdr *nlh, int quiet) {
     struct ifinfomsg *ifi = NLMSG_DATA(nlh);
     int ifindex = ifi->ifi_index;
     int is_up = (ifi->ifi_flags & IFF_RUNNING) ? 1 : 0;
+    int created = 0;
 
     /* parse attributes to get ifname (IFLA_IFNAME) */
     struct rtattr *tb[IFLA_MAX + 1];
@@ -86,25 +288,102 @@ static void handle_link_msg(struct nlmsghdr *nlh) {
     int len = IFLA_PAYLOAD(nlh);
     rtattr_get(tb, IFLA_MAX, rta, len);
 
-    if (tb[IFLA_IFNAME]) {
-        const char *ifname = (const char *)RTA_DATA(tb[IFLA_IFNAME]);
-        /* update parser table by name if we have it */
-        iface_info_t *inf = get_iface_by_name(ifname);
-        if (inf) {
-            update_iface_status(ifindex, is_up);
+    if (nlh->nlmsg_type == RTM_DELLINK) {
+        link_gone(ifindex, quiet);
+        return;
+    }
+
+    /* ifindex is authoritative: register unknown links, follow renames */
+    const char *ifname = tb[IFLA_IFNAME] ? (const char *)RTA_DATA(tb[IFLA_IFNAME]) : NULL;
+    iface_info_t *inf = get_iface_by_index(ifindex);
+    if (!nlfilter_keep_link(ifname)) {
+        /* ignored by netlink_filter_ignore (renamed into a pattern, or a dump reply) */
+        if (inf) link_gone(ifindex, quiet);
+        return;
+    }
+    if (!inf) {
+        if (quiet) {
+            inf = iface_register(ifindex, ifname);
         } else {
-            /* maybe new iface, try to register (parser init uses getifaddrs only once) */
-            log_info("link event for unknown ifname=%s ifindex=%d up=%d", ifname, ifindex, is_up);
-            /* best-effort: call update by index (parser will ignore if not found) */
-            update_iface_status(ifindex, is_up);
+            log_info("link event for unknown ifname=%s ifindex=%d up=%d", ifname ? ifname : "<none>", ifindex, is_up);
+            inf = ensure_iface_by_index(ifindex, ifname);
         }
-    } else {
-        update_iface_status(ifindex, is_up);
+        if (!inf) return;
+        created = 1;
+    } else if (ifname) {
+        iface_set_name(inf, ifname);
+    }
+    if (resync_gen) inf->sync_gen = resync_gen;
+
+    /* link notifications carry the counters for free */
+    if (tb[IFLA_STATS64] && RTA_PAYLOAD(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 s64;
+        iface_counters_t c = inf->stats;
+        memcpy(&s64, RTA_DATA(tb[IFLA_STATS64]), sizeof(s64));
+        copy_link_stats64(&c, &s64);
+        iface_set_counters(inf, &c);
+    }
+
+    link_state_t st;
+    st.flags = ifi->ifi_flags;
+    st.mtu = tb[IFLA_MTU] ? *(uint32_t *)RTA_DATA(tb[IFLA_MTU]) : inf->mtu;
+    st.operstate = tb[IFLA_OPERSTATE] ? *(uint8_t *)RTA_DATA(tb[IFLA_OPERSTATE]) : inf->operstate;
+    if (quiet || created) {
+        iface_set_link(inf, st.flags, st.mtu, st.operstate);
+        if (created && !quiet) {
+            watch_link("new", inf, 0);
+            journal_link(NLJ_OP_NEW, inf, 0);
+        }
+        return;
+    }
+    /* redundant NEWLINKs are dropped, bursts are merged per ifindex */
+    coalesce_link(inf, &st);
+}
+
+static void handle_link_msg(struct nlmsghdr *nlh) {
+    apply_link_msg(nlh, 0);
+}
+
+/* links renamed into an ignored pattern: the kernel filter dropped the
+ * NEWLINK with the new name, so compare names against a link dump instead */
+static reactor_timer_t rename_timer;
+
+static void rename_check_cb(struct nlmsghdr *nlh, void *arg) {
+    (void)arg;
+    if (nlh->nlmsg_type != RTM_NEWLINK) return;
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    iface_info_t *inf = get_iface_by_index(ifi->ifi_index);
+    if (!inf) return;
+    struct rtattr *tb[IFLA_MAX + 1];
+    memset(tb, 0, sizeof(tb));
+    rtattr_get(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nlh));
+    if (!tb[IFLA_IFNAME]) return;
+    const char *name = RTA_DATA(tb[IFLA_IFNAME]);
+    if (strcmp(name, inf->ifname) == 0 || nlfilter_keep_link(name)) return;
+    log_info("iface %s idx=%d renamed to ignored %s", inf->ifname, inf->ifindex, name);
+    link_gone(ifi->ifi_index, 0);
+}
+
+static void rename_check_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)t;
+    (void)expirations;
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len  = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nlh.nlmsg_type = RTM_GETLINK;
+    req.ifi.ifi_family = AF_UNSPEC;
+
+    if (nl_transact(&req.nlh, 1, rename_check_cb, NULL) < 0) {
+        log_warn("rename check: link dump failed: %s", strerror(errno));
     }
 }
 
 /* handle address (RTM_NEWADDR / RTM_DELADDR) */
-static void handle_addr_msg(struct nlmsghdr *nlh) {
+static void apply_addr_msg(struct nlmsghdr *nlh, int quiet) {
     struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
     int ifindex = ifa->ifa_index;
     int family = ifa->ifa_family; /* AF_INET or AF_INET6 */
@@ -116,86 +395,496 @@ static void handle_addr_msg(struct nlmsghdr *nlh) {
     int len = IFA_PAYLOAD(nlh);
     rtattr_get(tb, IFA_MAX, rta, len);
 
-    char addr_str[INET6_ADDRSTRLEN] = {0};
     if (ifa->ifa_prefixlen == 0) {
         return;
     }
+    if (family != AF_INET && family != AF_INET6) {
+        return;
+    }
 
-    if (tb[IFA_LOCAL]) {
-        void *addr = RTA_DATA(tb[IFA_LOCAL]);
-        if (family == AF_INET) {
-            inet_ntop(AF_INET, addr, addr_str, sizeof(addr_str));
-        } else if (family == AF_INET6) {
-            inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str));
-        }
-    } else if (tb[IFA_ADDRESS]) {
-        void *addr = RTA_DATA(tb[IFA_ADDRESS]);
-        if (family == AF_INET) {
-            inet_ntop(AF_INET, addr, addr_str, sizeof(addr_str));
-        } else if (family == AF_INET6) {
-            inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str));
-        }
+    /* raw address bytes; formatting happens only when rendering */
+    struct rtattr *ra = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    size_t alen = family == AF_INET ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+    if (!ra || RTA_PAYLOAD(ra) < alen) {
+        return;
+    }
+    const void *addr = RTA_DATA(ra);
+    uint32_t flags = ifa->ifa_flags;
+    if (tb[IFA_FLAGS] && RTA_PAYLOAD(tb[IFA_FLAGS]) >= sizeof(uint32_t)) {
+        flags = *(uint32_t *)RTA_DATA(tb[IFA_FLAGS]);
     }
 
+    iface_info_t *inf = get_iface_by_index(ifindex);
+    if (!nlfilter_keep_addr(family, ifindex, inf != NULL)) {
+        return;
+    }
+    if (!inf) {
+        inf = ensure_iface_by_index(ifindex, NULL);
+    }
+    if (!inf) {
+        return;
+    }
+    if (quiet) {
+        iface_addr_t a;
+        iface_addr_make(&a, family, addr, prefixlen, flags);
+        if (nlh->nlmsg_type == RTM_NEWADDR) addrset_add(&inf->addrs, &a);
+        else addrset_del(&inf->addrs, &a);
+        return;
+    }
     if (nlh->nlmsg_type == RTM_NEWADDR) {
-        log_info("NEWADDR on ifindex=%d family=%d addr=%s", ifindex, family, addr_str[0]?addr_str:"<none>");
-        if (addr_str[0]) {
-            iface_info_t *inf = get_iface_by_index(ifindex);
-            if (!inf) {
-                inf = ensure_iface_by_index(ifindex, NULL);
-            }
-            if (inf && addr_str[0]) {
-                iface_add_addr(inf, family, addr_str, prefixlen);
-            }
-        }
+        iface_add_addr(inf, family, addr, prefixlen, flags);
     } else if (nlh->nlmsg_type == RTM_DELADDR) {
-        log_info("DELADDR on ifindex=%d family=%d addr=%s", ifindex, family, addr_str[0]?addr_str:"<none>");
-        /* On address delete we might clear IP if matches; simple approach: clear if equal */
-        /* parser provides helper to clear if ip matches */
-        iface_info_t *inf = get_iface_by_index(ifindex);
-        if (!inf) {
-            inf = ensure_iface_by_index(ifindex, NULL);
-        }
-        if (inf && addr_str[0]) {
-            iface_del_addr(inf, family, addr_str, prefixlen);
+        iface_del_addr(inf, family, addr, prefixlen);
+    }
+}
+
+static void handle_addr_msg(struct nlmsghdr *nlh) {
+    apply_addr_msg(nlh, 0);
+}
+
+static void parse_gateway(rt_nexthop_t *nh, int family, struct rtattr *gw, struct rtattr *via) {
+    size_t alen = family == AF_INET ? 4 : 16;
+    if (gw && RTA_PAYLOAD(gw) >= alen) {
+        nh->gw_family = (uint8_t)family;
+        memcpy(nh->gw, RTA_DATA(gw), alen);
+    } else if (via && RTA_PAYLOAD(via) >= sizeof(struct rtvia)) {
+        /* RTA_VIA: IPv4 route with IPv6 next hop */
+        struct rtvia *v = RTA_DATA(via);
+        size_t vlen = v->rtvia_family == AF_INET ? 4 : 16;
+        if (RTA_PAYLOAD(via) >= sizeof(*v) + vlen) {
+            nh->gw_family = (uint8_t)v->rtvia_family;
+            memcpy(nh->gw, v->rtvia_addr, vlen);
         }
     }
 }
 
-/* handle route (RTM_NEWROUTE / RTM_DELROUTE) */
-static void handle_route_msg(struct nlmsghdr *nlh) {
+#define ROUTE_MAX_NH 256
+#define ROUTE_MAX_METRICS (RTAX_MAX)
+
+/* parse RTM_NEWROUTE / RTM_DELROUTE into the route table mirror */
+static void apply_route_msg(struct nlmsghdr *nlh, int log_event) {
     struct rtmsg *rt = NLMSG_DATA(nlh);
+    if (rt->rtm_family != AF_INET && rt->rtm_family != AF_INET6) return;
+    if (rt->rtm_flags & RTM_F_CLONED) return;   /* route cache entries */
+
     struct rtattr *tb[RTA_MAX + 1];
     memset(tb, 0, sizeof(tb));
     struct rtattr *rta = RTM_RTA(rt);
     int len = RTM_PAYLOAD(nlh);
     rtattr_get(tb, RTA_MAX, rta, len);
 
-    char dst[INET6_ADDRSTRLEN] = {0};
-    int oif = 0;
+    static rt_nexthop_t nhs[ROUTE_MAX_NH];
+    rt_metric_t metrics[ROUTE_MAX_METRICS];
+    rt_route_t r;
+    memset(&r, 0, sizeof(r));
+    r.family = rt->rtm_family;
+    r.dst_len = rt->rtm_dst_len;
+    r.tos = rt->rtm_tos;
+    r.protocol = rt->rtm_protocol;
+    r.scope = rt->rtm_scope;
+    r.type = rt->rtm_type;
+    r.table = rt->rtm_table;
+    if (tb[RTA_TABLE]) r.table = *(uint32_t *)RTA_DATA(tb[RTA_TABLE]);
+    if (!nlfilter_keep_route(r.family, r.table)) return;
+    if (tb[RTA_PRIORITY]) r.priority = *(uint32_t *)RTA_DATA(tb[RTA_PRIORITY]);
+    size_t alen = r.family == AF_INET ? 4 : 16;
+    if (tb[RTA_DST] && RTA_PAYLOAD(tb[RTA_DST]) >= alen) {
+        memcpy(r.dst, RTA_DATA(tb[RTA_DST]), alen);
+    }
+
+    if (tb[RTA_MULTIPATH]) {
+        struct rtnexthop *rtnh = RTA_DATA(tb[RTA_MULTIPATH]);
+        int rem = RTA_PAYLOAD(tb[RTA_MULTIPATH]);
+        while (rem >= (int)sizeof(*rtnh) && rtnh->rtnh_len >= sizeof(*rtnh) &&
+               rtnh->rtnh_len <= rem && r.nh_count < ROUTE_MAX_NH) {
+            rt_nexthop_t *nh = &nhs[r.nh_count++];
+            memset(nh, 0, sizeof(*nh));
+            nh->oif = rtnh->rtnh_ifindex;
+            nh->weight = (uint16_t)(rtnh->rtnh_hops + 1);
+            nh->flags = rtnh->rtnh_flags;
+            struct rtattr *ntb[RTA_MAX + 1];
+            memset(ntb, 0, sizeof(ntb));
+            rtattr_get(ntb, RTA_MAX, RTNH_DATA(rtnh), rtnh->rtnh_len - sizeof(*rtnh));
+            parse_gateway(nh, r.family, ntb[RTA_GATEWAY], ntb[RTA_VIA]);
+            rem -= RTNH_ALIGN(rtnh->rtnh_len);
+            rtnh = RTNH_NEXT(rtnh);
+        }
+    } else if (tb[RTA_OIF] || tb[RTA_GATEWAY] || tb[RTA_VIA]) {
+        rt_nexthop_t *nh = &nhs[r.nh_count++];
+        memset(nh, 0, sizeof(*nh));
+        if (tb[RTA_OIF]) nh->oif = *(int *)RTA_DATA(tb[RTA_OIF]);
+        nh->weight = 1;
+        parse_gateway(nh, r.family, tb[RTA_GATEWAY], tb[RTA_VIA]);
+    }
+    r.nh = nhs;
 
-    if (tb[RTA_DST]) {
-        void *addr = RTA_DATA(tb[RTA_DST]);
-        if (rt->rtm_family == AF_INET) {
-            inet_ntop(AF_INET, addr, dst, sizeof(dst));
-        } else if (rt->rtm_family == AF_INET6) {
-            inet_ntop(AF_INET6, addr, dst, sizeof(dst));
+    if (tb[RTA_METRICS]) {
+        struct rtattr *mx = RTA_DATA(tb[RTA_METRICS]);
+        int mlen = RTA_PAYLOAD(tb[RTA_METRICS]);
+        for (; RTA_OK(mx, mlen) && r.metric_count < ROUTE_MAX_METRICS; mx = RTA_NEXT(mx, mlen)) {
+            /* RTAX_CC_ALGO carries the algorithm name, not a u32 */
+            if (mx->rta_type == RTAX_CC_ALGO || RTA_PAYLOAD(mx) < sizeof(uint32_t)) continue;
+            metrics[r.metric_count].type = mx->rta_type;
+            metrics[r.metric_count].value = *(uint32_t *)RTA_DATA(mx);
+            r.metric_count++;
         }
+    }
+    r.metrics = metrics;
+
+    if (log_event) {
+        char dst[INET6_ADDRSTRLEN] = {0};
+        inet_ntop(r.family, r.dst, dst, sizeof(dst));
+        log_info("ROUTE event type=%d fam=%d dst=%s/%d table=%u oif=%d", nlh->nlmsg_type, r.family,
+                 dst, r.dst_len, r.table, r.nh_count ? nhs[0].oif : 0);
+        watch_route(nlh->nlmsg_type == RTM_NEWROUTE, &r);
+        journal_route(nlh->nlmsg_type == RTM_NEWROUTE, &r);
+    }
+
+    if (nlh->nlmsg_type == RTM_NEWROUTE) {
+        route_add(&r);
     } else {
-        /* default route */
-        strcpy(dst, "0.0.0.0/0");
+        route_del(&r);
+    }
+}
+
+/* handle route (RTM_NEWROUTE / RTM_DELROUTE) */
+static void handle_route_msg(struct nlmsghdr *nlh) {
+    apply_route_msg(nlh, 1);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/*
+ * Full-state sync: link, address, route (and optionally neighbor) dumps
+ * chained back-to-back on the request socket. The kernel runs one dump per
+ * socket at a time (a second request gets EBUSY), so each request is sent
+ * the moment the previous stage's NLMSG_DONE arrives; replies are matched
+ * to their stage by sequence number and applied in a single pass.
+ *
+ * The same stages reconcile an already populated table after an overrun:
+ * links are marked and swept, address sets are rebuilt and diffed against
+ * the previous ones, and the route mirror is rebuilt while the old one is
+ * kept aside. A dump that fails or comes back with NLM_F_DUMP_INTR is
+ * abandoned: its stage restores the previous state, the request socket is
+ * replaced (the kernel would refuse the next dump with EBUSY), and the sync
+ * runs again.
+ */
+typedef struct sync_ctx {
+    uint32_t gen;
+    int vanished;
+    int addrs_added;
+    int addrs_removed;
+    int old_count;
+    iface_addr_set_t *old;             /* address sets before the dump */
+    int neighbors;
+} sync_ctx_t;
+
+typedef struct sync_stage {
+    int type;                          /* RTM_GET* */
+    int family;
+    const char *name;
+    nl_msg_cb cb;
+    void (*begin)(sync_ctx_t *ctx);
+    void (*end)(sync_ctx_t *ctx);
+    void (*abort)(sync_ctx_t *ctx);    /* the dump did not complete */
+    int count;
+} sync_stage_t;
+
+static void sync_link_cb(struct nlmsghdr *nlh, void *arg) {
+    (void)arg;
+    if (nlh->nlmsg_type == RTM_NEWLINK) apply_link_msg(nlh, 1);
+}
+
+static void sync_addr_cb(struct nlmsghdr *nlh, void *arg) {
+    (void)arg;
+    if (nlh->nlmsg_type == RTM_NEWADDR) apply_addr_msg(nlh, 1);
+}
+
+static void sync_route_cb(struct nlmsghdr *nlh, void *arg) {
+    (void)arg;
+    if (nlh->nlmsg_type == RTM_NEWROUTE) apply_route_msg(nlh, 0);
+}
+
+static void sync_neigh_cb(struct nlmsghdr *nlh, void *arg) {
+    sync_ctx_t *ctx = arg;
+    if (nlh->nlmsg_type == RTM_NEWNEIGH) ctx->neighbors++;
+}
+
+static void sync_link_begin(sync_ctx_t *ctx) {
+    /* the dump is authoritative: settle open link records first */
+    coalesce_flush(1);
+    ctx->gen = iface_table_begin_sync();
+    resync_gen = ctx->gen;
+}
+
+static void sync_link_end(sync_ctx_t *ctx) {
+    resync_gen = 0;
+    ctx->vanished = iface_table_sweep(ctx->gen);
+}
+
+static void sync_link_abort(sync_ctx_t *ctx) {
+    /* links the partial dump has not reached yet are not gone: no sweep */
+    (void)ctx;
+    resync_gen = 0;
+}
+
+static void sync_addr_begin(sync_ctx_t *ctx) {
+    ctx->old_count = get_iface_count();
+    ctx->old = calloc(ctx->old_count ? ctx->old_count : 1, sizeof(*ctx->old));
+    if (!ctx->old) {
+        /* degrade to merging into the existing sets */
+        ctx->old_count = 0;
+        log_err("sync: out of memory, address sets will not be diffed");
+        return;
+    }
+    for (int pos = 0; pos < ctx->old_count; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        ctx->old[pos] = inf->addrs;
+        memset(&inf->addrs, 0, sizeof(inf->addrs));
+    }
+}
+
+static void sync_addr_end(sync_ctx_t *ctx) {
+    /* positions are stable here: the address stage only appends interfaces */
+    for (int pos = 0; pos < ctx->old_count; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        int changed = 0;
+        for (int i = 0; i < ctx->old[pos].count; i++) {
+            if (!addrset_find(&inf->addrs, &ctx->old[pos].items[i])) changed++, ctx->addrs_removed++;
+        }
+        for (int i = 0; i < inf->addrs.count; i++) {
+            if (!addrset_find(&ctx->old[pos], &inf->addrs.items[i])) changed++, ctx->addrs_added++;
+        }
+        if (changed) iface_touch(inf);
+        addrset_free(&ctx->old[pos]);
+    }
+    for (int pos = ctx->old_count; pos < get_iface_count(); pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        ctx->addrs_added += inf->addrs.count;
+        if (inf->addrs.count) iface_touch(inf);
+    }
+    free(ctx->old);
+    ctx->old = NULL;
+    ctx->old_count = 0;
+}
+
+static void sync_addr_abort(sync_ctx_t *ctx) {
+    /* keep the previous sets; interfaces the stage appended keep what arrived */
+    for (int pos = 0; pos < ctx->old_count; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        addrset_free(&inf->addrs);
+        inf->addrs = ctx->old[pos];
+    }
+    free(ctx->old);
+    ctx->old = NULL;
+    ctx->old_count = 0;
+}
+
+static void sync_route_begin(sync_ctx_t *ctx) {
+    (void)ctx;
+    route_sync_begin();
+}
+
+static void sync_route_end(sync_ctx_t *ctx) {
+    (void)ctx;
+    route_sync_end(1);
+}
+
+static void sync_route_abort(sync_ctx_t *ctx) {
+    /* a partial dump must not replace the mirror: keep the previous routes */
+    (void)ctx;
+    route_sync_end(0);
+}
+
+static int send_dump_req(int type, int family, unsigned int seq) {
+    struct {
+        struct nlmsghdr nlh;
+        struct rtgenmsg g;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    req.nlh.nlmsg_type  = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq   = seq;
+    req.g.rtgen_family  = family;
+
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    return sendto(req_sock, &req, req.nlh.nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel));
+}
+
+static int run_sync_stages(sync_stage_t *stages, int n, sync_ctx_t *ctx) {
+    if (open_req_sock() < 0) return -1;
+
+    static char buf[NL_DUMP_BUFSZ] __attribute__((aligned(NLMSG_ALIGNTO)));
+    unsigned int base = req_seq + 1;
+    req_seq += n;
+
+    int cur = 0;
+    if (send_dump_req(stages[0].type, stages[0].family, base) < 0) {
+        log_err("sync: %s request failed: %s", stages[0].name, strerror(errno));
+        return -1;
+    }
+    if (stages[0].begin) stages[0].begin(ctx);
+
+    while (cur < n) {
+        ssize_t len = recv(req_sock, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            log_err("sync: recv during %s dump failed: %s", stages[cur].name, strerror(errno));
+            req_sock_reset();
+            if (stages[cur].abort) stages[cur].abort(ctx);
+            return -1;
+        }
+        for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != base + (unsigned int)cur) continue;   /* stale reply */
+            sync_stage_t *st = &stages[cur];
+            if (nlh->nlmsg_type == NLMSG_ERROR || (nlh->nlmsg_flags & NLM_F_DUMP_INTR)) {
+                /* an incomplete dump must not be reconciled: the caller syncs again */
+                if (nlh->nlmsg_type == NLMSG_ERROR) {
+                    struct nlmsgerr *e = NLMSG_DATA(nlh);
+                    log_err("sync: %s dump failed: %s", st->name, strerror(-e->error));
+                } else {
+                    log_warn("sync: %s dump interrupted by a concurrent change", st->name);
+                }
+                req_sock_reset();
+                if (st->abort) st->abort(ctx);
+                return -1;
+            }
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                /* issue the next dump before finishing this stage */
+                if (cur + 1 < n && send_dump_req(stages[cur + 1].type, stages[cur + 1].family,
+                                                 base + (unsigned int)cur + 1) < 0) {
+                    log_err("sync: %s request failed: %s", stages[cur + 1].name, strerror(errno));
+                    if (st->end) st->end(ctx);
+                    return -1;
+                }
+                if (st->end) st->end(ctx);
+                cur++;
+                if (cur < n && stages[cur].begin) stages[cur].begin(ctx);
+                break;
+            }
+            st->cb(nlh, ctx);
+            st->count++;
+        }
+    }
+    return 0;
+}
+
+static nl_sync_stats_t sync_stats;
+static int resync_pending = 0;      /* the last resync failed: retry on the next wakeup */
+
+int netlink_sync(void) {
+    sync_stage_t stages[] = {
+        { RTM_GETLINK,  AF_UNSPEC, "link",     sync_link_cb,  sync_link_begin,  sync_link_end,  sync_link_abort,  0 },
+        { RTM_GETADDR,  AF_UNSPEC, "address",  sync_addr_cb,  sync_addr_begin,  sync_addr_end,  sync_addr_abort,  0 },
+        { RTM_GETROUTE, AF_UNSPEC, "route",    sync_route_cb, sync_route_begin, sync_route_end, sync_route_abort, 0 },
+        { RTM_GETNEIGH, AF_UNSPEC, "neighbor", sync_neigh_cb, NULL,             NULL,           NULL,             0 },
+    };
+    int n = config_get_int("sync_neighbors", 0) ? 4 : 3;
+    sync_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    uint64_t t0 = now_us();
+    int ret = run_sync_stages(stages, n, &ctx);
+    uint64_t took = now_us() - t0;
+
+    sync_stats.syncs++;
+    sync_stats.last_us = took;
+    sync_stats.links = stages[0].count;
+    sync_stats.addrs = stages[1].count;
+    sync_stats.routes = stages[2].count;
+    sync_stats.neighbors = ctx.neighbors;
+    if (ret < 0) return -1;
+
+    log_info("sync done in %llu us: %d links (%d vanished), %d addrs (+%d/-%d), %d routes, %d neighbors",
+             (unsigned long long)took, stages[0].count, ctx.vanished, stages[1].count,
+             ctx.addrs_added, ctx.addrs_removed, stages[2].count, ctx.neighbors);
+    return 0;
+}
+
+/* a dump interrupted by churn usually succeeds when issued again */
+static int sync_retry(void) {
+    for (int i = 1;; i++) {
+        if (netlink_sync() == 0) return 0;
+        if (i == NL_SYNC_ATTEMPTS) return -1;
+        log_warn("sync attempt %d of %d failed, retrying", i, NL_SYNC_ATTEMPTS);
+    }
+}
+
+/* re-dump and reconcile after the kernel dropped notifications */
+int netlink_resync(void) {
+    int ret = sync_retry();
+    resync_pending = ret < 0;
+    if (ret < 0) log_err("resync failed, retrying on the next netlink wakeup");
+    uint64_t took = sync_stats.last_us;
+    RX_ADD(resyncs, 1);
+    RX_SET(last_resync_us, took);
+    if (took > rx_stats.max_resync_us) RX_SET(max_resync_us, took);
+    watch_resync();
+    journal_resync();
+    return ret;
+}
+
+const nl_sync_stats_t *netlink_sync_stats(void) {
+    return &sync_stats;
+}
+
+static int set_rcvbuf(int sock, int bytes) {
+    /* SO_RCVBUFFORCE ignores rmem_max but needs CAP_NET_ADMIN */
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0 &&
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) < 0) {
+        log_warn("could not set netlink rcvbuf to %d: %s", bytes, strerror(errno));
     }
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &len);
+    return actual;
+}
+
+static void capture_open(void) {
+    const char *path = config_get_str("netlink_capture", "");
+    if (!path[0]) return;
+    if (nlcap_create(&capture, path, 0) < 0) {
+        log_warn("netlink capture %s: %s", path, strerror(errno));
+        return;
+    }
+    capture_limit = (uint64_t)config_get_int("netlink_capture_max_mb", NL_CAPTURE_MAX_MB_DEFAULT) << 20;
+    capturing = 1;
+    log_info("capturing netlink datagrams to %s", path);
+}
 
-    if (tb[RTA_OIF]) {
-        oif = *(int *)RTA_DATA(tb[RTA_OIF]);
+static void capture_end(const char *why) {
+    if (!capturing) return;
+    capturing = 0;
+    if (nlcap_close(&capture) < 0) why = "write error";
+    log_info("netlink capture stopped (%s): %llu datagrams, %llu bytes", why,
+             (unsigned long long)rx_stats.captured, (unsigned long long)rx_stats.capture_bytes);
+}
+
+static void capture_record(uint16_t type, uint64_t ts_ns, const char *buf, unsigned int len) {
+    if (nlcap_write(&capture, type, ts_ns, buf, len) < 0) {
+        capture_end("write error");
+        return;
     }
+    if (type == NLCAP_DATAGRAM) RX_ADD(captured, 1);
+    RX_SET(capture_bytes, capture.bytes);
+    if (capture_limit && capture.bytes >= capture_limit) capture_end("netlink_capture_max_mb reached");
+}
 
-    log_info("ROUTE event type=%d fam=%d dst=%s oif=%d", nlh->nlmsg_type, rt->rtm_family, dst, oif);
-    /* Could update route-related structures here; for now just log */
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-/* start netlink socket and register to epoll */
-int netlink_start(int epoll_fd) {
+/* start netlink socket and register with the reactor */
+int netlink_start(void) {
+    uint64_t start_us = now_us();
     nl_sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
     if (nl_sock < 0) {
         log_err("socket NETLINK_ROUTE failed: %s", strerror(errno));
@@ -213,61 +902,253 @@ int netlink_start(int epoll_fd) {
         return -1;
     }
 
+    /* drop untracked notifications in the kernel; the rules also hold for dumps */
+    if (nlfilter_attach(nl_sock) < 0) {
+        log_warn("netlink filter not attached, filtering in userspace only");
+    } else if (nlfilter_drops_links() && reactor_timer_init(&rename_timer, rename_check_fire, NULL) == 0) {
+        reactor_timer_arm(&rename_timer, NL_RENAME_CHECK_MS, NL_RENAME_CHECK_MS);
+    }
+
     /* set socket non-blocking (optional but good) */
     int flags = fcntl(nl_sock, F_GETFL, 0);
     if (flags >= 0) fcntl(nl_sock, F_SETFL, flags | O_NONBLOCK);
 
-    /* add to epoll */
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = nl_sock;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, nl_sock, &ev) < 0) {
-        log_err("epoll_ctl add nl_sock failed: %s", strerror(errno));
+    /* size for bursts: mass veth teardown or a route flap queues thousands of messages */
+    RX_SET(rcvbuf, set_rcvbuf(nl_sock, (int)config_get_int("netlink_rcvbuf", NL_RCVBUF_DEFAULT)));
+    coalesce_init();
+    rx_batch = (int)config_get_int("netlink_batch", NL_BATCH_DEFAULT);
+    if (rx_batch < 1) rx_batch = 1;
+    if (rx_batch > NL_BATCH_MAX) rx_batch = NL_BATCH_MAX;
+    if (rx_alloc() < 0) {
+        close(nl_sock);
+        return -1;
+    }
+    capture_open();
+
+    /* the receive loop drains to EAGAIN, so edge-triggered is safe;
+     * in threaded mode the ingestion thread reads the socket instead */
+    nl_handler.fd = nl_sock;
+    if (!pipeline_threaded() && reactor_add(&nl_handler, EPOLLIN | reactor_et_flag()) < 0) {
         close(nl_sock);
         return -1;
     }
     log_info("netlink socket started (fd=%d)", nl_sock);
+
+    /* events queued on nl_sock while syncing are applied afterwards */
     log_info("syncing netlink state...");
-    send_nl_addr_dump_req(nl_sock);
+    if (sync_retry() < 0) {
+        log_err("initial netlink sync failed");
+        return -1;
+    }
+    sync_stats.ready_us = now_us() - start_us;
+    log_info("ready in %.1f ms", sync_stats.ready_us / 1000.0);
     return nl_sock;
 }
 
-/* main message processing */
-void process_netlink_messages(void) {
-    char buf[8192];
-    struct iovec iov = { buf, sizeof(buf) };
-    struct sockaddr_nl sa;
-    struct msghdr msg = { (void*)&sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+static void dispatch_msg(struct nlmsghdr *nlh) {
+    switch (nlh->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            handle_link_msg(nlh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            handle_addr_msg(nlh);
+            break;
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            handle_route_msg(nlh);
+            break;
+        default:
+            /* skip other types */
+            break;
+    }
+}
 
-    ssize_t len;
-    while ((len = recvmsg(nl_sock, &msg, 0)) > 0) {
-        for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
-            if (nlh->nlmsg_type == NLMSG_ERROR) {
+typedef void (*rx_sink)(char *buf, unsigned int len, void *arg);
+
+void netlink_dispatch(struct nlmsghdr *nlh) {
+    RX_ADD(messages, 1);
+    rx_wakeup_msgs++;
+    nlfilter_delivered(nlh->nlmsg_type);
+    dispatch_msg(nlh);
+}
+
+static void dispatch_datagram(char *buf, unsigned int len, void *arg) {
+    (void)arg;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+        netlink_dispatch(nlh);
+    }
+}
+
+/* drain the socket with recvmmsg batches into sink; 1 if notifications were lost */
+static int rx_drain(rx_sink sink, void *arg) {
+    int overrun = 0;
+    uint32_t datagrams = 0;
+
+    rx_wakeup_msgs = 0;
+    RX_ADD(wakeups, 1);
+    for (;;) {
+        for (int i = 0; i < rx_batch; i++) {
+            rx_iov[i].iov_base = rx_bufs + (size_t)i * NL_RX_BUFSZ;
+            rx_iov[i].iov_len = NL_RX_BUFSZ;
+            memset(&rx_msgs[i].msg_hdr, 0, sizeof(rx_msgs[i].msg_hdr));
+            rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+            rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_addrs[i]);
+            rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+            rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(nl_sock, rx_msgs, rx_batch, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                /* kernel dropped notifications; keep draining, then resync */
+                RX_ADD(overruns, 1);
+                overrun = 1;
+                if (capturing) capture_record(NLCAP_OVERRUN, realtime_ns(), NULL, 0);
                 continue;
             }
-            if (nlh->nlmsg_type == NLMSG_DONE) {
-                log_info("netlink dump completed");
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_err("recvmmsg nl_sock failed: %s", strerror(errno));
             }
-            switch (nlh->nlmsg_type) {
-                case RTM_NEWLINK:
-                case RTM_DELLINK:
-                    handle_link_msg(nlh);
-                    break;
-                case RTM_NEWADDR:
-                case RTM_DELADDR:
-                    handle_addr_msg(nlh);
-                    break;
-                case RTM_NEWROUTE:
-                case RTM_DELROUTE:
-                    handle_route_msg(nlh);
-                    break;
-                default:
-                    /* skip other types */
-                    break;
+            break;
+        }
+        uint64_t ts_ns = capturing ? realtime_ns() : 0;
+        for (int i = 0; i < n; i++) {
+            if (rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                /* a message bigger than our buffer was cut: its content is lost */
+                RX_ADD(truncated, 1);
+                overrun = 1;
+                if (capturing) capture_record(NLCAP_OVERRUN, ts_ns, NULL, 0);
+                continue;
             }
+            if (rx_addrs[i].nl_pid != 0) continue;   /* only trust the kernel */
+            /* netlink_filter=audit: a message the filter would drop, cut to a marker */
+            if (nlfilter_audit_marker(rx_bufs + (size_t)i * NL_RX_BUFSZ, rx_msgs[i].msg_len)) continue;
+            if (capturing) capture_record(NLCAP_DATAGRAM, ts_ns, rx_bufs + (size_t)i * NL_RX_BUFSZ, rx_msgs[i].msg_len);
+            sink(rx_bufs + (size_t)i * NL_RX_BUFSZ, rx_msgs[i].msg_len, arg);
+        }
+        datagrams += n;
+        RX_ADD(datagrams, (uint64_t)n);
+        if (n < rx_batch) break;
+    }
+
+    /* a capture is complete up to the last wakeup, also when the agent is killed */
+    if (capturing && datagrams && nlcap_flush(&capture) < 0) capture_end("write error");
+    if (datagrams > rx_stats.max_datagrams_per_wakeup) RX_SET(max_datagrams_per_wakeup, datagrams);
+    if (rx_wakeup_msgs > rx_stats.max_messages_per_wakeup) RX_SET(max_messages_per_wakeup, rx_wakeup_msgs);
+    return overrun;
+}
+
+static void resync_after_overrun(void) {
+    if (resync_pending) log_warn("retrying the failed resync");
+    else log_warn("netlink overrun detected (overruns=%llu truncated=%llu), resyncing",
+             (unsigned long long)__atomic_load_n(&rx_stats.overruns, __ATOMIC_RELAXED),
+             (unsigned long long)__atomic_load_n(&rx_stats.truncated, __ATOMIC_RELAXED));
+    netlink_resync();
+}
+
+/* main message processing: drain the socket and apply every message */
+void process_netlink_messages(void) {
+    if (rx_drain(dispatch_datagram, NULL) || resync_pending) resync_after_overrun();
+}
+
+/* ---- threaded mode: ingestion thread -> ring -> state owner ---- */
+
+enum { NL_REC_MSG = 1, NL_REC_OVERRUN };
+
+typedef struct ingest_ctx {
+    spsc_ring_t *out;
+    int stop_fd;
+    int stopped;
+} ingest_ctx_t;
+
+/* one record per message the state owner acts on; the rest never leave this thread */
+static void forward_datagram(char *buf, unsigned int len, void *arg) {
+    ingest_ctx_t *ctx = arg;
+    for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+        RX_ADD(messages, 1);
+        rx_wakeup_msgs++;
+        nlfilter_delivered(nlh->nlmsg_type);
+        switch (nlh->nlmsg_type) {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+            case RTM_NEWROUTE:
+            case RTM_DELROUTE:
+                break;
+            default:
+                continue;
+        }
+        if (ctx->stopped) return;
+        if (spsc_push_wait(ctx->out, NL_REC_MSG, nlh, nlh->nlmsg_len, ctx->stop_fd) < 0) {
+            ctx->stopped = 1;
         }
     }
-    if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-        log_err("recvmsg nl_sock failed: %s", strerror(errno));
+}
+
+void netlink_ingest(spsc_ring_t *out, int stop_fd) {
+    ingest_ctx_t ctx = { out, stop_fd, 0 };
+    struct pollfd p[2] = {
+        { .fd = nl_sock, .events = POLLIN },
+        { .fd = stop_fd, .events = POLLIN },
+    };
+    while (!ctx.stopped) {
+        if (poll(p, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            log_err("netlink ingest: poll failed: %s", strerror(errno));
+            return;
+        }
+        if (p[1].revents) return;
+        if (rx_drain(forward_datagram, &ctx) && !ctx.stopped &&
+            spsc_push_wait(out, NL_REC_OVERRUN, NULL, 0, stop_fd) < 0) {
+            return;
+        }
+        spsc_notify(out);
     }
 }
+
+int netlink_apply_queued(spsc_ring_t *in, int budget) {
+    int n = 0;
+    int overrun = 0;
+    const spsc_rec_t *rec;
+    while (n < budget && (rec = spsc_peek(in))) {
+        /* records are message copies the ring owns until released */
+        if (rec->type == NL_REC_MSG) dispatch_msg((struct nlmsghdr *)spsc_payload(rec));
+        else if (rec->type == NL_REC_OVERRUN) overrun = 1;
+        spsc_release(in, rec);
+        n++;
+    }
+    if (overrun || resync_pending) resync_after_overrun();
+    return n;
+}
+
+void netlink_stop(void) {
+    capture_end("agent exiting");
+}
+
+static void nl_event(reactor_handler_t *h, uint32_t events) {
+    (void)h;
+    (void)events;
+    process_netlink_messages();
+}
+
+#define RX_LOAD(f) st->f = __atomic_load_n(&rx_stats.f, __ATOMIC_RELAXED)
+
+void netlink_get_rx_stats(nl_rx_stats_t *st) {
+    RX_LOAD(wakeups);
+    RX_LOAD(datagrams);
+    RX_LOAD(messages);
+    RX_LOAD(max_datagrams_per_wakeup);
+    RX_LOAD(max_messages_per_wakeup);
+    RX_LOAD(overruns);
+    RX_LOAD(truncated);
+    RX_LOAD(dump_truncated);
+    RX_LOAD(resyncs);
+    RX_LOAD(last_resync_us);
+    RX_LOAD(max_resync_us);
+    RX_LOAD(rcvbuf);
+    RX_LOAD(captured);
+    RX_LOAD(capture_bytes);
+}
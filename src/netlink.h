@@ -1,10 +1,89 @@
 #ifndef NETLINK_H
 #define NETLINK_H
 
-int netlink_start(int epoll_fd);
+#include <stdint.h>
+#include "parser.h"
+#include "spsc.h"
+
+/* receive path counters */
+typedef struct nl_rx_stats {
+    uint64_t wakeups;
+    uint64_t datagrams;
+    uint64_t messages;
+    uint32_t max_datagrams_per_wakeup;
+    uint32_t max_messages_per_wakeup;
+    uint64_t overruns;                 /* ENOBUFS: kernel dropped notifications */
+    uint64_t truncated;                /* MSG_TRUNC datagrams */
+    uint64_t dump_truncated;           /* request replies cut short: dump failed */
+    uint64_t resyncs;
+    uint64_t last_resync_us;
+    uint64_t max_resync_us;
+    int rcvbuf;                        /* effective SO_RCVBUF */
+    uint64_t captured;                 /* datagrams written to netlink_capture */
+    uint64_t capture_bytes;
+} nl_rx_stats_t;
+
+/* full-state sync results */
+typedef struct nl_sync_stats {
+    uint64_t syncs;
+    uint64_t last_us;                  /* duration of the last sync */
+    uint64_t ready_us;                 /* netlink_start() to table ready */
+    int links;
+    int addrs;
+    int routes;
+    int neighbors;
+} nl_sync_stats_t;
+
+int netlink_start(void);
 int netlink_fd(void);
 
 /* process incoming messages (to be called by main loop when nl fd is readable) */
 void process_netlink_messages(void);
+/* flush and close netlink_capture; after the receive path has stopped */
+void netlink_stop(void);
+
+/*
+ * one received message through the handlers, counted like the receive path
+ * does. nlreplay feeds captures through this without a socket.
+ */
+struct nlmsghdr;
+void netlink_dispatch(struct nlmsghdr *nlh);
+
+/* tb[type] = attribute for every type <= max in the list; the handlers' parser */
+struct rtattr;
+struct rtattr *rtattr_get(struct rtattr *tb[], int max, struct rtattr *rta, int len);
+
+/*
+ * threaded mode: body of the ingestion thread. Drains the event socket and
+ * forwards every link/address/route message as one record to out, until
+ * stop_fd becomes readable. An overrun is forwarded as a record too.
+ */
+void netlink_ingest(spsc_ring_t *out, int stop_fd);
+/* state owner side: apply up to budget forwarded records; returns how many */
+int netlink_apply_queued(spsc_ring_t *in, int budget);
+
+/* RTM_GETSTATS without touching the parser table: cb per interface.
+ * ifindex 0 dumps all. Safe from any thread (per-thread request socket).
+ * returns number of interfaces reported, -1 on failure (errno set) */
+typedef void (*netlink_stats_cb)(int ifindex, const iface_counters_t *c, void *arg);
+int netlink_query_stats(int ifindex, netlink_stats_cb cb, void *arg);
+
+/* dump 64-bit counters of all interfaces via RTM_GETSTATS into the parser table.
+ * returns number of interfaces updated, -1 on failure (errno set) */
+int netlink_poll_stats(void);
+/* same for one interface (no dump); returns 1 if updated, -1 on failure */
+int netlink_poll_stats_iface(int ifindex);
+
+/*
+ * full-state sync: link, address, route (+ neighbor with sync_neighbors=1)
+ * dumps chained on the request socket, reconciling the parser table and the
+ * route mirror in one pass. Used at startup and after overruns.
+ */
+int netlink_sync(void);
+/* netlink_sync() after an overrun, accounted in the rx stats */
+int netlink_resync(void);
+/* copy of the receive counters; safe while the ingest thread runs */
+void netlink_get_rx_stats(nl_rx_stats_t *st);
+const nl_sync_stats_t *netlink_sync_stats(void);
 
 #endif
@@ -0,0 +1,674 @@
+#define _GNU_SOURCE
+#include "netns.h"
+#include "parser.h"
+#include "addrset.h"
+#include "reactor.h"
+#include "config.h"
+#include "logger.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#define NETNS_DIR_DEFAULT "/var/run/netns"
+#define NETNS_SCAN_SEC_DEFAULT 10
+#define NETNS_POLL_SEC_DEFAULT 30
+#define NETNS_RCVBUF_DEFAULT (256 << 10)
+#define NETNS_RX_BUFSZ 32768
+#define NETNS_TICK_MS 1000
+#define NETNS_RESCAN_DELAY_MS 200      /* ip netns add creates the file before mounting it */
+#define NETNS_NAME_MAX 64
+
+typedef struct ns_iface {
+    int ifindex;
+    char ifname[IFNAMSIZ];
+    uint32_t flags;
+    uint32_t mtu;
+    uint8_t operstate;
+    uint8_t up;
+    uint32_t flaps;
+    uint32_t sync_gen;
+    iface_counters_t stats;
+    iface_addr_set_t addrs;
+} ns_iface_t;
+
+enum { NS_IDLE, NS_DUMP_LINK, NS_DUMP_ADDR };
+
+typedef struct netns {
+    reactor_handler_t h;               /* h.fd: NETLINK_ROUTE socket inside the namespace */
+    char name[NETNS_NAME_MAX];         /* netns_dir entry, or pid:<pid> */
+    int named;                         /* found in netns_dir */
+    dev_t dev;
+    ino_t ino;
+    /* a few interfaces per namespace: a dense array searched linearly */
+    ns_iface_t *ifaces;
+    int count;
+    int cap;
+    int state;                         /* NS_* */
+    int full;                          /* current sync also dumps addresses */
+    int resync;                        /* overrun: full sync once idle */
+    uint32_t dump_seq;
+    uint32_t sync_gen;
+    uint64_t next_poll_ms;
+    uint64_t msgs;
+    uint64_t bytes;
+    uint64_t cpu_ns;
+    uint64_t overruns;
+} netns_t;
+
+/* a namespace found by discovery */
+typedef struct ns_found {
+    dev_t dev;
+    ino_t ino;
+    int named;
+    int known;
+    char name[NETNS_NAME_MAX];
+    char path[96];
+} ns_found_t;
+
+static int enabled = 0;
+static char ns_dir[128];
+static int scan_proc = 1;
+static int rcvbuf = NETNS_RCVBUF_DEFAULT;
+static uint64_t scan_ms = NETNS_SCAN_SEC_DEFAULT * 1000;
+static uint64_t poll_ms = NETNS_POLL_SEC_DEFAULT * 1000;
+static uint64_t next_scan_ms = 0;
+
+static int self_fd = -1;               /* the agent's own namespace, to switch back */
+static dev_t self_dev;
+static ino_t self_ino;
+
+static netns_t **nss = NULL;
+static int ns_count = 0;
+static int ns_cap = 0;
+
+static char *rx_buf = NULL;            /* shared by every namespace socket */
+static reactor_timer_t tick_timer;
+static reactor_timer_t rescan_timer;
+static int ino_fd = -1;
+static int ino_wd = -1;
+static reactor_handler_t ino_handler;
+
+static netns_stats_t totals;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_ms(void) {
+    return now_ns() / 1000000;
+}
+
+/* ---- per-namespace interface table ---- */
+
+static ns_iface_t *ns_find(netns_t *ns, int ifindex) {
+    for (int i = 0; i < ns->count; i++) {
+        if (ns->ifaces[i].ifindex == ifindex) return &ns->ifaces[i];
+    }
+    return NULL;
+}
+
+static ns_iface_t *ns_ensure(netns_t *ns, int ifindex) {
+    ns_iface_t *inf = ns_find(ns, ifindex);
+    if (inf) return inf;
+    if (ns->count == ns->cap) {
+        int cap = ns->cap ? ns->cap * 2 : 4;
+        ns_iface_t *n = realloc(ns->ifaces, (size_t)cap * sizeof(*n));
+        if (!n) return NULL;
+        ns->ifaces = n;
+        ns->cap = cap;
+    }
+    inf = &ns->ifaces[ns->count++];
+    memset(inf, 0, sizeof(*inf));
+    inf->ifindex = ifindex;
+    return inf;
+}
+
+/* swap with the last entry: the array stays dense */
+static void ns_remove_at(netns_t *ns, int i) {
+    addrset_free(&ns->ifaces[i].addrs);
+    ns->ifaces[i] = ns->ifaces[--ns->count];
+}
+
+static void ns_remove(netns_t *ns, int ifindex) {
+    for (int i = 0; i < ns->count; i++) {
+        if (ns->ifaces[i].ifindex == ifindex) {
+            ns_remove_at(ns, i);
+            return;
+        }
+    }
+}
+
+static void rtattr_parse(struct rtattr *tb[], int max, struct rtattr *rta, int len) {
+    while (RTA_OK(rta, len)) {
+        if (rta->rta_type <= max) tb[rta->rta_type] = rta;
+        rta = RTA_NEXT(rta, len);
+    }
+}
+
+static void ns_link_msg(netns_t *ns, struct nlmsghdr *nlh) {
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    if (nlh->nlmsg_type == RTM_DELLINK) {
+        ns_remove(ns, ifi->ifi_index);
+        return;
+    }
+    struct rtattr *tb[IFLA_MAX + 1];
+    memset(tb, 0, sizeof(tb));
+    rtattr_parse(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nlh));
+
+    ns_iface_t *inf = ns_ensure(ns, ifi->ifi_index);
+    if (!inf) return;
+    if (tb[IFLA_IFNAME]) snprintf(inf->ifname, sizeof(inf->ifname), "%s", (const char *)RTA_DATA(tb[IFLA_IFNAME]));
+    uint8_t up = (ifi->ifi_flags & IFF_RUNNING) ? 1 : 0;
+    if (inf->flags && up != inf->up) inf->flaps++;
+    inf->up = up;
+    inf->flags = ifi->ifi_flags;
+    if (tb[IFLA_MTU]) inf->mtu = *(uint32_t *)RTA_DATA(tb[IFLA_MTU]);
+    if (tb[IFLA_OPERSTATE]) inf->operstate = *(uint8_t *)RTA_DATA(tb[IFLA_OPERSTATE]);
+    if (tb[IFLA_STATS64] && RTA_PAYLOAD(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 s;
+        memcpy(&s, RTA_DATA(tb[IFLA_STATS64]), sizeof(s));
+        inf->stats.rx_bytes = s.rx_bytes;
+        inf->stats.tx_bytes = s.tx_bytes;
+        inf->stats.rx_packets = s.rx_packets;
+        inf->stats.tx_packets = s.tx_packets;
+        inf->stats.rx_err = s.rx_errors;
+        inf->stats.tx_err = s.tx_errors;
+        inf->stats.rx_dropped = s.rx_dropped;
+        inf->stats.tx_dropped = s.tx_dropped;
+        inf->stats.rx_fifo = s.rx_fifo_errors;
+        inf->stats.tx_fifo = s.tx_fifo_errors;
+        inf->stats.multicast = s.multicast;
+    }
+    inf->sync_gen = ns->sync_gen;
+}
+
+static void ns_addr_msg(netns_t *ns, struct nlmsghdr *nlh) {
+    struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    if (ifa->ifa_prefixlen == 0 || (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)) return;
+    struct rtattr *tb[IFA_MAX + 1];
+    memset(tb, 0, sizeof(tb));
+    rtattr_parse(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nlh));
+    struct rtattr *ra = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    size_t alen = ifa->ifa_family == AF_INET ? 4 : 16;
+    if (!ra || RTA_PAYLOAD(ra) < alen) return;
+    uint32_t flags = ifa->ifa_flags;
+    if (tb[IFA_FLAGS] && RTA_PAYLOAD(tb[IFA_FLAGS]) >= sizeof(uint32_t)) flags = *(uint32_t *)RTA_DATA(tb[IFA_FLAGS]);
+
+    iface_addr_t a;
+    iface_addr_make(&a, ifa->ifa_family, RTA_DATA(ra), ifa->ifa_prefixlen, flags);
+    if (nlh->nlmsg_type == RTM_NEWADDR) {
+        ns_iface_t *inf = ns_ensure(ns, (int)ifa->ifa_index);
+        if (inf) addrset_add(&inf->addrs, &a);
+    } else {
+        ns_iface_t *inf = ns_find(ns, (int)ifa->ifa_index);
+        if (inf) addrset_del(&inf->addrs, &a);
+    }
+}
+
+/* ---- dumps: link (counters, sweep) and, for a full sync, addresses ---- */
+
+static int ns_send_dump(netns_t *ns, int type) {
+    struct {
+        struct nlmsghdr nlh;
+        struct rtgenmsg g;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    req.nlh.nlmsg_type = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++ns->dump_seq;
+    req.g.rtgen_family = AF_UNSPEC;
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (sendto(ns->h.fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        log_debug("netns %s: dump request failed: %s", ns->name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void ns_start_sync(netns_t *ns, int full) {
+    ns->full = full;
+    ns->sync_gen++;
+    ns->state = ns_send_dump(ns, RTM_GETLINK) == 0 ? NS_DUMP_LINK : NS_IDLE;
+    ns->next_poll_ms = now_ms() + poll_ms;
+}
+
+static void ns_dump_done(netns_t *ns, int interrupted) {
+    if (ns->state == NS_DUMP_LINK) {
+        /* links the dump did not return are gone */
+        if (!interrupted) {
+            for (int i = ns->count - 1; i >= 0; i--) {
+                if (ns->ifaces[i].sync_gen != ns->sync_gen) ns_remove_at(ns, i);
+            }
+        }
+        if (ns->full) {
+            /* the address dump repopulates from scratch */
+            for (int i = 0; i < ns->count; i++) addrset_clear(&ns->ifaces[i].addrs);
+            ns->state = ns_send_dump(ns, RTM_GETADDR) == 0 ? NS_DUMP_ADDR : NS_IDLE;
+            if (ns->state != NS_IDLE) return;
+        }
+    }
+    ns->state = NS_IDLE;
+    if (interrupted) ns->resync = 1;
+    if (ns->resync) {
+        ns->resync = 0;
+        ns_start_sync(ns, 1);
+    }
+}
+
+static void ns_dispatch(netns_t *ns, char *buf, int len) {
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+        ns->msgs++;
+        int ours = ns->state != NS_IDLE && nlh->nlmsg_seq == ns->dump_seq;
+        switch (nlh->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            ns_link_msg(ns, nlh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            ns_addr_msg(ns, nlh);
+            break;
+        case NLMSG_DONE:
+            if (ours) ns_dump_done(ns, (nlh->nlmsg_flags & NLM_F_DUMP_INTR) != 0);
+            break;
+        case NLMSG_ERROR:
+            /* a dump that failed outright: try again on the next poll */
+            if (ours) {
+                ns->state = NS_IDLE;
+                ns->resync = 0;
+                ns->next_poll_ms = now_ms() + NETNS_TICK_MS;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void ns_event(reactor_handler_t *h, uint32_t events) {
+    (void)events;
+    netns_t *ns = h->arg;
+    uint64_t t0 = now_ns();
+    for (;;) {
+        ssize_t n = recv(h->fd, rx_buf, NETNS_RX_BUFSZ, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                /* events were lost: the table is rebuilt from a full dump */
+                ns->overruns++;
+                totals.overruns++;
+                if (ns->state == NS_IDLE) ns_start_sync(ns, 1);
+                else ns->resync = 1;
+                continue;
+            }
+            break;                      /* EAGAIN */
+        }
+        if (n == 0) break;
+        ns->bytes += (uint64_t)n;
+        totals.bytes += (uint64_t)n;
+        uint64_t before = ns->msgs;
+        ns_dispatch(ns, rx_buf, (int)n);
+        totals.msgs += ns->msgs - before;
+    }
+    uint64_t dt = now_ns() - t0;
+    ns->cpu_ns += dt;
+    totals.cpu_ns += dt;
+}
+
+/* ---- namespaces ---- */
+
+static int ns_socket_in(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (setns(fd, CLONE_NEWNET) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    close(fd);
+    /* a socket stays in the namespace it was created in */
+    int s = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    int e = errno;
+    if (setns(self_fd, CLONE_NEWNET) < 0) {
+        log_err("netns: cannot return to the agent's namespace: %s", strerror(errno));
+        abort();
+    }
+    errno = e;
+    return s;
+}
+
+static netns_t *ns_add(const ns_found_t *f) {
+    int s = ns_socket_in(f->path);
+    if (s < 0) {
+        log_debug("netns %s: cannot open a socket in %s: %s", f->name, f->path, strerror(errno));
+        return NULL;
+    }
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(s, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        log_warn("netns %s: bind failed: %s", f->name, strerror(errno));
+        close(s);
+        return NULL;
+    }
+    if (setsockopt(s, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    if (ns_count == ns_cap) {
+        int cap = ns_cap ? ns_cap * 2 : 64;
+        netns_t **n = realloc(nss, (size_t)cap * sizeof(*n));
+        if (!n) {
+            close(s);
+            return NULL;
+        }
+        nss = n;
+        ns_cap = cap;
+    }
+    netns_t *ns = calloc(1, sizeof(*ns));
+    if (!ns) {
+        close(s);
+        return NULL;
+    }
+    ns->h.fd = s;
+    ns->h.cb = ns_event;
+    ns->h.arg = ns;
+    snprintf(ns->name, sizeof(ns->name), "%s", f->name);
+    ns->named = f->named;
+    ns->dev = f->dev;
+    ns->ino = f->ino;
+    if (reactor_add(&ns->h, EPOLLIN | reactor_et_flag()) < 0) {
+        close(s);
+        free(ns);
+        return NULL;
+    }
+    nss[ns_count++] = ns;
+    ns_start_sync(ns, 1);
+    /* spread the counter polls over the interval */
+    ns->next_poll_ms = now_ms() + (uint64_t)(ns->ino % (poll_ms ? poll_ms : 1));
+    totals.added++;
+    log_info("netns %s: monitoring (inode %lu)", ns->name, (unsigned long)ns->ino);
+    return ns;
+}
+
+static void ns_free(reactor_handler_t *h) {
+    free(h->arg);
+}
+
+/* scan() runs from timer callbacks: the namespace's own socket event may be
+ * queued in the same batch, so the struct is freed after it */
+static void ns_destroy(netns_t *ns) {
+    int fd = ns->h.fd;
+    for (int i = 0; i < ns->count; i++) addrset_free(&ns->ifaces[i].addrs);
+    free(ns->ifaces);
+    ns->ifaces = NULL;
+    ns->count = 0;
+    reactor_release(&ns->h, ns_free);
+    close(fd);
+}
+
+/* ---- discovery ---- */
+
+typedef struct found_list {
+    ns_found_t *items;
+    int count;
+    int cap;
+} found_list_t;
+
+static void found_add(found_list_t *fl, const char *path, const char *name, int named) {
+    struct stat st;
+    /* a netns_dir file that is not (yet) a bind mount lives on tmpfs, not nsfs */
+    if (stat(path, &st) < 0 || st.st_dev != self_dev || st.st_ino == self_ino) return;
+    if (fl->count == fl->cap) {
+        int cap = fl->cap ? fl->cap * 2 : 256;
+        ns_found_t *n = realloc(fl->items, (size_t)cap * sizeof(*n));
+        if (!n) return;
+        fl->items = n;
+        fl->cap = cap;
+    }
+    ns_found_t *f = &fl->items[fl->count++];
+    memset(f, 0, sizeof(*f));
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->named = named;
+    snprintf(f->name, sizeof(f->name), "%s", name);
+    snprintf(f->path, sizeof(f->path), "%s", path);
+}
+
+/* by inode; per inode a named entry first, then the lowest pid */
+static int found_cmp(const void *a, const void *b) {
+    const ns_found_t *x = a, *y = b;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    if (x->named != y->named) return y->named - x->named;
+    return strcmp(x->name, y->name);
+}
+
+static int found_key_cmp(const void *key, const void *elem) {
+    ino_t ino = *(const ino_t *)key;
+    const ns_found_t *f = elem;
+    return ino == f->ino ? 0 : (ino < f->ino ? -1 : 1);
+}
+
+static void watch_dir(void) {
+    if (ino_fd < 0 || ino_wd >= 0) return;
+    ino_wd = inotify_add_watch(ino_fd, ns_dir, IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM);
+}
+
+static void scan(void) {
+    uint64_t t0 = now_ns();
+    found_list_t fl = { NULL, 0, 0 };
+    char path[384];
+
+    DIR *d = opendir(ns_dir);
+    if (d) {
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.' || strlen(de->d_name) >= NETNS_NAME_MAX) continue;
+            snprintf(path, sizeof(path), "%s/%.63s", ns_dir, de->d_name);
+            if (strlen(path) < sizeof(fl.items[0].path)) found_add(&fl, path, de->d_name, 1);
+        }
+        closedir(d);
+    }
+    if (scan_proc && (d = opendir("/proc")) != NULL) {
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] < '1' || de->d_name[0] > '9') continue;
+            char name[NETNS_NAME_MAX];
+            snprintf(path, sizeof(path), "/proc/%s/ns/net", de->d_name);
+            snprintf(name, sizeof(name), "pid:%.16s", de->d_name);
+            found_add(&fl, path, name, 0);
+        }
+        closedir(d);
+    }
+    qsort(fl.items, (size_t)fl.count, sizeof(ns_found_t), found_cmp);
+    /* one entry per namespace */
+    int u = 0;
+    for (int i = 0; i < fl.count; i++) {
+        if (u == 0 || fl.items[u - 1].ino != fl.items[i].ino) fl.items[u++] = fl.items[i];
+    }
+    fl.count = u;
+
+    /* drop namespaces nobody references any more; our socket alone keeps them alive */
+    int keep = 0;
+    for (int i = 0; i < ns_count; i++) {
+        netns_t *ns = nss[i];
+        ns_found_t *f = bsearch(&ns->ino, fl.items, (size_t)fl.count, sizeof(ns_found_t), found_key_cmp);
+        if (!f) {
+            log_info("netns %s: gone", ns->name);
+            ns_destroy(ns);
+            totals.removed++;
+            continue;
+        }
+        f->known = 1;
+        if (f->named && !ns->named) {
+            snprintf(ns->name, sizeof(ns->name), "%s", f->name);
+            ns->named = 1;
+        }
+        nss[keep++] = ns;
+    }
+    ns_count = keep;
+    for (int i = 0; i < fl.count; i++) {
+        if (!fl.items[i].known) ns_add(&fl.items[i]);
+    }
+    free(fl.items);
+
+    watch_dir();
+    totals.scans++;
+    totals.last_scan_us = (now_ns() - t0) / 1000;
+    next_scan_ms = now_ms() + scan_ms;
+}
+
+static void tick_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)t;
+    (void)expirations;
+    uint64_t now = now_ms();
+    if (now >= next_scan_ms) scan();
+    for (int i = 0; i < ns_count; i++) {
+        netns_t *ns = nss[i];
+        if (ns->state != NS_IDLE || now < ns->next_poll_ms) continue;
+        uint64_t t0 = now_ns();
+        ns_start_sync(ns, 0);
+        ns->cpu_ns += now_ns() - t0;
+    }
+}
+
+static void rescan_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)t;
+    (void)expirations;
+    scan();
+}
+
+static void ino_event(reactor_handler_t *h, uint32_t events) {
+    (void)events;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    for (;;) {
+        ssize_t n = read(h->fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & IN_IGNORED) ino_wd = -1;   /* directory removed: re-added on a scan */
+            else changed = 1;
+        }
+    }
+    if (changed) reactor_timer_arm(&rescan_timer, NETNS_RESCAN_DELAY_MS, 0);
+}
+
+/* one socket per namespace: 1k namespaces need more than the usual 1024 descriptors */
+static void raise_nofile(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == 0) {
+            log_info("netns: open file limit raised to %llu", (unsigned long long)rl.rlim_cur);
+        }
+    }
+}
+
+int netns_start(void) {
+    if (!config_get_int("netns_monitor", 0)) return 0;
+    snprintf(ns_dir, sizeof(ns_dir), "%s", config_get_str("netns_dir", NETNS_DIR_DEFAULT));
+    scan_proc = (int)config_get_int("netns_scan_proc", 1);
+    rcvbuf = (int)config_get_int("netns_rcvbuf", NETNS_RCVBUF_DEFAULT);
+    long v = config_get_int("netns_scan_sec", NETNS_SCAN_SEC_DEFAULT);
+    scan_ms = (uint64_t)(v > 0 ? v : 1) * 1000;
+    v = config_get_int("netns_poll_sec", NETNS_POLL_SEC_DEFAULT);
+    poll_ms = (uint64_t)(v > 0 ? v : 1) * 1000;
+
+    self_fd = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (self_fd < 0 || fstat(self_fd, &st) < 0) {
+        log_err("netns: cannot open the agent's own namespace: %s", strerror(errno));
+        return -1;
+    }
+    self_dev = st.st_dev;
+    self_ino = st.st_ino;
+    rx_buf = malloc(NETNS_RX_BUFSZ);
+    if (!rx_buf) return -1;
+    if (reactor_timer_init(&tick_timer, tick_fire, NULL) < 0 ||
+        reactor_timer_init(&rescan_timer, rescan_fire, NULL) < 0) {
+        return -1;
+    }
+    raise_nofile();
+
+    ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ino_fd >= 0) {
+        ino_handler.fd = ino_fd;
+        ino_handler.cb = ino_event;
+        ino_handler.arg = NULL;
+        if (reactor_add(&ino_handler, EPOLLIN) < 0) {
+            close(ino_fd);
+            ino_fd = -1;
+        }
+    }
+    enabled = 1;
+    scan();
+    reactor_timer_arm(&tick_timer, NETNS_TICK_MS, NETNS_TICK_MS);
+    log_info("netns: monitoring %d namespaces (%s%s)", ns_count, ns_dir, scan_proc ? ", /proc" : "");
+    return 0;
+}
+
+static uint64_t ns_memory(const netns_t *ns) {
+    uint64_t m = sizeof(*ns) + sizeof(nss[0]) + (uint64_t)ns->cap * sizeof(ns_iface_t);
+    for (int i = 0; i < ns->count; i++) m += addrset_memory(&ns->ifaces[i].addrs);
+    return m;
+}
+
+void netns_get_stats(netns_stats_t *st) {
+    *st = totals;
+    st->namespaces = ns_count;
+    st->interfaces = 0;
+    st->memory = enabled ? NETNS_RX_BUFSZ + (uint64_t)(ns_cap - ns_count) * sizeof(nss[0]) : 0;
+    for (int i = 0; i < ns_count; i++) {
+        st->interfaces += nss[i]->count;
+        st->memory += ns_memory(nss[i]);
+    }
+}
+
+void netns_render_list(obuf_t *out) {
+    for (int i = 0; i < ns_count; i++) {
+        const netns_t *ns = nss[i];
+        obuf_printf(out, "%s\tinode=%lu\tifaces=%d\tmsgs=%llu\tcpu_us=%llu\tmem=%llu\toverruns=%llu\n",
+                    ns->name, (unsigned long)ns->ino, ns->count,
+                    (unsigned long long)ns->msgs, (unsigned long long)(ns->cpu_ns / 1000),
+                    (unsigned long long)ns_memory(ns), (unsigned long long)ns->overruns);
+    }
+}
+
+int netns_render_ifaces(obuf_t *out, const char *name) {
+    for (int i = 0; i < ns_count; i++) {
+        const netns_t *ns = nss[i];
+        if (strcmp(ns->name, name) != 0) continue;
+        for (int j = 0; j < ns->count; j++) {
+            const ns_iface_t *inf = &ns->ifaces[j];
+            obuf_printf(out, "%s\t%s\tmtu=%u\trx_bytes=%llu\ttx_bytes=%llu\n",
+                        inf->ifname, inf->up ? "UP" : "DOWN", inf->mtu,
+                        (unsigned long long)inf->stats.rx_bytes, (unsigned long long)inf->stats.tx_bytes);
+            for (int k = 0; k < inf->addrs.count; k++) {
+                char abuf[INET6_ADDRSTRLEN];
+                obuf_printf(out, "  - %s/%d\n",
+                            iface_addr_ntop(&inf->addrs.items[k], abuf, sizeof(abuf)),
+                            inf->addrs.items[k].prefixlen);
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
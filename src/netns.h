@@ -0,0 +1,42 @@
+#ifndef NETNS_H
+#define NETNS_H
+
+#include <stdint.h>
+#include "buffer.h"
+
+/*
+ * Other network namespaces (netns_monitor=1). Namespaces are discovered
+ * from netns_dir (ip netns, watched with inotify) and /proc/<pid>/ns/net,
+ * deduplicated by namespace inode, and each gets one NETLINK_ROUTE socket
+ * on the shared event loop plus a compact interface table of its own:
+ * link state, counters and addresses. Counters come from a link dump every
+ * netns_poll_sec. A namespace is dropped once discovery no longer finds it;
+ * until then our socket keeps it alive (for netns_dir the inotify watch
+ * makes that a fraction of a second, for /proc up to netns_scan_sec).
+ *
+ * The agent's own namespace stays with netlink.c and the full interface
+ * table; nothing here feeds alerts, history or the published views.
+ */
+
+typedef struct netns_stats {
+    int namespaces;
+    int interfaces;
+    uint64_t memory;                   /* bytes of tables and bookkeeping */
+    uint64_t msgs;
+    uint64_t bytes;                    /* netlink bytes received */
+    uint64_t cpu_ns;                   /* spent in receive and dump handling */
+    uint64_t overruns;
+    uint64_t added;
+    uint64_t removed;
+    uint64_t scans;
+    uint64_t last_scan_us;
+} netns_stats_t;
+
+int netns_start(void);
+void netns_get_stats(netns_stats_t *st);
+/* one line per namespace */
+void netns_render_list(obuf_t *out);
+/* interfaces of one namespace; -1 if there is no such namespace */
+int netns_render_ifaces(obuf_t *out, const char *name);
+
+#endif
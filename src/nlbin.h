@@ -0,0 +1,138 @@
+#ifndef NLBIN_H
+#define NLBIN_H
+
+#include <stdint.h>
+
+/*
+ * Binary protocol on the CLI socket (/tmp/nlagent.sock), version 1.
+ *
+ * A client selects it by sending the 4 bytes NLB_MAGIC before anything
+ * else; without them the connection speaks the text commands. Then it
+ * sends request frames and gets one reply frame per request, in order:
+ *
+ *   request  nlb_hdr_t (type NLB_REQUEST, count queries) + count x nlb_query_t
+ *   reply    nlb_hdr_t (type NLB_REPLY, count records, seq echoed) + records
+ *
+ * All integers are host byte order (the socket is local), all structures
+ * are naturally aligned with explicit padding. Every record starts with an
+ * nlb_rec_t naming its type, its length and the query that produced it, so
+ * a client can skip record types it does not know. A request is at most
+ * NLB_MAX_REQUEST bytes; requests may be pipelined. A malformed request is
+ * answered with an NLB_ERROR frame and the connection is closed.
+ */
+
+#define NLB_MAGIC "NLB1"
+#define NLB_MAX_REQUEST 4080            /* header + 127 queries */
+#define NLB_IFNAMSIZ 16
+
+enum { NLB_REQUEST = 1, NLB_REPLY = 2, NLB_ERROR = 3 };
+
+typedef struct nlb_hdr {
+    uint32_t len;                      /* frame bytes, this header included */
+    uint32_t count;                    /* queries or records that follow */
+    uint16_t type;                     /* NLB_REQUEST / NLB_REPLY / NLB_ERROR */
+    uint16_t reserved;
+    uint32_t seq;                      /* chosen by the client, echoed */
+} nlb_hdr_t;
+
+/* queries; an interface is named by ifindex, or by ifname when ifindex is 0 */
+enum {
+    NLB_Q_IFACE = 1,                   /* one NLB_R_IFACE */
+    NLB_Q_COUNTERS = 2,                /* one NLB_R_COUNTERS */
+    NLB_Q_ADDRS = 3,                   /* one NLB_R_ADDR per address */
+    NLB_Q_ALL = 4,                     /* NLB_R_IFACE for every interface with gen > query gen;
+                                          once per request, later ones get NLB_S_LIMIT */
+    NLB_Q_GEN = 5,                     /* one NLB_R_GEN */
+};
+
+/* IFACE / COUNTERS: answer NLB_S_UNCHANGED while the interface gen is still gen */
+#define NLB_QF_IF_CHANGED 0x1
+
+typedef struct nlb_query {
+    uint16_t op;                       /* NLB_Q_* */
+    uint16_t flags;                    /* NLB_QF_* */
+    int32_t ifindex;
+    uint64_t gen;
+    char ifname[NLB_IFNAMSIZ];
+} nlb_query_t;
+
+enum {
+    NLB_R_IFACE = 1,
+    NLB_R_COUNTERS = 2,
+    NLB_R_ADDR = 3,
+    NLB_R_GEN = 4,
+    NLB_R_STATUS = 5,                  /* the query produced no data record */
+};
+
+enum { NLB_S_UNCHANGED = 1, NLB_S_NOT_FOUND = 2, NLB_S_BAD_QUERY = 3, NLB_S_LIMIT = 4 };
+
+typedef struct nlb_rec {
+    uint16_t type;                     /* NLB_R_* */
+    uint16_t len;                      /* record bytes, this header included */
+    uint16_t query;                    /* index of the query in its request */
+    uint16_t reserved;
+} nlb_rec_t;
+
+typedef struct nlb_counters {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_fifo_errors;
+    uint64_t tx_fifo_errors;
+    uint64_t multicast;
+} nlb_counters_t;
+
+typedef struct nlb_iface {
+    nlb_rec_t rec;
+    int32_t ifindex;
+    uint32_t flags;                    /* IFF_* */
+    uint32_t mtu;
+    uint8_t operstate;                 /* IF_OPER_* */
+    uint8_t up;                        /* IFF_RUNNING */
+    uint16_t naddr;
+    uint32_t flaps;
+    uint32_t reserved;
+    uint64_t gen;                      /* changes whenever the interface changes */
+    char ifname[NLB_IFNAMSIZ];
+    nlb_counters_t stats;
+} nlb_iface_t;
+
+typedef struct nlb_counters_rec {
+    nlb_rec_t rec;
+    int32_t ifindex;
+    uint32_t reserved;
+    uint64_t gen;
+    nlb_counters_t stats;
+} nlb_counters_rec_t;
+
+typedef struct nlb_addr {
+    nlb_rec_t rec;
+    int32_t ifindex;
+    uint8_t family;                    /* AF_INET / AF_INET6 */
+    uint8_t prefixlen;
+    uint16_t reserved;
+    uint32_t flags;                    /* IFA_F_* */
+    uint32_t reserved2;
+    uint8_t addr[16];                  /* network byte order */
+} nlb_addr_t;
+
+typedef struct nlb_gen {
+    nlb_rec_t rec;
+    uint64_t table_gen;                /* interfaces came, went or were renamed */
+    uint64_t data_gen;                 /* any interface changed */
+    uint32_t ifaces;
+    uint32_t reserved;
+} nlb_gen_t;
+
+typedef struct nlb_status {
+    nlb_rec_t rec;
+    int32_t ifindex;
+    uint32_t status;                   /* NLB_S_* */
+} nlb_status_t;
+
+#endif
@@ -0,0 +1,94 @@
+#define _GNU_SOURCE
+#include "nlcap.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+_Static_assert(sizeof(nlcap_file_t) == 32 && sizeof(nlcap_rec_t) == 16, "nlcap layout");
+
+#define NLCAP_IOBUF (1 << 20)
+
+static uint32_t pad8(uint32_t len) {
+    return (len + 7u) & ~7u;
+}
+
+int nlcap_create(nlcap_t *c, const char *path, uint32_t flags) {
+    memset(c, 0, sizeof(*c));
+    c->f = fopen(path, "we");
+    if (!c->f) return -1;
+    setvbuf(c->f, NULL, _IOFBF, NLCAP_IOBUF);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    c->hdr.magic = NLCAP_MAGIC;
+    c->hdr.version = NLCAP_VERSION;
+    c->hdr.start_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    c->hdr.flags = flags;
+    if (fwrite(&c->hdr, sizeof(c->hdr), 1, c->f) != 1) {
+        fclose(c->f);
+        c->f = NULL;
+        return -1;
+    }
+    c->bytes = sizeof(c->hdr);
+    return 0;
+}
+
+int nlcap_write(nlcap_t *c, uint16_t type, uint64_t ts_ns, const void *buf, uint32_t len) {
+    static const char zeros[8];
+    nlcap_rec_t r = { ts_ns, len, type, 0 };
+    uint32_t padded = pad8(len);
+    if (fwrite(&r, sizeof(r), 1, c->f) != 1 || (len && fwrite(buf, len, 1, c->f) != 1) ||
+        (padded != len && fwrite(zeros, padded - len, 1, c->f) != 1)) {
+        return -1;
+    }
+    c->records++;
+    c->bytes += sizeof(r) + padded;
+    return 0;
+}
+
+int nlcap_flush(nlcap_t *c) {
+    return fflush(c->f) == 0 ? 0 : -1;
+}
+
+int nlcap_open(nlcap_t *c, const char *path) {
+    memset(c, 0, sizeof(*c));
+    c->f = fopen(path, "re");
+    if (!c->f) return -1;
+    setvbuf(c->f, NULL, _IOFBF, NLCAP_IOBUF);
+    c->buf = malloc(NLCAP_MAX_DATAGRAM);
+    if (!c->buf || fread(&c->hdr, sizeof(c->hdr), 1, c->f) != 1 || c->hdr.magic != NLCAP_MAGIC ||
+        c->hdr.version != NLCAP_VERSION) {
+        nlcap_close(c);
+        errno = EPROTO;
+        return -1;
+    }
+    c->bytes = sizeof(c->hdr);
+    return 0;
+}
+
+int nlcap_next(nlcap_t *c, nlcap_rec_t *rec, const char **payload) {
+    size_t n = fread(rec, 1, sizeof(*rec), c->f);
+    if (n == 0 && feof(c->f)) return 0;
+    if (n != sizeof(*rec) || rec->len > NLCAP_MAX_DATAGRAM) return -1;
+    uint32_t padded = pad8(rec->len);
+    if (padded && fread(c->buf, padded, 1, c->f) != 1) return -1;
+    c->records++;
+    c->bytes += sizeof(*rec) + padded;
+    *payload = c->buf;
+    return 1;
+}
+
+int nlcap_rewind(nlcap_t *c) {
+    if (fseek(c->f, (long)sizeof(c->hdr), SEEK_SET) < 0) return -1;
+    c->records = 0;
+    c->bytes = sizeof(c->hdr);
+    return 0;
+}
+
+int nlcap_close(nlcap_t *c) {
+    int rc = 0;
+    if (c->f && fclose(c->f) != 0) rc = -1;
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+    return rc;
+}
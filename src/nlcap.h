@@ -0,0 +1,61 @@
+#ifndef NLCAP_H
+#define NLCAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Netlink capture files: the datagrams the event socket received, as they
+ * were handed to dispatch, each with its receive time. Written by the agent
+ * with netlink_capture=<path>, generated synthetically and replayed by
+ * nlreplay. Host byte order: a capture is replayed on the machine type it
+ * was taken on, like the netlink messages inside it.
+ *
+ *   nlcap_file_t, then per datagram nlcap_rec_t + len bytes, padded to 8
+ */
+
+#define NLCAP_MAGIC 0x50434c4eu        /* "NLCP" little-endian */
+#define NLCAP_VERSION 1
+#define NLCAP_MAX_DATAGRAM 65536
+
+typedef struct nlcap_file {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_ns;                 /* CLOCK_REALTIME when the capture began */
+    uint32_t flags;                    /* NLCAP_F_* */
+    uint32_t reserved[3];
+} nlcap_file_t;
+
+enum { NLCAP_F_SYNTHETIC = 1 };
+
+enum { NLCAP_DATAGRAM = 1, NLCAP_OVERRUN = 2 };
+
+typedef struct nlcap_rec {
+    uint64_t ts_ns;                    /* CLOCK_REALTIME */
+    uint32_t len;                      /* payload bytes, 0 for NLCAP_OVERRUN */
+    uint16_t type;                     /* NLCAP_* */
+    uint16_t reserved;
+} nlcap_rec_t;
+
+typedef struct nlcap {
+    FILE *f;
+    nlcap_file_t hdr;
+    uint64_t records;
+    uint64_t bytes;                    /* file size so far */
+    char *buf;                         /* reader: payload of the last record */
+} nlcap_t;
+
+/* create path (truncating) and write the file header */
+int nlcap_create(nlcap_t *c, const char *path, uint32_t flags);
+int nlcap_write(nlcap_t *c, uint16_t type, uint64_t ts_ns, const void *buf, uint32_t len);
+int nlcap_flush(nlcap_t *c);
+
+int nlcap_open(nlcap_t *c, const char *path);
+/* next record: 1 and *rec, *payload (valid until the next call); 0 at the end, -1 corrupt */
+int nlcap_next(nlcap_t *c, nlcap_rec_t *rec, const char **payload);
+int nlcap_rewind(nlcap_t *c);
+
+/* flushes a capture being written; 0 or -1 if anything failed to reach the file */
+int nlcap_close(nlcap_t *c);
+
+#endif
@@ -0,0 +1,446 @@
+#define _GNU_SOURCE
+#include "nlfilter.h"
+#include "config.h"
+#include "logger.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define NLF_MAX_RULES 64
+#define NLF_MAX_TABLES 32
+#define NLF_MAX_INSNS 2048
+#define NLF_MAX_LABELS 256
+#define NLF_ACCEPT 0xffffffffu
+
+/* fixed offsets in a notification (one message per datagram) */
+#define OFF_TYPE 4                                  /* nlmsghdr.nlmsg_type */
+#define OFF_BODY NLMSG_HDRLEN                       /* ifinfomsg / ifaddrmsg / rtmsg */
+#define OFF_FAMILY OFF_BODY                         /* *_family is the first byte of all three */
+#define OFF_RTM_TABLE (OFF_BODY + 4)                /* rtmsg.rtm_table */
+#define OFF_LINK_ATTR (OFF_BODY + (int)sizeof(struct ifinfomsg))
+#define OFF_IFNAME (OFF_LINK_ATTR + 4)              /* the kernel puts IFLA_IFNAME first */
+
+enum { R_DROP_ADDR4, R_DROP_ADDR6, R_DROP_ROUTE4, R_DROP_ROUTE6, R_ROUTE_TABLE, R_IGNORE };
+
+typedef struct nlf_rule {
+    int type;                          /* R_* */
+    char name[48];
+    char pattern[IFNAMSIZ + 1];        /* R_IGNORE */
+    int prefix;                        /* pattern is name* */
+    int in_kernel;
+    uint64_t hits;
+} nlf_rule_t;
+
+static int mode = NLF_OFF;
+static nlf_rule_t rules[NLF_MAX_RULES];
+static int rule_count = 0;
+static int rule_of[R_IGNORE];          /* R_* (but ignore) -> rule index + 1 */
+static int ignore_count = 0;
+static uint32_t tables[NLF_MAX_TABLES];
+static int table_count = 0;
+static int kernel_names = 0;           /* the attached program drops NEWLINK by name */
+static nlfilter_stats_t stats;
+
+/* ---- configuration ---- */
+
+static nlf_rule_t *rule_add(int type, const char *name) {
+    if (rule_count == NLF_MAX_RULES) {
+        log_warn("nlfilter: more than %d rules, ignoring %s", NLF_MAX_RULES, name);
+        return NULL;
+    }
+    nlf_rule_t *r = &rules[rule_count++];
+    memset(r, 0, sizeof(*r));
+    r->type = type;
+    r->in_kernel = 1;
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    if (type < R_IGNORE) rule_of[type] = rule_count;
+    return r;
+}
+
+static void drop_token(const char *tok) {
+    static const struct { const char *name; int r1; int r2; } kinds[] = {
+        { "addr",   R_DROP_ADDR4,  R_DROP_ADDR6 },
+        { "addr4",  R_DROP_ADDR4,  -1 },
+        { "addr6",  R_DROP_ADDR6,  -1 },
+        { "route",  R_DROP_ROUTE4, R_DROP_ROUTE6 },
+        { "route4", R_DROP_ROUTE4, -1 },
+        { "route6", R_DROP_ROUTE6, -1 },
+    };
+    static const char *names[] = { "drop:addr4", "drop:addr6", "drop:route4", "drop:route6" };
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(tok, kinds[i].name) != 0) continue;
+        if (!rule_of[kinds[i].r1]) rule_add(kinds[i].r1, names[kinds[i].r1]);
+        if (kinds[i].r2 >= 0 && !rule_of[kinds[i].r2]) rule_add(kinds[i].r2, names[kinds[i].r2]);
+        return;
+    }
+    log_warn("nlfilter: unknown kind '%s' in netlink_filter_drop (addr4 addr6 route4 route6 addr route)", tok);
+}
+
+static void table_token(const char *tok) {
+    uint32_t id;
+    char *end;
+    if (strcmp(tok, "main") == 0) id = RT_TABLE_MAIN;
+    else if (strcmp(tok, "local") == 0) id = RT_TABLE_LOCAL;
+    else if (strcmp(tok, "default") == 0) id = RT_TABLE_DEFAULT;
+    else {
+        unsigned long v = strtoul(tok, &end, 0);
+        if (*end || v == 0 || v > UINT32_MAX) {
+            log_warn("nlfilter: bad route table '%s'", tok);
+            return;
+        }
+        id = (uint32_t)v;
+    }
+    if (table_count == NLF_MAX_TABLES) {
+        log_warn("nlfilter: more than %d route tables, ignoring %s", NLF_MAX_TABLES, tok);
+        return;
+    }
+    tables[table_count++] = id;
+    if (!rule_of[R_ROUTE_TABLE]) rule_add(R_ROUTE_TABLE, "route_tables");
+}
+
+static void ignore_token(const char *tok) {
+    size_t len = strlen(tok);
+    if (len > IFNAMSIZ || (len == IFNAMSIZ && tok[len - 1] != '*')) {
+        log_warn("nlfilter: ignore pattern '%s' longer than an interface name", tok);
+        return;
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "ignore:%s", tok);
+    nlf_rule_t *r = rule_add(R_IGNORE, name);
+    if (!r) return;
+    snprintf(r->pattern, sizeof(r->pattern), "%s", tok);
+    size_t n = strlen(tok);
+    const char *wild = strpbrk(tok, "*?[");
+    if (!wild) {
+        r->prefix = 0;
+    } else if (wild == tok + n - 1 && *wild == '*') {
+        r->prefix = 1;
+    } else {
+        /* the kernel side only compares fixed bytes */
+        r->in_kernel = 0;
+        log_info("nlfilter: pattern '%s' is matched in userspace only", tok);
+    }
+    ignore_count++;
+}
+
+static void parse_list(const char *key, void (*fn)(const char *tok)) {
+    const char *v = config_get_str(key, "");
+    char *copy = strdup(v), *save = NULL;
+    if (!copy) return;
+    for (char *tok = strtok_r(copy, " \t,", &save); tok; tok = strtok_r(NULL, " \t,", &save)) fn(tok);
+    free(copy);
+}
+
+/* ---- program assembly ---- */
+
+static struct sock_filter prog[NLF_MAX_INSNS];
+static int plen;
+static int label_pos[NLF_MAX_LABELS];
+static int label_count;
+static struct { int insn; int label; } fixups[NLF_MAX_INSNS];
+static int fixup_count;
+static int overflow;
+
+static void emit(uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+    if (plen == NLF_MAX_INSNS) {
+        overflow = 1;
+        return;
+    }
+    prog[plen++] = (struct sock_filter)BPF_JUMP(code, k, jt, jf);
+}
+
+static int new_label(void) {
+    if (label_count == NLF_MAX_LABELS) {
+        overflow = 1;
+        return 0;
+    }
+    label_pos[label_count] = -1;
+    return label_count++;
+}
+
+static void bind_label(int l) {
+    label_pos[l] = plen;
+}
+
+static void jump(int l) {
+    if (plen < NLF_MAX_INSNS) {
+        fixups[fixup_count].insn = plen;
+        fixups[fixup_count].label = l;
+        fixup_count++;
+    }
+    emit(BPF_JMP | BPF_JA, 0, 0, 0);
+}
+
+/* BPF_JA takes a 32-bit offset, so sections may be any distance apart */
+static void jump_if(uint32_t k, int l) {
+    emit(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, k);
+    jump(l);
+}
+
+static void jump_unless(uint32_t k, int l) {
+    emit(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, k);
+    jump(l);
+}
+
+/* drop; in audit mode deliver only a marker: header plus one byte per rule index */
+static void ret_drop(int rule) {
+    emit(BPF_RET | BPF_K, 0, 0, mode == NLF_AUDIT ? (uint32_t)(NLMSG_HDRLEN + rule + 1) : 0);
+}
+
+static void ret_accept(void) {
+    emit(BPF_RET | BPF_K, 0, 0, NLF_ACCEPT);
+}
+
+static void load(uint16_t size, uint32_t off) {
+    emit(BPF_LD | size | BPF_ABS, 0, 0, off);
+}
+
+/* falls through for families that are kept */
+static void gen_family_drops(int r4, int r6) {
+    static const int family[2] = { AF_INET, AF_INET6 };
+    int r[2] = { r4, r6 };
+    if (!rule_of[r4] && !rule_of[r6]) return;
+    load(BPF_B, OFF_FAMILY);
+    for (int i = 0; i < 2; i++) {
+        if (!rule_of[r[i]]) continue;
+        int next = new_label();
+        jump_unless((uint32_t)family[i], next);
+        ret_drop(rule_of[r[i]] - 1);
+        bind_label(next);
+    }
+}
+
+/* compare the name bytes after the IFLA_IFNAME header, 4/2/1 at a time (BPF loads are big-endian) */
+static void gen_name_match(const nlf_rule_t *r, int l_next) {
+    const uint8_t *p = (const uint8_t *)r->pattern;
+    int n = (int)strlen(r->pattern);
+    if (r->prefix) n--;                 /* trailing '*' */
+    else n++;                           /* exact: the terminating NUL too */
+    int off = 0;
+    while (n - off >= 4) {
+        load(BPF_W, (uint32_t)(OFF_IFNAME + off));
+        jump_unless((uint32_t)p[off] << 24 | (uint32_t)p[off + 1] << 16 | (uint32_t)p[off + 2] << 8 | p[off + 3], l_next);
+        off += 4;
+    }
+    if (n - off >= 2) {
+        load(BPF_H, (uint32_t)(OFF_IFNAME + off));
+        jump_unless((uint32_t)p[off] << 8 | p[off + 1], l_next);
+        off += 2;
+    }
+    if (n - off == 1) {
+        load(BPF_B, (uint32_t)(OFF_IFNAME + off));
+        jump_unless(p[off], l_next);
+    }
+}
+
+static int build(void) {
+    plen = 0;
+    label_count = 0;
+    fixup_count = 0;
+    overflow = 0;
+    int l_accept = new_label();
+    int l_link = new_label();
+    int l_addr = new_label();
+    int l_route = new_label();
+    int kernel_ignores = 0;
+    for (int i = 0; i < rule_count; i++) {
+        if (rules[i].type == R_IGNORE && rules[i].in_kernel) kernel_ignores++;
+    }
+    int want_addr = rule_of[R_DROP_ADDR4] || rule_of[R_DROP_ADDR6];
+    int want_route = rule_of[R_DROP_ROUTE4] || rule_of[R_DROP_ROUTE6] || table_count;
+    if (!kernel_ignores && !want_addr && !want_route) return 0;
+
+    /* dispatch on the message type; nlmsg_type is host order, BPF loads are network order */
+    load(BPF_H, OFF_TYPE);
+    /* RTM_DELLINK always passes: it is rare, and a link renamed into an
+     * ignored pattern must still leave the table when it goes away */
+    if (kernel_ignores) jump_if(htons(RTM_NEWLINK), l_link);
+    if (want_addr) {
+        jump_if(htons(RTM_NEWADDR), l_addr);
+        jump_if(htons(RTM_DELADDR), l_addr);
+    }
+    if (want_route) {
+        jump_if(htons(RTM_NEWROUTE), l_route);
+        jump_if(htons(RTM_DELROUTE), l_route);
+    }
+    ret_accept();
+
+    if (want_addr) {
+        bind_label(l_addr);
+        gen_family_drops(R_DROP_ADDR4, R_DROP_ADDR6);
+        jump(l_accept);
+    }
+
+    if (want_route) {
+        bind_label(l_route);
+        gen_family_drops(R_DROP_ROUTE4, R_DROP_ROUTE6);
+        if (table_count) {
+            int wide = 0;
+            load(BPF_B, OFF_RTM_TABLE);
+            for (int i = 0; i < table_count; i++) {
+                if (tables[i] < 256) jump_if(tables[i], l_accept);
+                else wide = 1;
+            }
+            /* ids above 255 only travel in RTA_TABLE: userspace decides */
+            if (wide) jump_if(RT_TABLE_COMPAT, l_accept);
+            ret_drop(rule_of[R_ROUTE_TABLE] - 1);
+        } else {
+            jump(l_accept);
+        }
+    }
+
+    if (kernel_ignores) {
+        bind_label(l_link);
+        /* short or unusual messages are left to userspace */
+        emit(BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+        emit(BPF_JMP | BPF_JGE | BPF_K, 1, 0, OFF_IFNAME + IFNAMSIZ);
+        jump(l_accept);
+        load(BPF_H, OFF_LINK_ATTR + 2);
+        jump_unless(htons(IFLA_IFNAME), l_accept);
+        for (int i = 0; i < rule_count; i++) {
+            if (rules[i].type != R_IGNORE || !rules[i].in_kernel) continue;
+            int next = new_label();
+            gen_name_match(&rules[i], next);
+            ret_drop(i);
+            bind_label(next);
+        }
+    }
+    /* classic BPF only jumps forward: the shared accept goes last */
+    bind_label(l_accept);
+    ret_accept();
+
+    if (overflow) return -1;
+    for (int i = 0; i < fixup_count; i++) {
+        prog[fixups[i].insn].k = (uint32_t)(label_pos[fixups[i].label] - fixups[i].insn - 1);
+    }
+    return plen;
+}
+
+int nlfilter_attach(int sock) {
+    const char *m = config_get_str("netlink_filter", "off");
+    if (strcmp(m, "on") == 0 || strcmp(m, "1") == 0) mode = NLF_ON;
+    else if (strcmp(m, "audit") == 0) mode = NLF_AUDIT;
+    else mode = NLF_OFF;
+    stats.mode = mode;
+    if (mode == NLF_OFF) return 0;
+
+    parse_list("netlink_filter_drop", drop_token);
+    parse_list("netlink_filter_route_tables", table_token);
+    parse_list("netlink_filter_ignore", ignore_token);
+    stats.rules = rule_count;
+
+    int n = build();
+    if (n < 0) {
+        log_err("nlfilter: program longer than %d instructions", NLF_MAX_INSNS);
+        return -1;
+    }
+    if (n == 0) {
+        log_info("nlfilter: no kernel-side rules");
+        return 0;
+    }
+    struct sock_fprog fp = { .len = (unsigned short)n, .filter = prog };
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fp, sizeof(fp)) < 0) {
+        log_err("nlfilter: SO_ATTACH_FILTER failed: %s", strerror(errno));
+        return -1;
+    }
+    stats.insns = n;
+    for (int i = 0; i < rule_count; i++) {
+        if (rules[i].type == R_IGNORE && rules[i].in_kernel) kernel_names = 1;
+    }
+    log_info("nlfilter: %s, %d rules, %d BPF instructions", mode == NLF_AUDIT ? "audit" : "on", rule_count, n);
+    return 0;
+}
+
+/* ---- userspace side ---- */
+
+int nlfilter_drops_links(void) {
+    return kernel_names;
+}
+
+int nlfilter_keep_link(const char *ifname) {
+    if (!ignore_count || !ifname) return 1;
+    for (int i = 0; i < rule_count; i++) {
+        if (rules[i].type == R_IGNORE && fnmatch(rules[i].pattern, ifname, 0) == 0) {
+            stats.user_dropped++;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int nlfilter_keep_addr(int family, int ifindex, int known) {
+    if (mode == NLF_OFF) return 1;
+    if ((family == AF_INET && rule_of[R_DROP_ADDR4]) || (family == AF_INET6 && rule_of[R_DROP_ADDR6])) {
+        stats.user_dropped++;
+        return 0;
+    }
+    /* link events of ignored interfaces never arrive; their addresses still do */
+    if (!known && ignore_count) {
+        char name[IFNAMSIZ];
+        if (if_indextoname((unsigned int)ifindex, name)) return nlfilter_keep_link(name);
+    }
+    return 1;
+}
+
+int nlfilter_keep_route(int family, uint32_t table) {
+    if (mode == NLF_OFF) return 1;
+    if ((family == AF_INET && rule_of[R_DROP_ROUTE4]) || (family == AF_INET6 && rule_of[R_DROP_ROUTE6])) {
+        stats.user_dropped++;
+        return 0;
+    }
+    if (!table_count) return 1;
+    for (int i = 0; i < table_count; i++) {
+        if (tables[i] == table) return 1;
+    }
+    stats.user_dropped++;
+    return 0;
+}
+
+int nlfilter_audit_marker(const void *buf, unsigned int len) {
+    if (mode != NLF_AUDIT || len <= NLMSG_HDRLEN || len > NLMSG_HDRLEN + (unsigned int)rule_count) return 0;
+    const struct nlmsghdr *nlh = buf;
+    if (nlh->nlmsg_len <= len) return 0;
+    rules[len - NLMSG_HDRLEN - 1].hits++;
+    stats.audited++;
+    return 1;
+}
+
+void nlfilter_delivered(uint16_t type) {
+    switch (type) {
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+        stats.delivered[NLF_KIND_LINK]++;
+        break;
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+        stats.delivered[NLF_KIND_ADDR]++;
+        break;
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+        stats.delivered[NLF_KIND_ROUTE]++;
+        break;
+    default:
+        stats.delivered[NLF_KIND_OTHER]++;
+        break;
+    }
+}
+
+void nlfilter_get_stats(nlfilter_stats_t *st) {
+    *st = stats;
+}
+
+int nlfilter_rule_stats(int i, nlfilter_rule_stats_t *st) {
+    if (i < 0 || i >= rule_count) return -1;
+    st->name = rules[i].name;
+    st->in_kernel = rules[i].in_kernel;
+    st->hits = rules[i].hits;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef NLFILTER_H
+#define NLFILTER_H
+
+#include <stdint.h>
+
+/*
+ * Kernel-side filtering of netlink notifications: a classic BPF program on
+ * the event socket drops what the agent does not track before it is copied
+ * or wakes anybody up (netlink_filter=on):
+ *
+ *   netlink_filter_drop=addr4 addr6 route4 route6 (or addr / route)
+ *   netlink_filter_route_tables=main local 100   routes of other tables
+ *   netlink_filter_ignore=cali* veth* tmp0       link events by name
+ *
+ * Name patterns are matched in the kernel when they are exact names or
+ * prefixes (name*); other globs only in userspace. The same rules are
+ * applied to dump replies in userspace, so the table never holds what
+ * notifications would no longer keep current. Only RTM_NEWLINK is matched
+ * by name in the kernel. When a tracked link is renamed into an ignored
+ * pattern, the kernel drops the NEWLINK carrying the new name, so the agent
+ * compares the names in its table with the kernel's periodically instead.
+ *
+ * Classic BPF cannot count what it drops. netlink_filter=audit keeps every
+ * wakeup but cuts each matching message down to a marker naming the rule,
+ * which is counted and discarded: exact per-rule numbers for validating a
+ * rule set before enforcing it.
+ */
+
+enum { NLF_OFF, NLF_ON, NLF_AUDIT };
+enum { NLF_KIND_LINK, NLF_KIND_ADDR, NLF_KIND_ROUTE, NLF_KIND_OTHER, NLF_KIND_MAX };
+
+typedef struct nlfilter_stats {
+    int mode;                          /* NLF_* */
+    int rules;
+    int insns;                         /* BPF program length, 0 if none attached */
+    uint64_t delivered[NLF_KIND_MAX];  /* notifications that reached userspace */
+    uint64_t audited;                  /* audit markers: would have been dropped */
+    uint64_t user_dropped;             /* dump replies and glob-only matches dropped in userspace */
+} nlfilter_stats_t;
+
+typedef struct nlfilter_rule_stats {
+    const char *name;
+    int in_kernel;                     /* 0: userspace only (glob) */
+    uint64_t hits;                     /* audit markers for this rule */
+} nlfilter_rule_stats_t;
+
+/* parse the netlink_filter* keys and attach the program to sock */
+int nlfilter_attach(int sock);
+
+/* 1 if the attached program drops link notifications by name */
+int nlfilter_drops_links(void);
+
+/* userspace side of the same rules; 1 = keep */
+int nlfilter_keep_link(const char *ifname);
+int nlfilter_keep_addr(int family, int ifindex, int known);
+int nlfilter_keep_route(int family, uint32_t table);
+
+/* receive path: 1 if the datagram was an audit marker (counted, discard it) */
+int nlfilter_audit_marker(const void *buf, unsigned int len);
+void nlfilter_delivered(uint16_t nlmsg_type);
+
+void nlfilter_get_stats(nlfilter_stats_t *st);
+/* 0 and st for rule i, -1 past the last rule */
+int nlfilter_rule_stats(int i, nlfilter_rule_stats_t *st);
+
+#endif
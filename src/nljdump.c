@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include "nljournal.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * nljdump: print nlagent journal segments offline.
+ *
+ *   nljdump [-d dir] [-f from] [-t to] [-i glob] [-s] [segment...]
+ *
+ * Without segment files every segment in dir (default
+ * /var/lib/nlagent/journal) is read in order. -s prints one summary line
+ * per segment instead of the records.
+ */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-d dir] [-f from] [-t to] [-i ifname glob] [-s] [segment...]\n"
+            "  times: now, -<n>s|m|h|d, unix seconds, YYYY-MM-DD[THH:MM[:SS]]\n",
+            prog);
+}
+
+static void fmt_time(uint64_t ts_ns, char *buf, size_t len) {
+    time_t sec = (time_t)(ts_ns / 1000000000ull);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+}
+
+static void summary(const char *path, const nlj_seg_t *s) {
+    char first[32] = "-", last[32] = "-";
+    if (s->hdr->count) {
+        fmt_time(s->hdr->first_ts_ns, first, sizeof(first));
+        fmt_time(s->hdr->last_ts_ns, last, sizeof(last));
+    }
+    printf("%s\tno=%llu\trecords=%llu\tused=%llu/%llu\tindex=%u/%u\t%s\tfirst=%s\tlast=%s\n", path,
+           (unsigned long long)s->hdr->seg_no, (unsigned long long)s->hdr->count,
+           (unsigned long long)s->hdr->used, (unsigned long long)s->hdr->seg_size, s->hdr->index_count,
+           s->hdr->index_cap, s->hdr->sealed ? "sealed" : "open", first, last);
+}
+
+static void dump(const nlj_seg_t *s, uint64_t from, uint64_t to, const char *glob) {
+    if (!s->hdr->count || s->hdr->first_ts_ns > to || s->hdr->last_ts_ns < from) return;
+    uint64_t off = nlj_seg_seek(s, from);
+    const nlj_rec_t *r;
+    char line[512], name[NLJ_IFNAMSIZ + 1];
+    while ((r = nlj_seg_next(s, &off)) && r->ts_ns <= to) {
+        if (glob) {
+            memcpy(name, r->ifname, NLJ_IFNAMSIZ);
+            name[NLJ_IFNAMSIZ] = '\0';
+            if (fnmatch(glob, name, 0) != 0) continue;
+        }
+        if (nlj_format(r, line, sizeof(line)) > 0) fputs(line, stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *dir = "/var/lib/nlagent/journal";
+    const char *glob = NULL;
+    uint64_t from = 0, to = UINT64_MAX;
+    int summaries = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f:t:i:sh")) != -1) {
+        switch (opt) {
+        case 'd': dir = optarg; break;
+        case 'i': glob = optarg; break;
+        case 's': summaries = 1; break;
+        case 'f':
+        case 't':
+            if (nlj_parse_time(optarg, opt == 'f' ? &from : &to) < 0) {
+                fprintf(stderr, "bad time %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    char **paths = argv + optind;
+    int npaths = argc - optind;
+    char **owned = NULL;
+    if (npaths == 0) {
+        uint64_t *nos = NULL;
+        int n = nlj_list(dir, &nos);
+        if (n < 0) {
+            fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+            return 1;
+        }
+        owned = calloc((size_t)n + 1, sizeof(*owned));
+        for (int i = 0; owned && i < n; i++) {
+            char buf[4096];
+            nlj_seg_path(buf, sizeof(buf), dir, nos[i]);
+            owned[i] = strdup(buf);
+        }
+        free(nos);
+        paths = owned;
+        npaths = owned ? n : 0;
+    }
+
+    int rc = 0;
+    for (int i = 0; i < npaths; i++) {
+        nlj_seg_t s;
+        if (!paths[i] || nlj_seg_open(&s, paths[i]) < 0) {
+            fprintf(stderr, "%s: %s\n", paths[i] ? paths[i] : "?", strerror(errno));
+            rc = 1;
+            continue;
+        }
+        if (summaries) summary(paths[i], &s);
+        else dump(&s, from, to, glob);
+        nlj_seg_close(&s);
+    }
+    if (owned) {
+        for (int i = 0; i < npaths; i++) free(owned[i]);
+        free(owned);
+    }
+    return rc;
+}
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include "nljournal.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+_Static_assert(sizeof(nlj_header_t) == 128, "nlj header layout");
+_Static_assert(sizeof(nlj_rec_t) % 8 == 0 && sizeof(nlj_link_t) % 8 == 0 &&
+               sizeof(nlj_addr_t) % 8 == 0 && sizeof(nlj_route_t) % 8 == 0, "nlj records are 8-aligned");
+
+void nlj_seg_path(char *buf, size_t len, const char *dir, uint64_t no) {
+    snprintf(buf, len, "%s/" NLJ_SEG_PREFIX "%016llx" NLJ_SEG_SUFFIX, dir, (unsigned long long)no);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int nlj_list(const char *dir, uint64_t **nos) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    uint64_t *v = NULL;
+    int n = 0, cap = 0;
+    struct dirent *de;
+    size_t plen = strlen(NLJ_SEG_PREFIX), slen = strlen(NLJ_SEG_SUFFIX);
+    while ((de = readdir(d))) {
+        size_t len = strlen(de->d_name);
+        if (len != plen + 16 + slen || strncmp(de->d_name, NLJ_SEG_PREFIX, plen) != 0 ||
+            strcmp(de->d_name + plen + 16, NLJ_SEG_SUFFIX) != 0) {
+            continue;
+        }
+        char hex[17];
+        memcpy(hex, de->d_name + plen, 16);
+        hex[16] = '\0';
+        char *end;
+        uint64_t no = strtoull(hex, &end, 16);
+        if (*end) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            uint64_t *p = realloc(v, (size_t)cap * sizeof(*p));
+            if (!p) {
+                free(v);
+                closedir(d);
+                return -1;
+            }
+            v = p;
+        }
+        v[n++] = no;
+    }
+    closedir(d);
+    if (n) qsort(v, (size_t)n, sizeof(*v), cmp_u64);
+    *nos = v;
+    return n;
+}
+
+int nlj_seg_attach(nlj_seg_t *s, const void *base, size_t size) {
+    const nlj_header_t *h = base;
+    memset(s, 0, sizeof(*s));
+    if (size < sizeof(*h) || h->magic != NLJ_MAGIC || h->version != NLJ_VERSION ||
+        h->seg_size > size || h->data_off > h->seg_size || h->index_off < sizeof(*h) ||
+        h->index_off + (uint64_t)h->index_cap * sizeof(nlj_index_t) > h->data_off) {
+        errno = EPROTO;
+        return -1;
+    }
+    s->base = base;
+    s->size = size;
+    s->hdr = h;
+    return 0;
+}
+
+int nlj_seg_open(nlj_seg_t *s, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(nlj_header_t)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    if (nlj_seg_attach(s, p, (size_t)st.st_size) < 0) {
+        munmap(p, (size_t)st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+    s->mapped = 1;
+    return 0;
+}
+
+void nlj_seg_close(nlj_seg_t *s) {
+    if (s->mapped && s->base) munmap((void *)s->base, s->size);
+    memset(s, 0, sizeof(*s));
+}
+
+static uint64_t used_of(const nlj_seg_t *s) {
+    uint64_t used = __atomic_load_n(&s->hdr->used, __ATOMIC_ACQUIRE);
+    return used > s->hdr->seg_size ? s->hdr->seg_size : used;
+}
+
+uint64_t nlj_seg_seek(const nlj_seg_t *s, uint64_t ts_ns) {
+    const nlj_index_t *ix = (const nlj_index_t *)(s->base + s->hdr->index_off);
+    uint32_t n = __atomic_load_n(&s->hdr->index_count, __ATOMIC_ACQUIRE);
+    if (n > s->hdr->index_cap) n = s->hdr->index_cap;
+    /* last index entry before ts_ns, then walk at most a stride of records */
+    uint64_t off = s->hdr->data_off;
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ix[mid].ts_ns < ts_ns) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0 && ix[lo - 1].off >= s->hdr->data_off) off = ix[lo - 1].off;
+    uint64_t cur = off;
+    const nlj_rec_t *r;
+    while ((r = nlj_seg_next(s, &cur))) {
+        if (r->ts_ns >= ts_ns) return cur - r->len;
+    }
+    return cur;
+}
+
+const nlj_rec_t *nlj_seg_next(const nlj_seg_t *s, uint64_t *off) {
+    uint64_t used = used_of(s);
+    if (*off + sizeof(nlj_rec_t) > used) return NULL;
+    const nlj_rec_t *r = (const nlj_rec_t *)(s->base + *off);
+    if (r->len < sizeof(nlj_rec_t) || (r->len & 7) || *off + r->len > used) return NULL;
+    *off += r->len;
+    return r;
+}
+
+static const char *oper_names[] = {
+    "unknown", "notpresent", "down", "lowerlayerdown", "testing", "dormant", "up"
+};
+
+static const char *op_name(const nlj_rec_t *r) {
+    switch (r->op) {
+    case NLJ_OP_NEW: return r->type == NLJ_T_LINK ? "new" : "add";
+    case NLJ_OP_CHANGE: return "change";
+    case NLJ_OP_DEL: return "del";
+    case NLJ_OP_RENAME: return "rename";
+    default: return "?";
+    }
+}
+
+int nlj_format(const nlj_rec_t *r, char *buf, size_t len) {
+    char when[48], name[NLJ_IFNAMSIZ + 1];
+    time_t sec = (time_t)(r->ts_ns / 1000000000ull);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    size_t w = strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf(when + w, sizeof(when) - w, ".%06llu", (unsigned long long)(r->ts_ns % 1000000000ull / 1000));
+    memcpy(name, r->ifname, NLJ_IFNAMSIZ);
+    name[NLJ_IFNAMSIZ] = '\0';
+
+    switch (r->type) {
+    case NLJ_T_LINK: {
+        const nlj_link_t *l = (const nlj_link_t *)r;
+        if (r->len < sizeof(*l)) break;
+        if (r->op == NLJ_OP_DEL) return snprintf(buf, len, "%s link del %s idx=%d\n", when, name, r->ifindex);
+        if (r->op == NLJ_OP_RENAME) {
+            char old[NLJ_IFNAMSIZ + 1];
+            memcpy(old, l->old_ifname, NLJ_IFNAMSIZ);
+            old[NLJ_IFNAMSIZ] = '\0';
+            return snprintf(buf, len, "%s link rename %s idx=%d from=%s\n", when, name, r->ifindex, old);
+        }
+        const char *oper = l->operstate < sizeof(oper_names) / sizeof(oper_names[0]) ? oper_names[l->operstate] : "?";
+        int n = snprintf(buf, len, "%s link %s %s idx=%d %s admin=%s mtu=%u oper=%s", when, op_name(r), name,
+                         r->ifindex, l->up ? "running" : "down", (l->flags & IFF_UP) ? "up" : "down", l->mtu, oper);
+        if (n < 0 || (size_t)n >= len) return n;
+        if (l->transitions) return n + snprintf(buf + n, len - (size_t)n, " transitions=%u\n", l->transitions);
+        return n + snprintf(buf + n, len - (size_t)n, "\n");
+    }
+    case NLJ_T_ADDR: {
+        const nlj_addr_t *a = (const nlj_addr_t *)r;
+        if (r->len < sizeof(*a)) break;
+        char addr[INET6_ADDRSTRLEN];
+        if (!inet_ntop(a->family, a->addr, addr, sizeof(addr))) snprintf(addr, sizeof(addr), "?");
+        return snprintf(buf, len, "%s addr %s %s idx=%d %s/%u\n", when, op_name(r), name, r->ifindex, addr,
+                        a->prefixlen);
+    }
+    case NLJ_T_ROUTE: {
+        const nlj_route_t *rt = (const nlj_route_t *)r;
+        if (r->len < sizeof(*rt)) break;
+        char dst[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN + 5] = "", dev[NLJ_IFNAMSIZ + 16] = "-";
+        if (!inet_ntop(rt->family, rt->dst, dst, sizeof(dst))) snprintf(dst, sizeof(dst), "?");
+        if (name[0]) snprintf(dev, sizeof(dev), "%s", name);
+        else if (r->ifindex) snprintf(dev, sizeof(dev), "if%d", r->ifindex);
+        if (rt->gw_family) {
+            char a[INET6_ADDRSTRLEN];
+            if (inet_ntop(rt->gw_family, rt->gw, a, sizeof(a))) snprintf(gw, sizeof(gw), " via %s", a);
+        }
+        return snprintf(buf, len, "%s route %s %s/%u table=%u dev=%s%s proto=%u metric=%u%s\n", when,
+                        op_name(r), dst, rt->dst_len, rt->table, dev, gw, rt->protocol, rt->priority,
+                        rt->nh_count > 1 ? " multipath" : "");
+    }
+    case NLJ_T_RESYNC:
+        return snprintf(buf, len, "%s resync\n", when);
+    }
+    return snprintf(buf, len, "%s unknown record type=%u len=%u\n", when, r->type, r->len);
+}
+
+int nlj_parse_time(const char *s, uint64_t *ts_ns) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    char *end;
+
+    if (strcmp(s, "now") == 0) {
+        *ts_ns = now_ns;
+        return 0;
+    }
+    if (s[0] == '-') {
+        unsigned long long n = strtoull(s + 1, &end, 10);
+        uint64_t unit;
+        switch (*end) {
+        case 's': case '\0': unit = 1; break;
+        case 'm': unit = 60; break;
+        case 'h': unit = 3600; break;
+        case 'd': unit = 86400; break;
+        default: return -1;
+        }
+        if (end == s + 1 || (*end && end[1])) return -1;
+        uint64_t back = (uint64_t)n * unit * 1000000000ull;
+        *ts_ns = back < now_ns ? now_ns - back : 0;
+        return 0;
+    }
+    int digits = 1;
+    for (const char *p = s; *p; p++) digits &= isdigit((unsigned char)*p) != 0;
+    if (digits && s[0]) {
+        *ts_ns = (uint64_t)strtoull(s, NULL, 10) * 1000000000ull;
+        return 0;
+    }
+    static const char *formats[] = { "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d" };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, formats[i], &tm);
+        if (!end || *end) continue;
+        tm.tm_isdst = -1;
+        time_t t = mktime(&tm);
+        if (t < 0) return -1;
+        *ts_ns = (uint64_t)t * 1000000000ull;
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,129 @@
+#ifndef NLJOURNAL_H
+#define NLJOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * nlagent event journal: link, address and route changes as fixed-layout
+ * binary records in size-bounded segment files <journal_dir>/seg-<no>.nlj,
+ * each with its own time index. The reader functions below are what the
+ * "events" command and nljdump use.
+ *
+ * A segment is a file of seg_size bytes (host byte order): the header, the
+ * time index at index_off (index_cap entries) and records from data_off.
+ * Every NLJ_INDEX_STRIDE-th record gets an index entry {ts_ns, off}. The
+ * writer stores a record (and its index entry) first and then publishes it
+ * by a release store of used (index_count); readers load used with acquire
+ * and only look at records below it, so a segment may be read while it is
+ * being written. Timestamps never decrease, across segments too, and
+ * segment numbers increase; sealed is set once the writer has moved on.
+ * The oldest segments are deleted beyond journal_segments.
+ */
+
+#define NLJ_MAGIC 0x314a4c4eu          /* "NLJ1" little-endian */
+#define NLJ_VERSION 1
+#define NLJ_IFNAMSIZ 16
+#define NLJ_INDEX_STRIDE 64            /* records between time index entries */
+#define NLJ_SEG_PREFIX "seg-"
+#define NLJ_SEG_SUFFIX ".nlj"
+
+typedef struct nlj_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t data_off;                 /* first record */
+    uint32_t index_off;                /* first nlj_index_t */
+    uint32_t index_cap;
+    uint32_t index_count;              /* published after the entry */
+    uint64_t seg_size;                 /* file size */
+    uint64_t seg_no;
+    uint64_t used;                     /* end of the last complete record, published last */
+    uint64_t count;                    /* records */
+    uint64_t first_ts_ns;
+    uint64_t last_ts_ns;
+    uint32_t sealed;                   /* 1: the writer moved on to the next segment */
+    uint32_t reserved[13];
+} nlj_header_t;                        /* 128 bytes */
+
+typedef struct nlj_index {
+    uint64_t ts_ns;
+    uint64_t off;                      /* record with this timestamp */
+} nlj_index_t;
+
+enum { NLJ_T_LINK = 1, NLJ_T_ADDR = 2, NLJ_T_ROUTE = 3, NLJ_T_RESYNC = 4 };
+enum { NLJ_OP_NEW = 1, NLJ_OP_CHANGE = 2, NLJ_OP_DEL = 3, NLJ_OP_RENAME = 4 };
+
+/* common record header; len is a multiple of 8 */
+typedef struct nlj_rec {
+    uint16_t len;
+    uint8_t type;                      /* NLJ_T_* */
+    uint8_t op;                        /* NLJ_OP_* */
+    int32_t ifindex;
+    uint64_t ts_ns;                    /* CLOCK_REALTIME, never decreasing within a journal */
+    char ifname[NLJ_IFNAMSIZ];
+} nlj_rec_t;
+
+typedef struct nlj_link {
+    nlj_rec_t h;
+    uint32_t flags;                    /* IFF_* */
+    uint32_t mtu;
+    uint8_t operstate;                 /* IF_OPER_* */
+    uint8_t up;                        /* IFF_RUNNING */
+    uint16_t reserved;
+    uint32_t transitions;              /* up/down flips merged into this change */
+    char old_ifname[NLJ_IFNAMSIZ];     /* NLJ_OP_RENAME */
+} nlj_link_t;
+
+typedef struct nlj_addr {
+    nlj_rec_t h;
+    uint8_t family;                    /* AF_INET / AF_INET6 */
+    uint8_t prefixlen;
+    uint16_t reserved;
+    uint32_t flags;                    /* IFA_F_* */
+    uint8_t addr[16];                  /* network byte order */
+} nlj_addr_t;
+
+typedef struct nlj_route {
+    nlj_rec_t h;                       /* ifindex/ifname: first next hop */
+    uint32_t table;
+    uint32_t priority;
+    uint8_t family;
+    uint8_t dst_len;
+    uint8_t protocol;                  /* RTPROT_* */
+    uint8_t scope;
+    uint8_t type;                      /* RTN_* */
+    uint8_t gw_family;                 /* 0: no gateway */
+    uint16_t nh_count;
+    uint8_t dst[16];
+    uint8_t gw[16];
+} nlj_route_t;
+
+/* ---- readers ---- */
+
+typedef struct nlj_seg {
+    const uint8_t *base;
+    size_t size;
+    const nlj_header_t *hdr;
+    int mapped;                        /* 1: nlj_seg_open mapped it */
+} nlj_seg_t;
+
+void nlj_seg_path(char *buf, size_t len, const char *dir, uint64_t no);
+/* segment numbers found in dir, ascending, in a malloc'd array; -1 on error */
+int nlj_list(const char *dir, uint64_t **nos);
+
+int nlj_seg_open(nlj_seg_t *s, const char *path);
+/* validate a mapping the caller already holds */
+int nlj_seg_attach(nlj_seg_t *s, const void *base, size_t size);
+void nlj_seg_close(nlj_seg_t *s);
+
+/* offset of the first record at or after ts_ns */
+uint64_t nlj_seg_seek(const nlj_seg_t *s, uint64_t ts_ns);
+/* record at *off and advance; NULL at the end of the committed records */
+const nlj_rec_t *nlj_seg_next(const nlj_seg_t *s, uint64_t *off);
+
+/* one text line with a trailing newline; length as snprintf */
+int nlj_format(const nlj_rec_t *r, char *buf, size_t len);
+/* now, -<n>[smhd], <unix seconds>, YYYY-MM-DD[THH:MM[:SS]] (local time) */
+int nlj_parse_time(const char *s, uint64_t *ts_ns);
+
+#endif
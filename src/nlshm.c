@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include "nlshm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* a writer holds a seqlock for one record copy or one batch of index
+ * updates; give up (EAGAIN) rather than spin forever on a dead writer */
+#define NLSHM_SPIN_MAX (1u << 20)
+
+struct nlshm {
+    char path[256];
+    const uint8_t *base;
+    size_t size;
+    const nlshm_header_t *hdr;
+    const nlshm_record_t *recs;
+    const nlshm_index_t *by_index;
+    const nlshm_index_t *by_name;
+    uint32_t capacity;
+    uint32_t mask;
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void unmap(nlshm_t *h) {
+    if (h->base) munmap((void *)h->base, h->size);
+    h->base = NULL;
+    h->hdr = NULL;
+}
+
+static int map(nlshm_t *h) {
+    int fd = open(h->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(nlshm_header_t)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    const nlshm_header_t *hdr = p;
+    uint64_t idx_bytes = (uint64_t)hdr->index_size * sizeof(nlshm_index_t);
+    if (hdr->magic != NLSHM_MAGIC || hdr->version != NLSHM_VERSION ||
+        hdr->record_size != sizeof(nlshm_record_t) || hdr->total_size > (uint64_t)st.st_size ||
+        hdr->index_size == 0 || (hdr->index_size & (hdr->index_size - 1)) != 0 ||
+        hdr->records_off + (uint64_t)hdr->capacity * sizeof(nlshm_record_t) > hdr->total_size ||
+        hdr->ifindex_index_off + idx_bytes > hdr->total_size ||
+        hdr->name_index_off + idx_bytes > hdr->total_size) {
+        munmap(p, (size_t)st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+    h->base = p;
+    h->size = (size_t)st.st_size;
+    h->hdr = hdr;
+    h->recs = (const nlshm_record_t *)(h->base + hdr->records_off);
+    h->by_index = (const nlshm_index_t *)(h->base + hdr->ifindex_index_off);
+    h->by_name = (const nlshm_index_t *)(h->base + hdr->name_index_off);
+    h->capacity = hdr->capacity;
+    h->mask = hdr->index_size - 1;
+    return 0;
+}
+
+/* the mapping is current; reopen (the only system calls) after the writer replaced it */
+static int ensure(nlshm_t *h) {
+    if (h->hdr && !__atomic_load_n(&h->hdr->stale, __ATOMIC_ACQUIRE)) return 0;
+    unmap(h);
+    return map(h);
+}
+
+nlshm_t *nlshm_open(const char *path) {
+    if (!path) path = NLSHM_DEFAULT_PATH;
+    if (strlen(path) >= sizeof(((nlshm_t *)0)->path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    nlshm_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    snprintf(h->path, sizeof(h->path), "%s", path);
+    if (map(h) < 0) {
+        int e = errno;
+        free(h);
+        errno = e;
+        return NULL;
+    }
+    return h;
+}
+
+void nlshm_close(nlshm_t *h) {
+    if (!h) return;
+    unmap(h);
+    free(h);
+}
+
+/* consistent copy of one slot: 1 in use, 0 free, -1 writer stuck */
+static int read_record(const nlshm_record_t *r, nlshm_iface_t *out) {
+    for (uint32_t spin = 0; spin < NLSHM_SPIN_MAX; spin++) {
+        uint32_t s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            cpu_relax();
+            continue;
+        }
+        memcpy(out, &r->d, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == s1) {
+            out->ifname[NLSHM_IFNAMSIZ - 1] = '\0';
+            return out->ifindex != 0;
+        }
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+typedef int (*key_match_fn)(const nlshm_iface_t *d, const void *key);
+
+static int match_index(const nlshm_iface_t *d, const void *key) {
+    return d->ifindex == *(const int *)key;
+}
+
+static int match_name(const nlshm_iface_t *d, const void *key) {
+    return strncmp(d->ifname, key, NLSHM_IFNAMSIZ) == 0;
+}
+
+/*
+ * Probe one index. A hit is trusted on its own: the record was copied under
+ * its seqlock and carries the key. A miss is trusted only if the indexes
+ * did not change during the probe (dir_seq).
+ */
+static int lookup(nlshm_t *h, const nlshm_index_t *ix, uint32_t hash,
+                  key_match_fn match, const void *key, nlshm_iface_t *out) {
+    for (uint32_t spin = 0; spin < NLSHM_SPIN_MAX; spin++) {
+        uint32_t d1 = __atomic_load_n(&h->hdr->dir_seq, __ATOMIC_ACQUIRE);
+        if (d1 & 1) {
+            cpu_relax();
+            continue;
+        }
+        uint32_t i = hash & h->mask;
+        for (uint32_t n = 0; n <= h->mask; n++, i = (i + 1) & h->mask) {
+            uint32_t slot = __atomic_load_n(&ix[i].slot, __ATOMIC_RELAXED);
+            if (!slot) break;
+            if (__atomic_load_n(&ix[i].hash, __ATOMIC_RELAXED) != hash || slot > h->capacity) continue;
+            int rc = read_record(&h->recs[slot - 1], out);
+            if (rc < 0) return -1;
+            if (rc == 1 && match(out, key)) return 0;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&h->hdr->dir_seq, __ATOMIC_RELAXED) == d1) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+int nlshm_get_by_index(nlshm_t *h, int ifindex, nlshm_iface_t *out) {
+    if (ensure(h) < 0) return -1;
+    return lookup(h, h->by_index, nlshm_hash_index(ifindex), match_index, &ifindex, out);
+}
+
+int nlshm_get_by_name(nlshm_t *h, const char *ifname, nlshm_iface_t *out) {
+    if (ensure(h) < 0) return -1;
+    return lookup(h, h->by_name, nlshm_hash_name(ifname), match_name, ifname, out);
+}
+
+int nlshm_foreach(nlshm_t *h, int (*cb)(const nlshm_iface_t *iface, void *arg), void *arg) {
+    if (ensure(h) < 0) return -1;
+    uint32_t hw = __atomic_load_n(&h->hdr->high_water, __ATOMIC_ACQUIRE);
+    if (hw > h->capacity) hw = h->capacity;
+    int visited = 0;
+    nlshm_iface_t d;
+    for (uint32_t s = 0; s < hw; s++) {
+        int rc = read_record(&h->recs[s], &d);
+        if (rc < 0) return -1;
+        if (rc == 0) continue;
+        visited++;
+        if (cb(&d, arg)) break;
+    }
+    return visited;
+}
+
+uint64_t nlshm_table_gen(nlshm_t *h) {
+    if (ensure(h) < 0) return 0;
+    return __atomic_load_n(&h->hdr->table_gen, __ATOMIC_ACQUIRE);
+}
+
+uint64_t nlshm_data_gen(nlshm_t *h) {
+    if (ensure(h) < 0) return 0;
+    return __atomic_load_n(&h->hdr->data_gen, __ATOMIC_ACQUIRE);
+}
+
+uint64_t nlshm_age_ms(nlshm_t *h) {
+    if (ensure(h) < 0) return UINT64_MAX;
+    uint64_t hb = __atomic_load_n(&h->hdr->heartbeat_ms, __ATOMIC_ACQUIRE);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);   /* vDSO, no system call */
+    uint64_t now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+    return now > hb ? now - hb : 0;
+}
@@ -0,0 +1,148 @@
+#ifndef NLSHM_H
+#define NLSHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * nlagent shared-memory interface table (shm_path, default /dev/shm/nlagent).
+ *
+ * Layout, all offsets from the start of the mapping:
+ *
+ *   header        nlshm_header_t, one page
+ *   records       capacity x nlshm_record_t (one slot per interface, stable
+ *                 while the interface exists; ifindex 0 = free)
+ *   ifindex index index_size x nlshm_index_t, open addressing on ifindex
+ *   name index    index_size x nlshm_index_t, open addressing on ifname
+ *
+ * Every record carries its own seqlock: seq is odd while nlagent rewrites
+ * it, and a copy taken between two equal even reads is consistent. The two
+ * indexes are covered by dir_seq in the same way. When the table outgrows
+ * the region nlagent writes a larger one, renames it over shm_path and sets
+ * stale in the old header; on shutdown it sets stale and unlinks the file.
+ *
+ * The reader functions below do no system calls on the read path; they
+ * reopen the region only after it was replaced.
+ *
+ * Link with -lnlshm (libnlshm.a); the header has no other dependencies.
+ */
+
+#define NLSHM_MAGIC 0x48534c4eu        /* "NLSH" little-endian */
+#define NLSHM_VERSION 1
+#define NLSHM_MAX_ADDRS 8
+#define NLSHM_IFNAMSIZ 16
+#define NLSHM_DEFAULT_PATH "/dev/shm/nlagent"
+
+typedef struct nlshm_addr {
+    uint8_t family;                    /* AF_INET / AF_INET6 */
+    uint8_t prefixlen;
+    uint16_t reserved;
+    uint32_t flags;                    /* IFA_F_* */
+    uint8_t addr[16];                  /* network byte order */
+} nlshm_addr_t;
+
+typedef struct nlshm_counters {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_fifo_errors;
+    uint64_t tx_fifo_errors;
+    uint64_t multicast;
+} nlshm_counters_t;
+
+typedef struct nlshm_iface {
+    int32_t ifindex;                   /* 0: free slot */
+    char ifname[NLSHM_IFNAMSIZ];
+    uint32_t flags;                    /* IFF_* */
+    uint32_t mtu;
+    uint8_t operstate;                 /* IF_OPER_* */
+    uint8_t up;                        /* IFF_RUNNING */
+    uint8_t naddr;                     /* entries in addrs */
+    uint8_t reserved;
+    uint32_t naddr_total;              /* may exceed NLSHM_MAX_ADDRS */
+    uint32_t flaps;
+    uint64_t gen;                      /* changes whenever this record changes */
+    nlshm_counters_t stats;
+    nlshm_addr_t addrs[NLSHM_MAX_ADDRS];
+} nlshm_iface_t;
+
+typedef struct nlshm_record {
+    uint32_t seq;
+    uint32_t reserved;
+    nlshm_iface_t d;
+} __attribute__((aligned(64))) nlshm_record_t;
+
+typedef struct nlshm_index {
+    uint32_t hash;
+    uint32_t slot;                     /* record slot + 1, 0: empty */
+} nlshm_index_t;
+
+typedef struct nlshm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t capacity;                 /* record slots */
+    uint32_t index_size;               /* entries per index, power of two */
+    uint64_t records_off;
+    uint64_t ifindex_index_off;
+    uint64_t name_index_off;
+    uint64_t total_size;
+    int32_t writer_pid;
+    uint32_t stale;                    /* 1: replaced or writer gone, reopen */
+    uint32_t dir_seq;                  /* odd while the indexes change */
+    uint32_t high_water;               /* slots [0, high_water) may be in use */
+    uint32_t count;                    /* interfaces */
+    uint32_t reserved;
+    uint64_t table_gen;                /* interfaces came, went or were renamed */
+    uint64_t data_gen;                 /* any record changed */
+    uint64_t heartbeat_ms;             /* CLOCK_MONOTONIC ms of the last update */
+} nlshm_header_t;
+
+/* FNV-1a, shared by writer and readers for the indexes */
+static inline uint32_t nlshm_hash_name(const char *s) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < NLSHM_IFNAMSIZ && s[i]; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+static inline uint32_t nlshm_hash_index(int32_t ifindex) {
+    uint32_t x = (uint32_t)ifindex;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+/* ---- reader library ---- */
+
+typedef struct nlshm nlshm_t;
+
+/* map the region read-only (path NULL: NLSHM_DEFAULT_PATH); NULL with errno on failure */
+nlshm_t *nlshm_open(const char *path);
+void nlshm_close(nlshm_t *h);
+
+/* 0 and a consistent copy in out, -1 if not present (errno ENOENT) or
+ * the region is unavailable */
+int nlshm_get_by_index(nlshm_t *h, int ifindex, nlshm_iface_t *out);
+int nlshm_get_by_name(nlshm_t *h, const char *ifname, nlshm_iface_t *out);
+
+/* every interface, each copy consistent on its own; cb returns non-zero to
+ * stop. Returns the number of interfaces visited, -1 if unavailable */
+int nlshm_foreach(nlshm_t *h, int (*cb)(const nlshm_iface_t *iface, void *arg), void *arg);
+
+/* cheap change detection: equal values mean nothing changed in between */
+uint64_t nlshm_table_gen(nlshm_t *h);
+uint64_t nlshm_data_gen(nlshm_t *h);
+
+/* milliseconds since nlagent last touched the region, UINT64_MAX if unavailable */
+uint64_t nlshm_age_ms(nlshm_t *h);
+
+#endif
@@ -0,0 +1,761 @@
+#define _GNU_SOURCE
+#include "openmetrics.h"
+#include "parser.h"
+#include "reactor.h"
+#include "buffer.h"
+#include "config.h"
+#include "logger.h"
+#include "netlink.h"
+#include "coalesce.h"
+#include "sched.h"
+#include "history.h"
+#include "alert.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#define OM_LISTEN_DEFAULT "127.0.0.1:9417"
+#define OM_STEP_DEFAULT 4096
+#define OM_MAX_CLIENTS_DEFAULT 16
+#define OM_REQ_MAX 4096
+/* bytes written to one client per wakeup */
+#define OM_SEND_BUDGET (1u << 20)
+#define OM_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* ---- per-interface families ---- */
+
+typedef struct om_family {
+    const char *name;
+    const char *type;                  /* counters get a _total sample name */
+    const char *help;
+    int width;                         /* digits of the fixed value field */
+    uint64_t (*get)(const iface_info_t *inf);
+} om_family_t;
+
+static uint64_t get_up(const iface_info_t *inf)        { return inf->up ? 1 : 0; }
+static uint64_t get_admin_up(const iface_info_t *inf)  { return (inf->flags & IFF_UP) ? 1 : 0; }
+static uint64_t get_operstate(const iface_info_t *inf) { return inf->operstate; }
+static uint64_t get_mtu(const iface_info_t *inf)       { return inf->mtu; }
+static uint64_t get_flaps(const iface_info_t *inf)     { return inf->flaps; }
+
+static uint64_t count_addrs(const iface_info_t *inf, int family) {
+    uint64_t n = 0;
+    for (int i = 0; i < inf->addrs.count; i++) {
+        if (inf->addrs.items[i].family == family) n++;
+    }
+    return n;
+}
+static uint64_t get_ipv4(const iface_info_t *inf) { return count_addrs(inf, AF_INET); }
+static uint64_t get_ipv6(const iface_info_t *inf) { return count_addrs(inf, AF_INET6); }
+
+#define COUNTER_GETTER(field) \
+    static uint64_t get_##field(const iface_info_t *inf) { return inf->stats.field; }
+COUNTER_GETTER(rx_bytes)
+COUNTER_GETTER(tx_bytes)
+COUNTER_GETTER(rx_packets)
+COUNTER_GETTER(tx_packets)
+COUNTER_GETTER(rx_err)
+COUNTER_GETTER(tx_err)
+COUNTER_GETTER(rx_dropped)
+COUNTER_GETTER(tx_dropped)
+COUNTER_GETTER(rx_fifo)
+COUNTER_GETTER(tx_fifo)
+COUNTER_GETTER(multicast)
+
+static const om_family_t families[] = {
+    { "nlagent_iface_up", "gauge", "Carrier up (IFF_RUNNING).", 1, get_up },
+    { "nlagent_iface_admin_up", "gauge", "Administratively up (IFF_UP).", 1, get_admin_up },
+    { "nlagent_iface_operstate", "gauge", "RFC 2863 operational state (IF_OPER_*).", 3, get_operstate },
+    { "nlagent_iface_mtu_bytes", "gauge", "Interface MTU.", 10, get_mtu },
+    { "nlagent_iface_flaps", "counter", "Carrier transitions seen by the agent.", 10, get_flaps },
+    { "nlagent_iface_ipv4_addresses", "gauge", "IPv4 addresses configured.", 5, get_ipv4 },
+    { "nlagent_iface_ipv6_addresses", "gauge", "IPv6 addresses configured.", 5, get_ipv6 },
+    { "nlagent_iface_receive_bytes", "counter", "Bytes received.", 20, get_rx_bytes },
+    { "nlagent_iface_transmit_bytes", "counter", "Bytes transmitted.", 20, get_tx_bytes },
+    { "nlagent_iface_receive_packets", "counter", "Packets received.", 20, get_rx_packets },
+    { "nlagent_iface_transmit_packets", "counter", "Packets transmitted.", 20, get_tx_packets },
+    { "nlagent_iface_receive_errors", "counter", "Receive errors.", 20, get_rx_err },
+    { "nlagent_iface_transmit_errors", "counter", "Transmit errors.", 20, get_tx_err },
+    { "nlagent_iface_receive_dropped", "counter", "Received packets dropped.", 20, get_rx_dropped },
+    { "nlagent_iface_transmit_dropped", "counter", "Transmit packets dropped.", 20, get_tx_dropped },
+    { "nlagent_iface_receive_fifo_errors", "counter", "Receive FIFO overruns.", 20, get_rx_fifo },
+    { "nlagent_iface_transmit_fifo_errors", "counter", "Transmit FIFO errors.", 20, get_tx_fifo },
+    { "nlagent_iface_receive_multicast_packets", "counter", "Multicast packets received.", 20, get_multicast },
+};
+#define OM_FAMILIES (int)(sizeof(families) / sizeof(families[0]))
+
+/* ---- rendered body ---- */
+
+typedef struct om_seg {
+    char *data;
+    size_t len;
+    size_t cap;
+} om_seg_t;
+
+/* one segment per family; shared by reference with the clients sending it */
+typedef struct om_body {
+    int refs;
+    size_t bytes;
+    om_seg_t seg[OM_FAMILIES];
+} om_body_t;
+
+/* where an interface's values live in the body */
+typedef struct om_slot {
+    int ifindex;
+    uint32_t gen;                      /* iface gen the values were written for */
+    uint32_t voff[OM_FAMILIES];
+} om_slot_t;
+
+typedef struct om_conn {
+    reactor_handler_t h;
+    int fd;
+    int state;
+    size_t in_len;
+    char in[OM_REQ_MAX];
+    obuf_t out;                        /* headers and self-stats, then "# EOF" */
+    om_body_t *body;                   /* NULL once sent */
+    int seg;
+    size_t off;
+    struct om_conn *next_wait;
+} om_conn_t;
+
+enum { CONN_READ, CONN_WAIT, CONN_SEND };
+enum { JOB_IDLE, JOB_LAYOUT, JOB_PATCH };
+
+static int listen_fd = -1;
+static void listen_event(reactor_handler_t *h, uint32_t events);
+static reactor_handler_t listen_handler = { .fd = -1, .cb = listen_event };
+static int max_clients = OM_MAX_CLIENTS_DEFAULT;
+static int step_size = OM_STEP_DEFAULT;
+
+static om_body_t *body = NULL;         /* current layout */
+static om_slot_t *slots = NULL;
+static int slot_count = 0;
+static uint32_t layout_gen = 0;
+static int layout_valid = 0;
+
+static int job = JOB_IDLE;
+static int job_pos = 0;
+static om_body_t *job_body = NULL;     /* layout being built */
+static om_slot_t *job_slots = NULL;
+static int job_slot_count = 0;
+static int *job_ifindex = NULL;        /* table snapshot the layout walks */
+static int job_n = 0;
+static uint32_t job_gen = 0;
+static reactor_timer_t step_timer;
+static om_conn_t *waiting = NULL;
+
+static om_seg_t self;                  /* self-stats, rendered per scrape */
+static om_stats_t stats;
+
+static int seg_reserve(om_seg_t *s, size_t more) {
+    if (s->len + more <= s->cap) return 0;
+    size_t cap = s->cap ? s->cap : 4096;
+    while (cap < s->len + more) cap *= 2;
+    char *n = realloc(s->data, cap);
+    if (!n) return -1;
+    s->data = n;
+    s->cap = cap;
+    return 0;
+}
+
+static int seg_printf(om_seg_t *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static int seg_printf(om_seg_t *s, const char *fmt, ...) {
+    va_list ap;
+    if (seg_reserve(s, 256) < 0) return -1;
+    va_start(ap, fmt);
+    int n = vsnprintf(s->data + s->len, s->cap - s->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+    if ((size_t)n >= s->cap - s->len) {
+        /* longer than the headroom: grow and format again */
+        if (seg_reserve(s, (size_t)n + 1) < 0) return -1;
+        va_start(ap, fmt);
+        vsnprintf(s->data + s->len, (size_t)n + 1, fmt, ap);
+        va_end(ap);
+    }
+    s->len += (size_t)n;
+    return n;
+}
+
+static void body_release(om_body_t *b) {
+    if (!b || --b->refs > 0) return;
+    for (int f = 0; f < OM_FAMILIES; f++) free(b->seg[f].data);
+    free(b);
+}
+
+static om_body_t *body_new(void) {
+    om_body_t *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->refs = 1;
+    for (int f = 0; f < OM_FAMILIES; f++) {
+        const om_family_t *fam = &families[f];
+        if (seg_printf(&b->seg[f], "# TYPE %s %s\n# HELP %s %s\n",
+                       fam->name, fam->type, fam->name, fam->help) < 0) {
+            body_release(b);
+            return NULL;
+        }
+    }
+    return b;
+}
+
+static om_body_t *body_clone(const om_body_t *src) {
+    om_body_t *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->refs = 1;
+    b->bytes = src->bytes;
+    for (int f = 0; f < OM_FAMILIES; f++) {
+        if (seg_reserve(&b->seg[f], src->seg[f].len) < 0) {
+            body_release(b);
+            return NULL;
+        }
+        memcpy(b->seg[f].data, src->seg[f].data, src->seg[f].len);
+        b->seg[f].len = src->seg[f].len;
+    }
+    return b;
+}
+
+/* v as exactly width digits, zero padded (saturating) */
+static void put_padded(char *p, uint64_t v, int width) {
+    uint64_t limit = 1;
+    for (int i = 0; i < width && limit <= UINT64_MAX / 10; i++) limit *= 10;
+    if (width < 20 && v >= limit) v = limit - 1;
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+}
+
+/* label value escaping: backslash, double quote, newline */
+static void escape_label(const char *in, char *out, size_t len) {
+    size_t o = 0;
+    for (; *in && o + 3 < len; in++) {
+        if (*in == '\\' || *in == '"') out[o++] = '\\';
+        if (*in == '\n') {
+            out[o++] = '\\';
+            out[o++] = 'n';
+            continue;
+        }
+        out[o++] = *in;
+    }
+    out[o] = '\0';
+}
+
+static int layout_iface(om_body_t *b, om_slot_t *slot, const iface_info_t *inf) {
+    char label[IFNAMSIZ * 2 + 1];
+    escape_label(inf->ifname, label, sizeof(label));
+    slot->ifindex = inf->ifindex;
+    slot->gen = inf->gen;
+    for (int f = 0; f < OM_FAMILIES; f++) {
+        const om_family_t *fam = &families[f];
+        om_seg_t *s = &b->seg[f];
+        int n = seg_printf(s, "%s%s{ifname=\"%s\"} ", fam->name,
+                           fam->type[0] == 'c' ? "_total" : "", label);
+        if (n < 0 || seg_reserve(s, (size_t)fam->width + 1) < 0) return -1;
+        slot->voff[f] = (uint32_t)s->len;
+        put_padded(s->data + s->len, fam->get(inf), fam->width);
+        s->len += (size_t)fam->width;
+        s->data[s->len++] = '\n';
+    }
+    return 0;
+}
+
+static void patch_iface(om_body_t *b, om_slot_t *slot, const iface_info_t *inf) {
+    for (int f = 0; f < OM_FAMILIES; f++) {
+        put_padded(b->seg[f].data + slot->voff[f], families[f].get(inf), families[f].width);
+    }
+    slot->gen = inf->gen;
+    stats.patched++;
+}
+
+/* ---- self-stats ---- */
+
+static void self_metric(const char *name, const char *type, const char *help, uint64_t v) {
+    int counter = type[0] == 'c';
+    seg_printf(&self, "# TYPE %s %s\n# HELP %s %s\n%s%s %llu\n", name, type, name, help,
+               name, counter ? "_total" : "", (unsigned long long)v);
+}
+
+static void count_alert(const alert_active_t *a, void *arg) {
+    (void)a;
+    (*(uint64_t *)arg)++;
+}
+
+static void render_self(void) {
+    nl_rx_stats_t rxs;
+    const nl_rx_stats_t *rx = &rxs;
+    netlink_get_rx_stats(&rxs);
+    const nl_sync_stats_t *sy = netlink_sync_stats();
+    const coalesce_stats_t *co = coalesce_get_stats();
+    const reactor_stats_t *lo = reactor_get_stats();
+    const sched_stats_t *sc = sched_get_stats();
+    log_stats_t lg;
+    history_stats_t hi;
+    uint64_t firing = 0;
+    logger_get_stats(&lg);
+    history_get_stats(&hi);
+    alert_foreach_active(count_alert, &firing);
+
+    self.len = 0;
+    self_metric("nlagent_interfaces", "gauge", "Interfaces in the table.", (uint64_t)get_iface_count());
+    self_metric("nlagent_netlink_messages", "counter", "Netlink notifications processed.", rx->messages);
+    self_metric("nlagent_netlink_overruns", "counter", "Netlink receive buffer overruns (ENOBUFS).", rx->overruns);
+    self_metric("nlagent_netlink_resyncs", "counter", "Full resyncs after overruns.", rx->resyncs);
+    self_metric("nlagent_netlink_rcvbuf_bytes", "gauge", "Effective netlink SO_RCVBUF.", (uint64_t)rx->rcvbuf);
+    self_metric("nlagent_netlink_syncs", "counter", "Full-state syncs.", sy->syncs);
+    self_metric("nlagent_coalesce_emitted", "counter", "Consolidated link changes applied.", co->emitted);
+    self_metric("nlagent_coalesce_merged", "counter", "Link notifications absorbed into a pending change.", co->merged);
+    self_metric("nlagent_loop_wakeups", "counter", "Event loop wakeups.", lo->wakeups);
+    self_metric("nlagent_loop_events", "counter", "Events dispatched.", lo->events);
+    self_metric("nlagent_sched_polls", "counter", "Interface counter refreshes.", sc->polls);
+    self_metric("nlagent_sched_deferred", "counter", "Refreshes pushed to the next tick by the budget.", sc->deferred);
+    self_metric("nlagent_log_written", "counter", "Log lines written.", lg.written);
+    self_metric("nlagent_log_dropped", "counter", "Log lines dropped on a full ring.", lg.dropped);
+    self_metric("nlagent_log_suppressed", "counter", "Log lines suppressed by the rate limit.", lg.suppressed);
+    self_metric("nlagent_history_interfaces", "gauge", "Interfaces with counter history.", (uint64_t)hi.tracked);
+    self_metric("nlagent_history_bytes", "gauge", "Memory held by counter history.", hi.bytes);
+    self_metric("nlagent_alerts_firing", "gauge", "Alerts currently firing.", firing);
+    self_metric("nlagent_openmetrics_scrapes", "counter", "Scrapes served.", stats.scrapes);
+    self_metric("nlagent_openmetrics_layouts", "counter", "Full re-renders of the interface body.", stats.layouts);
+    self_metric("nlagent_openmetrics_patched_interfaces", "counter", "Interfaces rewritten in place.", stats.patched);
+    self_metric("nlagent_openmetrics_body_bytes", "gauge", "Size of the pre-rendered interface body.", stats.body_bytes);
+}
+
+/* ---- rendering job ---- */
+
+static void conn_close(om_conn_t *c);
+static void conn_flush(om_conn_t *c);
+
+static void job_begin_layout(void) {
+    int n = get_iface_count();
+    int *snap = realloc(job_ifindex, (size_t)(n ? n : 1) * sizeof(int));
+    om_slot_t *sl = malloc((size_t)(n ? n : 1) * sizeof(om_slot_t));
+    om_body_t *b = body_new();
+    if (!snap || !sl || !b) {
+        if (snap) job_ifindex = snap;
+        free(sl);
+        body_release(b);
+        log_err("openmetrics: out of memory laying out %d interfaces", n);
+        job = JOB_IDLE;
+        return;
+    }
+    job_ifindex = snap;
+    for (int i = 0; i < n; i++) job_ifindex[i] = get_iface_at(i)->ifindex;
+    job_n = n;
+    job_gen = iface_table_gen();
+    free(job_slots);
+    job_slots = sl;
+    job_slot_count = 0;
+    body_release(job_body);
+    job_body = b;
+    job_pos = 0;
+    job = JOB_LAYOUT;
+}
+
+static void job_begin_patch(void) {
+    /* a client still sends the old values: patch a private copy */
+    if (body->refs > 1) {
+        om_body_t *b = body_clone(body);
+        if (!b) {
+            log_err("openmetrics: out of memory copying the body");
+            job = JOB_IDLE;
+            return;
+        }
+        body_release(body);
+        body = b;
+        stats.cow_copies++;
+    }
+    job_pos = 0;
+    job = JOB_PATCH;
+}
+
+/* hand the body to every waiting client */
+static void job_finish(void) {
+    job = JOB_IDLE;
+    render_self();
+    while (waiting) {
+        om_conn_t *c = waiting;
+        waiting = c->next_wait;
+        c->next_wait = NULL;
+        if (!body) {
+            obuf_printf(&c->out, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        } else {
+            obuf_printf(&c->out, "HTTP/1.1 200 OK\r\nContent-Type: " OM_CONTENT_TYPE
+                        "\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                        self.len + body->bytes + sizeof("# EOF\n") - 1);
+            obuf_append(&c->out, self.data, self.len);
+            c->body = body;
+            body->refs++;
+            c->seg = 0;
+            c->off = 0;
+        }
+        stats.scrapes++;
+        c->state = CONN_SEND;
+        reactor_mod(&c->h, EPOLLOUT | EPOLLRDHUP);
+        conn_flush(c);
+    }
+}
+
+static void job_step(reactor_timer_t *t, uint64_t expirations) {
+    (void)expirations;
+    stats.steps++;
+    if (job == JOB_PATCH && iface_table_gen() != layout_gen) job_begin_layout();
+
+    int end = job_pos + step_size;
+    if (job == JOB_LAYOUT) {
+        if (end > job_n) end = job_n;
+        for (; job_pos < end; job_pos++) {
+            iface_info_t *inf = get_iface_by_index(job_ifindex[job_pos]);
+            if (!inf) continue;        /* gone since the snapshot */
+            if (layout_iface(job_body, &job_slots[job_slot_count], inf) < 0) {
+                log_err("openmetrics: out of memory rendering %s", inf->ifname);
+                body_release(job_body);
+                job_body = NULL;
+                job_finish();
+                return;
+            }
+            job_slot_count++;
+        }
+        if (job_pos < job_n) {
+            reactor_timer_arm(t, 0, 0);
+            return;
+        }
+        body_release(body);
+        body = job_body;
+        job_body = NULL;
+        body->bytes = 0;
+        for (int f = 0; f < OM_FAMILIES; f++) body->bytes += body->seg[f].len;
+        om_slot_t *old = slots;
+        slots = job_slots;
+        slot_count = job_slot_count;
+        job_slots = old;
+        /* churn during the walk shows up as a gen mismatch next scrape */
+        layout_gen = job_gen;
+        layout_valid = 1;
+        stats.layouts++;
+        stats.interfaces = slot_count;
+        stats.body_bytes = body->bytes;
+        job_finish();
+    } else if (job == JOB_PATCH) {
+        if (end > slot_count) end = slot_count;
+        for (; job_pos < end; job_pos++) {
+            om_slot_t *slot = &slots[job_pos];
+            iface_info_t *inf = get_iface_by_index(slot->ifindex);
+            if (inf && inf->gen != slot->gen) patch_iface(body, slot, inf);
+        }
+        if (job_pos < slot_count) {
+            reactor_timer_arm(t, 0, 0);
+            return;
+        }
+        job_finish();
+    } else {
+        job_finish();
+    }
+}
+
+static void job_kick(void) {
+    if (job != JOB_IDLE) return;
+    if (!layout_valid || iface_table_gen() != layout_gen) job_begin_layout();
+    else job_begin_patch();
+    /* out of memory: answer with what there is */
+    if (job == JOB_IDLE) job_finish();
+    else reactor_timer_arm(&step_timer, 0, 0);
+}
+
+/* ---- connections ---- */
+
+static int om_conn_count = 0;
+
+static void conn_free(reactor_handler_t *h) {
+    free(h->arg);
+}
+
+/* also called for other connections (job_finish): the free waits for the batch */
+static void conn_close(om_conn_t *c) {
+    if (c->state == CONN_WAIT) {
+        om_conn_t **pp = &waiting;
+        while (*pp && *pp != c) pp = &(*pp)->next_wait;
+        if (*pp) *pp = c->next_wait;
+    }
+    int fd = c->fd;
+    obuf_free(&c->out);
+    body_release(c->body);
+    c->body = NULL;
+    reactor_release(&c->h, conn_free);
+    close(fd);
+    om_conn_count--;
+    stats.clients = om_conn_count;
+}
+
+/* write what the socket takes, up to OM_SEND_BUDGET; closes when done or on error */
+static void conn_flush(om_conn_t *c) {
+    size_t budget = OM_SEND_BUDGET;
+    for (;;) {
+        if (!obuf_empty(&c->out)) {
+            if (obuf_flush(&c->out, c->fd) < 0) break;
+            if (!obuf_empty(&c->out)) return;
+            continue;
+        }
+        if (!c->body) break;
+        while (c->seg < OM_FAMILIES && c->off == c->body->seg[c->seg].len) {
+            c->seg++;
+            c->off = 0;
+        }
+        if (c->seg == OM_FAMILIES) {
+            body_release(c->body);
+            c->body = NULL;
+            obuf_append(&c->out, "# EOF\n", 6);
+            continue;
+        }
+        if (budget == 0) return;       /* level-triggered EPOLLOUT brings us back */
+
+        struct iovec iov[OM_FAMILIES];
+        int n = 0;
+        size_t want = 0;
+        for (int s = c->seg; s < OM_FAMILIES && want < budget; s++) {
+            size_t off = s == c->seg ? c->off : 0;
+            size_t len = c->body->seg[s].len - off;
+            if (len > budget - want) len = budget - want;
+            iov[n].iov_base = c->body->seg[s].data + off;
+            iov[n].iov_len = len;
+            want += len;
+            n++;
+        }
+        ssize_t w = writev(c->fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            break;
+        }
+        budget -= (size_t)w;
+        size_t left = (size_t)w;
+        while (left > 0) {
+            size_t rest = c->body->seg[c->seg].len - c->off;
+            if (left < rest) {
+                c->off += left;
+                break;
+            }
+            left -= rest;
+            c->seg++;
+            c->off = 0;
+        }
+    }
+    conn_close(c);
+}
+
+static void respond(om_conn_t *c, const char *status, const char *text) {
+    obuf_printf(&c->out, "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                "Connection: close\r\n\r\n%s", status, strlen(text), text);
+    c->state = CONN_SEND;
+    reactor_mod(&c->h, EPOLLOUT | EPOLLRDHUP);
+    conn_flush(c);
+}
+
+static void handle_request(om_conn_t *c) {
+    char method[8], path[256];
+    c->in[c->in_len] = '\0';
+    if (sscanf(c->in, "%7s %255s", method, path) != 2) {
+        respond(c, "400 Bad Request", "bad request\n");
+        return;
+    }
+    if (strcmp(method, "GET") != 0) {
+        respond(c, "405 Method Not Allowed", "only GET\n");
+        return;
+    }
+    char *q = strchr(path, '?');
+    if (q) *q = '\0';
+    if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+        respond(c, "404 Not Found", "try /metrics\n");
+        return;
+    }
+    /* served when the current rendering pass completes */
+    c->state = CONN_WAIT;
+    reactor_mod(&c->h, EPOLLRDHUP);
+    c->next_wait = waiting;
+    waiting = c;
+    job_kick();
+}
+
+static void conn_read(om_conn_t *c) {
+    for (;;) {
+        if (c->in_len >= OM_REQ_MAX - 1) {
+            respond(c, "431 Request Header Fields Too Large", "request too large\n");
+            return;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, OM_REQ_MAX - 1 - c->in_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            conn_close(c);
+            return;
+        }
+        if (n == 0) {
+            conn_close(c);
+            return;
+        }
+        c->in_len += (size_t)n;
+        c->in[c->in_len] = '\0';
+        if (strstr(c->in, "\r\n\r\n") || strstr(c->in, "\n\n")) {
+            handle_request(c);
+            return;
+        }
+    }
+}
+
+static void conn_event(reactor_handler_t *h, uint32_t events) {
+    om_conn_t *c = h->arg;
+    switch (c->state) {
+    case CONN_READ:
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) conn_read(c);
+        break;
+    case CONN_WAIT:
+        /* peer gave up before the body was ready */
+        if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) conn_close(c);
+        break;
+    default:
+        if (events & (EPOLLERR | EPOLLHUP)) conn_close(c);
+        else if (events & EPOLLOUT) conn_flush(c);
+        break;
+    }
+}
+
+static void listen_event(reactor_handler_t *h, uint32_t events) {
+    (void)h;
+    (void)events;
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_err("openmetrics: accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        if (om_conn_count >= max_clients) {
+            close(fd);
+            continue;
+        }
+        om_conn_t *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->h.fd = fd;
+        c->h.cb = conn_event;
+        c->h.arg = c;
+        c->state = CONN_READ;
+        obuf_init(&c->out);
+        if (reactor_add(&c->h, EPOLLIN | EPOLLRDHUP) < 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        om_conn_count++;
+        stats.clients = om_conn_count;
+    }
+}
+
+/* ---- listener ---- */
+
+static int open_listener(const char *spec) {
+    struct sockaddr_storage ss;
+    socklen_t slen;
+    memset(&ss, 0, sizeof(ss));
+
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un *sun = (struct sockaddr_un *)&ss;
+        if (strlen(spec + 5) >= sizeof(sun->sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, spec + 5);
+        unlink(sun->sun_path);
+        slen = sizeof(*sun);
+    } else {
+        char host[64];
+        const char *colon = strrchr(spec, ':');
+        errno = EINVAL;
+        if (!colon || (size_t)(colon - spec) >= sizeof(host)) return -1;
+        memcpy(host, spec, (size_t)(colon - spec));
+        host[colon - spec] = '\0';
+        int port = atoi(colon + 1);
+        if (port <= 0 || port > 65535) return -1;
+        /* [v6addr]:port */
+        char *h = host;
+        if (h[0] == '[') {
+            h++;
+            char *e = strchr(h, ']');
+            if (e) *e = '\0';
+        }
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        if (inet_pton(AF_INET, h, &sin->sin_addr) == 1) {
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons((uint16_t)port);
+            slen = sizeof(*sin);
+        } else if (inet_pton(AF_INET6, h, &sin6->sin6_addr) == 1) {
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons((uint16_t)port);
+            slen = sizeof(*sin6);
+        } else {
+            return -1;
+        }
+    }
+
+    int fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    if (ss.ss_family != AF_UNIX) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&ss, slen) < 0 || listen(fd, 64) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int openmetrics_start(void) {
+    const char *spec = config_get_str("openmetrics_listen", OM_LISTEN_DEFAULT);
+    if (!spec[0]) {
+        log_info("openmetrics: disabled");
+        return 0;
+    }
+    max_clients = (int)config_get_int("openmetrics_max_clients", OM_MAX_CLIENTS_DEFAULT);
+    step_size = (int)config_get_int("openmetrics_step", OM_STEP_DEFAULT);
+    if (step_size < 64) step_size = 64;
+
+    listen_fd = open_listener(spec);
+    if (listen_fd < 0) {
+        log_err("openmetrics: cannot listen on %s: %s", spec, strerror(errno));
+        return -1;
+    }
+    if (reactor_timer_init(&step_timer, job_step, NULL) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    /* accept loop runs to EAGAIN, so the listener may be edge-triggered */
+    listen_handler.fd = listen_fd;
+    if (reactor_add(&listen_handler, EPOLLIN | reactor_et_flag()) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    log_info("openmetrics: serving /metrics on %s", spec);
+    return 0;
+}
+
+const om_stats_t *openmetrics_get_stats(void) {
+    return &stats;
+}
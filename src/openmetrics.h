@@ -0,0 +1,36 @@
+#ifndef OPENMETRICS_H
+#define OPENMETRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * OpenMetrics exposition over HTTP (GET /metrics) on openmetrics_listen:
+ * "host:port" for TCP, "unix:<path>" for a unix socket, empty to disable.
+ *
+ * Per-interface families are kept pre-rendered, one segment per family,
+ * with every value in a fixed-width zero-padded field. A scrape rewrites in
+ * place only the values of interfaces whose gen moved since the previous
+ * one; the segments are laid out again only when interfaces come, go or are
+ * renamed. Both passes run openmetrics_step interfaces per loop iteration
+ * and responses go out in bounded writes, so a scrape of a large table
+ * never holds the event loop for long. Agent self-stats are rendered fresh
+ * on every scrape.
+ */
+
+typedef struct om_stats {
+    uint64_t scrapes;
+    uint64_t layouts;                  /* full re-renders */
+    uint64_t patched;                  /* interfaces rewritten in place */
+    uint64_t steps;                    /* loop iterations spent rendering */
+    uint64_t cow_copies;               /* body copied because a send was in flight */
+    size_t body_bytes;
+    int interfaces;                    /* in the current layout */
+    int clients;
+} om_stats_t;
+
+/* 0 when listening or disabled, -1 on failure */
+int openmetrics_start(void);
+const om_stats_t *openmetrics_get_stats(void);
+
+#endif
@@ -1,158 +1,199 @@
 #define _GNU_SOURCE
 #include "parser.h"
 #include "logger.h"
+#include "watch.h"
+#include "journal.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <ifaddrs.h>
 #include <arpa/inet.h>
+#include "hash.h"
 
-#define MAX_IFACES 128
+/* ifindex 直接索引上限（超过则拒绝登记） */
+#define IFINDEX_DIRECT_MAX (1 << 24)
 
-iface_info_t *iface_list = NULL;
+/*
+ * 接口表：连续数组保存接口（遍历友好），
+ * ifindex -> 位置 的直接索引表，以及按名称的开放寻址哈希（线性探测）。
+ * 两个索引都保存 "位置 + 1"，0 表示空。
+ */
+static iface_info_t *ifaces = NULL;
 static int iface_count = 0;
+static int iface_cap = 0;
 
-/* 链表辅助函数 */
-static iface_info_t *create_iface_node(void) {
-    iface_info_t *node = (iface_info_t *)calloc(1, sizeof(iface_info_t));
-    if (!node) {
-        log_err("Failed to allocate iface node");
+static int *idx_map = NULL;
+static int idx_cap = 0;
+
+static int *name_slots = NULL;
+static uint32_t name_mask = 0;      /* 槽位数 - 1，槽位数为 2 的幂 */
+
+static uint32_t table_gen = 0;      /* 登记/删除/改名时递增 */
+static uint32_t data_gen = 0;       /* 任一接口内容变化时递增，接口的 gen 取自它 */
+
+static void name_hash_insert(int pos) {
+    uint32_t i = hash_str(ifaces[pos].ifname) & name_mask;
+    while (name_slots[i]) i = (i + 1) & name_mask;
+    name_slots[i] = pos + 1;
+}
+
+static int name_hash_rebuild(uint32_t nslots) {
+    int *slots = calloc(nslots, sizeof(int));
+    if (!slots) {
+        log_err("Failed to allocate iface name hash (%u slots)", nslots);
+        return -1;
+    }
+    free(name_slots);
+    name_slots = slots;
+    name_mask = nslots - 1;
+    for (int pos = 0; pos < iface_count; pos++) {
+        name_hash_insert(pos);
+    }
+    return 0;
+}
+
+/* 找到保存指定位置的槽 */
+static uint32_t name_hash_slot_of(int pos) {
+    uint32_t i = hash_str(ifaces[pos].ifname) & name_mask;
+    while (name_slots[i] != pos + 1) i = (i + 1) & name_mask;
+    return i;
+}
+
+/* 向后移位删除，探测链无需墓碑 */
+static void name_hash_remove_slot(uint32_t i) {
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & name_mask;
+        if (!name_slots[j]) break;
+        uint32_t home = hash_str(ifaces[name_slots[j] - 1].ifname) & name_mask;
+        if (((j - home) & name_mask) >= ((j - i) & name_mask)) {
+            name_slots[i] = name_slots[j];
+            i = j;
+        }
+    }
+    name_slots[i] = 0;
+}
+
+static iface_info_t *iface_insert(int ifindex, const char *ifname) {
+    if (ifindex <= 0 || ifindex >= IFINDEX_DIRECT_MAX) {
+        log_warn("ifindex %d out of table range, not registered", ifindex);
         return NULL;
     }
-    node->next = NULL;
-    node->addr_cnt = 0;
-    return node;
+    if (iface_count == iface_cap) {
+        int cap = iface_cap ? iface_cap * 2 : 64;
+        iface_info_t *n = realloc(ifaces, (size_t)cap * sizeof(*n));
+        if (!n) {
+            log_err("Failed to grow iface table to %d entries", cap);
+            return NULL;
+        }
+        ifaces = n;
+        iface_cap = cap;
+    }
+    if (ifindex >= idx_cap) {
+        int cap = (int)hash_pow2((uint32_t)ifindex + 1);
+        if (cap < 256) cap = 256;
+        int *n = realloc(idx_map, (size_t)cap * sizeof(int));
+        if (!n) {
+            log_err("Failed to grow ifindex map to %d entries", cap);
+            return NULL;
+        }
+        memset(n + idx_cap, 0, (size_t)(cap - idx_cap) * sizeof(int));
+        idx_map = n;
+        idx_cap = cap;
+    }
+    /* 负载因子保持在 1/2 以下 */
+    if (!name_slots || (uint32_t)(iface_count + 1) * 2 > name_mask + 1) {
+        uint32_t nslots = name_slots ? (name_mask + 1) * 2 : 128;
+        if (name_hash_rebuild(nslots) < 0) return NULL;
+    }
+
+    int pos = iface_count++;
+    iface_info_t *inf = &ifaces[pos];
+    memset(inf, 0, sizeof(*inf));
+    inf->ifindex = ifindex;
+    inf->gen = ++data_gen;
+    if (ifname && ifname[0] != '\0') {
+        strncpy(inf->ifname, ifname, IFNAMSIZ - 1);
+        inf->ifname[IFNAMSIZ - 1] = '\0';
+    } else {
+        snprintf(inf->ifname, IFNAMSIZ, "if%d", ifindex);
+    }
+    idx_map[ifindex] = pos + 1;
+    name_hash_insert(pos);
+    table_gen++;
+    return inf;
 }
 
-static void free_iface_list(void) {
-    iface_info_t *current = iface_list;
-    while (current) {
-        iface_info_t *next = current->next;
-        free(current);
-        current = next;
+/* 删除位置 pos 的接口，末尾元素移入空位 */
+static void iface_remove_at(int pos) {
+    addrset_free(&ifaces[pos].addrs);
+    name_hash_remove_slot(name_hash_slot_of(pos));
+    idx_map[ifaces[pos].ifindex] = 0;
+
+    int last = iface_count - 1;
+    if (pos != last) {
+        uint32_t slot = name_hash_slot_of(last);
+        ifaces[pos] = ifaces[last];
+        name_slots[slot] = pos + 1;
+        idx_map[ifaces[pos].ifindex] = pos + 1;
     }
-    iface_list = NULL;
-    iface_count = 0;
+    iface_count--;
+    table_gen++;
 }
 
-static iface_info_t *find_iface_by_index(int ifindex) {
-    for (iface_info_t *p = iface_list; p; p = p->next) {
-        if (p->ifindex == ifindex) return p;
+static void free_iface_table(void) {
+    for (int pos = 0; pos < iface_count; pos++) {
+        addrset_free(&ifaces[pos].addrs);
     }
-    return NULL;
+    free(ifaces);
+    free(idx_map);
+    free(name_slots);
+    ifaces = NULL;
+    idx_map = NULL;
+    name_slots = NULL;
+    iface_count = iface_cap = idx_cap = 0;
+    name_mask = 0;
+}
+
+static iface_info_t *find_iface_by_index(int ifindex) {
+    if (ifindex <= 0 || ifindex >= idx_cap || !idx_map[ifindex]) return NULL;
+    return &ifaces[idx_map[ifindex] - 1];
 }
 
 static iface_info_t *find_iface_by_name(const char *ifname) {
-    for (iface_info_t *p = iface_list; p; p = p->next) {
+    if (!name_slots || !ifname) return NULL;
+    uint32_t i = hash_str(ifname) & name_mask;
+    while (name_slots[i]) {
+        iface_info_t *p = &ifaces[name_slots[i] - 1];
         if (strcmp(p->ifname, ifname) == 0) return p;
+        i = (i + 1) & name_mask;
     }
     return NULL;
 }
 
 /* 主功能函数 */
+/* 清空接口表；内容由 netlink 全量同步（netlink_sync）填充 */
 void init_iface_table(void) {
-    // 清理现有链表
-    free_iface_list();
-    
-    struct ifaddrs *ifaddr, *ifa;
-    if (getifaddrs(&ifaddr) == -1) {
-        log_err("getifaddrs failed");
-        return;
-    }
-    
-    // 第一次遍历：收集所有接口
-    for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
-        if (!ifa->ifa_name) continue;
-        
-        // 检查是否已存在
-        if (find_iface_by_name(ifa->ifa_name)) continue;
-        
-        // 创建新节点
-        iface_info_t *new_iface = create_iface_node();
-        if (!new_iface) {
-            log_err("Failed to create iface node for %s", ifa->ifa_name);
-            continue;
-        }
-        
-        // 初始化接口基本信息
-        strncpy(new_iface->ifname, ifa->ifa_name, IFNAMSIZ - 1);
-        new_iface->ifname[IFNAMSIZ - 1] = '\0';
-        new_iface->ifindex = if_nametoindex(ifa->ifa_name);
-        new_iface->up = (ifa->ifa_flags & IFF_UP) ? 1 : 0;
-        new_iface->rx_bytes = 0;
-        new_iface->tx_bytes = 0;
-        new_iface->rx_err = 0;
-        new_iface->tx_err = 0;
-        new_iface->addr_cnt = 0;
-        
-        // 添加到链表头部
-        new_iface->next = iface_list;
-        iface_list = new_iface;
-        iface_count++;
-    }
-    
-    // 第二次遍历：收集IP地址
-    for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
-        if (!ifa->ifa_name || !ifa->ifa_addr) continue;
-        
-        iface_info_t *iface = find_iface_by_name(ifa->ifa_name);
-        if (!iface) continue;
-        
-        // 获取IP地址
-        char addr_str[INET6_ADDRSTRLEN] = {0};
-        int family = ifa->ifa_addr->sa_family;
-        int prefix_len = 0;
-        
-        if (family == AF_INET) {
-            struct sockaddr_in *sa = (struct sockaddr_in *)ifa->ifa_addr;
-            inet_ntop(AF_INET, &(sa->sin_addr), addr_str, INET_ADDRSTRLEN);
-        } else if (family == AF_INET6) {
-            struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)ifa->ifa_addr;
-            inet_ntop(AF_INET6, &(sa6->sin6_addr), addr_str, INET6_ADDRSTRLEN);
-        } else {
-            continue;
-        }
-        
-        if (strlen(addr_str) > 0) {
-            iface_add_addr(iface, family, addr_str, prefix_len);
-        }
-    }
-    
-    freeifaddrs(ifaddr);
-    log_info("init_iface_table found %d interfaces", iface_count);
+    free_iface_table();
+}
+
+/* 静默登记（全量同步使用），已存在则直接返回 */
+iface_info_t *iface_register(int ifindex, const char *ifname) {
+    iface_info_t *inf = find_iface_by_index(ifindex);
+    if (inf) return inf;
+    return iface_insert(ifindex, ifname);
 }
 
 iface_info_t *ensure_iface_by_index(int ifindex, const char *ifname) {
     iface_info_t *inf = get_iface_by_index(ifindex);
     if (inf) return inf;
     
-    // 创建新接口节点
-    iface_info_t *new_iface = create_iface_node();
+    // 登记新接口，默认状态 DOWN
+    iface_info_t *new_iface = iface_insert(ifindex, ifname);
     if (!new_iface) {
-        log_err("Failed to create iface node for index %d", ifindex);
+        log_err("Failed to create iface entry for index %d", ifindex);
         return NULL;
     }
     
-    new_iface->ifindex = ifindex;
-    if (ifname && ifname[0] != '\0') {
-        strncpy(new_iface->ifname, ifname, IFNAMSIZ - 1);
-        new_iface->ifname[IFNAMSIZ - 1] = '\0';
-    } else {
-        snprintf(new_iface->ifname, IFNAMSIZ, "if%d", ifindex);
-    }
-    
-    new_iface->up = 0;  // 默认状态
-    new_iface->rx_bytes = 0;
-    new_iface->tx_bytes = 0;
-    new_iface->rx_err = 0;
-    new_iface->tx_err = 0;
-    new_iface->addr_cnt = 0;
-    
-    // 添加到链表头部
-    new_iface->next = iface_list;
-    iface_list = new_iface;
-    iface_count++;
-    
     log_info("register iface: %s idx=%d", new_iface->ifname, new_iface->ifindex);
     return new_iface;
 }
@@ -165,53 +206,96 @@ iface_info_t *get_iface_by_name(const char *ifname) {
     return find_iface_by_name(ifname);
 }
 
+void iface_set_name(iface_info_t *inf, const char *ifname) {
+    if (!inf || !ifname || !ifname[0] || strcmp(inf->ifname, ifname) == 0) return;
+    int pos = (int)(inf - ifaces);
+    name_hash_remove_slot(name_hash_slot_of(pos));
+    log_info("iface idx=%d renamed %s -> %s", inf->ifindex, inf->ifname, ifname);
+    char old[IFNAMSIZ];
+    memcpy(old, inf->ifname, IFNAMSIZ);
+    strncpy(inf->ifname, ifname, IFNAMSIZ - 1);
+    inf->ifname[IFNAMSIZ - 1] = '\0';
+    name_hash_insert(pos);
+    iface_touch(inf);
+    table_gen++;
+    watch_link_rename(inf, old);
+    journal_link_rename(inf, old);
+}
+
 void update_iface_status(int ifindex, int up) {
     iface_info_t *inf = get_iface_by_index(ifindex);
     if (!inf) return;
     inf->up = up;
+    iface_touch(inf);
     log_info("iface %s (idx %d) status -> %s", inf->ifname, ifindex, up ? "UP" : "DOWN");
 }
 
-void update_iface_counters(int ifindex, unsigned long rx_bytes, unsigned long tx_bytes, 
-                          unsigned long rx_err, unsigned long tx_err) {
+void iface_set_link(iface_info_t *inf, uint32_t flags, uint32_t mtu, uint8_t operstate) {
+    int up = (flags & IFF_RUNNING) ? 1 : 0;
+    if (inf->flags == flags && inf->mtu == mtu && inf->operstate == operstate && inf->up == up) return;
+    iface_touch(inf);
+    inf->up = up;
+    inf->flags = flags;
+    inf->mtu = mtu;
+    inf->operstate = operstate;
+}
+
+void update_iface_counters(int ifindex, const iface_counters_t *c) {
     iface_info_t *inf = get_iface_by_index(ifindex);
-    if (!inf) return;
-    inf->rx_bytes = rx_bytes;
-    inf->tx_bytes = tx_bytes;
-    inf->rx_err = rx_err;
-    inf->tx_err = tx_err;
+    if (!inf || !c) return;
+    iface_set_counters(inf, c);
+}
+
+void iface_set_counters(iface_info_t *inf, const iface_counters_t *c) {
+    if (memcmp(&inf->stats, c, sizeof(*c)) == 0) return;
+    inf->stats = *c;
+    iface_touch(inf);
 }
 
 /* 更新IP（旧函数，保持兼容性）*/
 void update_iface_ip(int ifindex, const char *ip) {
     iface_info_t *inf = get_iface_by_index(ifindex);
     if (!inf) return;
-    
+
     // 这里只更新第一个IPv4地址作为主IP（兼容旧代码）
-    for (int i = 0; i < inf->addr_cnt; i++) {
-        if (inf->addrs[i].family == AF_INET) {
-            strncpy(inf->addrs[i].addr, ip, INET6_ADDRSTRLEN - 1);
-            inf->addrs[i].addr[INET6_ADDRSTRLEN - 1] = '\0';
-            log_info("updated IP for iface %s (idx %d) -> %s", 
-                    inf->ifname, ifindex, ip);
-            return;
+    int first_v4 = -1;
+    for (int i = 0; i < inf->addrs.count; i++) {
+        if (inf->addrs.items[i].family == AF_INET) {
+            first_v4 = i;
+            break;
         }
     }
-    
-    // 如果没有IPv4地址，添加一个
-    if (inf->addr_cnt < MAX_ADDR_PER_IF) {
-        inf->addrs[inf->addr_cnt].family = AF_INET;
-        strncpy(inf->addrs[inf->addr_cnt].addr, ip, INET6_ADDRSTRLEN - 1);
-        inf->addrs[inf->addr_cnt].addr[INET6_ADDRSTRLEN - 1] = '\0';
-        inf->addr_cnt++;
-        log_info("added IP for iface %s (idx %d) -> %s", 
-                inf->ifname, ifindex, ip);
+
+    if (!ip) {
+        if (first_v4 >= 0 && addrset_del(&inf->addrs, &inf->addrs.items[first_v4])) iface_touch(inf);
+        return;
+    }
+
+    struct in_addr in;
+    if (inet_pton(AF_INET, ip, &in) != 1) {
+        log_warn("update_iface_ip: invalid IPv4 address %s", ip);
+        return;
+    }
+
+    int prefixlen = 32;
+    if (first_v4 >= 0) {
+        iface_addr_t old = inf->addrs.items[first_v4];
+        prefixlen = old.prefixlen;
+        addrset_del(&inf->addrs, &old);
     }
+    iface_touch(inf);
+    iface_addr_t a;
+    iface_addr_make(&a, AF_INET, &in, prefixlen, 0);
+    if (addrset_add(&inf->addrs, &a) < 0) {
+        log_err("iface %s: failed to store addr %s", inf->ifname, ip);
+        return;
+    }
+    log_info("updated IP for iface %s (idx %d) -> %s", inf->ifname, ifindex, ip);
 }
 
-void iface_add_addr(iface_info_t *inf, int family, const char *addr, int prefixlen) {
-    if (!inf || !addr || !addr[0]) return;
-    
+void iface_add_addr(iface_info_t *inf, int family, const void *addr, int prefixlen, uint32_t flags) {
+    if (!inf || !addr) return;
+
     // 检查参数有效性
     if (family != AF_INET && family != AF_INET6) {
         log_warn("Invalid address family: %d", family);
@@ -219,72 +303,75 @@ void iface_add_addr(iface_info_t *inf, int family, const char *addr, int prefixl
     }
 
     // 前缀长度检查
-    if(prefixlen == 0) {
-        log_info("Prefix length is zero, skipping address addition");
+    if (prefixlen == 0 || prefixlen > (family == AF_INET ? 32 : 128)) {
+        log_info("Prefix length %d invalid, skipping address addition", prefixlen);
         return;
     }
-    
-    // 去重检查
-    for (int i = 0; i < inf->addr_cnt; i++) {
-        if (inf->addrs[i].family == family &&
-            inf->addrs[i].prefixlen == prefixlen &&
-            strcmp(inf->addrs[i].addr, addr) == 0) {
-            return;  // 地址已存在
-        }
-    }
-    
-    if (inf->addr_cnt >= MAX_ADDR_PER_IF) {
-        log_warn("iface %s addr list full (max %d)", inf->ifname, MAX_ADDR_PER_IF);
+
+    iface_addr_t a;
+    iface_addr_make(&a, family, addr, prefixlen, flags);
+    int r = addrset_add(&inf->addrs, &a);
+    if (r < 0) {
+        log_err("iface %s: failed to grow address set (%d addrs)", inf->ifname, inf->addrs.count);
         return;
     }
-    
-    // 添加新地址
-    inf->addrs[inf->addr_cnt].family = family;
-    inf->addrs[inf->addr_cnt].prefixlen = prefixlen;
-    strncpy(inf->addrs[inf->addr_cnt].addr, addr, INET6_ADDRSTRLEN - 1);
-    inf->addrs[inf->addr_cnt].addr[INET6_ADDRSTRLEN - 1] = '\0';
-    inf->addr_cnt++;
-    
-    log_info("iface %s add addr %s (family: %s)", inf->ifname, addr,
-            family == AF_INET ? "IPv4" : "IPv6");
+    if (r == 0) return;  // 地址已存在（flags 已更新）
+    iface_touch(inf);
+    watch_addr("add", inf, &a);
+    journal_addr(NLJ_OP_NEW, inf, &a);
+
+    char buf[INET6_ADDRSTRLEN];
+    log_info("iface %s add addr %s/%d (family: %s)", inf->ifname,
+             iface_addr_ntop(&a, buf, sizeof(buf)), prefixlen,
+             family == AF_INET ? "IPv4" : "IPv6");
 }
 
-void iface_del_addr(iface_info_t *inf, int family, const char *addr, int prefixlen) {
-    if (!inf || !addr || !addr[0]) return;
-    
-    for (int i = 0; i < inf->addr_cnt; i++) {
-        if (inf->addrs[i].family == family &&
-            inf->addrs[i].prefixlen == prefixlen &&
-            strcmp(inf->addrs[i].addr, addr) == 0) {
-            
-            // 移除地址
-            for (int j = i; j < inf->addr_cnt - 1; j++) {
-                inf->addrs[j] = inf->addrs[j + 1];
-            }
-            inf->addr_cnt--;
-            
-            log_info("iface %s del addr %s (family: %s)", inf->ifname, addr,
-                    family == AF_INET ? "IPv4" : "IPv6");
-            return;
-        }
+void iface_del_addr(iface_info_t *inf, int family, const void *addr, int prefixlen) {
+    if (!inf || !addr) return;
+    if (family != AF_INET && family != AF_INET6) return;
+
+    iface_addr_t a;
+    char buf[INET6_ADDRSTRLEN];
+    iface_addr_make(&a, family, addr, prefixlen, 0);
+    if (addrset_del(&inf->addrs, &a)) {
+        iface_touch(inf);
+        watch_addr("del", inf, &a);
+        journal_addr(NLJ_OP_DEL, inf, &a);
+        log_info("iface %s del addr %s/%d (family: %s)", inf->ifname,
+                 iface_addr_ntop(&a, buf, sizeof(buf)), prefixlen,
+                 family == AF_INET ? "IPv4" : "IPv6");
+        return;
     }
-    
-    log_info("iface %s addr %s not found for deletion", inf->ifname, addr);
+
+    log_info("iface %s addr %s not found for deletion", inf->ifname,
+             iface_addr_ntop(&a, buf, sizeof(buf)));
 }
 
 void list_interfaces(void) {
     printf("=== Network Interfaces (%d) ===\n", iface_count);
-    for (iface_info_t *p = iface_list; p; p = p->next) {
+    for (int pos = 0; pos < iface_count; pos++) {
+        iface_info_t *p = &ifaces[pos];
         printf("Interface: %s\n", p->ifname);
         printf("  Index: %d, Status: %s\n", p->ifindex, p->up ? "UP" : "DOWN");
-        printf("  Counters: RX=%lu TX=%lu RX_ERR=%lu TX_ERR=%lu\n",
-               p->rx_bytes, p->tx_bytes, p->rx_err, p->tx_err);
+        printf("  Counters: RX=%llu TX=%llu RX_ERR=%llu TX_ERR=%llu\n",
+               (unsigned long long)p->stats.rx_bytes,
+               (unsigned long long)p->stats.tx_bytes,
+               (unsigned long long)p->stats.rx_err,
+               (unsigned long long)p->stats.tx_err);
+        printf("  Drops: RX=%llu TX=%llu FIFO: RX=%llu TX=%llu MCAST=%llu\n",
+               (unsigned long long)p->stats.rx_dropped,
+               (unsigned long long)p->stats.tx_dropped,
+               (unsigned long long)p->stats.rx_fifo,
+               (unsigned long long)p->stats.tx_fifo,
+               (unsigned long long)p->stats.multicast);
         
-        if (p->addr_cnt > 0) {
-            printf("  Addresses (%d):\n", p->addr_cnt);
-            for (int i = 0; i < p->addr_cnt; i++) {
-                printf("    [%d] %s (%s)\n", i + 1, p->addrs[i].addr,
-                       p->addrs[i].family == AF_INET ? "IPv4" : "IPv6");
+        if (p->addrs.count > 0) {
+            char buf[INET6_ADDRSTRLEN];
+            printf("  Addresses (%d):\n", p->addrs.count);
+            for (int i = 0; i < p->addrs.count; i++) {
+                const iface_addr_t *a = &p->addrs.items[i];
+                printf("    [%d] %s/%d (%s)\n", i + 1, iface_addr_ntop(a, buf, sizeof(buf)),
+                       a->prefixlen, a->family == AF_INET ? "IPv4" : "IPv6");
             }
         } else {
             printf("  No addresses\n");
@@ -295,46 +382,67 @@ void list_interfaces(void) {
 
 /* 新增功能函数 */
 void cleanup_iface_table(void) {
-    free_iface_list();
+    free_iface_table();
     log_info("iface table cleaned up");
 }
 
+uint32_t iface_table_gen(void) {
+    return table_gen;
+}
+
+uint32_t iface_table_data_gen(void) {
+    return data_gen;
+}
+
+void iface_touch(iface_info_t *inf) {
+    inf->gen = ++data_gen;
+}
+
 int get_iface_count(void) {
     return iface_count;
 }
 
-iface_info_t *get_iface_list(void) {
-    return iface_list;
+iface_info_t *get_iface_at(int pos) {
+    if (pos < 0 || pos >= iface_count) return NULL;
+    return &ifaces[pos];
 }
 
 /* 删除接口 */
 void delete_iface_by_index(int ifindex) {
-    iface_info_t *prev = NULL;
-    iface_info_t *current = iface_list;
-    
-    while (current) {
-        if (current->ifindex == ifindex) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                iface_list = current->next;
-            }
-            
-            log_info("deleted iface: %s idx=%d", current->ifname, current->ifindex);
-            free(current);
-            iface_count--;
-            return;
+    iface_info_t *inf = find_iface_by_index(ifindex);
+    if (!inf) {
+        log_info("iface with index %d not found for deletion", ifindex);
+        return;
+    }
+    log_info("deleted iface: %s idx=%d", inf->ifname, inf->ifindex);
+    watch_link_del(inf);
+    journal_link(NLJ_OP_DEL, inf, 0);
+    iface_remove_at((int)(inf - ifaces));
+}
+
+static uint32_t sync_gen = 0;
+
+uint32_t iface_table_begin_sync(void) {
+    return ++sync_gen;
+}
+
+int iface_table_sweep(uint32_t gen) {
+    int removed = 0;
+    for (int pos = iface_count - 1; pos >= 0; pos--) {
+        if (ifaces[pos].sync_gen != gen) {
+            log_info("iface %s idx=%d vanished during resync", ifaces[pos].ifname, ifaces[pos].ifindex);
+            watch_link_del(&ifaces[pos]);
+            journal_link(NLJ_OP_DEL, &ifaces[pos], 0);
+            iface_remove_at(pos);
+            removed++;
         }
-        prev = current;
-        current = current->next;
     }
-    
-    log_info("iface with index %d not found for deletion", ifindex);
+    return removed;
 }
 
 /* 遍历接口的回调函数接口 */
 void foreach_iface(void (*callback)(iface_info_t *iface, void *data), void *data) {
-    for (iface_info_t *p = iface_list; p; p = p->next) {
-        callback(p, data);
+    for (int pos = 0; pos < iface_count; pos++) {
+        callback(&ifaces[pos], data);
     }
 }
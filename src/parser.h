@@ -2,44 +2,77 @@
 #define PARSER_H
 
 #include <net/if.h>
+#include <stdint.h>
+#include "addrset.h"
 
-#define MAX_ADDR_PER_IF 8
-#define INET6_ADDRSTRLEN 46
-
-typedef struct iface_addr {
-    int family;
-    int prefixlen;                     /* CIDR prefix */
-    char addr[INET6_ADDRSTRLEN];
-} iface_addr_t;
+/* 64 位接口计数器（来自 IFLA_STATS_LINK_64 或 sysfs 回退） */
+typedef struct iface_counters {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_err;
+    uint64_t tx_err;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_fifo;
+    uint64_t tx_fifo;
+    uint64_t multicast;
+} iface_counters_t;
 
 typedef struct iface_info {
     char ifname[IFNAMSIZ];
     int ifindex;
-    int up;
-    unsigned long rx_bytes;
-    unsigned long tx_bytes;
-    unsigned long rx_err;
-    unsigned long tx_err;
-
-    iface_addr_t addrs[MAX_ADDR_PER_IF];
-    int addr_cnt;
-    struct iface_info *next;
-} iface_info_t;
+    int up;                            /* IFF_RUNNING */
+    uint32_t flags;                    /* ifi_flags */
+    uint32_t mtu;
+    uint8_t operstate;                 /* IF_OPER_* */
+    uint32_t flaps;                    /* 累计 up/down 变化次数 */
+    int coalesce_slot;                 /* 合并队列中的位置 + 1，0 表示无待处理事件 */
+    iface_counters_t stats;
 
-/* 全局接口链表（只读） */
-extern iface_info_t *iface_list;
+    iface_addr_set_t addrs;            /* addrs.items[0 .. addrs.count) */
+    uint32_t sync_gen;                 /* 最近一次全量同步看到该接口的轮次 */
+    uint32_t gen;                      /* 名称/链路状态/计数器/地址每次变化时更新（取自表级 data_gen） */
+} iface_info_t;
 
 void init_iface_table(void);
 iface_info_t *get_iface_by_index(int ifindex);
 iface_info_t *get_iface_by_name(const char *ifname);
 void update_iface_status(int ifindex, int up);
-void update_iface_counters(int ifindex, unsigned long rx_bytes, unsigned long tx_bytes, unsigned long rx_err, unsigned long tx_err);
+/* 静默写入链路状态（flags/mtu/operstate），up 由 IFF_RUNNING 得出 */
+void iface_set_link(iface_info_t *inf, uint32_t flags, uint32_t mtu, uint8_t operstate);
+void update_iface_counters(int ifindex, const iface_counters_t *c);
+/* 写入计数器，与原值不同时递增 gen */
+void iface_set_counters(iface_info_t *inf, const iface_counters_t *c);
 void update_iface_ip(int ifindex, const char *ip); /* ip==NULL clears the stored ip */
 void list_interfaces(void);
 iface_info_t *ensure_iface_by_index(int ifindex, const char *ifname);
+iface_info_t *iface_register(int ifindex, const char *ifname);   /* 同 ensure，但不打日志 */
+void iface_set_name(iface_info_t *inf, const char *ifname);
+void delete_iface_by_index(int ifindex);
+void cleanup_iface_table(void);
+
+/*
+ * 遍历接口表：位置 0 .. get_iface_count()-1，接口在表内连续存放。
+ * 返回的指针在下一次登记/删除接口之前有效；删除会把末尾接口移入空位。
+ */
+int get_iface_count(void);
+/* 接口集合或名称每次变化都会改变该值 */
+uint32_t iface_table_gen(void);
+/* 任一接口内容变化都会改变该值 */
+uint32_t iface_table_data_gen(void);
+/* 记录接口内容变化：inf->gen 取新的表级版本号，同一 ifindex 重建后也不会重复 */
+void iface_touch(iface_info_t *inf);
+iface_info_t *get_iface_at(int pos);
+void foreach_iface(void (*callback)(iface_info_t *iface, void *data), void *data);
+
+/* 全量对账：begin 返回新轮次，dump 中出现的接口置 sync_gen，sweep 删除未出现的接口 */
+uint32_t iface_table_begin_sync(void);
+int iface_table_sweep(uint32_t gen);
 
-/* 地址操作 */
-void iface_add_addr(iface_info_t *inf, int family, const char *addr, int prefixlen);
-void iface_del_addr(iface_info_t *inf, int family, const char *addr, int prefixlen);
+/* 地址操作：addr 为原始地址（in_addr / in6_addr） */
+void iface_add_addr(iface_info_t *inf, int family, const void *addr, int prefixlen, uint32_t flags);
+void iface_del_addr(iface_info_t *inf, int family, const void *addr, int prefixlen);
 
 #endif
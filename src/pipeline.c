@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include "pipeline.h"
+#include "spsc.h"
+#include "netlink.h"
+#include "metrics.h"
+#include "alert.h"
+#include "sched.h"
+#include "reactor.h"
+#include "config.h"
+#include "logger.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define PIPE_RING_KB_DEFAULT 4096
+/* records applied per wakeup on the main thread before yielding to other fds */
+#define PIPE_APPLY_BUDGET 4096
+
+enum { REC_COLLECT = 1, REC_FLUSH, REC_COUNTERS, REC_SAMPLE };
+
+typedef struct counters_rec {
+    int ifindex;
+    iface_counters_t c;
+} counters_rec_t;
+
+/* what the alert rules read from an interface */
+typedef struct sample_rec {
+    double now;
+    int ifindex;
+    int up;
+    uint32_t flags;
+    char ifname[IFNAMSIZ];
+    iface_counters_t stats;
+} sample_rec_t;
+
+static const char *stage_names[PIPE_STAGES] = { "ingest", "collect", "counters", "alert" };
+
+static int threaded = 0;
+static int running = 0;
+static spsc_ring_t rings[PIPE_STAGES];
+static int stop_fd = -1;
+static pthread_t ingest_thread, collect_thread, alert_thread;
+
+static void ingest_ready(reactor_handler_t *h, uint32_t events);
+static void counters_ready(reactor_handler_t *h, uint32_t events);
+static reactor_handler_t ingest_handler = { .fd = -1, .cb = ingest_ready };
+static reactor_handler_t counters_handler = { .fd = -1, .cb = counters_ready };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---- main thread: consumer of ingest and counters ---- */
+
+static void ingest_ready(reactor_handler_t *h, uint32_t events) {
+    (void)h;
+    (void)events;
+    spsc_ring_t *r = &rings[PIPE_INGEST];
+    spsc_ack(r);
+    /* over budget: keep the eventfd readable and come back next iteration */
+    if (netlink_apply_queued(r, PIPE_APPLY_BUDGET) == PIPE_APPLY_BUDGET) spsc_notify(r);
+}
+
+static void counters_ready(reactor_handler_t *h, uint32_t events) {
+    (void)h;
+    (void)events;
+    spsc_ring_t *r = &rings[PIPE_COUNTERS];
+    const spsc_rec_t *rec;
+    double now = now_sec();
+    int n = 0;
+
+    spsc_ack(r);
+    while (n < PIPE_APPLY_BUDGET && (rec = spsc_peek(r))) {
+        const counters_rec_t *cr = spsc_payload(rec);
+        sched_collected(cr->ifindex, &cr->c, now);
+        spsc_release(r, rec);
+        n++;
+    }
+    if (n == PIPE_APPLY_BUDGET) spsc_notify(r);
+}
+
+/* ---- threads ---- */
+
+static void *ingest_main(void *arg) {
+    (void)arg;
+    netlink_ingest(&rings[PIPE_INGEST], stop_fd);
+    return NULL;
+}
+
+static void push_counters(int ifindex, const iface_counters_t *c, void *arg) {
+    int *stopped = arg;
+    counters_rec_t cr;
+    if (*stopped) return;
+    cr.ifindex = ifindex;
+    cr.c = *c;
+    if (spsc_push_wait(&rings[PIPE_COUNTERS], REC_COUNTERS, &cr, sizeof(cr), stop_fd) < 0) *stopped = 1;
+}
+
+static void *collect_main(void *arg) {
+    (void)arg;
+    spsc_ring_t *in = &rings[PIPE_COLLECT];
+    metrics_req_t *batch = NULL;
+    int count = 0, cap = 0, stopped = 0;
+
+    while (!stopped && spsc_wait(in, stop_fd) == 0) {
+        const spsc_rec_t *rec;
+        while (!stopped && (rec = spsc_peek(in))) {
+            if (rec->type == REC_COLLECT) {
+                if (count == cap) {
+                    int ncap = cap ? cap * 2 : 256;
+                    metrics_req_t *b = realloc(batch, (size_t)ncap * sizeof(*b));
+                    if (!b) {
+                        /* drop it: the interface comes due again */
+                        spsc_release(in, rec);
+                        continue;
+                    }
+                    batch = b;
+                    cap = ncap;
+                }
+                memcpy(&batch[count++], spsc_payload(rec), sizeof(*batch));
+            } else if (rec->type == REC_FLUSH) {
+                int dump = *(const int *)spsc_payload(rec);
+                metrics_collect(batch, count, dump, push_counters, &stopped);
+                spsc_notify(&rings[PIPE_COUNTERS]);
+                count = 0;
+            }
+            spsc_release(in, rec);
+        }
+    }
+    free(batch);
+    return NULL;
+}
+
+static void *alert_main(void *arg) {
+    (void)arg;
+    spsc_ring_t *in = &rings[PIPE_ALERT];
+    iface_info_t inf;
+    memset(&inf, 0, sizeof(inf));
+
+    while (spsc_wait(in, stop_fd) == 0) {
+        const spsc_rec_t *rec;
+        while ((rec = spsc_peek(in))) {
+            const sample_rec_t *s = spsc_payload(rec);
+            memcpy(inf.ifname, s->ifname, IFNAMSIZ);
+            inf.ifindex = s->ifindex;
+            inf.up = s->up;
+            inf.flags = s->flags;
+            inf.stats = s->stats;
+            alert_eval_iface(&inf, s->now);
+            spsc_release(in, rec);
+        }
+    }
+    return NULL;
+}
+
+/* ---- producers on the main thread never block ---- */
+
+int pipeline_collect(const iface_info_t *inf) {
+    metrics_req_t req;
+    req.ifindex = inf->ifindex;
+    memcpy(req.ifname, inf->ifname, IFNAMSIZ);
+    return spsc_push(&rings[PIPE_COLLECT], REC_COLLECT, &req, sizeof(req));
+}
+
+void pipeline_collect_flush(int dump) {
+    spsc_ring_t *r = &rings[PIPE_COLLECT];
+    /* the flush must get through or the queued requests wait for the next one */
+    if (spsc_push(r, REC_FLUSH, &dump, sizeof(dump)) < 0) log_debug("pipeline: collect ring full");
+    spsc_notify(r);
+}
+
+void pipeline_alert(const iface_info_t *inf, double now) {
+    sample_rec_t s;
+    s.now = now;
+    s.ifindex = inf->ifindex;
+    s.up = inf->up;
+    s.flags = inf->flags;
+    memcpy(s.ifname, inf->ifname, IFNAMSIZ);
+    s.stats = inf->stats;
+    /* a dropped sample only delays the rates by one refresh */
+    if (spsc_push(&rings[PIPE_ALERT], REC_SAMPLE, &s, sizeof(s)) == 0) spsc_notify(&rings[PIPE_ALERT]);
+}
+
+/* ---- setup ---- */
+
+int pipeline_threaded(void) {
+    return threaded;
+}
+
+int pipeline_init(void) {
+    threaded = config_get_int("threaded", 0) != 0;
+    if (!threaded) return 0;
+
+    long kb = config_get_int("pipeline_ring_kb", PIPE_RING_KB_DEFAULT);
+    if (kb < 64) kb = 64;
+    for (int i = 0; i < PIPE_STAGES; i++) {
+        if (spsc_init(&rings[i], stage_names[i], (size_t)kb << 10) < 0) {
+            log_err("pipeline: cannot allocate %s ring (%ld KB)", stage_names[i], kb);
+            return -1;
+        }
+    }
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stop_fd < 0) {
+        log_err("pipeline: eventfd failed: %s", strerror(errno));
+        return -1;
+    }
+    ingest_handler.fd = rings[PIPE_INGEST].efd;
+    counters_handler.fd = rings[PIPE_COUNTERS].efd;
+    if (reactor_add(&ingest_handler, EPOLLIN) < 0 || reactor_add(&counters_handler, EPOLLIN) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_start(void) {
+    if (!threaded) return 0;
+    if (pthread_create(&ingest_thread, NULL, ingest_main, NULL) != 0) {
+        log_err("pipeline: ingest thread start failed");
+        return -1;
+    }
+    pthread_setname_np(ingest_thread, "nl-ingest");
+    running = 1;
+    if (pthread_create(&collect_thread, NULL, collect_main, NULL) != 0) {
+        log_err("pipeline: collector thread start failed");
+        pipeline_stop();
+        return -1;
+    }
+    pthread_setname_np(collect_thread, "nl-collect");
+    running = 2;
+    if (pthread_create(&alert_thread, NULL, alert_main, NULL) != 0) {
+        log_err("pipeline: alert thread start failed");
+        pipeline_stop();
+        return -1;
+    }
+    pthread_setname_np(alert_thread, "nl-alert");
+    running = 3;
+    log_info("pipeline: threaded mode, %llu KB rings", (unsigned long long)(rings[0].size >> 10));
+    return 0;
+}
+
+void pipeline_stop(void) {
+    if (!running) return;
+    uint64_t one = 1;
+    (void)!write(stop_fd, &one, sizeof(one));
+    pthread_join(ingest_thread, NULL);
+    if (running > 1) pthread_join(collect_thread, NULL);
+    if (running > 2) pthread_join(alert_thread, NULL);
+    running = 0;
+}
+
+int pipeline_stage_stats(int stage, pipeline_stage_stats_t *st) {
+    if (stage < 0 || stage >= PIPE_STAGES) return -1;
+    memset(st, 0, sizeof(*st));
+    st->name = stage_names[stage];
+    if (!threaded) return 0;
+    spsc_stats_t s;
+    spsc_get_stats(&rings[stage], &s);
+    st->pushed = s.pushed;
+    st->popped = s.popped;
+    st->depth = spsc_depth(&rings[stage]);
+    st->depth_max = s.depth_max;
+    st->full = s.full;
+    st->lat_avg_us = s.popped ? s.lat_sum_ns / 1000.0 / s.popped : 0;
+    st->lat_max_us = s.lat_max_ns / 1000.0;
+    return 0;
+}
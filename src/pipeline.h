@@ -0,0 +1,57 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include "parser.h"
+
+/*
+ * Optional threaded mode (threaded=1). The main thread stays the only owner
+ * of the interface table, route mirror, history and scheduler; around it:
+ *
+ *   ingest   netlink event socket -> kernel messages  -> main
+ *   collect  main -> poll requests                    -> collector thread
+ *   counters collector thread -> fresh counters       -> main
+ *   alert    main -> interface samples                -> alert thread
+ *
+ * Every hop is a lock-free SPSC ring (spsc.h) plus an eventfd, with depth
+ * and enqueue-to-dequeue latency kept per stage. With threaded=0 (the
+ * default, fine for small hosts) everything runs on the event loop as
+ * before and none of this is started.
+ */
+
+enum {
+    PIPE_INGEST,
+    PIPE_COLLECT,
+    PIPE_COUNTERS,
+    PIPE_ALERT,
+    PIPE_STAGES
+};
+
+typedef struct pipeline_stage_stats {
+    const char *name;
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t depth;
+    uint64_t depth_max;
+    uint64_t full;                     /* producer found the ring full */
+    double lat_avg_us;
+    double lat_max_us;
+} pipeline_stage_stats_t;
+
+/* read threaded / pipeline_ring_kb and set up the rings; before netlink_start() */
+int pipeline_init(void);
+int pipeline_threaded(void);
+/* start the threads (after netlink_start()); 0 in single-threaded mode */
+int pipeline_start(void);
+void pipeline_stop(void);
+
+/* sched: queue a counter refresh for inf; 0, or -1 when the ring is full */
+int pipeline_collect(const iface_info_t *inf);
+/* sched: end of a batch; dump asks for one RTM_GETSTATS dump for all of it */
+void pipeline_collect_flush(int dump);
+/* hand a freshly refreshed interface to the alert thread */
+void pipeline_alert(const iface_info_t *inf, double now);
+
+int pipeline_stage_stats(int stage, pipeline_stage_stats_t *st);
+
+#endif
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include "reactor.h"
+#include "logger.h"
+#include "config.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#define REACTOR_MAX_EVENTS 64
+
+static int epfd = -1;
+static int running = 0;
+static reactor_stats_t stats;
+
+static struct {
+    void (*fn)(void *arg);
+    void *arg;
+} post[REACTOR_MAX_POST];
+static int post_count = 0;
+
+static int dispatching = 0;
+static reactor_handler_t *dead_list = NULL;
+
+static reactor_handler_t sig_handler = { .fd = -1 };
+static void (*sig_cb)(int signo) = NULL;
+
+int reactor_init(void) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        log_err("epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t reactor_et_flag(void) {
+    stats.edge_triggered = config_get_int("event_loop_et", 0) ? 1 : 0;
+    return stats.edge_triggered ? EPOLLET : 0;
+}
+
+static int ctl(int op, reactor_handler_t *h, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = h;
+    return epoll_ctl(epfd, op, h->fd, &ev);
+}
+
+int reactor_add(reactor_handler_t *h, uint32_t events) {
+    if (ctl(EPOLL_CTL_ADD, h, events) < 0) {
+        log_err("epoll_ctl add fd %d failed: %s", h->fd, strerror(errno));
+        return -1;
+    }
+    h->dead = 0;
+    stats.handlers++;
+    return 0;
+}
+
+int reactor_post(void (*fn)(void *arg), void *arg) {
+    if (post_count == REACTOR_MAX_POST) {
+        log_err("reactor: too many post-dispatch hooks");
+        return -1;
+    }
+    post[post_count].fn = fn;
+    post[post_count].arg = arg;
+    post_count++;
+    return 0;
+}
+
+int reactor_mod(reactor_handler_t *h, uint32_t events) {
+    return ctl(EPOLL_CTL_MOD, h, events);
+}
+
+int reactor_del(reactor_handler_t *h) {
+    /* events already returned by epoll_wait may still be queued for h */
+    h->dead = 1;
+    if (epoll_ctl(epfd, EPOLL_CTL_DEL, h->fd, NULL) < 0) return -1;
+    stats.handlers--;
+    return 0;
+}
+
+void reactor_release(reactor_handler_t *h, void (*release)(reactor_handler_t *h)) {
+    reactor_del(h);
+    if (!dispatching) {
+        release(h);
+        return;
+    }
+    h->release = release;
+    h->dead_next = dead_list;
+    dead_list = h;
+}
+
+static void release_dead(void) {
+    while (dead_list) {
+        reactor_handler_t *h = dead_list;
+        dead_list = h->dead_next;
+        h->release(h);
+    }
+}
+
+void reactor_run(void) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    running = 1;
+    while (running) {
+        /* no timeout: everything periodic is a timerfd */
+        int n = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_err("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+        stats.wakeups++;
+        stats.events += (uint64_t)n;
+        dispatching = 1;
+        for (int i = 0; i < n; i++) {
+            reactor_handler_t *h = events[i].data.ptr;
+            if (!h->dead) h->cb(h, events[i].events);
+        }
+        for (int i = 0; i < post_count; i++) post[i].fn(post[i].arg);
+        dispatching = 0;
+        release_dead();
+    }
+}
+
+void reactor_stop(void) {
+    running = 0;
+}
+
+/* ---- timers ---- */
+
+static void timer_cb(reactor_handler_t *h, uint32_t events) {
+    (void)events;
+    reactor_timer_t *t = (reactor_timer_t *)h;
+    uint64_t exp = 0;
+    if (read(h->fd, &exp, sizeof(exp)) != sizeof(exp) || exp == 0) return;
+    stats.timer_fires++;
+    stats.timer_overruns += exp - 1;
+    t->fire(t, exp);
+}
+
+int reactor_timer_init(reactor_timer_t *t, void (*fire)(reactor_timer_t *t, uint64_t expirations), void *arg) {
+    memset(t, 0, sizeof(*t));
+    t->h.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (t->h.fd < 0) {
+        log_err("timerfd_create failed: %s", strerror(errno));
+        return -1;
+    }
+    t->h.cb = timer_cb;
+    t->h.arg = arg;
+    t->fire = fire;
+    t->arg = arg;
+    if (reactor_add(&t->h, EPOLLIN) < 0) {
+        close(t->h.fd);
+        t->h.fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void ms_to_ts(uint64_t ms, struct timespec *ts) {
+    ts->tv_sec = (time_t)(ms / 1000);
+    ts->tv_nsec = (long)(ms % 1000) * 1000000L;
+}
+
+int reactor_timer_arm(reactor_timer_t *t, uint64_t delay_ms, uint64_t interval_ms) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    ms_to_ts(delay_ms, &its.it_value);
+    /* a zero it_value would disarm: fire "now" instead */
+    if (delay_ms == 0) its.it_value.tv_nsec = 1;
+    ms_to_ts(interval_ms, &its.it_interval);
+    t->interval_ms = interval_ms;
+    if (timerfd_settime(t->h.fd, 0, &its, NULL) < 0) {
+        log_err("timerfd_settime failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int reactor_timer_disarm(reactor_timer_t *t) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    t->interval_ms = 0;
+    return timerfd_settime(t->h.fd, 0, &its, NULL);
+}
+
+/* ---- signals ---- */
+
+static void signal_cb(reactor_handler_t *h, uint32_t events) {
+    (void)events;
+    struct signalfd_siginfo si;
+    while (read(h->fd, &si, sizeof(si)) == sizeof(si)) {
+        stats.signals++;
+        if (sig_cb) sig_cb((int)si.ssi_signo);
+    }
+}
+
+int reactor_signals(const sigset_t *mask, void (*cb)(int signo)) {
+    if (sigprocmask(SIG_BLOCK, mask, NULL) < 0) {
+        log_err("sigprocmask failed: %s", strerror(errno));
+        return -1;
+    }
+    int fd = signalfd(sig_handler.fd, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        log_err("signalfd failed: %s", strerror(errno));
+        return -1;
+    }
+    sig_cb = cb;
+    if (sig_handler.fd < 0) {
+        sig_handler.fd = fd;
+        sig_handler.cb = signal_cb;
+        if (reactor_add(&sig_handler, EPOLLIN) < 0) return -1;
+    }
+    return 0;
+}
+
+const reactor_stats_t *reactor_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,72 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#define REACTOR_MAX_POST 8
+
+#include <stdint.h>
+#include <signal.h>
+
+/*
+ * epoll event loop. Every registered fd carries a reactor_handler_t in
+ * epoll_data.ptr, so dispatch is a single indirect call. Periodic and
+ * one-shot work uses timerfd (CLOCK_MONOTONIC, absolute periods: no drift),
+ * signals arrive through a signalfd.
+ */
+
+typedef struct reactor_handler reactor_handler_t;
+typedef void (*reactor_cb)(reactor_handler_t *h, uint32_t events);
+
+struct reactor_handler {
+    int fd;
+    reactor_cb cb;
+    void *arg;
+    /* reactor-private */
+    int dead;                          /* deleted: skip its queued events */
+    reactor_handler_t *dead_next;
+    void (*release)(reactor_handler_t *h);
+};
+
+typedef struct reactor_timer {
+    reactor_handler_t h;               /* h.fd is the timerfd */
+    void (*fire)(struct reactor_timer *t, uint64_t expirations);
+    void *arg;
+    uint64_t interval_ms;
+} reactor_timer_t;
+
+typedef struct reactor_stats {
+    uint64_t wakeups;                  /* epoll_wait returns */
+    uint64_t events;
+    uint64_t timer_fires;
+    uint64_t timer_overruns;           /* expirations beyond the first per fire */
+    uint64_t signals;
+    int handlers;
+    int edge_triggered;                /* event_loop_et */
+} reactor_stats_t;
+
+int reactor_init(void);
+void reactor_run(void);
+void reactor_stop(void);
+
+/* events may include EPOLLET; handlers then must drain until EAGAIN */
+int reactor_add(reactor_handler_t *h, uint32_t events);
+int reactor_mod(reactor_handler_t *h, uint32_t events);
+int reactor_del(reactor_handler_t *h);
+/* reactor_del, then release(h) once no event of the batch being dispatched
+ * can still reach h: the way to free a handler from inside a callback */
+void reactor_release(reactor_handler_t *h, void (*release)(reactor_handler_t *h));
+/* run fn after every batch of dispatched events (at most REACTOR_MAX_POST) */
+int reactor_post(void (*fn)(void *arg), void *arg);
+/* EPOLLET when event_loop_et=1 in the config, else 0 */
+uint32_t reactor_et_flag(void);
+
+/* first expiry after delay_ms, then every interval_ms (0: one-shot) */
+int reactor_timer_init(reactor_timer_t *t, void (*fire)(reactor_timer_t *t, uint64_t expirations), void *arg);
+int reactor_timer_arm(reactor_timer_t *t, uint64_t delay_ms, uint64_t interval_ms);
+int reactor_timer_disarm(reactor_timer_t *t);
+
+/* block the signals in mask (call before starting threads) and deliver them to cb */
+int reactor_signals(const sigset_t *mask, void (*cb)(int signo));
+
+const reactor_stats_t *reactor_get_stats(void);
+
+#endif
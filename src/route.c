@@ -0,0 +1,428 @@
+#define _GNU_SOURCE
+#include "route.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/* 路径压缩前缀树节点：key 只保存前 plen 位有效的地址（4 或 16 字节） */
+typedef struct rt_node {
+    struct rt_node *child[2];
+    rt_entry_t *routes;                /* NULL: 仅作分叉用的中间节点 */
+    uint8_t plen;
+    uint8_t key[];
+} rt_node_t;
+
+typedef struct rt_table {
+    uint32_t id;
+    rt_node_t *root[2];                /* [0] IPv4, [1] IPv6 */
+    size_t routes[2];
+    size_t prefixes[2];
+    size_t nodes[2];
+    size_t memory;
+} rt_table_t;
+
+static rt_table_t *tables = NULL;
+static int table_count = 0;
+static int table_cap = 0;
+
+/* route_sync_begin 移走的旧路由表，dump 失败时恢复 */
+static rt_table_t *saved_tables = NULL;
+static int saved_count = 0;
+static int saved_cap = 0;
+
+static int fam_idx(int family) {
+    if (family == AF_INET) return 0;
+    if (family == AF_INET6) return 1;
+    return -1;
+}
+
+static const size_t key_len[2] = { 4, 16 };
+static const int max_len[2] = { 32, 128 };
+
+static inline int key_bit(const uint8_t *key, int i) {
+    return (key[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/* a、b 前 maxbits 位中相同前缀的长度 */
+static int common_len(const uint8_t *a, const uint8_t *b, int maxbits) {
+    int bits = 0;
+    for (int i = 0; bits < maxbits; i++, bits += 8) {
+        uint8_t x = a[i] ^ b[i];
+        if (x) {
+            bits += __builtin_clz((unsigned)x) - 24;
+            break;
+        }
+    }
+    return bits < maxbits ? bits : maxbits;
+}
+
+/* addr 的前 plen 位是否与 key 相同 */
+static inline int prefix_match(const uint8_t *key, const uint8_t *addr, int plen) {
+    int full = plen >> 3;
+    if (memcmp(key, addr, full) != 0) return 0;
+    int rem = plen & 7;
+    if (!rem) return 1;
+    uint8_t mask = (uint8_t)(0xff << (8 - rem));
+    return ((key[full] ^ addr[full]) & mask) == 0;
+}
+
+/* out 只写 len 字节 */
+static void mask_key(uint8_t *out, const uint8_t *addr, int plen, size_t len) {
+    memmove(out, addr, len);
+    int full = plen >> 3;
+    int rem = plen & 7;
+    if ((size_t)full < len) {
+        if (rem) out[full] &= (uint8_t)(0xff << (8 - rem));
+        else out[full] = 0;
+        for (size_t i = (size_t)full + 1; i < len; i++) out[i] = 0;
+    }
+}
+
+static rt_table_t *table_get(uint32_t id, int create) {
+    for (int i = 0; i < table_count; i++) {
+        if (tables[i].id == id) return &tables[i];
+    }
+    if (!create) return NULL;
+    if (table_count == table_cap) {
+        int cap = table_cap ? table_cap * 2 : 8;
+        rt_table_t *n = realloc(tables, (size_t)cap * sizeof(*n));
+        if (!n) {
+            log_err("Failed to grow route table list to %d", cap);
+            return NULL;
+        }
+        tables = n;
+        table_cap = cap;
+    }
+    rt_table_t *t = &tables[table_count++];
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    return t;
+}
+
+static rt_node_t *node_new(rt_table_t *t, int fi, const uint8_t *key, int plen) {
+    size_t sz = sizeof(rt_node_t) + key_len[fi];
+    rt_node_t *n = malloc(sz);
+    if (!n) return NULL;
+    n->child[0] = n->child[1] = NULL;
+    n->routes = NULL;
+    n->plen = (uint8_t)plen;
+    mask_key(n->key, key, plen, key_len[fi]);
+    t->nodes[fi]++;
+    t->memory += sz;
+    return n;
+}
+
+static void node_free(rt_table_t *t, int fi, rt_node_t *n) {
+    t->nodes[fi]--;
+    t->memory -= sizeof(rt_node_t) + key_len[fi];
+    free(n);
+}
+
+static size_t entry_size(const rt_entry_t *e) {
+    return sizeof(rt_entry_t) + e->nh_count * sizeof(rt_nexthop_t) +
+           e->metric_count * sizeof(rt_metric_t);
+}
+
+static void entry_free(rt_table_t *t, rt_entry_t *e) {
+    t->memory -= entry_size(e);
+    free(e->metrics);
+    free(e);
+}
+
+/* 查找或创建 (key, plen) 对应的节点 */
+static rt_node_t *trie_insert(rt_table_t *t, int fi, const uint8_t *key, int plen) {
+    rt_node_t **pp = &t->root[fi];
+    while (*pp) {
+        rt_node_t *n = *pp;
+        int limit = plen < n->plen ? plen : n->plen;
+        int common = common_len(key, n->key, limit);
+        if (common < n->plen) {
+            if (common == plen) {
+                /* 新前缀是 n 的前缀：插在 n 之上 */
+                rt_node_t *nn = node_new(t, fi, key, plen);
+                if (!nn) return NULL;
+                nn->child[key_bit(n->key, plen)] = n;
+                *pp = nn;
+                return nn;
+            }
+            /* 在 common 位分叉：中间节点 + 新叶子 */
+            rt_node_t *leaf = node_new(t, fi, key, plen);
+            if (!leaf) return NULL;
+            rt_node_t *glue = node_new(t, fi, key, common);
+            if (!glue) {
+                node_free(t, fi, leaf);
+                return NULL;
+            }
+            glue->child[key_bit(key, common)] = leaf;
+            glue->child[key_bit(n->key, common)] = n;
+            *pp = glue;
+            return leaf;
+        }
+        if (plen == n->plen) return n;
+        pp = &n->child[key_bit(key, n->plen)];
+    }
+    *pp = node_new(t, fi, key, plen);
+    return *pp;
+}
+
+/* 精确查找，path 记录经过的指针位置，返回深度（0 表示未找到） */
+static int trie_find(rt_table_t *t, int fi, const uint8_t *key, int plen, rt_node_t ***path) {
+    rt_node_t **pp = &t->root[fi];
+    int depth = 0;
+    while (*pp) {
+        rt_node_t *n = *pp;
+        if (n->plen > plen || !prefix_match(n->key, key, n->plen)) return 0;
+        path[depth++] = pp;
+        if (n->plen == plen) return depth;
+        pp = &n->child[key_bit(key, n->plen)];
+    }
+    return 0;
+}
+
+/* 删除已无路由的节点，并合并只剩一个孩子的中间父节点 */
+static void trie_prune(rt_table_t *t, int fi, rt_node_t ***path, int depth) {
+    rt_node_t *n = *path[depth - 1];
+    if (n->routes || (n->child[0] && n->child[1])) return;
+    rt_node_t *c = n->child[0] ? n->child[0] : n->child[1];
+    *path[depth - 1] = c;
+    node_free(t, fi, n);
+    if (c || depth < 2) return;
+    rt_node_t *parent = *path[depth - 2];
+    if (parent->routes) return;
+    rt_node_t *rest = parent->child[0] ? parent->child[0] : parent->child[1];
+    *path[depth - 2] = rest;
+    node_free(t, fi, parent);
+}
+
+static rt_entry_t *entry_new(rt_table_t *t, const rt_route_t *r) {
+    int nh = r->nh_count > 0 ? r->nh_count : 0;
+    rt_entry_t *e = malloc(sizeof(rt_entry_t) + (size_t)nh * sizeof(rt_nexthop_t));
+    if (!e) return NULL;
+    e->next = NULL;
+    e->priority = r->priority;
+    e->tos = r->tos;
+    e->protocol = r->protocol;
+    e->scope = r->scope;
+    e->type = r->type;
+    e->nh_count = (uint16_t)nh;
+    e->metric_count = 0;
+    e->metrics = NULL;
+    if (nh) memcpy(e->nh, r->nh, (size_t)nh * sizeof(rt_nexthop_t));
+    if (r->metric_count > 0) {
+        e->metrics = malloc((size_t)r->metric_count * sizeof(rt_metric_t));
+        if (e->metrics) {
+            memcpy(e->metrics, r->metrics, (size_t)r->metric_count * sizeof(rt_metric_t));
+            e->metric_count = (uint16_t)r->metric_count;
+        }
+    }
+    t->memory += entry_size(e);
+    return e;
+}
+
+/* IPv6 允许同前缀同 metric 的路由经不同出接口共存（如各链路的 fe80::/64） */
+static int same_route(const rt_entry_t *e, const rt_route_t *r, int fi) {
+    if (e->tos != r->tos) return 0;
+    if (fi == 1 && e->nh_count && r->nh_count > 0 && e->nh[0].oif != r->nh[0].oif) return 0;
+    return 1;
+}
+
+int route_add(const rt_route_t *r) {
+    int fi = fam_idx(r->family);
+    if (fi < 0 || r->dst_len > max_len[fi]) return -1;
+    rt_table_t *t = table_get(r->table, 1);
+    if (!t) return -1;
+
+    /* 先分配路由再插入节点，失败时不会在树里留下空节点 */
+    rt_entry_t *e = entry_new(t, r);
+    if (!e) {
+        log_err("route table %u: out of memory storing route", r->table);
+        return -1;
+    }
+    uint8_t key[16];
+    mask_key(key, r->dst, r->dst_len, key_len[fi]);
+    rt_node_t *n = trie_insert(t, fi, key, r->dst_len);
+    if (!n) {
+        log_err("route table %u: out of memory inserting prefix", r->table);
+        entry_free(t, e);
+        return -1;
+    }
+
+    /* 相同 tos + priority（IPv6 还要同一出接口）视为替换 */
+    int had = n->routes != NULL;
+    for (rt_entry_t **pp = &n->routes; *pp; pp = &(*pp)->next) {
+        if (same_route(*pp, r, fi) && (*pp)->priority == r->priority) {
+            rt_entry_t *old = *pp;
+            *pp = old->next;
+            entry_free(t, old);
+            t->routes[fi]--;
+            break;
+        }
+    }
+    if (!had) t->prefixes[fi]++;
+    rt_entry_t **pp = &n->routes;
+    while (*pp && (*pp)->priority <= e->priority) pp = &(*pp)->next;
+    e->next = *pp;
+    *pp = e;
+    t->routes[fi]++;
+    return 0;
+}
+
+int route_del(const rt_route_t *r) {
+    int fi = fam_idx(r->family);
+    if (fi < 0 || r->dst_len > max_len[fi]) return -1;
+    rt_table_t *t = table_get(r->table, 0);
+    if (!t) return -1;
+
+    uint8_t key[16];
+    rt_node_t **path[130];
+    mask_key(key, r->dst, r->dst_len, key_len[fi]);
+    int depth = trie_find(t, fi, key, r->dst_len, path);
+    if (!depth) return -1;
+
+    rt_node_t *n = *path[depth - 1];
+    for (rt_entry_t **pp = &n->routes; *pp; pp = &(*pp)->next) {
+        rt_entry_t *e = *pp;
+        if (same_route(e, r, fi) && (r->priority == 0 || e->priority == r->priority)) {
+            *pp = e->next;
+            entry_free(t, e);
+            t->routes[fi]--;
+            if (!n->routes) {
+                t->prefixes[fi]--;
+                trie_prune(t, fi, path, depth);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int entry_uses_oif(const rt_entry_t *e, int oif) {
+    for (int i = 0; i < e->nh_count; i++) {
+        if (e->nh[i].oif == oif) return 1;
+    }
+    return 0;
+}
+
+/* 删除子树中经过 oif 的路由，并回收因此变空的节点；返回删除条数 */
+static size_t prune_oif(rt_table_t *t, int fi, rt_node_t **pp, int oif) {
+    rt_node_t *n = *pp;
+    if (!n) return 0;
+    size_t removed = prune_oif(t, fi, &n->child[0], oif) + prune_oif(t, fi, &n->child[1], oif);
+    int had = n->routes != NULL;
+    for (rt_entry_t **ep = &n->routes; *ep;) {
+        rt_entry_t *e = *ep;
+        if (entry_uses_oif(e, oif)) {
+            *ep = e->next;
+            entry_free(t, e);
+            t->routes[fi]--;
+            removed++;
+        } else {
+            ep = &e->next;
+        }
+    }
+    if (n->routes) return removed;
+    if (had) t->prefixes[fi]--;
+    /* 无路由的节点只在有两个孩子时作为分叉保留 */
+    if (n->child[0] && n->child[1]) return removed;
+    *pp = n->child[0] ? n->child[0] : n->child[1];
+    node_free(t, fi, n);
+    return removed;
+}
+
+size_t route_prune_oif(int oif) {
+    size_t removed = 0;
+    for (int i = 0; i < table_count; i++) {
+        for (int fi = 0; fi < 2; fi++) {
+            removed += prune_oif(&tables[i], fi, &tables[i].root[fi], oif);
+        }
+    }
+    return removed;
+}
+
+static void free_subtree(rt_table_t *t, int fi, rt_node_t *n) {
+    if (!n) return;
+    free_subtree(t, fi, n->child[0]);
+    free_subtree(t, fi, n->child[1]);
+    while (n->routes) {
+        rt_entry_t *e = n->routes;
+        n->routes = e->next;
+        entry_free(t, e);
+    }
+    node_free(t, fi, n);
+}
+
+static void tables_free(rt_table_t *t, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int fi = 0; fi < 2; fi++) {
+            free_subtree(&t[i], fi, t[i].root[fi]);
+        }
+    }
+    free(t);
+}
+
+void route_flush(void) {
+    tables_free(tables, table_count);
+    tables = NULL;
+    table_count = table_cap = 0;
+}
+
+void route_sync_begin(void) {
+    tables_free(saved_tables, saved_count);
+    saved_tables = tables;
+    saved_count = table_count;
+    saved_cap = table_cap;
+    tables = NULL;
+    table_count = table_cap = 0;
+}
+
+void route_sync_end(int complete) {
+    if (!complete) {
+        route_flush();
+        tables = saved_tables;
+        table_count = saved_count;
+        table_cap = saved_cap;
+    } else {
+        tables_free(saved_tables, saved_count);
+    }
+    saved_tables = NULL;
+    saved_count = saved_cap = 0;
+}
+
+const rt_entry_t *route_lookup(uint32_t table, int family, const void *addr, int *plen, uint8_t *prefix) {
+    int fi = fam_idx(family);
+    if (fi < 0) return NULL;
+    rt_table_t *t = table_get(table, 0);
+    if (!t) return NULL;
+
+    const uint8_t *a = addr;
+    const rt_node_t *best = NULL;
+    const rt_node_t *n = t->root[fi];
+    while (n) {
+        if (!prefix_match(n->key, a, n->plen)) break;
+        if (n->routes) best = n;
+        if (n->plen >= max_len[fi]) break;
+        n = n->child[key_bit(a, n->plen)];
+    }
+    if (!best) return NULL;
+    if (plen) *plen = best->plen;
+    if (prefix) memcpy(prefix, best->key, key_len[fi]);
+    return best->routes;
+}
+
+int route_table_count(void) {
+    return table_count;
+}
+
+int route_table_stats(int i, rt_table_stats_t *st) {
+    if (i < 0 || i >= table_count) return -1;
+    const rt_table_t *t = &tables[i];
+    st->table = t->id;
+    for (int fi = 0; fi < 2; fi++) {
+        st->routes[fi] = t->routes[fi];
+        st->prefixes[fi] = t->prefixes[fi];
+        st->nodes[fi] = t->nodes[fi];
+    }
+    st->memory = t->memory;
+    return 0;
+}
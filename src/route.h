@@ -0,0 +1,82 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 路由表镜像：每个 (table, family) 一棵路径压缩二叉前缀树（LPM），
+ * 启动时由 RTM_GETROUTE dump 填充，之后随 RTM_NEWROUTE/RTM_DELROUTE 增量更新。
+ */
+
+typedef struct rt_nexthop {
+    int oif;
+    uint16_t weight;                   /* rtnh_hops + 1，最大 256 */
+    uint8_t flags;                     /* RTNH_F_* */
+    uint8_t gw_family;                 /* 0: 无网关 */
+    uint8_t gw[16];
+} rt_nexthop_t;
+
+typedef struct rt_metric {
+    uint16_t type;                     /* RTAX_* */
+    uint32_t value;
+} rt_metric_t;
+
+/* 解析后的路由，作为 route_add/route_del 的输入 */
+typedef struct rt_route {
+    uint32_t table;
+    uint8_t family;
+    uint8_t dst_len;
+    uint8_t tos;
+    uint8_t protocol;
+    uint8_t scope;
+    uint8_t type;
+    uint8_t dst[16];
+    uint32_t priority;                 /* RTA_PRIORITY，路由 metric */
+    int nh_count;
+    const rt_nexthop_t *nh;
+    int metric_count;
+    const rt_metric_t *metrics;        /* RTA_METRICS */
+} rt_route_t;
+
+/* 树中保存的路由；同一前缀的多条按 priority 升序链接 */
+typedef struct rt_entry {
+    struct rt_entry *next;
+    uint32_t priority;
+    uint8_t tos;
+    uint8_t protocol;
+    uint8_t scope;
+    uint8_t type;
+    uint16_t nh_count;
+    uint16_t metric_count;
+    rt_metric_t *metrics;
+    rt_nexthop_t nh[];
+} rt_entry_t;
+
+typedef struct rt_table_stats {
+    uint32_t table;
+    size_t routes[2];                  /* [0] IPv4, [1] IPv6 */
+    size_t prefixes[2];
+    size_t nodes[2];
+    size_t memory;                     /* 节点 + 路由 + metrics 字节数 */
+} rt_table_stats_t;
+
+/* 新增或替换 (table, dst, tos, priority) 相同的路由（IPv6 另比较首个出接口）；返回 0 / -1 */
+int route_add(const rt_route_t *r);
+/* 删除匹配的路由；priority 为 0 时匹配该前缀下第一条 tos 相同的路由 */
+int route_del(const rt_route_t *r);
+void route_flush(void);
+/* 全量同步：begin 移走现有路由表并从空表开始填充；end 时 dump 完整则释放旧表，
+ * 否则丢弃不完整的新表并恢复旧表 */
+void route_sync_begin(void);
+void route_sync_end(int complete);
+/* 链路删除时内核不逐条通告 RTM_DELROUTE：删除任一下一跳经过 oif 的路由，返回条数 */
+size_t route_prune_oif(int oif);
+
+/* 最长前缀匹配：addr 为 4/16 字节网络序；返回首选路由，plen 输出匹配前缀长度 */
+const rt_entry_t *route_lookup(uint32_t table, int family, const void *addr, int *plen, uint8_t *prefix);
+
+int route_table_count(void);
+int route_table_stats(int i, rt_table_stats_t *st);
+
+#endif
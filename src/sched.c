@@ -0,0 +1,514 @@
+#define _GNU_SOURCE
+#include "sched.h"
+#include "parser.h"
+#include "metrics.h"
+#include "alert.h"
+#include "history.h"
+#include "pipeline.h"
+#include "reactor.h"
+#include "config.h"
+#include "logger.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fnmatch.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define SCHED_TICK_DEFAULT 100
+#define SCHED_BUDGET_DEFAULT 256
+#define SCHED_DUMP_MIN_DEFAULT 32
+#define SCHED_DUMP_PCT_DEFAULT 10
+#define SCHED_RECONCILE_DEFAULT 5000
+#define SCHED_BUSY_PPS_DEFAULT 100.0
+
+typedef struct poll_class {
+    char name[32];
+    char match[64];
+    uint32_t min_ms;
+    uint32_t max_ms;
+    double busy_pps;
+    uint64_t polls;
+} poll_class_t;
+
+typedef struct sched_node {
+    struct sched_node *next;
+    struct sched_node **pprev;         /* NULL: not in the wheel */
+    uint64_t expires;                  /* tick */
+    uint8_t level;
+    uint8_t slot;
+    int pos;                           /* index in nodes[] */
+    int ifindex;
+    int cls;
+    uint32_t interval_ms;
+    char ifname[IFNAMSIZ];             /* name the class was matched for */
+    double last_t;                     /* previous sample, 0: none */
+    uint64_t last_packets;
+    uint64_t last_faults;              /* errors + drops */
+} sched_node_t;
+
+static sched_node_t *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t occupied[WHEEL_LEVELS];
+static uint64_t cur_tick = 0;
+static uint64_t start_ms = 0;
+
+static sched_node_t **nodes = NULL;    /* dense */
+static int node_count = 0;
+static int node_cap = 0;
+static int *node_map = NULL;           /* ifindex -> position + 1 */
+static int node_map_cap = 0;
+
+static poll_class_t *classes = NULL;
+static int class_count = 0;
+static int class_cap = 0;
+
+static int tick_ms = SCHED_TICK_DEFAULT;
+static int budget = SCHED_BUDGET_DEFAULT;
+static int dump_min = SCHED_DUMP_MIN_DEFAULT;
+static int dump_pct = SCHED_DUMP_PCT_DEFAULT;
+static int reconcile_ms = SCHED_RECONCILE_DEFAULT;
+static uint32_t seen_gen = 0;
+static uint64_t next_reconcile = 0;    /* tick */
+
+static sched_node_t **due = NULL;
+static int due_cap = 0;
+
+static reactor_timer_t timer;
+static sched_stats_t stats;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint64_t now_tick(void) {
+    return (now_ms() - start_ms) / (uint64_t)tick_ms;
+}
+
+static uint64_t ms_to_ticks(uint32_t ms) {
+    uint64_t t = (ms + (uint32_t)tick_ms - 1) / (uint32_t)tick_ms;
+    return t ? t : 1;
+}
+
+/* ---- wheel ---- */
+
+static void wheel_add(sched_node_t *n) {
+    if (n->expires < cur_tick) n->expires = cur_tick;
+    uint64_t delta = n->expires - cur_tick;
+    if (delta >= WHEEL_SPAN) {
+        n->expires = cur_tick + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) level++;
+    int slot = (int)((n->expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    sched_node_t **head = &wheel[level][slot];
+    n->next = *head;
+    if (n->next) n->next->pprev = &n->next;
+    n->pprev = head;
+    *head = n;
+    n->level = (uint8_t)level;
+    n->slot = (uint8_t)slot;
+    occupied[level] |= (uint64_t)1 << slot;
+}
+
+static void wheel_del(sched_node_t *n) {
+    if (!n->pprev) return;
+    *n->pprev = n->next;
+    if (n->next) n->next->pprev = n->pprev;
+    n->pprev = NULL;
+    if (!wheel[n->level][n->slot]) occupied[n->level] &= ~((uint64_t)1 << n->slot);
+}
+
+static sched_node_t *wheel_take(int level, int slot) {
+    sched_node_t *list = wheel[level][slot];
+    wheel[level][slot] = NULL;
+    occupied[level] &= ~((uint64_t)1 << slot);
+    for (sched_node_t *n = list; n; n = n->next) n->pprev = NULL;
+    return list;
+}
+
+/* move the slot of the next level that covers cur_tick down one level */
+static void cascade(void) {
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        int slot = (int)((cur_tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+        sched_node_t *n = wheel_take(level, slot);
+        while (n) {
+            sched_node_t *next = n->next;
+            wheel_add(n);
+            n = next;
+        }
+        if (slot != 0) break;
+    }
+}
+
+/* ticks from cur_tick to the next level-0 slot with entries (or the next cascade) */
+static uint64_t next_expiry(void) {
+    int base = (int)(cur_tick & WHEEL_MASK);
+    uint64_t occ = occupied[0];
+    if (occ) {
+        uint64_t rot = (occ >> base) | (base ? occ << (WHEEL_SIZE - base) : 0);
+        uint64_t dist = (uint64_t)__builtin_ctzll(rot);
+        if (dist < (uint64_t)(WHEEL_SIZE - base)) return cur_tick + dist;
+    }
+    /* nothing before the wrap: wake at the next cascade point */
+    return (cur_tick | WHEEL_MASK) + 1;
+}
+
+/* ---- classes ---- */
+
+static int add_class(const poll_class_t *c) {
+    if (class_count == class_cap) {
+        int cap = class_cap ? class_cap * 2 : 4;
+        poll_class_t *n = realloc(classes, (size_t)cap * sizeof(*n));
+        if (!n) return -1;
+        classes = n;
+        class_cap = cap;
+    }
+    classes[class_count++] = *c;
+    return 0;
+}
+
+static void load_class_cb(const char *value, void *arg) {
+    (void)arg;
+    poll_class_t c;
+    unsigned min_ms, max_ms;
+    int used = 0;
+    memset(&c, 0, sizeof(c));
+    c.busy_pps = SCHED_BUSY_PPS_DEFAULT;
+    if (sscanf(value, "%31s %u %u %63s%n", c.name, &min_ms, &max_ms, c.match, &used) != 4 ||
+        min_ms == 0 || max_ms < min_ms) {
+        log_err("sched: cannot parse poll_class '%s'", value);
+        return;
+    }
+    const char *p = strstr(value + used, "busy_pps=");
+    if (p) c.busy_pps = strtod(p + 9, NULL);
+    c.min_ms = min_ms;
+    c.max_ms = max_ms;
+    add_class(&c);
+}
+
+static int match_class(const char *ifname) {
+    for (int i = 0; i < class_count; i++) {
+        if (fnmatch(classes[i].match, ifname, 0) == 0) return i;
+    }
+    return class_count - 1;              /* the catch-all added last */
+}
+
+static void node_set_class(sched_node_t *n, const char *ifname) {
+    memcpy(n->ifname, ifname, IFNAMSIZ);
+    n->cls = match_class(ifname);
+    const poll_class_t *c = &classes[n->cls];
+    if (n->interval_ms < c->min_ms) n->interval_ms = c->min_ms;
+    if (n->interval_ms > c->max_ms) n->interval_ms = c->max_ms;
+}
+
+/* ---- nodes ---- */
+
+static sched_node_t *node_find(int ifindex) {
+    if (ifindex <= 0 || ifindex >= node_map_cap || !node_map[ifindex]) return NULL;
+    return nodes[node_map[ifindex] - 1];
+}
+
+static sched_node_t *node_new(iface_info_t *inf) {
+    if (inf->ifindex >= node_map_cap) {
+        int cap = (int)hash_pow2((uint32_t)inf->ifindex + 1);
+        if (cap < 256) cap = 256;
+        int *m = realloc(node_map, (size_t)cap * sizeof(int));
+        if (!m) return NULL;
+        memset(m + node_map_cap, 0, (size_t)(cap - node_map_cap) * sizeof(int));
+        node_map = m;
+        node_map_cap = cap;
+    }
+    if (node_count == node_cap) {
+        int cap = node_cap ? node_cap * 2 : 64;
+        sched_node_t **a = realloc(nodes, (size_t)cap * sizeof(*a));
+        if (!a) return NULL;
+        nodes = a;
+        node_cap = cap;
+    }
+    sched_node_t *n = calloc(1, sizeof(*n));
+    if (!n) return NULL;
+    n->ifindex = inf->ifindex;
+    n->pos = node_count;
+    node_set_class(n, inf->ifname);
+    n->interval_ms = classes[n->cls].min_ms;
+    nodes[node_count++] = n;
+    node_map[n->ifindex] = node_count;
+    stats.nodes = node_count;
+    return n;
+}
+
+static void node_free(sched_node_t *n) {
+    wheel_del(n);
+    node_map[n->ifindex] = 0;
+    node_count--;
+    if (n->pos != node_count) {
+        nodes[n->pos] = nodes[node_count];
+        nodes[n->pos]->pos = n->pos;
+        node_map[nodes[n->pos]->ifindex] = n->pos + 1;
+    }
+    stats.nodes = node_count;
+    free(n);
+}
+
+/* pick up new and renamed interfaces; vanished ones are freed when they come due */
+static void reconcile(void) {
+    uint32_t gen = iface_table_gen();
+    if (gen == seen_gen) return;
+    seen_gen = gen;
+    stats.reconciles++;
+
+    int count = get_iface_count();
+    for (int pos = 0; pos < count; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        sched_node_t *n = node_find(inf->ifindex);
+        if (n) {
+            if (strcmp(n->ifname, inf->ifname) != 0) node_set_class(n, inf->ifname);
+            continue;
+        }
+        n = node_new(inf);
+        if (!n) {
+            log_err("sched: out of memory adding %s", inf->ifname);
+            return;
+        }
+        /* spread first polls over the class minimum instead of one burst */
+        n->expires = cur_tick + (uint64_t)inf->ifindex % ms_to_ticks(n->interval_ms);
+        wheel_add(n);
+    }
+    alert_sweep();
+    history_sweep();
+}
+
+/* next interval from what moved since the previous sample */
+static void adapt(sched_node_t *n, const iface_info_t *inf, double now) {
+    const poll_class_t *c = &classes[n->cls];
+    uint64_t packets = inf->stats.rx_packets + inf->stats.tx_packets;
+    uint64_t faults = inf->stats.rx_err + inf->stats.tx_err + inf->stats.rx_dropped + inf->stats.tx_dropped;
+
+    if (n->last_t > 0 && now > n->last_t) {
+        double pps = packets >= n->last_packets ? (packets - n->last_packets) / (now - n->last_t) : 0;
+        uint32_t iv = n->interval_ms;
+        if (faults != n->last_faults) iv = c->min_ms;
+        else if (pps >= c->busy_pps) iv /= 2;
+        else if (packets == n->last_packets) iv *= 2;
+        if (iv < c->min_ms) iv = c->min_ms;
+        if (iv > c->max_ms) iv = c->max_ms;
+        n->interval_ms = iv;
+    }
+    n->last_t = now;
+    n->last_packets = packets;
+    n->last_faults = faults;
+}
+
+/* after a refresh: rules, history, next interval */
+static void sampled(sched_node_t *n, iface_info_t *inf, double now) {
+    if (pipeline_threaded()) pipeline_alert(inf, now);
+    else alert_eval_iface(inf, now);
+    history_record(inf);
+    adapt(n, inf, now);
+}
+
+/* a dump walks the whole table: only worth it when enough of it is due */
+static int dump_pays(int due_count) {
+    return due_count >= dump_min && (int64_t)due_count * 100 >= (int64_t)get_iface_count() * dump_pct;
+}
+
+/* threaded: requests go to the collector, results come back via sched_collected() */
+static void run_due_threaded(int live) {
+    int queued = 0;
+    for (int i = 0; i < live; i++) {
+        sched_node_t *n = due[i];
+        if (pipeline_collect(get_iface_by_index(n->ifindex)) == 0) {
+            queued++;
+            classes[n->cls].polls++;
+            stats.polls++;
+        }
+        n->expires = cur_tick - 1 + ms_to_ticks(n->interval_ms);
+        wheel_add(n);
+    }
+    int dump = dump_pays(queued);
+    if (dump) stats.dumps++;
+    else stats.single_requests += (uint64_t)queued;
+    pipeline_collect_flush(dump);
+}
+
+void sched_collected(int ifindex, const iface_counters_t *c, double now) {
+    iface_info_t *inf = get_iface_by_index(ifindex);
+    sched_node_t *n = node_find(ifindex);
+    if (!inf || !n) return;
+    iface_set_counters(inf, c);
+    sampled(n, inf, now);
+}
+
+static void run_due(int ndue) {
+    int take = ndue < budget ? ndue : budget;
+    double now = now_ms() / 1000.0;
+
+    /* over budget: the rest go first next tick */
+    for (int i = take; i < ndue; i++) {
+        due[i]->expires = cur_tick;
+        wheel_add(due[i]);
+        stats.deferred++;
+    }
+
+    int live = 0;
+    for (int i = 0; i < take; i++) {
+        if (get_iface_by_index(due[i]->ifindex)) due[live++] = due[i];
+        else node_free(due[i]);
+    }
+    if (pipeline_threaded()) {
+        if (live) run_due_threaded(live);
+        return;
+    }
+    int dump = dump_pays(live);
+    if (dump) {
+        metrics_poll_once();
+        stats.dumps++;
+    }
+    for (int i = 0; i < live; i++) {
+        sched_node_t *n = due[i];
+        iface_info_t *inf = get_iface_by_index(n->ifindex);
+        if (!dump) {
+            metrics_poll_iface(inf);
+            stats.single_requests++;
+            /* the request path never changes the table, but be strict about it */
+            inf = get_iface_by_index(n->ifindex);
+            if (!inf) {
+                node_free(n);
+                continue;
+            }
+        }
+        sampled(n, inf, now);
+        classes[n->cls].polls++;
+        stats.polls++;
+        n->expires = cur_tick - 1 + ms_to_ticks(n->interval_ms);
+        wheel_add(n);
+    }
+}
+
+static void timer_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)expirations;
+    uint64_t target = now_tick();
+    int ndue = 0;
+
+    if (target >= next_reconcile) {
+        reconcile();
+        next_reconcile = target + ms_to_ticks((uint32_t)reconcile_ms);
+    }
+
+    while (cur_tick <= target) {
+        if ((cur_tick & WHEEL_MASK) == 0) cascade();
+        for (sched_node_t *n = wheel_take(0, (int)(cur_tick & WHEEL_MASK)); n; ) {
+            sched_node_t *next = n->next;
+            if (ndue == due_cap) {
+                int cap = due_cap ? due_cap * 2 : 256;
+                sched_node_t **d = realloc(due, (size_t)cap * sizeof(*d));
+                if (!d) {
+                    /* keep it scheduled, try again next tick */
+                    n->expires = cur_tick + 1;
+                    wheel_add(n);
+                    n = next;
+                    continue;
+                }
+                due = d;
+                due_cap = cap;
+            }
+            due[ndue++] = n;
+            n = next;
+        }
+        cur_tick++;
+        stats.ticks++;
+    }
+    if (ndue) run_due(ndue);
+
+    /* sleep until the next occupied slot, a cascade point or the reconcile check */
+    uint64_t next = next_expiry();
+    if (next > next_reconcile) next = next_reconcile;
+    uint64_t at_ms = start_ms + next * (uint64_t)tick_ms;
+    uint64_t now = now_ms();
+    reactor_timer_arm(t, at_ms > now ? at_ms - now : 0, 0);
+}
+
+void sched_configure(void) {
+    class_count = 0;
+    config_foreach("poll_class", load_class_cb, NULL);
+    /* catch-all from the old fixed period: 1/5 of it busy, 6x idle */
+    double sec = config_get_double("poll_interval_sec", 5);
+    poll_class_t def;
+    memset(&def, 0, sizeof(def));
+    strcpy(def.name, "default");
+    strcpy(def.match, "*");
+    def.min_ms = (uint32_t)(sec * 200);
+    def.max_ms = (uint32_t)(sec * 6000);
+    if (def.min_ms < 100) def.min_ms = 100;
+    if (def.max_ms < def.min_ms) def.max_ms = def.min_ms;
+    def.busy_pps = SCHED_BUSY_PPS_DEFAULT;
+    if (class_count == 0 || strcmp(classes[class_count - 1].match, "*") != 0) add_class(&def);
+
+    budget = (int)config_get_int("sched_budget", SCHED_BUDGET_DEFAULT);
+    if (budget < 1) budget = 1;
+    dump_min = (int)config_get_int("sched_dump_min", SCHED_DUMP_MIN_DEFAULT);
+    if (dump_min < 1) dump_min = 1;
+    dump_pct = (int)config_get_int("sched_dump_pct", SCHED_DUMP_PCT_DEFAULT);
+    if (dump_pct < 0) dump_pct = 0;
+    if (dump_pct > 100) dump_pct = 100;
+    reconcile_ms = (int)config_get_int("sched_reconcile_ms", SCHED_RECONCILE_DEFAULT);
+    if (reconcile_ms < tick_ms) reconcile_ms = tick_ms;
+    stats.budget = budget;
+
+    for (int i = 0; i < node_count; i++) {
+        nodes[i]->cls = 0;
+        node_set_class(nodes[i], nodes[i]->ifname);
+    }
+}
+
+int sched_start(void) {
+    /* the tick is fixed for the life of the wheel */
+    tick_ms = (int)config_get_int("sched_tick_ms", SCHED_TICK_DEFAULT);
+    if (tick_ms < 10) tick_ms = 10;
+    stats.tick_ms = tick_ms;
+    sched_configure();
+
+    start_ms = now_ms();
+    cur_tick = 0;
+    if (reactor_timer_init(&timer, timer_fire, NULL) < 0) return -1;
+    log_info("sched: %d poll classes, tick %d ms, budget %d/tick", class_count, tick_ms, budget);
+    /* first pass right away registers every interface */
+    return reactor_timer_arm(&timer, 0, 0);
+}
+
+const sched_stats_t *sched_get_stats(void) {
+    return &stats;
+}
+
+int sched_class_count(void) {
+    return class_count;
+}
+
+int sched_class_stats(int i, sched_class_stats_t *st) {
+    if (i < 0 || i >= class_count) return -1;
+    int members = 0;
+    for (int k = 0; k < node_count; k++) {
+        if (nodes[k]->cls == i) members++;
+    }
+    st->name = classes[i].name;
+    st->min_ms = classes[i].min_ms;
+    st->max_ms = classes[i].max_ms;
+    st->members = members;
+    st->polls = classes[i].polls;
+    return 0;
+}
+
+int sched_iface_interval(int ifindex) {
+    sched_node_t *n = node_find(ifindex);
+    return n ? (int)n->interval_ms : -1;
+}
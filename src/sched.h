@@ -0,0 +1,55 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "parser.h"
+
+/*
+ * Per-interface counter polling. Every interface has its own refresh
+ * interval, kept in a hierarchical timer wheel (4 levels x 64 slots of
+ * sched_tick_ms). The interval starts at the minimum of the interface's poll
+ * class, halves while the interface is busy and doubles while it is idle,
+ * and is reset to the minimum when errors or drops move.
+ *
+ * Classes come from repeated config lines, first match wins:
+ *   poll_class=<name> <min_ms> <max_ms> <glob> [busy_pps=<n>]
+ * Without any, a "default" class derived from poll_interval_sec covers all.
+ *
+ * At most sched_budget interfaces are refreshed per tick (the rest slip to
+ * the next tick). When at least sched_dump_min and at least sched_dump_pct
+ * percent of the table are due together, one RTM_GETSTATS dump replaces the
+ * individual requests.
+ */
+
+typedef struct sched_class_stats {
+    const char *name;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    int members;
+    uint64_t polls;
+} sched_class_stats_t;
+
+typedef struct sched_stats {
+    uint64_t ticks;                    /* timer expirations handled */
+    uint64_t polls;                    /* interface refreshes */
+    uint64_t single_requests;
+    uint64_t dumps;
+    uint64_t deferred;                 /* pushed to the next tick by the budget */
+    uint64_t reconciles;
+    int nodes;
+    int tick_ms;
+    int budget;
+} sched_stats_t;
+
+int sched_start(void);
+/* re-read classes and limits (SIGHUP) */
+void sched_configure(void);
+const sched_stats_t *sched_get_stats(void);
+int sched_class_count(void);
+int sched_class_stats(int i, sched_class_stats_t *st);
+/* threaded mode: counters for ifindex came back from the collector thread */
+void sched_collected(int ifindex, const iface_counters_t *c, double now);
+/* current interval for ifindex, -1 if not scheduled */
+int sched_iface_interval(int ifindex);
+
+#endif
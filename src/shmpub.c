@@ -0,0 +1,491 @@
+#define _GNU_SOURCE
+#include "shmpub.h"
+#include "nlshm.h"
+#include "parser.h"
+#include "reactor.h"
+#include "config.h"
+#include "logger.h"
+#include "hash.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SHM_CAPACITY_DEFAULT 1024
+#define SHM_HEADER_SIZE 4096
+#define SHM_HEARTBEAT_MS 1000
+#define SHM_GROW_BACKOFF_MAX_MS 60000
+
+_Static_assert(sizeof(nlshm_header_t) <= SHM_HEADER_SIZE, "nlshm header exceeds its page");
+_Static_assert(sizeof(nlshm_record_t) % 64 == 0, "nlshm records must fill whole cache lines");
+
+typedef struct region {
+    uint8_t *base;
+    size_t size;
+    nlshm_header_t *hdr;
+    nlshm_record_t *recs;
+    nlshm_index_t *by_index;
+    nlshm_index_t *by_name;
+    uint32_t mask;                     /* index_size - 1 */
+} region_t;
+
+static char path[256];
+static int enabled = 0;
+static region_t cur;
+static reactor_timer_t heartbeat;
+
+/* writer-private shadow of the slots, so publishing never reads the mapping back */
+typedef struct shadow {
+    int *ifindex;                      /* per slot, 0: free */
+    uint32_t *gen;                     /* per slot, iface gen last written */
+    uint32_t *free;                    /* released slots, reused first */
+    uint32_t free_count;
+    uint32_t *map;                     /* ifindex -> slot + 1 */
+    int map_cap;
+} shadow_t;
+
+static shadow_t sh;
+static int dir_open = 0;
+
+static uint32_t pub_table_gen = 0;
+static uint32_t pub_data_gen = 0;
+static int pub_valid = 0;
+static uint64_t publishes = 0;
+static uint64_t records_written = 0;
+static uint64_t grows = 0;
+static uint64_t grow_retry_ms = 0;     /* after a failed grow: next attempt, from the heartbeat */
+static uint32_t grow_backoff_ms = 0;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* ---- region files ---- */
+
+/* a zeroed region at a temporary name; readers see it only after region_commit() */
+static int region_create(region_t *r, uint32_t capacity, char *tmp, size_t tmplen) {
+    uint32_t index_size = hash_pow2(capacity * 2);
+    uint64_t records_off = SHM_HEADER_SIZE;
+    uint64_t ifindex_off = records_off + (uint64_t)capacity * sizeof(nlshm_record_t);
+    uint64_t name_off = ifindex_off + (uint64_t)index_size * sizeof(nlshm_index_t);
+    uint64_t size = name_off + (uint64_t)index_size * sizeof(nlshm_index_t);
+    size = (size + 4095) & ~(uint64_t)4095;
+
+    snprintf(tmp, tmplen, "%s.%d.tmp", path, (int)getpid());
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_err("shm: cannot create %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) < 0) {
+        log_err("shm: cannot size %s to %llu bytes: %s", tmp, (unsigned long long)size, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    /* back the pages now: a full tmpfs fails here, not with SIGBUS on a store */
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err && err != EOPNOTSUPP && err != EINVAL) {
+        log_err("shm: cannot allocate %llu bytes for %s: %s", (unsigned long long)size, tmp, strerror(err));
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        log_err("shm: cannot map %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    r->base = p;
+    r->size = size;
+    r->hdr = p;
+    r->recs = (nlshm_record_t *)(r->base + records_off);
+    r->by_index = (nlshm_index_t *)(r->base + ifindex_off);
+    r->by_name = (nlshm_index_t *)(r->base + name_off);
+    r->mask = index_size - 1;
+
+    nlshm_header_t *h = r->hdr;
+    h->magic = NLSHM_MAGIC;
+    h->version = NLSHM_VERSION;
+    h->header_size = SHM_HEADER_SIZE;
+    h->record_size = sizeof(nlshm_record_t);
+    h->capacity = capacity;
+    h->index_size = index_size;
+    h->records_off = records_off;
+    h->ifindex_index_off = ifindex_off;
+    h->name_index_off = name_off;
+    h->total_size = size;
+    h->writer_pid = (int32_t)getpid();
+    h->heartbeat_ms = now_ms();
+    return 0;
+}
+
+static int region_commit(const char *tmp) {
+    if (rename(tmp, path) < 0) {
+        log_err("shm: cannot rename %s to %s: %s", tmp, path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void region_retire(region_t *r) {
+    if (!r->base) return;
+    __atomic_store_n(&r->hdr->stale, 1, __ATOMIC_RELEASE);
+    munmap(r->base, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+static void shadow_free(shadow_t *w) {
+    free(w->ifindex);
+    free(w->gen);
+    free(w->free);
+    free(w->map);
+    memset(w, 0, sizeof(*w));
+}
+
+/* bookkeeping for an empty region of capacity slots */
+static int shadow_alloc(shadow_t *w, uint32_t capacity) {
+    memset(w, 0, sizeof(*w));
+    w->ifindex = calloc(capacity, sizeof(*w->ifindex));
+    w->gen = calloc(capacity, sizeof(*w->gen));
+    w->free = calloc(capacity, sizeof(*w->free));
+    if (!w->ifindex || !w->gen || !w->free) {
+        shadow_free(w);
+        return -1;
+    }
+    return 0;
+}
+
+static int map_reserve(int ifindex) {
+    if (ifindex < sh.map_cap) return 0;
+    int cap = (int)hash_pow2((uint32_t)ifindex + 1);
+    if (cap < 256) cap = 256;
+    uint32_t *n = realloc(sh.map, (size_t)cap * sizeof(*n));
+    if (!n) return -1;
+    memset(n + sh.map_cap, 0, (size_t)(cap - sh.map_cap) * sizeof(*n));
+    sh.map = n;
+    sh.map_cap = cap;
+    return 0;
+}
+
+/* ---- seqlocked writes ---- */
+
+static void dir_begin(void) {
+    if (dir_open) return;
+    nlshm_header_t *h = cur.hdr;
+    __atomic_store_n(&h->dir_seq, h->dir_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    dir_open = 1;
+}
+
+static void dir_end(void) {
+    if (!dir_open) return;
+    nlshm_header_t *h = cur.hdr;
+    __atomic_store_n(&h->dir_seq, h->dir_seq + 1, __ATOMIC_RELEASE);
+    dir_open = 0;
+}
+
+static void index_insert(nlshm_index_t *ix, uint32_t hash, uint32_t slot) {
+    uint32_t i = hash & cur.mask;
+    while (ix[i].slot) i = (i + 1) & cur.mask;
+    ix[i].hash = hash;
+    ix[i].slot = slot + 1;
+}
+
+/* backward-shift deletion: no tombstones, probe chains stay short */
+static void index_remove(nlshm_index_t *ix, uint32_t hash, uint32_t slot) {
+    uint32_t i = hash & cur.mask;
+    while (ix[i].slot && ix[i].slot != slot + 1) i = (i + 1) & cur.mask;
+    if (!ix[i].slot) return;
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & cur.mask;
+        if (!ix[j].slot) break;
+        uint32_t home = ix[j].hash & cur.mask;
+        /* move j into the hole unless its home lies cyclically in (i, j] */
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            ix[i] = ix[j];
+            i = j;
+        }
+    }
+    ix[i].hash = 0;
+    ix[i].slot = 0;
+}
+
+static void record_fill(nlshm_iface_t *d, const iface_info_t *inf) {
+    memset(d, 0, sizeof(*d));
+    d->ifindex = inf->ifindex;
+    memcpy(d->ifname, inf->ifname, NLSHM_IFNAMSIZ);
+    d->ifname[NLSHM_IFNAMSIZ - 1] = '\0';
+    d->flags = inf->flags;
+    d->mtu = inf->mtu;
+    d->operstate = inf->operstate;
+    d->up = inf->up ? 1 : 0;
+    d->flaps = inf->flaps;
+    d->gen = inf->gen;
+    d->stats.rx_bytes = inf->stats.rx_bytes;
+    d->stats.tx_bytes = inf->stats.tx_bytes;
+    d->stats.rx_packets = inf->stats.rx_packets;
+    d->stats.tx_packets = inf->stats.tx_packets;
+    d->stats.rx_errors = inf->stats.rx_err;
+    d->stats.tx_errors = inf->stats.tx_err;
+    d->stats.rx_dropped = inf->stats.rx_dropped;
+    d->stats.tx_dropped = inf->stats.tx_dropped;
+    d->stats.rx_fifo_errors = inf->stats.rx_fifo;
+    d->stats.tx_fifo_errors = inf->stats.tx_fifo;
+    d->stats.multicast = inf->stats.multicast;
+    d->naddr_total = (uint32_t)inf->addrs.count;
+    int n = inf->addrs.count < NLSHM_MAX_ADDRS ? inf->addrs.count : NLSHM_MAX_ADDRS;
+    for (int i = 0; i < n; i++) {
+        const iface_addr_t *a = &inf->addrs.items[i];
+        d->addrs[i].family = a->family;
+        d->addrs[i].prefixlen = a->prefixlen;
+        d->addrs[i].flags = a->flags;
+        memcpy(d->addrs[i].addr, a->addr.raw, sizeof(d->addrs[i].addr));
+    }
+    d->naddr = (uint8_t)n;
+}
+
+/* inf NULL clears the slot */
+static void record_write(uint32_t slot, const iface_info_t *inf) {
+    nlshm_record_t *r = &cur.recs[slot];
+    uint32_t s = r->seq;
+    __atomic_store_n(&r->seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (inf) record_fill(&r->d, inf);
+    else memset(&r->d, 0, sizeof(r->d));
+    __atomic_store_n(&r->seq, s + 2, __ATOMIC_RELEASE);
+    records_written++;
+}
+
+/* ---- publishing ---- */
+
+static void slot_release(uint32_t slot) {
+    int ifindex = sh.ifindex[slot];
+    dir_begin();
+    index_remove(cur.by_index, nlshm_hash_index(ifindex), slot);
+    index_remove(cur.by_name, nlshm_hash_name(cur.recs[slot].d.ifname), slot);
+    record_write(slot, NULL);
+    sh.ifindex[slot] = 0;
+    if (ifindex < sh.map_cap && sh.map[ifindex] == slot + 1) sh.map[ifindex] = 0;
+    sh.free[sh.free_count++] = slot;
+}
+
+static int slot_acquire(const iface_info_t *inf, uint32_t *slot) {
+    nlshm_header_t *h = cur.hdr;
+    if (map_reserve(inf->ifindex) < 0) return -1;
+    if (sh.free_count) *slot = sh.free[--sh.free_count];
+    else if (h->high_water < h->capacity) *slot = h->high_water;
+    else return -1;
+    record_write(*slot, inf);
+    dir_begin();
+    index_insert(cur.by_index, nlshm_hash_index(inf->ifindex), *slot);
+    index_insert(cur.by_name, nlshm_hash_name(inf->ifname), *slot);
+    if (*slot == h->high_water) __atomic_store_n(&h->high_water, *slot + 1, __ATOMIC_RELEASE);
+    sh.ifindex[*slot] = inf->ifindex;
+    sh.gen[*slot] = inf->gen;
+    sh.map[inf->ifindex] = *slot + 1;
+    return 0;
+}
+
+static void slot_update(uint32_t slot, const iface_info_t *inf) {
+    const char *old = cur.recs[slot].d.ifname;
+    if (strncmp(old, inf->ifname, NLSHM_IFNAMSIZ) != 0) {
+        dir_begin();
+        index_remove(cur.by_name, nlshm_hash_name(old), slot);
+        record_write(slot, inf);
+        index_insert(cur.by_name, nlshm_hash_name(inf->ifname), slot);
+    } else {
+        record_write(slot, inf);
+    }
+    sh.gen[slot] = inf->gen;
+}
+
+/* write the table into cur; full makes no use of what cur already holds */
+static int publish_into(int full) {
+    nlshm_header_t *h = cur.hdr;
+    uint32_t tgen = iface_table_gen();
+    int ok = 1;
+
+    if (!full && (!pub_valid || tgen != pub_table_gen)) {
+        for (uint32_t s = 0; s < h->high_water; s++) {
+            int ifindex = sh.ifindex[s];
+            if (!ifindex) continue;
+            iface_info_t *inf = get_iface_by_index(ifindex);
+            if (!inf) slot_release(s);
+        }
+    }
+
+    int n = get_iface_count();
+    for (int pos = 0; pos < n; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        uint32_t slot = inf->ifindex < sh.map_cap ? sh.map[inf->ifindex] : 0;
+        if (!slot) {
+            if (slot_acquire(inf, &slot) < 0) ok = 0;
+        } else if (sh.gen[slot - 1] != inf->gen) {
+            slot_update(slot - 1, inf);
+        }
+    }
+    dir_end();
+
+    __atomic_store_n(&h->count, (uint32_t)n, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->table_gen, (uint64_t)tgen, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->data_gen, (uint64_t)iface_table_data_gen(), __ATOMIC_RELEASE);
+    __atomic_store_n(&h->heartbeat_ms, now_ms(), __ATOMIC_RELEASE);
+    return ok ? 0 : -1;
+}
+
+/* a region twice as large (or more), filled before readers can find it;
+ * on failure the current region and its bookkeeping stay as they were */
+static int grow(uint32_t need) {
+    uint32_t cap = cur.hdr->capacity;
+    while (cap < need) cap *= 2;
+    region_t old = cur;
+    shadow_t old_sh = sh;
+    char tmp[300];
+    if (shadow_alloc(&sh, cap) < 0) {
+        log_err("shm: out of memory growing to %u records", cap);
+        sh = old_sh;
+        return -1;
+    }
+    if (region_create(&cur, cap, tmp, sizeof(tmp)) < 0) {
+        shadow_free(&sh);
+        sh = old_sh;
+        cur = old;
+        return -1;
+    }
+    publish_into(1);
+    if (region_commit(tmp) < 0) {
+        munmap(cur.base, cur.size);
+        shadow_free(&sh);
+        sh = old_sh;
+        cur = old;
+        return -1;
+    }
+    region_retire(&old);
+    shadow_free(&old_sh);
+    grows++;
+    log_info("shm: %s grown to %u records (%llu bytes)", path, cap, (unsigned long long)cur.size);
+    return 0;
+}
+
+void shmpub_publish(void) {
+    if (!enabled) return;
+    uint32_t tgen = iface_table_gen();
+    uint32_t dgen = iface_table_data_gen();
+    if (pub_valid && tgen == pub_table_gen && dgen == pub_data_gen) return;
+
+    int n = get_iface_count();
+    int grew = 0;
+    if ((uint32_t)n > cur.hdr->capacity && now_ms() >= grow_retry_ms) {
+        grew = grow((uint32_t)n) == 0;
+        if (grew) {
+            grow_retry_ms = 0;
+            grow_backoff_ms = 0;
+        } else {
+            /* no memory or a full /dev/shm rarely clears at once: back off */
+            grow_backoff_ms = grow_backoff_ms ? grow_backoff_ms * 2 : SHM_HEARTBEAT_MS;
+            if (grow_backoff_ms > SHM_GROW_BACKOFF_MAX_MS) grow_backoff_ms = SHM_GROW_BACKOFF_MAX_MS;
+            grow_retry_ms = now_ms() + grow_backoff_ms;
+        }
+    }
+    int rc = grew ? 0 : publish_into(0);
+    publishes++;
+    /* records that did not fit wait for the next change, or for the grow retry */
+    pub_valid = rc == 0 || grow_retry_ms != 0;
+    pub_table_gen = tgen;
+    pub_data_gen = dgen;
+}
+
+static void publish_hook(void *arg) {
+    (void)arg;
+    shmpub_publish();
+}
+
+/* readers tell a live writer from a dead one by the heartbeat age */
+static void heartbeat_fire(reactor_timer_t *t, uint64_t expirations) {
+    (void)t;
+    (void)expirations;
+    if (!enabled) return;
+    uint64_t now = now_ms();
+    __atomic_store_n(&cur.hdr->heartbeat_ms, now, __ATOMIC_RELEASE);
+    /* the publish hook runs after this batch and grows again */
+    if (grow_retry_ms && now >= grow_retry_ms) pub_valid = 0;
+}
+
+int shmpub_start(void) {
+    const char *p = config_get_str("shm_path", NLSHM_DEFAULT_PATH);
+    if (!p[0]) {
+        log_info("shm: disabled");
+        return 0;
+    }
+    if (strlen(p) >= sizeof(path) - 16) {
+        log_err("shm: shm_path too long: %s", p);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s", p);
+    long cap = config_get_int("shm_capacity", SHM_CAPACITY_DEFAULT);
+    if (cap < 16) cap = 16;
+    if (cap > (1L << 24)) cap = 1L << 24;
+    uint32_t capacity = hash_pow2((uint32_t)cap);
+    while (capacity < (uint32_t)get_iface_count()) capacity *= 2;
+
+    char tmp[300];
+    if (region_create(&cur, capacity, tmp, sizeof(tmp)) < 0) return -1;
+    if (shadow_alloc(&sh, capacity) < 0) {
+        log_err("shm: out of memory for %u records", capacity);
+        munmap(cur.base, cur.size);
+        unlink(tmp);
+        memset(&cur, 0, sizeof(cur));
+        return -1;
+    }
+    publish_into(1);
+    if (region_commit(tmp) < 0) {
+        munmap(cur.base, cur.size);
+        memset(&cur, 0, sizeof(cur));
+        shadow_free(&sh);
+        return -1;
+    }
+    enabled = 1;
+    pub_valid = 1;
+    pub_table_gen = iface_table_gen();
+    pub_data_gen = iface_table_data_gen();
+
+    if (reactor_timer_init(&heartbeat, heartbeat_fire, NULL) == 0) {
+        reactor_timer_arm(&heartbeat, SHM_HEARTBEAT_MS, SHM_HEARTBEAT_MS);
+    }
+    log_info("shm: publishing %d interfaces at %s (%u records, %llu bytes)",
+             get_iface_count(), path, capacity, (unsigned long long)cur.size);
+    return reactor_post(publish_hook, NULL);
+}
+
+void shmpub_stop(void) {
+    if (!enabled) return;
+    enabled = 0;
+    unlink(path);
+    region_retire(&cur);
+    shadow_free(&sh);
+}
+
+void shmpub_get_stats(shmpub_stats_t *st) {
+    memset(st, 0, sizeof(*st));
+    if (!enabled) return;
+    st->path = path;
+    st->capacity = cur.hdr->capacity;
+    st->count = cur.hdr->count;
+    st->high_water = cur.hdr->high_water;
+    st->size = cur.size;
+    st->publishes = publishes;
+    st->records_written = records_written;
+    st->grows = grows;
+}
@@ -0,0 +1,32 @@
+#ifndef SHMPUB_H
+#define SHMPUB_H
+
+#include <stdint.h>
+
+/*
+ * Publisher side of the shared-memory interface table (layout and reader
+ * library in nlshm.h). After every event loop iteration that changed the
+ * table, records of changed interfaces are rewritten under their seqlocks;
+ * unchanged ones are not touched. shm_path= (empty disables) and
+ * shm_capacity= (initial record slots, doubled when outgrown).
+ */
+
+typedef struct shmpub_stats {
+    const char *path;                  /* NULL: disabled */
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t high_water;
+    uint64_t size;                     /* bytes mapped */
+    uint64_t publishes;
+    uint64_t records_written;
+    uint64_t grows;
+} shmpub_stats_t;
+
+int shmpub_start(void);
+/* owner thread: publish now if the table changed (normally automatic) */
+void shmpub_publish(void);
+/* mark the region stale for readers and remove it */
+void shmpub_stop(void);
+void shmpub_get_stats(shmpub_stats_t *st);
+
+#endif
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include "snapshot.h"
+#include "reactor.h"
+#include "logger.h"
+#include "hash.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAP_MAX_READERS 64
+
+/* one cache line per reader: announcing an epoch never bounces another reader's line */
+typedef struct reader_slot {
+    _Alignas(64) _Atomic uint64_t epoch;   /* 0: outside any read section */
+} reader_slot_t;
+
+typedef struct retired {
+    void *p;
+    uint64_t epoch;                    /* global epoch when it was unlinked */
+} retired_t;
+
+static _Atomic(iface_view_t *) view = NULL;
+static _Atomic uint64_t epoch = 1;
+static reader_slot_t readers[SNAP_MAX_READERS];
+static _Atomic int reader_count = 0;
+static __thread int my_slot = -1;
+static __thread int my_depth = 0;
+
+/* owner side */
+static iface_info_t **recmap = NULL;   /* ifindex -> record in the published view */
+static int recmap_cap = 0;
+static retired_t *retire = NULL;
+static int retire_count = 0;
+static int retire_cap = 0;
+static uint32_t pub_table_gen = 0;
+static uint32_t pub_data_gen = 0;
+static uint64_t view_gen = 0;
+static uint64_t publishes = 0;
+static uint64_t records_copied = 0;
+static uint64_t reclaimed = 0;
+
+/* ---- readers ---- */
+
+const iface_view_t *iface_snap_begin(void) {
+    if (my_depth++ > 0) return atomic_load(&view);
+    if (my_slot < 0) {
+        int s = atomic_fetch_add(&reader_count, 1);
+        if (s >= SNAP_MAX_READERS) {
+            atomic_fetch_sub(&reader_count, 1);
+            my_depth = 0;
+            return NULL;
+        }
+        my_slot = s;
+    }
+    /* announce first, then look: the owner frees nothing this epoch can reach */
+    atomic_store(&readers[my_slot].epoch, atomic_load(&epoch));
+    return atomic_load(&view);
+}
+
+void iface_snap_end(void) {
+    if (my_slot < 0 || my_depth == 0) return;
+    if (--my_depth == 0) atomic_store(&readers[my_slot].epoch, 0);
+}
+
+uint64_t iface_snap_gen(void) {
+    iface_view_t *v = atomic_load_explicit(&view, memory_order_acquire);
+    return v ? v->gen : 0;
+}
+
+const iface_info_t *iface_view_find(const iface_view_t *v, int ifindex) {
+    for (int i = 0; v && i < v->count; i++) {
+        if (v->ifaces[i]->ifindex == ifindex) return v->ifaces[i];
+    }
+    return NULL;
+}
+
+/* ---- owner ---- */
+
+static int retire_add(void *p) {
+    if (retire_count == retire_cap) {
+        int cap = retire_cap ? retire_cap * 2 : 256;
+        retired_t *n = realloc(retire, (size_t)cap * sizeof(*n));
+        if (!n) return -1;
+        retire = n;
+        retire_cap = cap;
+    }
+    retire[retire_count].p = p;
+    retire[retire_count].epoch = 0;    /* tagged once unlinked */
+    retire_count++;
+    return 0;
+}
+
+/* free what no reader can still see: retired before the oldest active reader's epoch */
+static void reclaim(void) {
+    uint64_t oldest = UINT64_MAX;
+    int n = atomic_load(&reader_count);
+    if (n > SNAP_MAX_READERS) n = SNAP_MAX_READERS;
+    for (int i = 0; i < n; i++) {
+        uint64_t e = atomic_load(&readers[i].epoch);
+        if (e && e < oldest) oldest = e;
+    }
+    int keep = 0;
+    for (int i = 0; i < retire_count; i++) {
+        if (retire[i].epoch < oldest) {
+            free(retire[i].p);
+            reclaimed++;
+        } else {
+            retire[keep++] = retire[i];
+        }
+    }
+    retire_count = keep;
+}
+
+static int recmap_reserve(int ifindex) {
+    if (ifindex < recmap_cap) return 0;
+    int cap = (int)hash_pow2((uint32_t)ifindex + 1);
+    if (cap < 256) cap = 256;
+    iface_info_t **n = realloc(recmap, (size_t)cap * sizeof(*n));
+    if (!n) return -1;
+    memset(n + recmap_cap, 0, (size_t)(cap - recmap_cap) * sizeof(*n));
+    recmap = n;
+    recmap_cap = cap;
+    return 0;
+}
+
+/* immutable copy; the address array follows the record in the same block */
+static iface_info_t *rec_copy(const iface_info_t *inf) {
+    size_t naddr = (size_t)inf->addrs.count;
+    iface_info_t *r = malloc(sizeof(*r) + naddr * sizeof(iface_addr_t));
+    if (!r) return NULL;
+    *r = *inf;
+    r->coalesce_slot = 0;
+    r->addrs.items = (iface_addr_t *)(r + 1);
+    r->addrs.slots = NULL;
+    r->addrs.mask = 0;
+    r->addrs.cap = inf->addrs.count;
+    if (naddr) memcpy(r->addrs.items, inf->addrs.items, naddr * sizeof(iface_addr_t));
+    return r;
+}
+
+/* the view was not swapped: the old view still points at the records retired
+ * since mark, so put them back instead of letting reclaim() free them */
+static void publish_abort(iface_view_t *v, int mark) {
+    for (int i = mark; i < retire_count; i++) {
+        iface_info_t *r = retire[i].p;
+        free(recmap[r->ifindex]);
+        recmap[r->ifindex] = r;
+        records_copied--;
+    }
+    retire_count = mark;
+    free(v);
+}
+
+void iface_snap_publish(void) {
+    uint32_t tgen = iface_table_gen();
+    uint32_t dgen = iface_table_data_gen();
+    iface_view_t *old = atomic_load(&view);
+    if (old && tgen == pub_table_gen && dgen == pub_data_gen) {
+        if (retire_count) reclaim();
+        return;
+    }
+
+    int n = get_iface_count();
+    iface_view_t *v = malloc(sizeof(*v) + (size_t)n * sizeof(v->ifaces[0]));
+    if (!v) {
+        log_err("snapshot: out of memory publishing %d interfaces", n);
+        return;
+    }
+    int mark = retire_count;
+    int complete = 1;
+    for (int pos = 0; pos < n; pos++) {
+        iface_info_t *inf = get_iface_at(pos);
+        if (recmap_reserve(inf->ifindex) < 0) {
+            log_err("snapshot: out of memory publishing %d interfaces", n);
+            publish_abort(v, mark);
+            return;
+        }
+        iface_info_t *r = recmap[inf->ifindex];
+        /* gen is stamped from a table-wide counter: equal means identical */
+        if (!r || r->gen != inf->gen) {
+            iface_info_t *nr = rec_copy(inf);
+            if (nr && (!r || retire_add(r) == 0)) {
+                recmap[inf->ifindex] = r = nr;
+                records_copied++;
+            } else {
+                /* keep the stale record; retried on the next publish */
+                free(nr);
+                complete = 0;
+                if (!r) {
+                    publish_abort(v, mark);
+                    return;
+                }
+            }
+        }
+        v->ifaces[pos] = r;
+    }
+    /* records of interfaces that left the table */
+    for (int i = 0; old && i < old->count; i++) {
+        const iface_info_t *r = old->ifaces[i];
+        if (recmap[r->ifindex] == r && !get_iface_by_index(r->ifindex) && retire_add((void *)r) == 0) {
+            recmap[r->ifindex] = NULL;
+        }
+    }
+    if (old && retire_add(old) < 0) {
+        /* cannot track it: leak the old view rather than free it under a reader */
+        log_err("snapshot: out of memory retiring a view");
+    }
+    v->gen = ++view_gen;
+    v->count = n;
+    atomic_store(&view, v);
+
+    /* everything retired above is unreachable for readers that start from now on */
+    uint64_t e = atomic_fetch_add(&epoch, 1);
+    for (int i = mark; i < retire_count; i++) retire[i].epoch = e;
+    publishes++;
+    if (complete) {
+        pub_table_gen = tgen;
+        pub_data_gen = dgen;
+    }
+    reclaim();
+}
+
+static void publish_hook(void *arg) {
+    (void)arg;
+    iface_snap_publish();
+}
+
+int iface_snap_start(void) {
+    iface_snap_publish();
+    return reactor_post(publish_hook, NULL);
+}
+
+void iface_snap_get_stats(iface_snap_stats_t *st) {
+    int n = atomic_load(&reader_count);
+    if (n > SNAP_MAX_READERS) n = SNAP_MAX_READERS;
+    st->gen = view_gen;
+    st->publishes = publishes;
+    st->records_copied = records_copied;
+    st->reclaimed = reclaimed;
+    st->retired = retire_count;
+    st->readers = n;
+    st->active = 0;
+    for (int i = 0; i < n; i++) {
+        if (atomic_load(&readers[i].epoch)) st->active++;
+    }
+}
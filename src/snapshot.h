@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "parser.h"
+
+/*
+ * Read-copy-update view of the interface table for readers on any thread.
+ *
+ * After every event loop iteration that changed the table, the owner
+ * publishes a new immutable view: an array of immutable per-interface
+ * records (addresses included). Records of unchanged interfaces are shared
+ * with the previous view, so a publish copies only what moved plus one
+ * pointer per interface. Readers enter with iface_snap_begin() (one store,
+ * one load: wait-free), use the view as long as they like and leave with
+ * iface_snap_end(); superseded views and records are freed only once every
+ * reader that could still see them has left (epoch-based reclamation).
+ *
+ * iface_snap_gen() changes with every publish, so "nothing changed since
+ * my last look" costs a single atomic load.
+ */
+
+typedef struct iface_view {
+    uint64_t gen;                      /* publish generation */
+    int count;
+    const iface_info_t *ifaces[];      /* table order */
+} iface_view_t;
+
+typedef struct iface_snap_stats {
+    uint64_t gen;
+    uint64_t publishes;
+    uint64_t records_copied;
+    uint64_t reclaimed;
+    int retired;                       /* waiting for readers to leave */
+    int readers;                       /* registered reader threads */
+    int active;                        /* inside a read section right now */
+} iface_snap_stats_t;
+
+/* publish the current table and keep publishing after each loop iteration */
+int iface_snap_start(void);
+/* owner thread: publish now if the table changed (normally automatic) */
+void iface_snap_publish(void);
+
+/* reader: current view, valid until iface_snap_end(); NULL only if more
+ * than 64 threads registered as readers */
+const iface_view_t *iface_snap_begin(void);
+void iface_snap_end(void);
+uint64_t iface_snap_gen(void);
+/* linear scan of a view */
+const iface_info_t *iface_view_find(const iface_view_t *v, int ifindex);
+
+void iface_snap_get_stats(iface_snap_stats_t *st);
+
+#endif
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include "spsc.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REC_ALIGN 16
+
+static inline uint64_t rec_size(uint32_t len) {
+    return (sizeof(spsc_rec_t) + len + REC_ALIGN - 1) & ~(uint64_t)(REC_ALIGN - 1);
+}
+
+uint64_t spsc_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int spsc_init(spsc_ring_t *r, const char *name, size_t size) {
+    memset(r, 0, sizeof(*r));
+    r->efd = -1;
+    uint64_t sz = 4096;
+    while (sz < size) sz <<= 1;
+    r->buf = aligned_alloc(64, sz);
+    if (!r->buf) return -1;
+    r->size = sz;
+    r->name = name;
+    r->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->efd < 0) {
+        free(r->buf);
+        r->buf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void spsc_free(spsc_ring_t *r) {
+    if (r->efd >= 0) close(r->efd);
+    free(r->buf);
+    r->buf = NULL;
+    r->efd = -1;
+}
+
+int spsc_push(spsc_ring_t *r, uint16_t type, const void *data, uint32_t len) {
+    uint64_t need = rec_size(len);
+    if (need > r->size / 2) return -1;
+
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t pos = head & (r->size - 1);
+    uint64_t skip = r->size - pos < need ? r->size - pos : 0;
+    if (head + skip + need - r->tail_cache > r->size) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head + skip + need - r->tail_cache > r->size) {
+            atomic_fetch_add_explicit(&r->full, 1, memory_order_relaxed);
+            return -1;
+        }
+    }
+    if (skip) {
+        spsc_rec_t *s = (spsc_rec_t *)(r->buf + pos);
+        s->type = SPSC_SKIP;
+        s->len = (uint32_t)(skip - sizeof(spsc_rec_t));
+        head += skip;
+        pos = 0;
+    }
+    spsc_rec_t *rec = (spsc_rec_t *)(r->buf + pos);
+    rec->len = len;
+    rec->type = type;
+    rec->pad = 0;
+    rec->ts_ns = spsc_now_ns();
+    if (len) memcpy(rec + 1, data, len);
+    atomic_store_explicit(&r->head, head + need, memory_order_release);
+    atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+    return 0;
+}
+
+void spsc_notify(spsc_ring_t *r) {
+    uint64_t one = 1;
+    (void)!write(r->efd, &one, sizeof(one));
+}
+
+int spsc_push_wait(spsc_ring_t *r, uint16_t type, const void *data, uint32_t len, int stop_fd) {
+    if (rec_size(len) > r->size / 2) return -1;
+    while (spsc_push(r, type, data, len) < 0) {
+        /* make sure the consumer is draining, then back off for a millisecond */
+        spsc_notify(r);
+        struct pollfd p = { .fd = stop_fd, .events = POLLIN };
+        if (poll(&p, 1, 1) > 0) return -1;
+    }
+    return 0;
+}
+
+int spsc_wait(spsc_ring_t *r, int stop_fd) {
+    struct pollfd p[2] = {
+        { .fd = r->efd, .events = POLLIN },
+        { .fd = stop_fd, .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(p, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (p[1].revents) return -1;
+        if (p[0].revents) {
+            spsc_ack(r);
+            return 0;
+        }
+    }
+}
+
+void spsc_ack(spsc_ring_t *r) {
+    uint64_t v;
+    (void)!read(r->efd, &v, sizeof(v));
+}
+
+const spsc_rec_t *spsc_peek(spsc_ring_t *r) {
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        if (tail == r->head_cache) {
+            r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+            if (tail == r->head_cache) return NULL;
+        }
+        const spsc_rec_t *rec = (const spsc_rec_t *)(r->buf + (tail & (r->size - 1)));
+        if (rec->type != SPSC_SKIP) return rec;
+        atomic_store_explicit(&r->tail, tail + sizeof(spsc_rec_t) + rec->len, memory_order_release);
+    }
+}
+
+void spsc_release(spsc_ring_t *r, const spsc_rec_t *rec) {
+    uint64_t lat = spsc_now_ns() - rec->ts_ns;
+    uint64_t popped = atomic_load_explicit(&r->popped, memory_order_relaxed) + 1;
+    uint64_t depth = atomic_load_explicit(&r->pushed, memory_order_relaxed) - popped + 1;
+
+    /* only this thread writes the consumer-side counters */
+    atomic_store_explicit(&r->popped, popped, memory_order_relaxed);
+    atomic_store_explicit(&r->lat_sum_ns, atomic_load_explicit(&r->lat_sum_ns, memory_order_relaxed) + lat,
+                          memory_order_relaxed);
+    if (lat > atomic_load_explicit(&r->lat_max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&r->lat_max_ns, lat, memory_order_relaxed);
+    }
+    if (depth > atomic_load_explicit(&r->depth_max, memory_order_relaxed)) {
+        atomic_store_explicit(&r->depth_max, depth, memory_order_relaxed);
+    }
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + rec_size(rec->len), memory_order_release);
+}
+
+void spsc_get_stats(spsc_ring_t *r, spsc_stats_t *st) {
+    st->pushed = atomic_load_explicit(&r->pushed, memory_order_relaxed);
+    st->popped = atomic_load_explicit(&r->popped, memory_order_relaxed);
+    st->full = atomic_load_explicit(&r->full, memory_order_relaxed);
+    st->depth_max = atomic_load_explicit(&r->depth_max, memory_order_relaxed);
+    st->lat_sum_ns = atomic_load_explicit(&r->lat_sum_ns, memory_order_relaxed);
+    st->lat_max_ns = atomic_load_explicit(&r->lat_max_ns, memory_order_relaxed);
+}
+
+uint64_t spsc_depth(spsc_ring_t *r) {
+    uint64_t popped = atomic_load_explicit(&r->popped, memory_order_relaxed);
+    uint64_t pushed = atomic_load_explicit(&r->pushed, memory_order_relaxed);
+    return pushed > popped ? pushed - popped : 0;
+}
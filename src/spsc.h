@@ -0,0 +1,83 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Single-producer single-consumer ring of variable-length records, used to
+ * hand work between the threads of the threaded pipeline. Producer and
+ * consumer each own one index (bytes ever written / read) and cache the
+ * other's, so the fast path touches no shared cache line. Records are
+ * 16-byte aligned; a record that would straddle the end of the buffer is
+ * preceded by a skip record. An eventfd wakes the consumer.
+ */
+
+#define SPSC_SKIP 0xffff
+
+typedef struct spsc_rec {
+    uint32_t len;                      /* payload bytes */
+    uint16_t type;
+    uint16_t pad;
+    uint64_t ts_ns;                    /* enqueue time, CLOCK_MONOTONIC */
+    /* payload follows */
+} spsc_rec_t;
+
+typedef struct spsc_stats {
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t full;                     /* pushes refused for lack of space */
+    uint64_t depth_max;                /* records queued, seen by the consumer */
+    uint64_t lat_sum_ns;               /* enqueue -> dequeue */
+    uint64_t lat_max_ns;
+} spsc_stats_t;
+
+typedef struct spsc_ring {
+    _Alignas(64) _Atomic uint64_t head;  /* producer */
+    uint64_t tail_cache;
+    _Atomic uint64_t pushed;
+    _Atomic uint64_t full;
+    _Alignas(64) _Atomic uint64_t tail;  /* consumer */
+    uint64_t head_cache;
+    _Atomic uint64_t popped;
+    _Atomic uint64_t depth_max;
+    _Atomic uint64_t lat_sum_ns;
+    _Atomic uint64_t lat_max_ns;
+    _Alignas(64) uint8_t *buf;
+    uint64_t size;                     /* power of two */
+    int efd;                           /* consumer wakeup */
+    const char *name;
+} spsc_ring_t;
+
+/* size is rounded up to a power of two; 0 or -1 */
+int spsc_init(spsc_ring_t *r, const char *name, size_t size);
+void spsc_free(spsc_ring_t *r);
+
+uint64_t spsc_now_ns(void);
+
+/* producer: copy one record in; -1 when there is no room (or it is too big) */
+int spsc_push(spsc_ring_t *r, uint16_t type, const void *data, uint32_t len);
+/* producer: wake the consumer after a batch of pushes */
+void spsc_notify(spsc_ring_t *r);
+/* producer thread: spsc_push(), waiting for room while stop_fd stays quiet;
+ * -1 once stop_fd is readable */
+int spsc_push_wait(spsc_ring_t *r, uint16_t type, const void *data, uint32_t len, int stop_fd);
+
+/* consumer: next record or NULL; valid until spsc_release() */
+const spsc_rec_t *spsc_peek(spsc_ring_t *r);
+void spsc_release(spsc_ring_t *r, const spsc_rec_t *rec);
+/* consumer: clear the eventfd before draining */
+void spsc_ack(spsc_ring_t *r);
+/* consumer thread: block until notified (0, eventfd cleared) or stop_fd is readable (-1) */
+int spsc_wait(spsc_ring_t *r, int stop_fd);
+
+static inline const void *spsc_payload(const spsc_rec_t *rec) {
+    return rec + 1;
+}
+
+void spsc_get_stats(spsc_ring_t *r, spsc_stats_t *st);
+/* records queued right now */
+uint64_t spsc_depth(spsc_ring_t *r);
+
+#endif
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "watch.h"
+#include "logger.h"
+#include "config.h"
+#include "reactor.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define WATCH_RING_DEFAULT 8192
+#define WATCH_QUEUE_DEFAULT 4096
+#define WATCH_LINE_MAX 192
+
+enum { WK_LINK = 1, WK_ADDR = 2, WK_ROUTE = 4, WK_ALL = 7, WK_ALWAYS = 8 };
+
+/* one formatted event; the line is copied as is to every matching subscriber */
+typedef struct watch_ev {
+    uint8_t kind;                      /* WK_* */
+    uint16_t len;
+    char ifname[IFNAMSIZ];             /* for dev filters, "" when there is none */
+    char line[WATCH_LINE_MAX];
+} watch_ev_t;
+
+struct watch_sub {
+    int pos;                           /* index in subs[] */
+    uint64_t cursor;                   /* next sequence number to deliver */
+    uint32_t kinds;
+    uint32_t queue;                    /* how far behind the head it may fall */
+    int slow;                          /* WATCH_SLOW_* */
+    char dev[IFNAMSIZ * 2];            /* fnmatch glob, "" matches everything */
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t gaps;
+    uint64_t gap_from;                 /* first event of a gap not yet reported */
+    uint64_t gap_lost;
+    void (*notify)(void *arg);
+    void *arg;
+};
+
+static watch_ev_t *ring;
+static uint32_t ring_mask;
+static uint64_t head = 1;              /* sequence number of the next event */
+static uint64_t notified = 1;          /* head at the last fan-out */
+static watch_sub_t **subs;
+static int nsubs, subs_cap;
+static uint32_t default_queue = WATCH_QUEUE_DEFAULT;
+static int default_slow = WATCH_SLOW_DROP;
+static int hooked;
+static watch_stats_t stats;
+
+static const char *oper_names[] = {
+    "unknown", "notpresent", "down", "lowerlayerdown", "testing", "dormant", "up"
+};
+
+static const char *oper_name(uint8_t s) {
+    return s < sizeof(oper_names) / sizeof(oper_names[0]) ? oper_names[s] : "?";
+}
+
+/* wake every subscriber once per loop iteration that published something */
+static void fanout_hook(void *arg) {
+    (void)arg;
+    if (head == notified) return;
+    notified = head;
+    /* notify may unsubscribe: the last entry moves into its place, already visited */
+    for (int i = nsubs - 1; i >= 0; i--) {
+        if (i < nsubs) subs[i]->notify(subs[i]->arg);
+    }
+}
+
+static int parse_slow(const char *s) {
+    if (strcmp(s, "drop") == 0) return WATCH_SLOW_DROP;
+    if (strcmp(s, "disconnect") == 0) return WATCH_SLOW_DISCONNECT;
+    return -1;
+}
+
+static int ring_init(void) {
+    long n = config_get_int("watch_ring", WATCH_RING_DEFAULT);
+    long q = config_get_int("watch_queue", WATCH_QUEUE_DEFAULT);
+    const char *slow = config_get_str("watch_slow", "drop");
+    if (n < 64) n = 64;
+    if (n > (1L << 20)) n = 1L << 20;
+    uint32_t size = 64;
+    while (size < (uint32_t)n) size <<= 1;
+    ring = calloc(size, sizeof(*ring));
+    if (!ring) {
+        log_err("watch: cannot allocate %u event slots", size);
+        return -1;
+    }
+    ring_mask = size - 1;
+    default_queue = q < 1 ? 1 : q > (long)size ? size : (uint32_t)q;
+    default_slow = parse_slow(slow);
+    if (default_slow < 0) {
+        log_warn("watch: unknown watch_slow=%s, using drop", slow);
+        default_slow = WATCH_SLOW_DROP;
+    }
+    stats.ring = size;
+    if (!hooked && reactor_post(fanout_hook, NULL) == 0) hooked = 1;
+    return 0;
+}
+
+watch_sub_t *watch_subscribe(const char *filter, void (*notify)(void *arg), void *arg,
+                             char *err, size_t errlen) {
+    if (!ring && ring_init() < 0) {
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+    watch_sub_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+    s->queue = default_queue;
+    s->slow = default_slow;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", filter ? filter : "");
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(tok, "link") == 0) {
+            s->kinds |= WK_LINK;
+        } else if (strcmp(tok, "addr") == 0) {
+            s->kinds |= WK_ADDR;
+        } else if (strcmp(tok, "route") == 0) {
+            s->kinds |= WK_ROUTE;
+        } else if (strcmp(tok, "dev") == 0 || strcmp(tok, "queue") == 0 || strcmp(tok, "slow") == 0) {
+            char *val = strtok_r(NULL, " \t", &save);
+            if (!val) {
+                snprintf(err, errlen, "%s needs a value", tok);
+                goto fail;
+            }
+            if (tok[0] == 'd') {
+                snprintf(s->dev, sizeof(s->dev), "%s", val);
+            } else if (tok[0] == 'q') {
+                char *end;
+                unsigned long q = strtoul(val, &end, 10);
+                if (*end || q == 0) {
+                    snprintf(err, errlen, "bad queue %s", val);
+                    goto fail;
+                }
+                /* only the newest ring_mask + 1 events exist */
+                s->queue = q > ring_mask + 1 ? ring_mask + 1 : (uint32_t)q;
+            } else if ((s->slow = parse_slow(val)) < 0) {
+                snprintf(err, errlen, "bad slow %s (drop|disconnect)", val);
+                goto fail;
+            }
+        } else {
+            snprintf(err, errlen, "unknown filter %s", tok);
+            goto fail;
+        }
+    }
+    if (!s->kinds) s->kinds = WK_ALL;
+
+    if (nsubs == subs_cap) {
+        int cap = subs_cap ? subs_cap * 2 : 16;
+        watch_sub_t **p = realloc(subs, (size_t)cap * sizeof(*p));
+        if (!p) {
+            snprintf(err, errlen, "out of memory");
+            goto fail;
+        }
+        subs = p;
+        subs_cap = cap;
+    }
+    s->cursor = head;
+    s->notify = notify;
+    s->arg = arg;
+    s->pos = nsubs;
+    subs[nsubs++] = s;
+    stats.subscribers = nsubs;
+    return s;
+
+fail:
+    free(s);
+    return NULL;
+}
+
+void watch_unsubscribe(watch_sub_t *s) {
+    if (!s) return;
+    int last = --nsubs;
+    if (s->pos != last) {
+        subs[s->pos] = subs[last];
+        subs[s->pos]->pos = s->pos;
+    }
+    stats.subscribers = nsubs;
+    free(s);
+}
+
+static void describe(const watch_sub_t *s, obuf_t *out) {
+    obuf_printf(out, "%s%s%s", (s->kinds & WK_LINK) ? " link" : "",
+                (s->kinds & WK_ADDR) ? " addr" : "", (s->kinds & WK_ROUTE) ? " route" : "");
+    if (s->dev[0]) obuf_printf(out, " dev %s", s->dev);
+    obuf_printf(out, " queue %u slow %s", s->queue, s->slow == WATCH_SLOW_DROP ? "drop" : "disconnect");
+}
+
+void watch_describe(const watch_sub_t *s, obuf_t *out) {
+    obuf_printf(out, "watching");
+    describe(s, out);
+    obuf_printf(out, " from %llu\n", (unsigned long long)s->cursor);
+}
+
+static int matches(const watch_sub_t *s, const watch_ev_t *e) {
+    if (e->kind == WK_ALWAYS) return 1;
+    if (!(s->kinds & e->kind)) return 0;
+    return !s->dev[0] || fnmatch(s->dev, e->ifname, 0) == 0;
+}
+
+int watch_pump(watch_sub_t *s, obuf_t *out) {
+    uint64_t behind = head - s->cursor;
+    if (behind > s->queue) {
+        if (s->slow == WATCH_SLOW_DISCONNECT) {
+            stats.disconnected++;
+            log_warn("watch: subscriber %llu events behind, disconnecting", (unsigned long long)behind);
+            return -1;
+        }
+        /* drop the oldest: keep the newest queue events */
+        uint64_t lost = behind - s->queue;
+        if (!s->gap_lost) s->gap_from = s->cursor;
+        s->gap_lost += lost;
+        s->cursor += lost;
+        s->dropped += lost;
+        stats.dropped += lost;
+    }
+    if (out->bytes >= WATCH_OUT_MAX) return 0;
+    /* one marker for everything skipped while the output was full */
+    if (s->gap_lost) {
+        obuf_printf(out, "%llu gap %llu\n", (unsigned long long)s->gap_from, (unsigned long long)s->gap_lost);
+        s->gap_lost = 0;
+        s->gaps++;
+        stats.gaps++;
+    }
+    while (s->cursor != head && out->bytes < WATCH_OUT_MAX) {
+        const watch_ev_t *e = &ring[s->cursor & ring_mask];
+        s->cursor++;
+        if (!matches(s, e)) continue;
+        if (obuf_append(out, e->line, e->len) < 0) return -1;
+        s->delivered++;
+    }
+    return 0;
+}
+
+/* format the next event into the ring; nothing at all without subscribers */
+__attribute__((format(printf, 3, 4)))
+static void publish(uint8_t kind, const char *ifname, const char *fmt, ...) {
+    if (!nsubs) return;
+    watch_ev_t *e = &ring[head & ring_mask];
+    size_t max = sizeof(e->line) - 1;  /* room for the newline */
+    int n = snprintf(e->line, max, "%llu ", (unsigned long long)head);
+    va_list ap;
+    va_start(ap, fmt);
+    n += vsnprintf(e->line + n, max - (size_t)n, fmt, ap);
+    va_end(ap);
+    if ((size_t)n >= max) n = (int)max - 1;
+    e->line[n++] = '\n';
+    e->len = (uint16_t)n;
+    e->kind = kind;
+    snprintf(e->ifname, sizeof(e->ifname), "%s", ifname ? ifname : "");
+    head++;
+    stats.published++;
+}
+
+void watch_link(const char *op, const iface_info_t *inf, uint32_t transitions) {
+    if (!nsubs) return;
+    char extra[32] = "";
+    if (transitions) snprintf(extra, sizeof(extra), " transitions=%u", transitions);
+    publish(WK_LINK, inf->ifname, "link %s %s idx=%d %s admin=%s mtu=%u oper=%s%s", op,
+            inf->ifname, inf->ifindex, inf->up ? "running" : "down",
+            (inf->flags & IFF_UP) ? "up" : "down", inf->mtu, oper_name(inf->operstate), extra);
+}
+
+void watch_link_rename(const iface_info_t *inf, const char *old) {
+    publish(WK_LINK, inf->ifname, "link rename %s idx=%d from=%s", inf->ifname, inf->ifindex, old);
+}
+
+void watch_link_del(const iface_info_t *inf) {
+    publish(WK_LINK, inf->ifname, "link del %s idx=%d", inf->ifname, inf->ifindex);
+}
+
+void watch_addr(const char *op, const iface_info_t *inf, const iface_addr_t *a) {
+    if (!nsubs) return;
+    char buf[INET6_ADDRSTRLEN];
+    publish(WK_ADDR, inf->ifname, "addr %s %s idx=%d %s/%d", op, inf->ifname, inf->ifindex,
+            iface_addr_ntop(a, buf, sizeof(buf)), a->prefixlen);
+}
+
+void watch_route(int add, const rt_route_t *r) {
+    if (!nsubs) return;
+    char dst[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN + 5] = "";
+    char dev[IFNAMSIZ + 16] = "-";
+    const char *ifname = NULL;
+    inet_ntop(r->family, r->dst, dst, sizeof(dst));
+    if (r->nh_count) {
+        const rt_nexthop_t *nh = &r->nh[0];
+        const iface_info_t *inf = nh->oif ? get_iface_by_index(nh->oif) : NULL;
+        if (inf) {
+            ifname = inf->ifname;
+            snprintf(dev, sizeof(dev), "%s", ifname);
+        } else if (nh->oif) {
+            snprintf(dev, sizeof(dev), "if%d", nh->oif);
+        }
+        if (nh->gw_family) {
+            char a[INET6_ADDRSTRLEN];
+            inet_ntop(nh->gw_family, nh->gw, a, sizeof(a));
+            snprintf(gw, sizeof(gw), " via %s", a);
+        }
+    }
+    char extra[24] = "";
+    if (r->nh_count > 1) snprintf(extra, sizeof(extra), " nexthops=%d", r->nh_count);
+    publish(WK_ROUTE, ifname, "route %s %s/%u table=%u dev=%s%s%s", add ? "add" : "del", dst,
+            r->dst_len, r->table, dev, gw, extra);
+}
+
+void watch_resync(void) {
+    publish(WK_ALWAYS, NULL, "resync");
+}
+
+void watch_get_stats(watch_stats_t *st) {
+    *st = stats;
+}
+
+void watch_render(obuf_t *out) {
+    for (int i = 0; i < nsubs; i++) {
+        const watch_sub_t *s = subs[i];
+        obuf_printf(out, "sub %d:", i);
+        describe(s, out);
+        obuf_printf(out, " behind=%llu delivered=%llu gaps=%llu dropped=%llu\n",
+                    (unsigned long long)(head - s->cursor), (unsigned long long)s->delivered,
+                    (unsigned long long)s->gaps, (unsigned long long)s->dropped);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+#include "buffer.h"
+#include "parser.h"
+#include "route.h"
+
+/*
+ * Change events pushed to CLI subscribers ("watch [filter]"). Every event is
+ * formatted once into a shared ring of watch_ring lines; a subscriber is a
+ * cursor into it plus its own bound of watch_queue events. A subscriber
+ * whose socket cannot keep up falls behind its bound and is either moved
+ * forward with a gap marker (watch_slow=drop) or disconnected
+ * (watch_slow=disconnect). Lines look like
+ *
+ *   <seq> link new|change|rename|del <ifname> idx=<n> ...
+ *   <seq> addr add|del <ifname> idx=<n> <addr>/<len>
+ *   <seq> route add|del <dst>/<len> table=<t> dev=<ifname> [via <gw>]
+ *   <seq> resync                      the table was rebuilt, re-read it
+ *   <seq> gap <n>                     n events dropped for this subscriber
+ */
+
+enum { WATCH_SLOW_DROP, WATCH_SLOW_DISCONNECT };
+
+typedef struct watch_sub watch_sub_t;
+
+typedef struct watch_stats {
+    int subscribers;
+    uint32_t ring;                     /* lines in the shared ring, 0 before the first subscriber */
+    uint64_t published;                /* events formatted since start */
+    uint64_t gaps;
+    uint64_t dropped;                  /* events skipped by gap markers */
+    uint64_t disconnected;             /* subscribers dropped as slow consumers */
+} watch_stats_t;
+
+/*
+ * Filter: [link] [addr] [route] [dev <glob>] [queue <n>] [slow drop|disconnect];
+ * no kind means all kinds. notify(arg) runs once per event loop iteration
+ * that published something. NULL with a message in err on a bad filter.
+ */
+watch_sub_t *watch_subscribe(const char *filter, void (*notify)(void *arg), void *arg,
+                             char *err, size_t errlen);
+void watch_unsubscribe(watch_sub_t *s);
+/* one line describing the subscription */
+void watch_describe(const watch_sub_t *s, obuf_t *out);
+/* append pending lines to out while it holds less than WATCH_OUT_MAX; -1: disconnect it */
+int watch_pump(watch_sub_t *s, obuf_t *out);
+#define WATCH_OUT_MAX (64u << 10)
+
+/* publish points */
+void watch_link(const char *op, const iface_info_t *inf, uint32_t transitions);
+void watch_link_rename(const iface_info_t *inf, const char *old);
+void watch_link_del(const iface_info_t *inf);
+void watch_addr(const char *op, const iface_info_t *inf, const iface_addr_t *a);
+void watch_route(int add, const rt_route_t *r);
+void watch_resync(void);
+
+void watch_get_stats(watch_stats_t *st);
+/* one line per subscriber */
+void watch_render(obuf_t *out);
+
+#endif